@@ -185,7 +185,31 @@ string ParseTreeToString::select(const SelectStatement *stmt) {
 }
 
 string ParseTreeToString::insert(const InsertStatement *stmt) {
-    return "INSERT ...";
+    string ret("INSERT INTO ");
+    ret += stmt->tableName;
+    if (stmt->columns != NULL) {
+        ret += " (";
+        bool doComma = false;
+        for (char *column : *stmt->columns) {
+            if (doComma)
+                ret += ", ";
+            ret += column;
+            doComma = true;
+        }
+        ret += ")";
+    }
+    if (stmt->type != InsertStatement::kInsertValues)
+        return ret + " SELECT ...";
+    ret += " VALUES (";
+    bool doComma = false;
+    for (Expr *expr : *stmt->values) {
+        if (doComma)
+            ret += ", ";
+        ret += expression(expr);
+        doComma = true;
+    }
+    ret += ")";
+    return ret;
 }
 
 string ParseTreeToString::create(const CreateStatement *stmt) {
@@ -3,42 +3,96 @@
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Summer 2018"
  */
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include "SQLExec.h"
+#include "bitmap_scan.h"
+#include "metrics.h"
+#include "stats.h"
 using namespace std;
 using namespace hsql;
 
 // define static data
 Tables* SQLExec::tables = nullptr;
+Indices* SQLExec::indices = nullptr;
+
+// print one row's values in column order
+static void print_row(ostream &out, const ColumnNames &column_names, const ValueDict &row) {
+    for (auto const &column_name: column_names) {
+        ValueDict::const_iterator column = row.find(column_name);
+        if (column == row.end()) {
+            out << "NULL ";
+            continue;
+        }
+        out << column->second.to_string() << " ";
+    }
+    out << endl;
+}
 
 // make query result be printable
-ostream &operator<<(ostream &out, const QueryResult &qres) {
-    if (qres.column_names != nullptr) {
-        for (auto const &column_name: *qres.column_names)
+ostream &operator<<(ostream &out, QueryResult &qres) {
+    qres.print(out);
+    return out;
+}
+
+void QueryResult::print(ostream &out, uint max_rows) {
+    if (column_names != nullptr) {
+        for (auto const &column_name: *column_names)
             out << column_name << " ";
         out << endl << "+";
-        for (unsigned int i = 0; i < qres.column_names->size(); i++)
+        for (unsigned int i = 0; i < column_names->size(); i++)
             out << "----------+";
         out << endl;
-        for (auto const &row: *qres.rows) {
-            for (auto const &column_name: *qres.column_names) {
-                Value value = row->at(column_name);
-                switch (value.data_type) {
-                    case ColumnAttribute::INT:
-                        out << value.n;
-                        break;
-                    case ColumnAttribute::TEXT:
-                        out << "\"" << value.s << "\"";
-                        break;
-                    default:
-                        out << "???";
-                }
-                out << " ";
-            }
-            out << endl;
+    }
+    print_rows(out, max_rows);
+}
+
+uint QueryResult::print_rows(ostream &out, uint max_rows) {
+    uint printed = 0;
+    while (has_more() && (max_rows == 0 || printed < max_rows)) {
+        uint n = FETCH_BATCH;
+        if (max_rows != 0 && max_rows - printed < n)
+            n = max_rows - printed;
+        ValueDicts *batch = fetch(n);
+        for (auto const &row: *batch) {
+            print_row(out, *column_names, *row);
+            delete row;
         }
+        printed += batch->size();
+        delete batch;
     }
-    out << qres.message;
-    return out;
+    if (!has_more())
+        out << message;
+    return printed;
+}
+
+bool QueryResult::has_more() {
+    while (scanning && next_row >= handles->size()) {
+        handles->clear();
+        next_row = 0;
+        scanning = relation->select_more(where, position, handles);
+        n_found += handles->size();
+        if (!scanning)
+            message = "successfully returned " + to_string(n_found) + " rows";
+    }
+    if (handles != nullptr)
+        return next_row < handles->size();
+    return rows != nullptr && next_row < rows->size();
+}
+
+ValueDicts *QueryResult::fetch(uint n) {
+    OperatorTimer timer(Stats::FETCH);
+    ValueDicts *batch = new ValueDicts();
+    for (; n > 0 && has_more(); n--, next_row++) {
+        if (handles != nullptr) {
+            batch->push_back(relation->project(handles->at(next_row), column_names));
+        } else {
+            batch->push_back(rows->at(next_row));
+            rows->at(next_row) = nullptr;  // now belongs to the caller
+        }
+    }
+    return batch;
 }
 
 QueryResult::~QueryResult() {
@@ -51,92 +105,267 @@ QueryResult::~QueryResult() {
 			delete row;
 		delete rows;
 	}
+	if(handles)
+		delete handles;
+	if(where)
+		delete where;
 }
 
 
-QueryResult *SQLExec::execute(const SQLStatement *statement) throw(SQLExecError) {
+QueryResult *SQLExec::execute(const SQLStatement *statement, const SQLExtensions &extensions) throw(SQLExecError) {
 	if (!SQLExec::tables)
 		SQLExec::tables = new Tables();
+	if (!SQLExec::indices)
+		SQLExec::indices = new Indices();
 
     try {
+        if (extensions.explain_analyze)
+            return explain_analyze(statement, extensions);
+        StatementTimer statement_timer(extensions.alter.empty() ? statement_type(statement) : Metrics::OTHER);
+        OperatorTimer timer(Stats::EXECUTE);  // inside statement_timer, so its time counts toward the statement
+        QueryResult *result;
         switch (statement->type()) {
             case kStmtCreate:
-                return create((const CreateStatement *) statement);
+                result = create((const CreateStatement *) statement, extensions);
+                break;
             case kStmtDrop:
-                return drop((const DropStatement *) statement);
+                result = drop((const DropStatement *) statement);
+                break;
+            case kStmtInsert:
+                result = insert(vector<const InsertStatement *>(1, (const InsertStatement *) statement));
+                break;
+            case kStmtSelect:
+                result = select((const SelectStatement *) statement);
+                break;
             case kStmtShow:
-                return show((const ShowStatement *) statement);
+                if (extensions.show == "STATS")
+                    result = show_stats();
+                else if (extensions.show == "METRICS")
+                    result = show_metrics();
+                else if (extensions.show == "PARTITIONS")
+                    result = show_partitions(extensions.table_name);
+                else if (!extensions.alter.empty())
+                    result = alter_table(extensions);
+                else
+                    result = show((const ShowStatement *) statement);
+                break;
             default:
-                return new QueryResult("not implemented");
+                result = new QueryResult("not implemented");
         }
+        statement_timer.succeeded();
+        return result;
+    } catch (DbRelationError& e) {
+        throw SQLExecError(string("DbRelationError: ") + e.what());
+    } catch (DbException& e) {
+        throw SQLExecError(string("DbException: ") + e.what());
+    }
+}
+
+QueryResult *SQLExec::execute_batch(const vector<const InsertStatement *> &statements) throw(SQLExecError) {
+    if (!SQLExec::tables)
+        SQLExec::tables = new Tables();
+    if (!SQLExec::indices)
+        SQLExec::indices = new Indices();
+
+    try {
+        StatementTimer statement_timer(Metrics::INSERT);
+        OperatorTimer timer(Stats::EXECUTE);
+        QueryResult *result = insert(statements);
+        statement_timer.succeeded();
+        return result;
     } catch (DbRelationError& e) {
         throw SQLExecError(string("DbRelationError: ") + e.what());
+    } catch (DbException& e) {
+        throw SQLExecError(string("DbException: ") + e.what());
+    }
+}
+
+bool SQLExec::batches_with(const SQLStatement *statement, const SQLExtensions &extensions,
+                           const SQLStatement *previous) {
+    if (previous == nullptr || statement->type() != kStmtInsert || previous->type() != kStmtInsert
+        || extensions.explain_analyze)
+        return false;
+    const InsertStatement *insert = (const InsertStatement *) statement;
+    const InsertStatement *before = (const InsertStatement *) previous;
+    return insert->type == InsertStatement::kInsertValues && before->type == InsertStatement::kInsertValues
+           && string(insert->tableName) == before->tableName;
+}
+
+Metrics::StatementType SQLExec::statement_type(const SQLStatement *statement) {
+    switch (statement->type()) {
+        case kStmtCreate:
+            return Metrics::CREATE;
+        case kStmtDrop:
+            return Metrics::DROP;
+        case kStmtShow:
+            return Metrics::SHOW;
+        case kStmtSelect:
+            return Metrics::SELECT;
+        case kStmtInsert:
+            return Metrics::INSERT;
+        case kStmtUpdate:
+            return Metrics::UPDATE;
+        case kStmtDelete:
+            return Metrics::DELETE;
+        default:
+            return Metrics::OTHER;
     }
 }
 
-void SQLExec::column_definition(const ColumnDefinition *col, Identifier& column_name,
-                                ColumnAttribute& column_attribute) {
-	colName = col->name;
-	if(col->type == ColumnDefinition::INT)
+void SQLExec::column_definition(const ColumnDefinition *col, const SQLExtensions &extensions,
+                                Identifier& column_name, ColumnAttribute& column_attribute) {
+	column_name = col->name;
+	auto extended = extensions.column_types.find(column_name);
+	if(extended != extensions.column_types.end())
+		column_attribute.set_data_type(extended->second);
+	else if(col->type == ColumnDefinition::INT)
 		column_attribute.set_data_type(ColumnAttribute::INT);
 	else if(col->type == ColumnDefinition::TEXT)
 		column_attribute.set_data_type(ColumnAttribute::TEXT);
+	else if(col->type == ColumnDefinition::DOUBLE)
+		column_attribute.set_data_type(ColumnAttribute::DOUBLE);
 	else
-		throw SQLExecError("Unsupported data type, supported data types are: INT and TEXT");
+		throw SQLExecError("Unsupported data type, supported data types are: INT, BIGINT, DOUBLE, BOOLEAN, "
+						   "DATE, TIMESTAMP and TEXT");
 
 }
 
-QueryResult *SQLExec::create(const CreateStatement *statement) {
-	if (statement->type != CreateStatement::kTable)
-		return new QueryResult("Create table called with other statment type");//Change this text to something more professional
+// PARTITIONS <n> for HASH (named p0 ... pn-1), the PARTITION ... VALUES LESS THAN list, in increasing order, for RANGE
+vector<Partition> SQLExec::partition_definitions(const SQLExtensions &extensions, ColumnAttribute::DataType key_type) {
+	PartitionedTable::Method method = PartitionedTable::method_named(extensions.partition_method);
+	if (!PartitionedTable::is_acceptable_key(method, key_type))
+		throw SQLExecError("can't partition by " + extensions.partition_method + " on a "
+						   + ColumnAttribute::type_name(key_type) + " column");
+	vector<Partition> partitions;
+	if (method == PartitionedTable::HASH) {
+		if (!extensions.partitions.empty() || extensions.partition_count == 0)
+			throw SQLExecError("PARTITION BY HASH needs PARTITIONS <n>");
+		if (extensions.partition_count > PartitionedTable::MAX_PARTITIONS)
+			throw SQLExecError("a table can't have more than " + to_string(PartitionedTable::MAX_PARTITIONS) + " partitions");
+		for (uint i = 0; i < extensions.partition_count; i++)
+			partitions.push_back(Partition("p" + to_string(i), i, 0));
+		return partitions;
+	}
+
+	if (extensions.partitions.empty())
+		throw SQLExecError("PARTITION BY RANGE needs (PARTITION <name> VALUES LESS THAN (<bound>), ...)");
+	if (extensions.partitions.size() > PartitionedTable::MAX_PARTITIONS)
+		throw SQLExecError("a table can't have more than " + to_string(PartitionedTable::MAX_PARTITIONS) + " partitions");
+	for (auto const &definition : extensions.partitions) {
+		int64_t bound = PartitionedTable::bound_named(key_type, definition.second);
+		if (!partitions.empty() && bound <= partitions.back().upper_bound)
+			throw SQLExecError("partition " + definition.first + "'s VALUES LESS THAN must be above partition "
+							   + partitions.back().name + "'s");
+		for (auto const &partition : partitions)
+			if (partition.name == definition.first)
+				throw SQLExecError("partition " + definition.first + " is there more than once");
+		partitions.push_back(Partition(definition.first, partitions.size(), bound));
+	}
+	return partitions;
+}
+
+QueryResult *SQLExec::create(const CreateStatement *statement, const SQLExtensions &extensions) {
+	switch (statement->type) {
+		case CreateStatement::kTable:
+			return create_table(statement, extensions);
+		case CreateStatement::kIndex:
+			return create_index(statement, extensions);
+		default:
+			return new QueryResult("Only CREATE TABLE and CREATE INDEX are implemented");
+	}
+}
+
+// CREATE TABLE ...
+QueryResult *SQLExec::create_table(const CreateStatement *statement, const SQLExtensions &extensions) {
+	if (extensions.page_size != 0 && !DbBlock::is_valid_block_size(extensions.page_size))
+		throw SQLExecError("PAGE_SIZE must be a power of 2 from " + to_string(DbBlock::MIN_BLOCK_SZ) + " to "
+						   + to_string(DbBlock::MAX_BLOCK_SZ));
+	bool partitioned = !extensions.partition_method.empty();
+	if (partitioned && !extensions.storage_engine.empty() && extensions.storage_engine != "HEAP")
+		throw SQLExecError("the partitions of a partitioned table are HEAP tables");
 
-	//Add new table to _tables in schema
-	Identifier tableName = statement->tableName;
-	ValueDict row;
-	row["table_name"] = tableName;
-	Handle tableHandle = WQLExec::tables->insert(&row);
-	
 	//get new columns
 	Identifier colName;
 	ColumnNames colNames;
 	ColumnAttribute colAttrib;
 	ColumnAttributes colAttribs;
 
-	for(ColumnDefinition* col : *statement->colummns) {
-		column_definition(col, colName, colAttrib);
+	for(ColumnDefinition* col : *statement->columns) {
+		column_definition(col, extensions, colName, colAttrib);
+		if (extensions.storage_engine == "COLUMNAR" && colAttrib.get_data_type() != ColumnAttribute::INT
+			&& colAttrib.get_data_type() != ColumnAttribute::TEXT)
+			throw SQLExecError("COLUMNAR tables only have INT and TEXT columns");
 		colNames.push_back(colName);
-		colAttribspush_back(colAttrib);
+		colAttribs.push_back(colAttrib);
 	}
+
+	//get the partitions
+	vector<Partition> partitions;
+	if (partitioned) {
+		auto key = find(colNames.begin(), colNames.end(), extensions.partition_column);
+		if (key == colNames.end())
+			throw SQLExecError("no column " + extensions.partition_column + " to partition by");
+		partitions = partition_definitions(extensions, colAttribs[key - colNames.begin()].get_data_type());
+	}
+
+	//Add new table to _tables in schema
+	Identifier tableName = statement->tableName;
+	ValueDict row;
+	row["table_name"] = tableName;
+	row["storage_engine"] = Value(partitioned ? "PARTITIONED"
+								  : extensions.storage_engine.empty() ? "HEAP" : extensions.storage_engine);
+	Handle tableHandle = SQLExec::tables->insert(&row);
 	
 	//update _columns in schema
 	try {
 		DbRelation& columns = SQLExec::tables->get_table(Columns::TABLE_NAME);
-		Handles colHandles;
+		DbRelation& partitionMap = SQLExec::tables->get_table(Partitions::TABLE_NAME);
+		Handles colHandles, partHandles;
 		
 		try {
 			for(unsigned int i = 0; i < colNames.size(); i++) {
 				row["column_name"] = colNames[i];
-				row["data_type"] = Value(colAttribs[i].get_data_type == ColumnAttribute::INT ? "INT" : "TEXT");
+				row["data_type"] = Value(ColumnAttribute::type_name(colAttribs[i].get_data_type()));
 				colHandles.push_back(columns.insert(&row));
 			}
 
+			//update _partitions in schema
+			ValueDict partRow;
+			partRow["table_name"] = tableName;
+			partRow["method"] = Value(extensions.partition_method);
+			partRow["column_name"] = Value(extensions.partition_column);
+			for (auto const& partition : partitions) {
+				partRow["partition_name"] = Value(partition.name);
+				partRow["partition_id"] = Value((int) partition.id);
+				partRow["upper_bound"] = Value::bigint(partition.upper_bound);
+				partHandles.push_back(partitionMap.insert(&partRow));
+			}
+
 			//Create the relation
 			DbRelation& newTable = SQLExec::tables->get_table(tableName);
+			if (extensions.page_size != 0)
+				newTable.set_block_size(extensions.page_size);
 			if (statement->ifNotExists){
-				table.create_if_not_exists();
+				newTable.create_if_not_exists();
 			}
 			else {
-				table.create();
+				newTable.create();
 			}
 		}
 		catch (exception& e) {
-			//remove any new columns from _columns
+			//remove any new columns from _columns and partitions from _partitions
 			try {
 				for(unsigned int i = 0; i < colHandles.size(); i++){
 					columns.del(colHandles.at(i));
 				}
+				for (auto const& handle : partHandles)
+					partitionMap.del(handle);
+			}
+			catch (exception& rollback) {
+				throw SQLExecRollbackError("create table " + tableName + " failed (" + e.what()
+										   + ") and taking its columns and partitions back out of the catalog failed too ("
+										   + rollback.what() + "), so some of them may still be there");
 			}
-			catch (...) {} //TODO
 			throw; //create table exception
 		}
 	}
@@ -145,60 +374,794 @@ QueryResult *SQLExec::create(const CreateStatement *statement) {
 		try {
 			SQLExec::tables->del(tableHandle);
 		}
-		catch (...) {} //TODO
+		catch (exception& rollback) {
+			throw SQLExecRollbackError("create table " + tableName + " failed (" + e.what()
+									   + ") and taking it back out of _tables failed too (" + rollback.what()
+									   + "), so it may still be there");
+		}
 		throw;
 	}
+	SQLExec::tables->save_snapshot();
 	
 	return new QueryResult("Created: " + tableName);
 }
 
+// CREATE INDEX <index> ON <table> [USING BTREE] (<key columns>) [INCLUDE (<include columns>)]
+QueryResult *SQLExec::create_index(const CreateStatement *statement, const SQLExtensions &extensions) {
+	Identifier table_name = statement->tableName;
+	Identifier index_name = statement->indexName;
+	Identifier index_type = statement->indexType == nullptr ? "BTREE" : statement->indexType;
+	DbRelation& table = SQLExec::tables->get_table(table_name);
+
+	// each column has to be the table's, and can only be in the index once
+	ColumnNames columns;
+	for (auto const& column_name : *statement->indexColumns)
+		columns.push_back(column_name);
+	columns.insert(columns.end(), extensions.include_columns.begin(), extensions.include_columns.end());
+	const ColumnNames& table_columns = table.get_column_names();
+	for (uint i = 0; i < columns.size(); i++) {
+		if (find(table_columns.begin(), table_columns.end(), columns[i]) == table_columns.end())
+			throw SQLExecError("no column " + columns[i] + " in table " + table_name);
+		if (find(columns.begin(), columns.begin() + i, columns[i]) != columns.begin() + i)
+			throw SQLExecError("column " + columns[i] + " is in index " + index_name + " more than once");
+	}
+	ColumnNames index_names = SQLExec::indices->get_index_names(table_name);
+	if (find(index_names.begin(), index_names.end(), index_name) != index_names.end())
+		throw SQLExecError("index " + index_name + " already exists on " + table_name);
+
+	// add it to _indices, then build it
+	ValueDict row;
+	row["table_name"] = Value(table_name);
+	row["index_name"] = Value(index_name);
+	row["index_type"] = Value(index_type);
+	Handles handles;
+	try {
+		for (uint i = 0; i < columns.size(); i++) {
+			row["seq_in_index"] = Value((int) i + 1);
+			row["column_name"] = Value(columns[i]);
+			row["is_included"] = Value::boolean(i >= statement->indexColumns->size());
+			handles.push_back(SQLExec::indices->insert(&row));
+		}
+		SQLExec::indices->get_index(table, index_name).create();
+	}
+	catch (exception& e) {
+		try {
+			for (auto const& handle : handles)
+				SQLExec::indices->del(handle);
+		}
+		catch (exception& rollback) {
+			throw SQLExecRollbackError("create index " + index_name + " failed (" + e.what()
+									   + ") and taking it back out of _indices failed too (" + rollback.what()
+									   + "), so some of its rows may still be there");
+		}
+		throw;
+	}
+	return new QueryResult("Created index: " + index_name);
+}
+
 // DROP ...
 QueryResult *SQLExec::drop(const DropStatement *statement) {
-	if (statement->type != DropStatment::kTable)
-		return new QueryResult("Drop table called with other statement type");
-	
+	switch (statement->type) {
+		case DropStatement::kTable:
+			return drop_table(statement);
+		case DropStatement::kIndex:
+			return drop_index(statement);
+		default:
+			return new QueryResult("Only DROP TABLE and DROP INDEX are implemented");
+	}
+}
+
+// DROP TABLE <table> -- its indices go with it
+QueryResult *SQLExec::drop_table(const DropStatement *statement) {
 	Identifier tableName = statement->name;
 	
 	//Check if table is schema table (not allowed to be dropped)
-	if (tableName == Tables::TABLE_NAME || tableName == Columns::TABLE_NAMES)
+	if (tableName == Tables::TABLE_NAME || tableName == Columns::TABLE_NAME || tableName == Indices::TABLE_NAME
+		|| tableName == Partitions::TABLE_NAME)
 		throw SQLExecError("Cannot drop a schema table");
 
 	//Get table information
 	DbRelation& table = SQLExec::tables->get_table(tableName);
+	if (table.get_column_names().empty())
+		throw SQLExecError("no table " + tableName);
 	ValueDict dropTarget;
-	locationValDict["table_name"] = Value(tableName);
-	DbRelation& cols = SQLExec:tables->get_table(Columns::TABLE_NAME);
-	Handles* handles = cols.select(&locationValDict);
-
-	//TODO M4: Remove indices
-	DbRelation& indices = SQLExec::tables->get_table(Indices::TABLE_NAME);
-	Handles* index_handles = indices.select(&locationValDict);
-	vector<Value> dropList;
-	
-	//for(unsigned int i = 0; i < index_handles->size(); i++) {
-	//	ValueDict* 
-		
-	delete handles;
-	
-	//delete the table
-	table.drop();
-	
-	//delete the table from _tables
-	SQLExec::tables->del(*SQLExec::tables->select(&dropTarget)->begin()));
+	dropTarget["table_name"] = Value(tableName);
+
+	//keep hold of it and its indices, which would otherwise go with their rows
+	vector<DbIndex*> indices;
+	for (auto const& index_name : SQLExec::indices->get_index_names(tableName))
+		indices.push_back(SQLExec::indices->release_index(table, index_name));
+	DbRelation* dropped = SQLExec::tables->release_table(tableName);
+
+	//take it out of the catalog first, each schema table's rows in one go, and only then move the files of
+	//its indices and its own into the trash (they're removed in the background), so a failure leaves no
+	//catalog rows behind for files that are gone
+	try {
+		DbRelation& cols = SQLExec::tables->get_table(Columns::TABLE_NAME);
+		DbRelation& partitionMap = SQLExec::tables->get_table(Partitions::TABLE_NAME);
+		for (DbRelation* catalog : {&cols, &partitionMap, (DbRelation*)SQLExec::indices, (DbRelation*)SQLExec::tables}) {
+			catalog->open();
+			Handles* handles = catalog->select(&dropTarget);
+			catalog->del(handles);
+			delete handles;
+		}
+		SQLExec::tables->save_snapshot();
+		for (auto const& index : indices)
+			index->discard();
+		dropped->discard();
+	}
+	catch (exception& e) {
+		for (auto const& index : indices)
+			delete index;
+		delete dropped;
+		throw;
+	}
+	for (auto const& index : indices)
+		delete index;
+	delete dropped;
 
 	return new QueryResult("Dropped: " + tableName);	
 	
 }
 
+// DROP INDEX <index> FROM <table>
+QueryResult *SQLExec::drop_index(const DropStatement *statement) {
+	Identifier table_name = statement->name;
+	Identifier index_name = statement->indexName;
+	DbRelation& table = SQLExec::tables->get_table(table_name);
+	SQLExec::indices->get_index(table, index_name).discard();
+
+	ValueDict where;
+	where["table_name"] = Value(table_name);
+	where["index_name"] = Value(index_name);
+	Handles* handles = SQLExec::indices->select(&where);
+	SQLExec::indices->del(handles);
+	delete handles;
+	return new QueryResult("Dropped index: " + index_name);
+}
+
+// ALTER TABLE <table> ADD PARTITION (PARTITION <name> VALUES LESS THAN (<bound>), ...)
+// ALTER TABLE <table> DROP PARTITION <name>, ... -- its rows go with its files, and come out of the table's indices
+QueryResult *SQLExec::alter_table(const SQLExtensions &extensions) {
+	Identifier table_name = extensions.table_name;
+	PartitionedTable *table = dynamic_cast<PartitionedTable *>(&SQLExec::tables->get_table(table_name));
+	if (table == nullptr)
+		throw SQLExecError(table_name + " isn't partitioned");
+	DbRelation &partition_map = SQLExec::tables->get_table(Partitions::TABLE_NAME);
+
+	string names;
+	for (auto const &definition : extensions.partitions)
+		names += (names.empty() ? "" : ", ") + definition.first;
+	if (extensions.alter == "ADD") {
+		for (auto const &definition : extensions.partitions) {
+			Partition partition(definition.first, table->unused_id(),
+								PartitionedTable::bound_named(table->get_key_type(), definition.second));
+			table->add_partition(partition);
+			ValueDict row;
+			row["table_name"] = Value(table_name);
+			row["partition_name"] = Value(partition.name);
+			row["partition_id"] = Value((int) partition.id);
+			row["method"] = Value(PartitionedTable::method_name(table->get_method()));
+			row["column_name"] = Value(table->get_key_column());
+			row["upper_bound"] = Value::bigint(partition.upper_bound);
+			try {
+				partition_map.insert(&row);
+			}
+			catch (exception &e) {
+				table->drop_partition(partition.name);
+				throw;
+			}
+		}
+		return new QueryResult("Added partitions: " + names);
+	}
+
+	ColumnNames index_names = SQLExec::indices->get_index_names(table_name);
+	for (auto const &definition : extensions.partitions) {
+		Identifier partition_name = definition.first;
+		if (!index_names.empty()) {
+			Handles *handles = table->select_partition(partition_name);
+			for (auto const &index_name : index_names) {
+				DbIndex &index = SQLExec::indices->get_index(*table, index_name);
+				for (auto const &handle : *handles)
+					index.del(handle);
+			}
+			delete handles;
+		}
+		table->drop_partition(partition_name);
+
+		ValueDict where;
+		where["table_name"] = Value(table_name);
+		where["partition_name"] = Value(partition_name);
+		Handles *handles = partition_map.select(&where);
+		for (auto const &handle : *handles)
+			partition_map.del(handle);
+		delete handles;
+	}
+	return new QueryResult("Dropped partitions: " + names);
+}
+
+// INSERT INTO <table> [(<columns>)] VALUES (<literals>), for one statement or a batch of them into the same
+// table -- the new rows go into the table's indices too, and if any row can't, none of them stay
+QueryResult *SQLExec::insert(const vector<const InsertStatement *> &statements) {
+	Identifier table_name = statements.front()->tableName;
+	DbRelation& table = SQLExec::tables->get_table(table_name);
+	if (table.get_column_names().empty())
+		throw SQLExecError("no table " + table_name);
+
+	ValueDicts rows;
+	try {
+		for (auto const& statement : statements) {
+			if (table_name != statement->tableName)
+				throw SQLExecError("a batch of inserts has to be into one table");
+			rows.push_back(insert_row(statement, table));
+		}
+	}
+	catch (exception& e) {
+		for (auto const& row : rows)
+			delete row;
+		throw;
+	}
+	Handles* handles;
+	try {
+		handles = table.insert(&rows);
+	}
+	catch (exception& e) {
+		for (auto const& row : rows)
+			delete row;
+		throw;
+	}
+	for (auto const& row : rows)
+		delete row;
+
+	vector<DbIndex*> indexes;
+	for (auto const& index_name : SQLExec::indices->get_index_names(table_name))
+		indexes.push_back(&SQLExec::indices->get_index(table, index_name));
+	uint done = 0;  // indices with all the rows in
+	size_t n = 0;   // rows in the next one
+	try {
+		for (; done < indexes.size(); done++, n = 0)
+			for (; n < handles->size(); n++)
+				indexes[done]->insert(handles->at(n));
+	}
+	catch (exception& e) {
+		try {
+			for (uint i = 0; i <= done && i < indexes.size(); i++)
+				for (size_t j = 0; j < (i < done ? handles->size() : n); j++)
+					indexes[i]->del(handles->at(j));
+			table.del(handles);
+		}
+		catch (exception& rollback) {
+			delete handles;
+			throw SQLExecRollbackError("insert into " + table_name + " failed (" + e.what()
+									   + ") and taking its rows back out failed too (" + rollback.what()
+									   + "), so some of them may still be in the table or its indices");
+		}
+		delete handles;
+		throw;
+	}
+	string message = "successfully inserted " + to_string(handles->size()) + " row"
+					 + (handles->size() == 1 ? "" : "s") + " into " + table_name;
+	delete handles;
+	return new QueryResult(message);
+}
+
+// SELECT * | <columns> FROM <table> [WHERE <column> <op> <literal> [AND ...]] -- the result scans the
+// table as its rows are fetched, so the first rows don't wait for the whole table to be read, unless
+// an index can find the rows and has all the columns (an index-only scan)
+QueryResult *SQLExec::select(const SelectStatement *statement) {
+	if (statement->fromTable == nullptr || statement->fromTable->type != kTableName)
+		throw SQLExecError("only SELECT from a single table is implemented");
+	Identifier table_name = statement->fromTable->name;
+	DbRelation& table = SQLExec::tables->get_table(table_name);
+	if (table.get_column_names().empty())
+		throw SQLExecError("no table " + table_name);
+	const ColumnNames& table_columns = table.get_column_names();
+	const ColumnAttributes& table_attributes = table.get_column_attributes();
+
+	ColumnNames *column_names = new ColumnNames;
+	ColumnAttributes *column_attributes = new ColumnAttributes;
+	Predicates *where = nullptr;
+	try {
+		for (auto const& expr : *statement->selectList) {
+			if (expr->type == kExprStar) {
+				column_names->insert(column_names->end(), table_columns.begin(), table_columns.end());
+				column_attributes->insert(column_attributes->end(), table_attributes.begin(), table_attributes.end());
+				continue;
+			}
+			if (expr->type != kExprColumnRef)
+				throw SQLExecError("only columns can be selected");
+			auto column = find(table_columns.begin(), table_columns.end(), Identifier(expr->name));
+			if (column == table_columns.end())
+				throw SQLExecError("no column " + string(expr->name) + " in " + table_name);
+			column_names->push_back(*column);
+			column_attributes->push_back(table_attributes.at(column - table_columns.begin()));
+		}
+		if (statement->whereClause != nullptr) {
+			where = new Predicates;
+			where_clause(statement->whereClause, table, *where);
+		}
+		table.open();
+
+		// an index that has every column the query needs answers it without the table
+		vector<DbIndex*> indices;
+		bool narrowed = false;
+		for (auto const& index_name : SQLExec::indices->get_index_names(table_name)) {
+			DbIndex& index = SQLExec::indices->get_index(table, index_name);
+			if (index.narrows(where) && index.covers(column_names, where)) {
+				ValueDicts* rows = index.project(where, column_names);
+				delete where;
+				return new QueryResult(column_names, column_attributes, rows,
+									   "successfully returned " + to_string(rows->size()) + " rows");
+			}
+			indices.push_back(&index);
+			narrowed = narrowed || index.narrows(where);
+		}
+
+		// otherwise the indices that narrow the rows down find them, and only those are read from the table
+		if (narrowed) {
+			Handles* handles = BitmapScan::select(table, indices, where);
+			delete where;
+			return new QueryResult(column_names, column_attributes, &table, handles,
+								   "successfully returned " + to_string(handles->size()) + " rows");
+		}
+	}
+	catch (exception& e) {
+		delete column_names;
+		delete column_attributes;
+		delete where;
+		throw;
+	}
+	return new QueryResult(column_names, column_attributes, &table, where);
+}
+
+void SQLExec::where_clause(const Expr *expr, const DbRelation &table, Predicates &where) {
+	if (expr->type == kExprOperator && expr->opType == Expr::AND) {
+		where_clause(expr->expr, table, where);
+		where_clause(expr->expr2, table, where);
+		return;
+	}
+	string unsupported = "only <column> <op> <literal> comparisons joined by AND are implemented in WHERE";
+	if (expr->type != kExprOperator || expr->expr == nullptr || expr->expr2 == nullptr)
+		throw SQLExecError(unsupported);
+	Predicate::Operator op;
+	switch (expr->opType) {
+		case Expr::SIMPLE_OP:
+			if (expr->opChar == '=')
+				op = Predicate::EQ;
+			else if (expr->opChar == '<')
+				op = Predicate::LT;
+			else if (expr->opChar == '>')
+				op = Predicate::GT;
+			else
+				throw SQLExecError(unsupported);
+			break;
+		case Expr::NOT_EQUALS:
+			op = Predicate::NE;
+			break;
+		case Expr::LESS_EQ:
+			op = Predicate::LE;
+			break;
+		case Expr::GREATER_EQ:
+			op = Predicate::GE;
+			break;
+		default:
+			throw SQLExecError(unsupported);
+	}
+	const Expr *column = expr->expr, *value = expr->expr2;
+	if (column->type != kExprColumnRef) {  // <literal> <op> <column>: turn it around
+		swap(column, value);
+		op = op == Predicate::LT ? Predicate::GT : op == Predicate::GT ? Predicate::LT
+			 : op == Predicate::LE ? Predicate::GE : op == Predicate::GE ? Predicate::LE : op;
+	}
+	if (column->type != kExprColumnRef)
+		throw SQLExecError(unsupported);
+
+	const ColumnNames& table_columns = table.get_column_names();
+	auto found = find(table_columns.begin(), table_columns.end(), Identifier(column->name));
+	if (found == table_columns.end())
+		throw SQLExecError("no column " + string(column->name) + " in " + table.get_table_name());
+	ColumnAttribute::DataType data_type = table.get_column_attributes().at(found - table_columns.begin()).get_data_type();
+	where.push_back(Predicate(*found, op, literal(value, data_type)));
+}
+
+// Columns left out of the statement's column list are NULL.
+ValueDict *SQLExec::insert_row(const InsertStatement *statement, DbRelation &table) {
+	if (statement->type != InsertStatement::kInsertValues)
+		throw SQLExecError("only INSERT ... VALUES is implemented");
+	const ColumnNames& table_columns = table.get_column_names();
+	ColumnNames columns;
+	if (statement->columns == nullptr)
+		columns = table_columns;
+	else
+		for (auto const& column_name : *statement->columns)
+			columns.push_back(column_name);
+	if (columns.size() != statement->values->size())
+		throw SQLExecError(to_string(statement->values->size()) + " values for " + to_string(columns.size())
+						   + " columns of " + table.get_table_name());
+
+	ValueDict* row = new ValueDict();
+	try {
+		for (uint i = 0; i < columns.size(); i++) {
+			auto column = find(table_columns.begin(), table_columns.end(), columns[i]);
+			if (column == table_columns.end())
+				throw SQLExecError("no column " + columns[i] + " in table " + table.get_table_name());
+			if (row->find(columns[i]) != row->end())
+				throw SQLExecError("column " + columns[i] + " is given more than once");
+			ColumnAttribute::DataType data_type = table.get_column_attributes()[column - table_columns.begin()].get_data_type();
+			(*row)[columns[i]] = literal(statement->values->at(i), data_type);
+		}
+	}
+	catch (exception& e) {
+		delete row;
+		throw;
+	}
+	return row;
+}
+
+// Numbers go in any numeric column (an integer in a BOOLEAN, DATE or TIMESTAMP one as its stored value), and
+// strings in a TEXT column or, written as 'YYYY-MM-DD', a DATE or TIMESTAMP one.
+Value SQLExec::literal(const Expr *expr, ColumnAttribute::DataType data_type) {
+	bool negated = expr->type == kExprOperator && expr->opType == Expr::UMINUS && expr->expr != nullptr
+				   && (expr->expr->type == kExprLiteralInt || expr->expr->type == kExprLiteralFloat);
+	if (negated)
+		expr = expr->expr;
+	string mistyped = "a column of type " + ColumnAttribute::type_name(data_type) + " can't take ";
+	switch (expr->type) {
+		case kExprLiteralInt: {
+			int64_t n = negated ? -expr->ival : expr->ival;
+			switch (data_type) {
+				case ColumnAttribute::INT:
+				case ColumnAttribute::DATE:
+					if (n < INT_MIN || n > INT_MAX)
+						throw SQLExecError(to_string(n) + " is out of range for a column of type " + ColumnAttribute::type_name(data_type));
+					return data_type == ColumnAttribute::INT ? Value((int32_t) n) : Value::date((int32_t) n);
+				case ColumnAttribute::BIGINT:
+					return Value::bigint(n);
+				case ColumnAttribute::TIMESTAMP:
+					return Value::timestamp(n);
+				case ColumnAttribute::DOUBLE:
+					return Value::double_value(n);
+				case ColumnAttribute::BOOLEAN:
+					if (n != 0 && n != 1)
+						break;
+					return Value::boolean(n == 1);
+				default:
+					break;
+			}
+			throw SQLExecError(mistyped + to_string(n));
+		}
+		case kExprLiteralFloat:
+			if (data_type != ColumnAttribute::DOUBLE)
+				throw SQLExecError(mistyped + to_string(expr->fval));
+			return Value::double_value(negated ? -expr->fval : expr->fval);
+		case kExprLiteralString:
+			if (data_type == ColumnAttribute::TEXT)
+				return Value(string(expr->name));
+			if (data_type == ColumnAttribute::DATE || data_type == ColumnAttribute::TIMESTAMP) {
+				int64_t days;
+				if (Value::parse_date(expr->name, days)) {
+					if (data_type == ColumnAttribute::TIMESTAMP)
+						return Value::timestamp(days * 86400LL * 1000000);
+					if (days >= INT_MIN && days <= INT_MAX)
+						return Value::date((int32_t) days);
+				}
+			}
+			throw SQLExecError(mistyped + "\"" + expr->name + "\"");
+		default:
+			throw SQLExecError("only literal values can be inserted");
+	}
+}
+
 QueryResult *SQLExec::show(const ShowStatement *statement) {
-	return new QueryResult("not implemented"); // FIXME
+	switch (statement->type) {
+		case ShowStatement::kTables:
+			return show_tables();
+		case ShowStatement::kColumns:
+			return show_columns(statement);
+		case ShowStatement::kIndex:
+			return show_index(statement);
+		default:
+			return new QueryResult("not implemented"); // FIXME
+	}
 }
 
+// SHOW TABLES -- streams the table names out of _tables (leaving out the schema tables)
 QueryResult *SQLExec::show_tables() {
-	return new QueryResult("not implemented"); // FIXME
+	ColumnNames *column_names = new ColumnNames;
+	column_names->push_back("table_name");
+	ColumnAttributes *column_attributes = new ColumnAttributes;
+	column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+
+	Handles *handles = SQLExec::tables->select();
+	Handles *user_tables = new Handles;
+	for (auto const &handle : *handles) {
+		ValueDict *row = SQLExec::tables->project(handle, column_names);
+		Identifier table_name = row->at("table_name").s;
+		if (table_name != Tables::TABLE_NAME && table_name != Columns::TABLE_NAME)
+			user_tables->push_back(handle);
+		delete row;
+	}
+	delete handles;
+
+	string message = "successfully returned " + to_string(user_tables->size()) + " rows";
+	return new QueryResult(column_names, column_attributes, SQLExec::tables, user_tables, message);
 }
 
+// SHOW COLUMNS FROM <table> -- streams the table's rows out of _columns
 QueryResult *SQLExec::show_columns(const ShowStatement *statement) {
-	return new QueryResult("not implemented"); // FIXME
+	DbRelation &columns = SQLExec::tables->get_table(Columns::TABLE_NAME);
+
+	ColumnNames *column_names = new ColumnNames;
+	column_names->push_back("table_name");
+	column_names->push_back("column_name");
+	column_names->push_back("data_type");
+	ColumnAttributes *column_attributes = new ColumnAttributes(3, ColumnAttribute(ColumnAttribute::TEXT));
+
+	ValueDict where;
+	where["table_name"] = Value(statement->tableName);
+	Handles *handles = columns.select(&where);
+
+	string message = "successfully returned " + to_string(handles->size()) + " rows";
+	return new QueryResult(column_names, column_attributes, &columns, handles, message);
+}
+
+// SHOW INDEX FROM <table> -- streams the table's rows out of _indices
+QueryResult *SQLExec::show_index(const ShowStatement *statement) {
+	ColumnNames *column_names = new ColumnNames;
+	column_names->push_back("table_name");
+	column_names->push_back("index_name");
+	column_names->push_back("column_name");
+	column_names->push_back("seq_in_index");
+	column_names->push_back("index_type");
+	column_names->push_back("is_included");
+	ColumnAttributes *column_attributes = new ColumnAttributes;
+	column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+	column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+	column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+	column_attributes->push_back(ColumnAttribute(ColumnAttribute::INT));
+	column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+	column_attributes->push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+
+	ValueDict where;
+	where["table_name"] = Value(statement->tableName);
+	Handles *handles = SQLExec::indices->select(&where);
+
+	string message = "successfully returned " + to_string(handles->size()) + " rows";
+	return new QueryResult(column_names, column_attributes, SQLExec::indices, handles, message);
+}
+
+// SHOW PARTITIONS FROM <table> -- in the order rows are placed in them (by upper bound, or by hash bucket)
+QueryResult *SQLExec::show_partitions(const Identifier &table_name) {
+	PartitionedTable *table = dynamic_cast<PartitionedTable *>(&SQLExec::tables->get_table(table_name));
+	if (table == nullptr)
+		throw SQLExecError(table_name + " isn't partitioned");
+
+	ColumnNames *column_names = new ColumnNames;
+	column_names->push_back("table_name");
+	column_names->push_back("partition_name");
+	column_names->push_back("method");
+	column_names->push_back("column_name");
+	column_names->push_back("values_less_than");
+	ColumnAttributes *column_attributes = new ColumnAttributes(5, ColumnAttribute(ColumnAttribute::TEXT));
+
+	ValueDicts *rows = new ValueDicts;
+	for (auto const &partition : table->get_partitions()) {
+		ValueDict *row = new ValueDict;
+		(*row)["table_name"] = Value(table_name);
+		(*row)["partition_name"] = Value(partition.name);
+		(*row)["method"] = Value(PartitionedTable::method_name(table->get_method()));
+		(*row)["column_name"] = Value(table->get_key_column());
+		if (table->get_method() == PartitionedTable::RANGE)
+			(*row)["values_less_than"] = Value(PartitionedTable::bound_name(table->get_key_type(), partition.upper_bound));
+		rows->push_back(row);
+	}
+	string message = "successfully returned " + to_string(rows->size()) + " rows";
+	return new QueryResult(column_names, column_attributes, rows, message);
+}
+
+// (statistic, value) result columns for EXPLAIN ANALYZE and SHOW STATS
+static void stats_columns(ColumnNames *&column_names, ColumnAttributes *&column_attributes) {
+    column_names = new ColumnNames;
+    column_names->push_back("statistic");
+    column_names->push_back("value");
+    column_attributes = new ColumnAttributes;
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::TEXT));
+    column_attributes->push_back(ColumnAttribute(ColumnAttribute::BIGINT));
+}
+
+// add a (statistic, value) row
+static void add_stat(ValueDicts *rows, string statistic, u_int64_t value) {
+    ValueDict *row = new ValueDict;
+    (*row)["statistic"] = Value(statistic);
+    (*row)["value"] = Value::bigint((int64_t) min(value, (u_int64_t) INT64_MAX));
+    rows->push_back(row);
+}
+
+// add a row per counter, then calls and time for each operator that ran
+static void add_stats(ValueDicts *rows, const Stats &stats) {
+    for (uint i = 0; i < Stats::N_COUNTERS; i++)
+        add_stat(rows, Stats::name((Stats::Counter) i), stats.get((Stats::Counter) i));
+    for (uint i = 0; i < Stats::N_OPERATORS; i++) {
+        Stats::Operator op = (Stats::Operator) i;
+        if (stats.get_calls(op) == 0)
+            continue;
+        add_stat(rows, string(Stats::name(op)) + "_calls", stats.get_calls(op));
+        add_stat(rows, string(Stats::name(op)) + "_time_us", stats.get_ns(op) / 1000);
+    }
+}
+
+// EXPLAIN ANALYZE <statement> -- run the statement, fetching and throwing away all its rows, and
+// report what it took instead of its result
+QueryResult *SQLExec::explain_analyze(const SQLStatement *statement, const SQLExtensions &extensions) {
+    SQLExtensions plain = extensions;
+    plain.explain_analyze = false;
+
+    Stats before = Stats::snapshot();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    QueryResult *result = execute(statement, plain);
+    u_int64_t n_rows = 0;
+    while (result->has_more()) {
+        ValueDicts *batch = result->fetch(QueryResult::FETCH_BATCH);
+        n_rows += batch->size();
+        for (auto const &row: *batch)
+            delete row;
+        delete batch;
+    }
+    u_int64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    Stats stats = Stats::snapshot().since(before);
+    string message = result->get_message();
+    delete result;
+
+    ColumnNames *column_names;
+    ColumnAttributes *column_attributes;
+    stats_columns(column_names, column_attributes);
+    ValueDicts *rows = new ValueDicts;
+    add_stat(rows, "rows_returned", n_rows);
+    add_stat(rows, "total_time_us", ns / 1000);
+    add_stats(rows, stats);
+    return new QueryResult(column_names, column_attributes, rows, message);
+}
+
+// SHOW STATS -- the running totals since the program started
+QueryResult *SQLExec::show_stats() {
+    ColumnNames *column_names;
+    ColumnAttributes *column_attributes;
+    stats_columns(column_names, column_attributes);
+    ValueDicts *rows = new ValueDicts;
+    add_stats(rows, Stats::snapshot());
+    string message = "successfully returned " + to_string(rows->size()) + " rows";
+    return new QueryResult(column_names, column_attributes, rows, message);
+}
+
+// SHOW METRICS -- everything Metrics has, as the Prometheus text a scraper of MetricsServer would get
+QueryResult *SQLExec::show_metrics() {
+    return new QueryResult(Metrics::prometheus());
 }
 
+
+/*
+	TESTS
+*/
+
+// Execute the statements in sql, all the INSERTs as one batch after the others. Returns what went wrong ("" if nothing).
+static string execute_sql(const string& sql, bool& rolled_back) {
+	SQLParserResult* parse = SQLParser::parseSQLString(sql);
+	if (!parse->isValid()) {
+		string error = string("invalid SQL: ") + parse->errorMsg();
+		delete parse;
+		return error;
+	}
+	string error;
+	vector<const InsertStatement*> batch;
+	try {
+		for (uint i = 0; i < parse->size(); i++) {
+			const SQLStatement* statement = parse->getStatement(i);
+			if (statement->type() == kStmtInsert)
+				batch.push_back((const InsertStatement*)statement);
+			else
+				delete SQLExec::execute(statement);
+		}
+		if (!batch.empty())
+			delete SQLExec::execute_batch(batch);
+	}
+	catch (SQLExecRollbackError& e) {
+		rolled_back = false;
+		error = e.what();
+	}
+	catch (exception& e) {
+		rolled_back = true;
+		error = e.what();
+	}
+	delete parse;
+	return error;
+}
+
+// How many rows of the table, and entries of its indices on id and s, there are for ids 1-4 and s 'one' and 'two'.
+static size_t count_everywhere(DbRelation& table, DbIndex& by_id, DbIndex& by_s) {
+	Handles* handles = table.select();
+	size_t n = handles->size();
+	delete handles;
+	ValueDict key;
+	for (int id = 1; id <= 4; id++) {
+		key["id"] = Value(id);
+		handles = by_id.lookup(&key);
+		n += handles->size();
+		delete handles;
+	}
+	key.clear();
+	for (auto const& s : {"one", "two"}) {
+		key["s"] = Value(s);
+		handles = by_s.lookup(&key);
+		n += handles->size();
+		delete handles;
+	}
+	return n;
+}
+
+// The rows of a SELECT, each as its values separated by spaces, sorted.
+static vector<string> select_sql(const string& sql) {
+	SQLParserResult* parse = SQLParser::parseSQLString(sql);
+	QueryResult* result = nullptr;
+	vector<string> rows;
+	try {
+		result = SQLExec::execute(parse->getStatement(0));
+		while (result->has_more()) {
+			ValueDicts* batch = result->fetch(QueryResult::FETCH_BATCH);
+			for (auto const& row : *batch) {
+				string values;
+				for (auto const& column : *row)
+					values += (values.empty() ? "" : " ") + (column.second.data_type == ColumnAttribute::TEXT
+															 ? column.second.s : to_string(column.second.n));
+				rows.push_back(values);
+				delete row;
+			}
+			delete batch;
+		}
+	}
+	catch (exception& e) {
+		rows.assign(1, string("error: ") + e.what());
+	}
+	delete result;
+	delete parse;
+	sort(rows.begin(), rows.end());
+	return rows;
+}
+
+// A TEXT value too long for the index on it (over BTreeIndex::MAX_ENTRY) fails once its row and the rows
+// before it in the batch are in the table and the other index, and then none of them may stay.
+bool test_sql_exec() {
+	string table_name = "test_insert_rollback";
+	bool rolled_back = true;
+	if (!execute_sql("CREATE TABLE " + table_name + " (id INT, s TEXT); "
+					 "CREATE INDEX " + table_name + "_id ON " + table_name + " (id); "
+					 "CREATE INDEX " + table_name + "_s ON " + table_name + " (s)", rolled_back).empty())
+		return false;
+	DbRelation& table = SQLExec::tables->get_table(table_name);
+	DbIndex& by_id = SQLExec::indices->get_index(table, table_name + "_id");
+	DbIndex& by_s = SQLExec::indices->get_index(table, table_name + "_s");
+
+	string insert = "INSERT INTO " + table_name + " VALUES ";
+	string too_long = "'" + string(BTreeIndex::MAX_ENTRY + 1, 'x') + "'";
+	bool ok = !execute_sql(insert + "(1, 'one'); " + insert + "(2, 'two'); " + insert + "(3, " + too_long + ")",
+						   rolled_back).empty() && rolled_back
+			  && count_everywhere(table, by_id, by_s) == 0
+			  && !execute_sql(insert + "(4, " + too_long + ")", rolled_back).empty() && rolled_back
+			  && count_everywhere(table, by_id, by_s) == 0
+			  && execute_sql(insert + "(1, 'one'); " + insert + "(2, 'two')", rolled_back).empty()
+			  && count_everywhere(table, by_id, by_s) == 2 * 3;
+
+	// neither index has every column these need, but each narrows the rows down, so they're found
+	// from the indices and only those rows are read from the table
+	string select = "SELECT * FROM " + table_name + " WHERE ";
+	ok = ok && execute_sql(insert + "(3, 'two'); " + insert + "(4, 'four')", rolled_back).empty()
+		 && select_sql(select + "id >= 2 AND s = 'two'") == vector<string>({"2 two", "3 two"})
+		 && select_sql(select + "s = 'two' AND id < 3") == vector<string>({"2 two"})
+		 && select_sql(select + "id > 4").empty()
+		 && select_sql("SELECT s FROM " + table_name + " WHERE id > 2") == vector<string>({"four", "two"});
+	if (!execute_sql("DROP TABLE " + table_name, rolled_back).empty() || !ok)
+		return false;
+
+	// and once it's dropped it's gone, so dropping it again is an error rather than a crash
+	return SQLExec::indices->get_index_names(table_name).empty()
+		   && !execute_sql("DROP TABLE " + table_name, rolled_back).empty() && rolled_back;
+}
@@ -8,6 +8,8 @@
 #include <exception>
 #include <string>
 #include "SQLParser.h"
+#include "SQLExtensions.h"
+#include "metrics.h"
 #include "schema_tables.h"
 
 /**
@@ -18,19 +20,67 @@ public:
     explicit SQLExecError(std::string s) : runtime_error(s) {}
 };
 
+/**
+ * @class SQLExecRollbackError - a statement failed, and so did undoing what it had done so far,
+ * so some of its changes may still be there
+ */
+class SQLExecRollbackError : public SQLExecError {
+public:
+    explicit SQLExecRollbackError(std::string s) : SQLExecError(s) {}
+};
+
 
 /**
  * @class QueryResult - data structure to hold all the returned data for a query execution
+ *
+ * The rows are either fully materialized up front, or, for results that may be large, the
+ * QueryResult is a cursor over the qualifying handles of a relation and each row is projected
+ * only when it is fetched. Printing a cursor pulls FETCH_BATCH rows at a time, so the first rows
+ * show up right away and memory use doesn't grow with the size of the result.
  */
 class QueryResult {
 public:
-    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), message("") {}
+    /**
+     * Most rows we hold in memory at once while printing a streaming result.
+     */
+    static const uint FETCH_BATCH = 100;
+
+    QueryResult() : column_names(nullptr), column_attributes(nullptr), rows(nullptr), message(""),
+                    relation(nullptr), handles(nullptr), next_row(0), where(nullptr), position(0), scanning(false),
+                    n_found(0) {}
 
     QueryResult(std::string message) : column_names(nullptr), column_attributes(nullptr), rows(nullptr),
-                                       message(message) {}
+                                       message(message), relation(nullptr), handles(nullptr), next_row(0),
+                                       where(nullptr), position(0), scanning(false), n_found(0) {}
 
     QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, ValueDicts *rows, std::string message)
-            : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message) {}
+            : column_names(column_names), column_attributes(column_attributes), rows(rows), message(message),
+              relation(nullptr), handles(nullptr), next_row(0), where(nullptr), position(0), scanning(false),
+              n_found(0) {}
+
+    /**
+     * Streaming result: rows are projected from relation, one handle at a time, as they are fetched.
+     * @param relation  table the handles belong to (not owned; must outlive this result)
+     * @param handles   qualifying rows, in result order (owned by this result)
+     */
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, DbRelation *relation,
+                Handles *handles, std::string message)
+            : column_names(column_names), column_attributes(column_attributes), rows(nullptr), message(message),
+              relation(relation), handles(handles), next_row(0), where(nullptr), position(0), scanning(false),
+              n_found(0) {}
+
+    /**
+     * Scanning result: the qualifying rows themselves are found a few blocks at a time, as they are
+     * fetched (see DbRelation::select_more), so the first ones come back before the whole relation
+     * has been read. The message, how many rows were returned, is set once the scan is finished.
+     * @param relation  table to scan (not owned; must outlive this result)
+     * @param where     predicates the rows have to satisfy (owned by this result; null for all rows)
+     */
+    QueryResult(ColumnNames *column_names, ColumnAttributes *column_attributes, DbRelation *relation,
+                Predicates *where)
+            : column_names(column_names), column_attributes(column_attributes), rows(nullptr), message(""),
+              relation(relation), handles(new Handles()), next_row(0), where(where), position(0), scanning(true),
+              n_found(0) {}
 
     virtual ~QueryResult();
 
@@ -38,13 +88,51 @@ public:
     ColumnAttributes *get_column_attributes() const { return column_attributes; }
     ValueDicts *get_rows() const { return rows; }
     const std::string &get_message() const { return message; }
-    friend std::ostream &operator<<(std::ostream &stream, const QueryResult &qres);
+
+    /**
+     * Are there rows that haven't been fetched yet? (For a scanning result, this may scan on to find out.)
+     */
+    bool has_more();
+
+    /**
+     * Pull the next rows from the result (works for both materialized and streaming results).
+     * @param n  maximum number of rows to return
+     * @returns  up to n rows (freed by caller); empty once the result is exhausted
+     */
+    ValueDicts *fetch(uint n);
+
+    /**
+     * Print the column header, up to max_rows rows, and, if that exhausts the result, the message.
+     * @param max_rows  how many rows to print (0 for all of them)
+     */
+    void print(std::ostream &out, uint max_rows = 0);
+
+    /**
+     * Print up to max_rows more rows (e.g., for FETCH n), followed by the message once exhausted.
+     * @param max_rows  how many rows to print (0 for all the rest)
+     * @returns         number of rows printed
+     */
+    uint print_rows(std::ostream &out, uint max_rows = 0);
+
+    // printing consumes the rows, so the result can't be const
+    friend std::ostream &operator<<(std::ostream &stream, QueryResult &qres);
 
 protected:
     ColumnNames *column_names;
     ColumnAttributes *column_attributes;
     ValueDicts *rows;
     std::string message;
+
+    // streaming state
+    DbRelation *relation;
+    Handles *handles;
+    size_t next_row;
+
+    // scanning state (handles holds the piece of the scan being fetched from)
+    Predicates *where;
+    u_int64_t position;
+    bool scanning;
+    u_int64_t n_found;
 };
 
 
@@ -56,27 +144,106 @@ public:
 	/**
 	 * Execute the given SQL statement.
 	 * @param statement   the Hyrise AST of the SQL statement to execute
+	 * @param extensions  our additions to the statement that the parser didn't see
+	 * @returns           the query result (freed by caller)
+	 */
+    static QueryResult *execute(const hsql::SQLStatement *statement,
+                                const SQLExtensions &extensions = SQLExtensions()) throw(SQLExecError);
+
+	/**
+	 * Execute a run of INSERT ... VALUES statements into the same table as one batch: the table and
+	 * its indices are looked up and opened once, the rows are appended a block at a time, and either
+	 * they all go in or (if one can't) none do. It counts as one INSERT statement in Metrics.
+	 * @param statements  INSERT statements, all into the same table
 	 * @returns           the query result (freed by caller)
+	 * @throws            SQLExecRollbackError if a row couldn't go in and the ones before it couldn't
+	 *                    all be taken back out either
 	 */
-    static QueryResult *execute(const hsql::SQLStatement *statement) throw(SQLExecError);
+    static QueryResult *execute_batch(const std::vector<const hsql::InsertStatement*> &statements) throw(SQLExecError);
+
+	/**
+	 * Can this statement go in the same batch as the one before it?
+	 * @param statement   the next statement
+	 * @param extensions  our additions to it
+	 * @param previous    the statement before it (nullptr if none)
+	 * @returns           true if they're both INSERT ... VALUES into the same table (and this one isn't EXPLAIN ANALYZE)
+	 */
+    static bool batches_with(const hsql::SQLStatement *statement, const SQLExtensions &extensions,
+                             const hsql::SQLStatement *previous);
+
+    friend bool test_sql_exec();
 
 protected:
 	// the one place in the system that holds the _tables table
     static Tables *tables;
 
+	// the one place in the system that holds the _indices table
+    static Indices *indices;
+
 	// recursive decent into the AST
-    static QueryResult *create(const hsql::CreateStatement *statement);
+    static QueryResult *create(const hsql::CreateStatement *statement, const SQLExtensions &extensions);
+    static QueryResult *create_table(const hsql::CreateStatement *statement, const SQLExtensions &extensions);
+    static QueryResult *create_index(const hsql::CreateStatement *statement, const SQLExtensions &extensions);
     static QueryResult *drop(const hsql::DropStatement *statement);
+    static QueryResult *drop_table(const hsql::DropStatement *statement);
+    static QueryResult *drop_index(const hsql::DropStatement *statement);
+    static QueryResult *alter_table(const SQLExtensions &extensions);
+    static QueryResult *insert(const std::vector<const hsql::InsertStatement*> &statements);
+    static QueryResult *select(const hsql::SelectStatement *statement);
     static QueryResult *show(const hsql::ShowStatement *statement);
     static QueryResult *show_tables();
     static QueryResult *show_columns(const hsql::ShowStatement *statement);
+    static QueryResult *show_index(const hsql::ShowStatement *statement);
+    static QueryResult *show_stats();
+    static QueryResult *show_metrics();
+    static QueryResult *show_partitions(const Identifier &table_name);
+    static QueryResult *explain_analyze(const hsql::SQLStatement *statement, const SQLExtensions &extensions);
+
+	// which of Metrics' statement types this is
+    static Metrics::StatementType statement_type(const hsql::SQLStatement *statement);
 
 	/**
 	 * Pull out column name and attributes from AST's column definition clause
 	 * @param col                AST column definition
+	 * @param extensions         column types the parser didn't see
 	 * @param column_name        returned by reference
 	 * @param column_attributes  returned by reference
 	 */
-    static void column_definition(const hsql::ColumnDefinition *col, Identifier &column_name, ColumnAttribute &column_attribute);
+    static void column_definition(const hsql::ColumnDefinition *col, const SQLExtensions &extensions,
+                                  Identifier &column_name, ColumnAttribute &column_attribute);
+
+	/**
+	 * Make the row an INSERT ... VALUES statement adds to a table
+	 * @param statement  AST of the INSERT statement
+	 * @param table      the table it inserts into
+	 * @returns          the row (freed by caller)
+	 */
+    static ValueDict *insert_row(const hsql::InsertStatement *statement, DbRelation &table);
+
+	/**
+	 * Add a WHERE clause's comparisons to a list of predicates
+	 * @param expr   AST of the clause: <column> <op> <literal> comparisons joined by AND
+	 * @param table  the table the columns are in
+	 * @param where  returned by reference: the predicates, all of which must hold
+	 */
+    static void where_clause(const hsql::Expr *expr, const DbRelation &table, Predicates &where);
+
+	/**
+	 * Get a literal (a number, possibly negated, or a string) as a value of a column's type
+	 * @param expr       AST of the literal
+	 * @param data_type  type of the column it's going in
+	 * @returns          its value
+	 */
+    static Value literal(const hsql::Expr *expr, ColumnAttribute::DataType data_type);
+
+	/**
+	 * Make the partitions of a new PARTITIONED table from its PARTITION BY clause
+	 * @param extensions  the PARTITION BY clause
+	 * @param key_type    type of the column it's partitioned by
+	 * @returns           its partitions, with ids from 0
+	 */
+    static std::vector<Partition> partition_definitions(const SQLExtensions &extensions,
+                                                        ColumnAttribute::DataType key_type);
 };
 
+bool test_sql_exec();
@@ -0,0 +1,181 @@
+/**
+ * @file SQLExtensions.cpp - implementation of SQLExtensions
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <climits>
+#include <regex>
+#include "SQLExtensions.h"
+using namespace std;
+
+vector<SQLExtensions> SQLExtensions::strip(string &query) {
+    vector<SQLExtensions> all;
+    string stripped, statement;
+    char quote = '\0';
+    for (size_t i = 0; i <= query.length(); i++) {
+        char c = i < query.length() ? query[i] : ';';
+        if (quote != '\0') {
+            if (c == quote)
+                quote = '\0';
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == ';') {
+            if (statement.find_first_not_of(" \t\r\n") != string::npos) {
+                SQLExtensions extensions;
+                stripped += strip_statement(statement, extensions);
+                all.push_back(extensions);
+            } else {
+                stripped += statement;
+            }
+            if (i < query.length())
+                stripped += c;
+            statement.clear();
+            continue;
+        }
+        statement += c;
+    }
+    query = stripped;
+    return all;
+}
+
+string SQLExtensions::strip_statement(const string &statement, SQLExtensions &extensions) {
+    static const regex explain_analyze("^\\s*EXPLAIN\\s+ANALYZE\\s", regex::icase);
+    static const regex show_command("^\\s*SHOW\\s+(STATS|METRICS)\\s*$", regex::icase);
+    static const regex create_table("^\\s*CREATE\\s+TABLE\\s", regex::icase);
+    static const regex create_index("^\\s*CREATE\\s+INDEX\\s", regex::icase);
+    static const regex include_clause("\\bINCLUDE\\s*\\(([^)]*)\\)\\s*$", regex::icase);
+    static const regex column_name("\\w+");
+    static const regex using_clause("\\bUSING\\s+(\\w+)\\s*$", regex::icase);
+    static const regex with_clause("\\bWITH\\s*\\(\\s*PAGE_SIZE\\s*=\\s*(\\d+)\\s*\\)\\s*$", regex::icase);
+    static const regex partition_by("\\bPARTITION\\s+BY\\s+(RANGE|HASH)\\s*\\(\\s*(\\w+)\\s*\\)\\s*"
+                                     "(?:PARTITIONS\\s+(\\d+)|\\((.*)\\))\\s*$", regex::icase);
+    static const regex show_partitions("^\\s*SHOW\\s+PARTITIONS\\s+FROM\\s+(\\w+)\\s*$", regex::icase);
+    static const regex alter_table("^\\s*ALTER\\s+TABLE\\s+(\\w+)\\s+(ADD|DROP)\\s+PARTITION\\s+(.*?)\\s*$", regex::icase);
+    static const regex added("^\\s*\\((.*)\\)\\s*$");
+    static const regex dropped("^\\s*\\w+(\\s*,\\s*\\w+)*\\s*$");
+    static const regex extended_type("\\b(\\w+)(\\s+)(BIGINT|BOOLEAN|DATE|TIMESTAMP)\\b", regex::icase);
+
+    string ret = statement;
+    smatch match;
+    if (regex_search(ret, match, explain_analyze)) {
+        extensions.explain_analyze = true;
+        ret = match.suffix().str();
+    }
+    if (regex_search(ret, match, show_command)) {
+        extensions.show = match[1];
+        transform(extensions.show.begin(), extensions.show.end(), extensions.show.begin(), ::toupper);
+        return "SHOW TABLES";
+    }
+    if (regex_search(ret, match, show_partitions)) {
+        extensions.show = "PARTITIONS";
+        extensions.table_name = match[1];
+        return "SHOW TABLES";
+    }
+    if (regex_search(ret, match, alter_table)) {
+        string action = match[2], list = match[3];
+        transform(action.begin(), action.end(), action.begin(), ::toupper);
+        smatch parenthesized;
+        if (action == "ADD" && regex_search(list, parenthesized, added)) {
+            if (!partition_list(parenthesized[1], extensions))
+                return ret;
+        } else if (action == "DROP" && regex_search(list, dropped)) {
+            for (sregex_iterator it(list.begin(), list.end(), column_name); it != sregex_iterator(); it++)
+                extensions.partitions.push_back(make_pair(it->str(), ""));
+        } else {
+            return ret;
+        }
+        extensions.alter = action;
+        extensions.table_name = match[1];
+        return "SHOW TABLES";
+    }
+    if (regex_search(ret, create_index)) {
+        if (regex_search(ret, match, include_clause)) {
+            string columns = match[1];
+            for (sregex_iterator it(columns.begin(), columns.end(), column_name); it != sregex_iterator(); it++)
+                extensions.include_columns.push_back(it->str());
+            ret = match.prefix().str();
+        }
+        return ret;
+    }
+    if (!regex_search(ret, create_table))
+        return ret;
+    // trailing clauses can come in either order, so peel them off the end one at a time
+    for (bool found = true; found; ) {
+        found = false;
+        if (regex_search(ret, match, using_clause)) {
+            extensions.storage_engine = match[1];
+            transform(extensions.storage_engine.begin(), extensions.storage_engine.end(),
+                      extensions.storage_engine.begin(), ::toupper);
+            ret = match.prefix().str();
+            found = true;
+        }
+        if (regex_search(ret, match, with_clause)) {
+            string digits = match[1];
+            extensions.page_size = digits.length() > 6 ? UINT_MAX : stoul(digits);  // too big either way
+            ret = match.prefix().str();
+            found = true;
+        }
+        if (extensions.partition_method.empty() && regex_search(ret, match, partition_by)) {
+            SQLExtensions partitioning;
+            if (match[3].matched) {
+                string digits = match[3];
+                partitioning.partition_count = digits.length() > 6 ? UINT_MAX : stoul(digits);
+            }
+            if (!match[4].matched || partition_list(match[4], partitioning)) {
+                extensions.partition_method = match[1];
+                transform(extensions.partition_method.begin(), extensions.partition_method.end(),
+                          extensions.partition_method.begin(), ::toupper);
+                extensions.partition_column = match[2];
+                extensions.partition_count = partitioning.partition_count;
+                extensions.partitions = partitioning.partitions;
+                ret = match.prefix().str();
+                found = true;
+            }
+        }
+    }
+    // column types, which all come after the table name's opening parenthesis
+    size_t open = ret.find('(');
+    if (open == string::npos)
+        return ret;
+    string columns = ret.substr(open), rewritten;
+    while (regex_search(columns, match, extended_type)) {
+        string type = match[3];
+        transform(type.begin(), type.end(), type.begin(), ::toupper);
+        extensions.column_types[match[1]] = ColumnAttribute::type_named(type);
+        rewritten += match.prefix().str() + match[1].str() + match[2].str() + "INT";
+        columns = match.suffix().str();
+    }
+    return ret.substr(0, open) + rewritten + columns;
+}
+
+// PARTITION <name> VALUES LESS THAN (<bound>), ... into extensions.partitions; false if that's not what list is
+bool SQLExtensions::partition_list(const string &list, SQLExtensions &extensions) {
+    static const regex partition("^\\s*PARTITION\\s+(\\w+)\\s+VALUES\\s+LESS\\s+THAN\\s*"
+                                 "(?:\\(\\s*([^()]*?)\\s*\\)|(MAXVALUE))\\s*$", regex::icase);
+    string item;
+    int depth = 0;
+    char quote = '\0';
+    for (size_t i = 0; i <= list.length(); i++) {
+        char c = i < list.length() ? list[i] : ',';
+        if (quote != '\0') {
+            if (c == quote)
+                quote = '\0';
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+        } else if (c == '(' || c == ')') {
+            depth += c == '(' ? 1 : -1;
+        } else if (c == ',' && depth == 0) {
+            smatch match;
+            if (!regex_search(item, match, partition))
+                return false;
+            string bound = match[2].matched ? match[2].str() : match[3].str();
+            string upper = bound;
+            transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+            extensions.partitions.push_back(make_pair(match[1].str(), upper == "MAXVALUE" ? upper : bound));
+            item.clear();
+            continue;
+        }
+        item += c;
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file SQLExtensions.h - the parts of our SQL dialect the Hyrise parser doesn't know about
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+#include "storage_engine.h"
+
+/**
+ * @class SQLExtensions - clauses we add on to otherwise standard SQL statements
+ *
+ * For example:
+ *     CREATE TABLE foo (id INT, x TEXT) USING COLUMNAR
+ *     CREATE TABLE foo (id BIGINT, ok BOOLEAN, born DATE, seen TIMESTAMP)
+ *     CREATE INDEX fx ON foo (id) INCLUDE (x)
+ *     CREATE TABLE foo (id INT, x TEXT) WITH (PAGE_SIZE = 16384)
+ *     CREATE TABLE foo (day DATE, x TEXT) PARTITION BY RANGE (day)
+ *         (PARTITION d1 VALUES LESS THAN ('2018-07-21'), PARTITION d2 VALUES LESS THAN (MAXVALUE))
+ *     CREATE TABLE foo (id INT, x TEXT) PARTITION BY HASH (id) PARTITIONS 4
+ *     ALTER TABLE foo ADD PARTITION (PARTITION d3 VALUES LESS THAN ('2018-07-23'))
+ *     ALTER TABLE foo DROP PARTITION d1, d2
+ *     SHOW PARTITIONS FROM foo
+ *     EXPLAIN ANALYZE SHOW COLUMNS FROM foo
+ *     SHOW STATS
+ *     SHOW METRICS
+ *
+ * strip() takes them out of the query text, so that what's left is something the Hyrise parser
+ * understands, and records them, one SQLExtensions per statement, for SQLExec::execute. A SHOW
+ * command of our own, and an ALTER TABLE, is handed to the parser as SHOW TABLES, and a column of
+ * a type the parser doesn't have is handed to it as an INT column. A PARTITION BY or ALTER TABLE
+ * clause we can't make out is left in, for the parser to report.
+ */
+class SQLExtensions {
+public:
+    SQLExtensions() : storage_engine(""), page_size(0), partition_method(""), partition_column(""),
+                      partition_count(0), alter(""), table_name(""), explain_analyze(false), show("") {}
+    virtual ~SQLExtensions() {}
+
+    /**
+     * CREATE TABLE ... USING <storage_engine> (empty if no USING clause)
+     */
+    Identifier storage_engine;
+
+    /**
+     * CREATE TABLE ... WITH (PAGE_SIZE = <page_size>) (0 if no WITH clause)
+     */
+    uint page_size;
+
+    /**
+     * CREATE TABLE ... (<column> <type>, ...) for each column whose type the parser doesn't know
+     * (BIGINT, BOOLEAN, DATE or TIMESTAMP)
+     */
+    std::map<Identifier, ColumnAttribute::DataType> column_types;
+
+    /**
+     * CREATE TABLE ... PARTITION BY <partition_method> (<partition_column>) ... (RANGE or HASH, empty
+     * if no PARTITION BY clause)
+     */
+    Identifier partition_method;
+    Identifier partition_column;
+
+    /**
+     * CREATE TABLE ... PARTITION BY HASH (...) PARTITIONS <partition_count> (0 if not given)
+     */
+    uint partition_count;
+
+    /**
+     * CREATE TABLE ... PARTITION BY RANGE (...) (PARTITION <name> VALUES LESS THAN (<bound>), ...), and the
+     * same list in ALTER TABLE ... ADD PARTITION: each (name, bound) with the bound as written (an integer,
+     * a quoted date or MAXVALUE). For ALTER TABLE ... DROP PARTITION <name>, ..., the bounds are empty.
+     */
+    std::vector<std::pair<Identifier, std::string>> partitions;
+
+    /**
+     * ALTER TABLE ... <alter> PARTITION (ADD or DROP, empty if not an ALTER TABLE)
+     */
+    Identifier alter;
+
+    /**
+     * ALTER TABLE <table_name> ... or SHOW PARTITIONS FROM <table_name>
+     */
+    Identifier table_name;
+
+    /**
+     * CREATE INDEX ... INCLUDE (<include_columns>) (empty if no INCLUDE clause)
+     */
+    ColumnNames include_columns;
+
+    /**
+     * EXPLAIN ANALYZE <statement>
+     */
+    bool explain_analyze;
+
+    /**
+     * SHOW <show> for the SHOW commands the parser doesn't know (STATS, METRICS or PARTITIONS), empty otherwise
+     */
+    Identifier show;
+
+    /**
+     * Remove our extensions from each statement in query.
+     * @param query  SQL text (possibly several statements separated by semicolons), returned by
+     *               reference with the extensions taken out
+     * @returns      the extensions found in each (non-empty) statement, in order
+     */
+    static std::vector<SQLExtensions> strip(std::string &query);
+
+protected:
+    static std::string strip_statement(const std::string &statement, SQLExtensions &extensions);
+    static bool partition_list(const std::string &list, SQLExtensions &extensions);
+};
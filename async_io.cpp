@@ -0,0 +1,221 @@
+/**
+ * @file async_io.cpp - implementation of AsyncReader, IoUringReader and ThreadPoolReader
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "async_io.h"
+
+using namespace std;
+
+AsyncReader* AsyncReader::create(int fd, uint depth) {
+	AsyncReader* reader = IoUringReader::create(fd, depth);
+	if (reader == nullptr)
+		reader = new ThreadPoolReader(fd, min(depth, (uint)ThreadPoolReader::MAX_THREADS));
+	return reader;
+}
+
+
+/*
+	IoUringReader
+*/
+
+IoUringReader* IoUringReader::create(int fd, uint depth) {
+	IoUringReader* reader = new IoUringReader(fd);
+	if (!reader->setup(depth)) {
+		delete reader;
+		return nullptr;
+	}
+	return reader;
+}
+
+IoUringReader::~IoUringReader() {
+	if (this->ring_fd >= 0)
+		drain();
+	if (this->sqes != nullptr)
+		munmap(this->sqes, this->sqes_size);
+	if (this->cq_ring != nullptr && this->cq_ring != this->sq_ring)
+		munmap(this->cq_ring, this->cq_ring_size);
+	if (this->sq_ring != nullptr)
+		munmap(this->sq_ring, this->sq_ring_size);
+	if (this->ring_fd >= 0)
+		close(this->ring_fd);
+}
+
+bool IoUringReader::submit(u_int64_t tag, char* buffer, uint size, off_t offset) {
+	if (this->outstanding >= this->sq_entries)
+		return false;
+	unsigned tail = *this->sq_tail;
+	unsigned index = tail & *this->sq_mask;
+	struct io_uring_sqe* sqe = (struct io_uring_sqe*)this->sqes + index;
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = this->fd;
+	sqe->addr = (u_int64_t)buffer;
+	sqe->len = size;
+	sqe->off = offset;
+	sqe->user_data = tag;
+	this->sq_array[index] = index;
+	__atomic_store_n(this->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	if (syscall(__NR_io_uring_enter, this->ring_fd, 1, 0, 0, nullptr, 0) != 1) {
+		__atomic_store_n(this->sq_tail, tail, __ATOMIC_RELEASE);  // kernel didn't take it
+		return false;
+	}
+	this->outstanding++;
+	return true;
+}
+
+ssize_t IoUringReader::wait(u_int64_t tag) {
+	while (this->done.find(tag) == this->done.end()) {
+		if (this->outstanding == 0)
+			return -EINVAL;  // never submitted
+		reap_one();
+	}
+	ssize_t result = this->done[tag];
+	this->done.erase(tag);
+	return result;
+}
+
+void IoUringReader::drain() {
+	while (this->outstanding > 0)
+		reap_one();
+	this->done.clear();
+}
+
+// Map the submission and completion rings (see io_uring_setup(2)).
+bool IoUringReader::setup(uint depth) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	this->ring_fd = syscall(__NR_io_uring_setup, max(depth, 1U), &params);
+	if (this->ring_fd < 0)
+		return false;
+
+	this->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	this->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		this->sq_ring_size = this->cq_ring_size = max(this->sq_ring_size, this->cq_ring_size);
+	void* ring = mmap(nullptr, this->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					  this->ring_fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED)
+		return false;
+	this->sq_ring = ring;
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		this->cq_ring = this->sq_ring;
+	}
+	else {
+		ring = mmap(nullptr, this->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+					this->ring_fd, IORING_OFF_CQ_RING);
+		if (ring == MAP_FAILED)
+			return false;
+		this->cq_ring = ring;
+	}
+	this->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring = mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				this->ring_fd, IORING_OFF_SQES);
+	if (ring == MAP_FAILED)
+		return false;
+	this->sqes = ring;
+
+	char* sq = (char*)this->sq_ring;
+	this->sq_head = (unsigned*)(sq + params.sq_off.head);
+	this->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+	this->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+	this->sq_array = (unsigned*)(sq + params.sq_off.array);
+	this->sq_entries = params.sq_entries;
+	char* cq = (char*)this->cq_ring;
+	this->cq_head = (unsigned*)(cq + params.cq_off.head);
+	this->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+	this->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+	this->cqes = cq + params.cq_off.cqes;
+	return true;
+}
+
+// Wait for the next completion and file its result under its tag.
+void IoUringReader::reap_one() {
+	unsigned head = *this->cq_head;
+	while (head == __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE)) {
+		if (syscall(__NR_io_uring_enter, this->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+			&& errno != EINTR)
+			throw runtime_error(string("io_uring_enter: ") + strerror(errno));
+	}
+	struct io_uring_cqe* cqe = (struct io_uring_cqe*)this->cqes + (head & *this->cq_mask);
+	this->done[cqe->user_data] = cqe->res;
+	__atomic_store_n(this->cq_head, head + 1, __ATOMIC_RELEASE);
+	this->outstanding--;
+}
+
+
+/*
+	ThreadPoolReader
+*/
+
+ThreadPoolReader::ThreadPoolReader(int fd, uint threads) : AsyncReader(fd), outstanding(0), stopping(false) {
+	for (uint i = 0; i < max(threads, 1U); i++)
+		this->workers.push_back(thread(&ThreadPoolReader::work, this));
+}
+
+ThreadPoolReader::~ThreadPoolReader() {
+	drain();
+	{
+		lock_guard<mutex> lock(this->queue_mutex);
+		this->stopping = true;
+	}
+	this->work_ready.notify_all();
+	for (auto& worker : this->workers)
+		worker.join();
+}
+
+bool ThreadPoolReader::submit(u_int64_t tag, char* buffer, uint size, off_t offset) {
+	{
+		lock_guard<mutex> lock(this->queue_mutex);
+		this->queue.push_back(Request{tag, buffer, size, offset});
+		this->outstanding++;
+	}
+	this->work_ready.notify_one();
+	return true;
+}
+
+ssize_t ThreadPoolReader::wait(u_int64_t tag) {
+	unique_lock<mutex> lock(this->queue_mutex);
+	this->work_done.wait(lock, [&] {
+		return this->done.find(tag) != this->done.end() || this->outstanding == 0;
+	});
+	auto result = this->done.find(tag);
+	if (result == this->done.end())
+		return -EINVAL;  // never submitted
+	ssize_t n = result->second;
+	this->done.erase(result);
+	return n;
+}
+
+void ThreadPoolReader::drain() {
+	unique_lock<mutex> lock(this->queue_mutex);
+	this->work_done.wait(lock, [&] { return this->outstanding == 0; });
+	this->done.clear();
+}
+
+void ThreadPoolReader::work() {
+	unique_lock<mutex> lock(this->queue_mutex);
+	while (true) {
+		this->work_ready.wait(lock, [&] { return this->stopping || !this->queue.empty(); });
+		if (this->queue.empty())
+			return;  // stopping
+		Request request = this->queue.front();
+		this->queue.pop_front();
+		lock.unlock();
+		ssize_t n = pread(this->fd, request.buffer, request.size, request.offset);
+		if (n < 0)
+			n = -errno;
+		lock.lock();
+		this->done[request.tag] = n;
+		this->outstanding--;
+		this->work_done.notify_all();
+	}
+}
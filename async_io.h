@@ -0,0 +1,133 @@
+/**
+ * @file async_io.h - reads that run in the background while we do something else
+ * AsyncReader
+ * IoUringReader: AsyncReader
+ * ThreadPoolReader: AsyncReader
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @class AsyncReader - abstract base class for issuing pread's against a file and collecting them later
+ *
+ *      Each read is identified by a caller-chosen tag. submit() starts it and returns right away;
+        wait() blocks until that read is done and says how it went. Every submitted read must be
+        waited for (or drain()'ed) before its buffer is freed.
+ */
+class AsyncReader {
+public:
+	/**
+	 * Reader for fd: io_uring if the kernel lets us have one, otherwise a small pool of threads.
+	 * @param fd     file to read from (stays owned by the caller)
+	 * @param depth  how many reads may be outstanding at once
+	 * @returns      the reader (freed by caller)
+	 */
+	static AsyncReader* create(int fd, uint depth);
+
+	AsyncReader(int fd) : fd(fd) {}
+	virtual ~AsyncReader() {}
+	AsyncReader(const AsyncReader& other) = delete;
+	AsyncReader(AsyncReader&& temp) = delete;
+	AsyncReader& operator=(const AsyncReader& other) = delete;
+	AsyncReader& operator=(AsyncReader&& temp) = delete;
+
+	/**
+	 * Start reading size bytes at offset into buffer.
+	 * @param tag  identifies this read to wait() (must not already be outstanding)
+	 * @returns    false if the read couldn't be started (caller should just read it itself later)
+	 */
+	virtual bool submit(u_int64_t tag, char* buffer, uint size, off_t offset) = 0;
+
+	/**
+	 * Wait for a submitted read to finish.
+	 * @returns  number of bytes read, or -errno
+	 */
+	virtual ssize_t wait(u_int64_t tag) = 0;
+
+	/**
+	 * Wait for all outstanding reads.
+	 */
+	virtual void drain() = 0;
+
+protected:
+	int fd;
+};
+
+/**
+ * @class IoUringReader - AsyncReader on a Linux io_uring, driven with the raw system calls
+ */
+class IoUringReader : public AsyncReader {
+public:
+	/**
+	 * @returns  the reader, or nullptr if this kernel (or sandbox) won't give us an io_uring
+	 */
+	static IoUringReader* create(int fd, uint depth);
+
+	virtual ~IoUringReader();
+
+	virtual bool submit(u_int64_t tag, char* buffer, uint size, off_t offset);
+	virtual ssize_t wait(u_int64_t tag);
+	virtual void drain();
+
+protected:
+	IoUringReader(int fd) : AsyncReader(fd), ring_fd(-1), sq_ring(nullptr), cq_ring(nullptr), sqes(nullptr),
+							sq_ring_size(0), cq_ring_size(0), sqes_size(0), outstanding(0) {}
+
+	int ring_fd;
+	void* sq_ring;
+	void* cq_ring;
+	void* sqes;
+	size_t sq_ring_size, cq_ring_size, sqes_size;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array, sq_entries;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	void* cqes;
+	uint outstanding;
+	std::map<u_int64_t, ssize_t> done;  // results we reaped while waiting for some other read
+
+	virtual bool setup(uint depth);
+	virtual void reap_one();
+};
+
+/**
+ * @class ThreadPoolReader - AsyncReader that hands pread's to a few worker threads
+ */
+class ThreadPoolReader : public AsyncReader {
+public:
+	ThreadPoolReader(int fd, uint threads);
+	virtual ~ThreadPoolReader();
+
+	virtual bool submit(u_int64_t tag, char* buffer, uint size, off_t offset);
+	virtual ssize_t wait(u_int64_t tag);
+	virtual void drain();
+
+	/**
+	 * most worker threads a pool will start
+	 */
+	static const uint MAX_THREADS = 4;
+
+protected:
+	struct Request {
+		u_int64_t tag;
+		char* buffer;
+		uint size;
+		off_t offset;
+	};
+	std::vector<std::thread> workers;
+	std::mutex queue_mutex;
+	std::condition_variable work_ready, work_done;
+	std::deque<Request> queue;
+	std::map<u_int64_t, ssize_t> done;
+	uint outstanding;
+	bool stopping;
+
+	virtual void work();
+};
@@ -0,0 +1,686 @@
+/**
+ * @file bench.cpp - micro- and macro-benchmarks for the storage engines and the catalog
+ *
+ *      $ make bench
+ *      $ ./bench [--rows N] [--ops N] [--engine E] [--filter S] [--min-time SECONDS] [--json FILE] dbenvpath
+ *
+ *      Microbenchmarks (page/..., record/..., file/..., catalog/..., lock/...) run their body with
+ *      more and more iterations until it takes at least --min-time seconds and report the time per
+ *      iteration.
+ *      Macro workloads (macro/...) each run once against a fresh table with --rows rows in the --engine
+ *      storage engine (HEAP, COLUMNAR, FLAT, DIRECT or MMAP) and report the time per row or operation.
+ *      --json writes all the results to FILE ("-" for stdout) in the same layout Google Benchmark uses,
+ *      so its compare.py and friends work on them.
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "db_cxx.h"
+#include "bitmap_scan.h"
+#include "heap_storage.h"
+#include "lock_manager.h"
+#include "direct_storage.h"
+#include "memory_pool.h"
+#include "schema_tables.h"
+
+using namespace std;
+
+/*
+ * we allocate and initialize the _DB_ENV global
+ */
+DbEnv* _DB_ENV;
+
+/**
+ * Keep the compiler from optimizing away a result we don't otherwise use.
+ */
+template <typename T>
+inline void do_not_optimize(T const& value) {
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * @class Stopwatch - accumulates the time between start() and stop(), so a benchmark body can leave its setup out
+ */
+class Stopwatch {
+public:
+	Stopwatch() : total(0), running(false) {}
+
+	void start() {
+		began = chrono::steady_clock::now();
+		running = true;
+	}
+
+	void stop() {
+		if (running)
+			total += chrono::duration<double>(chrono::steady_clock::now() - began).count();
+		running = false;
+	}
+
+	double seconds() const {return total;}
+
+protected:
+	chrono::steady_clock::time_point began;
+	double total;
+	bool running;
+};
+
+/**
+ * @class Bench - runs benchmarks, prints a line for each, and collects the results for JSON output
+ */
+class Bench {
+public:
+	/**
+	 * body of a microbenchmark: do the thing iterations times (calling clock.stop()/start() around any setup)
+	 */
+	typedef function<void(u_int64_t iterations, Stopwatch& clock)> Body;
+
+	Bench(string filter, double min_time) : filter(filter), min_time(min_time) {}
+
+	/**
+	 * Should the named benchmark be run (per --filter)?
+	 */
+	bool wanted(string name) const {
+		return filter.empty() || name.find(filter) != string::npos;
+	}
+
+	/**
+	 * Run body with more iterations each time until it takes at least min_time, then record the last run.
+	 * @param name  benchmark name
+	 * @param body  what to time
+	 */
+	void micro(string name, Body body) {
+		if (!wanted(name))
+			return;
+		u_int64_t iterations = 1;
+		while (true) {
+			Stopwatch clock;
+			clock.start();
+			body(iterations, clock);
+			clock.stop();
+			double seconds = clock.seconds();
+			if (seconds >= min_time || iterations >= MAX_ITERATIONS) {
+				record(name, iterations, seconds, iterations);
+				return;
+			}
+			// aim a bit past min_time next round, but don't grow too fast off a noisy short run
+			double guess = seconds > 0 ? iterations * min_time * 1.4 / seconds : iterations * 100.0;
+			iterations = max(iterations + 1, (u_int64_t)min(guess, iterations * 100.0));
+			iterations = min(iterations, (u_int64_t)MAX_ITERATIONS);
+		}
+	}
+
+	/**
+	 * Run body once and record it as doing items things.
+	 * @param name   benchmark name
+	 * @param items  how many rows or operations body handles (the per-item time is what's reported)
+	 * @param body   what to time
+	 */
+	void macro(string name, u_int64_t items, Body body) {
+		if (!wanted(name))
+			return;
+		Stopwatch clock;
+		clock.start();
+		body(items, clock);
+		clock.stop();
+		record(name, items, clock.seconds(), items);
+	}
+
+	/**
+	 * Write the results out the way Google Benchmark's --benchmark_format=json does.
+	 */
+	void write_json(ostream& out, const vector<pair<string, string>>& context) const {
+		out << fixed << setprecision(2) << "{" << endl << "  \"context\": {" << endl;
+		for (uint i = 0; i < context.size(); i++)
+			out << "    \"" << context[i].first << "\": \"" << context[i].second << "\""
+				<< (i + 1 < context.size() ? "," : "") << endl;
+		out << "  }," << endl << "  \"benchmarks\": [" << endl;
+		for (uint i = 0; i < results.size(); i++) {
+			const Result& result = results[i];
+			out << "    {" << endl
+				<< "      \"name\": \"" << result.name << "\"," << endl
+				<< "      \"run_name\": \"" << result.name << "\"," << endl
+				<< "      \"run_type\": \"iteration\"," << endl
+				<< "      \"iterations\": " << result.iterations << "," << endl
+				<< "      \"real_time\": " << ns_per_item(result) << "," << endl
+				<< "      \"cpu_time\": " << ns_per_item(result) << "," << endl
+				<< "      \"time_unit\": \"ns\"," << endl
+				<< "      \"items_per_second\": " << items_per_second(result) << endl
+				<< "    }" << (i + 1 < results.size() ? "," : "") << endl;
+		}
+		out << "  ]" << endl << "}" << endl;
+	}
+
+	/**
+	 * most times a microbenchmark body is asked to repeat
+	 */
+	static const u_int64_t MAX_ITERATIONS = 1000000000;
+
+protected:
+	struct Result {
+		string name;
+		u_int64_t iterations;
+		double seconds;
+		u_int64_t items;
+	};
+	string filter;
+	double min_time;
+	vector<Result> results;
+
+	void record(string name, u_int64_t iterations, double seconds, u_int64_t items) {
+		Result result = {name, iterations, seconds, items};
+		results.push_back(result);
+		cout << left << setw(36) << name << right << setw(14) << fixed << setprecision(1) << ns_per_item(result)
+			 << " ns" << setw(14) << iterations << setw(16) << setprecision(0) << items_per_second(result)
+			 << " items/s" << endl;
+	}
+
+	static double ns_per_item(const Result& result) {
+		return result.items == 0 ? 0.0 : result.seconds * 1e9 / result.items;
+	}
+
+	static double items_per_second(const Result& result) {
+		return result.seconds == 0 ? 0.0 : result.items / result.seconds;
+	}
+};
+
+/**
+ * @class BenchTable - HeapTable that lets us get at marshal and unmarshal
+ */
+class BenchTable : public HeapTable {
+public:
+	BenchTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes)
+			: HeapTable(table_name, column_names, column_attributes) {}
+
+	using HeapTable::marshal;
+	using HeapTable::unmarshal;
+};
+
+// columns of every table we benchmark with: (id INT, name TEXT, score INT)
+static void bench_columns(ColumnNames& column_names, ColumnAttributes& column_attributes) {
+	column_names = {"id", "name", "score"};
+	column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT),
+						 ColumnAttribute(ColumnAttribute::INT)};
+}
+
+// a typical row of a benchmark table
+static ValueDict bench_row(int id) {
+	ValueDict row;
+	row["id"] = Value(id);
+	row["name"] = Value("customer-" + to_string(id) + "-abcdefghij");
+	row["score"] = Value(id % 1000);
+	return row;
+}
+
+// SlottedPage add, get and del on 100-byte records in a standard-size block
+static void bench_page(Bench& bench) {
+	const uint record_size = 100;
+	const uint per_page = (DbBlock::BLOCK_SZ - 4) / (record_size + 4);  // what fits with the block and record headers
+	char* buffer = (char*)MemoryPool::allocate(DbBlock::BLOCK_SZ);
+	char record_bytes[record_size];
+	memset(record_bytes, 'x', record_size);
+	Dbt record(record_bytes, record_size);
+
+	bench.micro("page/add", [&](u_int64_t iterations, Stopwatch& clock) {
+		SlottedPage* page = nullptr;
+		for (u_int64_t i = 0; i < iterations; i++) {
+			if (i % per_page == 0) {
+				clock.stop();
+				delete page;
+				memset(buffer, 0, DbBlock::BLOCK_SZ);
+				Dbt block(buffer, DbBlock::BLOCK_SZ);
+				page = new SlottedPage(block, 1, true);
+				clock.start();
+			}
+			do_not_optimize(page->add(&record));
+		}
+		delete page;
+	});
+
+	memset(buffer, 0, DbBlock::BLOCK_SZ);
+	Dbt block(buffer, DbBlock::BLOCK_SZ);
+	SlottedPage* full = new SlottedPage(block, 1, true);
+	for (uint i = 0; i < per_page; i++)
+		full->add(&record);
+	bench.micro("page/get", [&](u_int64_t iterations, Stopwatch& clock) {
+		for (u_int64_t i = 0; i < iterations; i++) {
+			Dbt* data = full->get(i % per_page + 1);
+			do_not_optimize(data);
+			delete data;
+		}
+	});
+	delete full;
+
+	bench.micro("page/del", [&](u_int64_t iterations, Stopwatch& clock) {
+		SlottedPage* page = nullptr;
+		for (u_int64_t i = 0; i < iterations; i++) {
+			if (i % per_page == 0) {
+				clock.stop();
+				delete page;
+				memset(buffer, 0, DbBlock::BLOCK_SZ);
+				Dbt block(buffer, DbBlock::BLOCK_SZ);
+				page = new SlottedPage(block, 1, true);
+				for (uint j = 0; j < per_page; j++)
+					page->add(&record);
+				clock.start();
+			}
+			page->del(i % per_page + 1);  // front to back, so each one slides the rest
+		}
+		delete page;
+	});
+	MemoryPool::release(buffer, DbBlock::BLOCK_SZ);
+}
+
+// HeapTable marshal and unmarshal of a bench_row (all of it, and just its last column)
+static void bench_record(Bench& bench) {
+	if (!bench.wanted("record/"))
+		return;
+	ColumnNames column_names;
+	ColumnAttributes column_attributes;
+	bench_columns(column_names, column_attributes);
+	BenchTable table("_bench_record", column_names, column_attributes);
+	ValueDict row = bench_row(12345);
+
+	bench.micro("record/marshal", [&](u_int64_t iterations, Stopwatch& clock) {
+		for (u_int64_t i = 0; i < iterations; i++) {
+			Dbt data;
+			table.marshal(&row, data);
+			do_not_optimize(data);
+			MemoryPool::release(data.get_data(), DbBlock::BLOCK_SZ);
+		}
+	});
+
+	Dbt data;
+	table.marshal(&row, data);
+	bench.micro("record/unmarshal", [&](u_int64_t iterations, Stopwatch& clock) {
+		for (u_int64_t i = 0; i < iterations; i++) {
+			ValueDict* values = table.unmarshal(&data);
+			do_not_optimize(values);
+			delete values;
+		}
+	});
+
+	ColumnNames score = {"score"};
+	bench.micro("record/unmarshal_one", [&](u_int64_t iterations, Stopwatch& clock) {
+		for (u_int64_t i = 0; i < iterations; i++) {
+			ValueDict* values = table.unmarshal(&data, &score);
+			do_not_optimize(values);
+			delete values;
+		}
+	});
+	MemoryPool::release(data.get_data(), DbBlock::BLOCK_SZ);
+}
+
+// get and put of whole blocks on each kind of heap file
+static void bench_file(Bench& bench) {
+	const BlockID n_blocks = 256;
+	const vector<string> kinds = {"HEAP", "FLAT", "DIRECT", "MMAP"};
+	for (auto const& kind : kinds) {
+		if (!bench.wanted("file/get/" + kind) && !bench.wanted("file/put/" + kind))
+			continue;
+		string name = "_bench_file_" + kind;
+		HeapFile* file;
+		if (kind == "FLAT")
+			file = new DirectFile(name, DirectFile::BUFFERED);
+		else if (kind == "DIRECT")
+			file = new DirectFile(name, DirectFile::DIRECT);
+		else if (kind == "MMAP")
+			file = new DirectFile(name, DirectFile::MMAP);
+		else
+			file = new HeapFile(name);
+		file->create();
+		while (file->get_last_block_id() < n_blocks)
+			delete file->get_new();
+		file->close();
+		file->open();  // so MMAP maps what's there now
+
+		bench.micro("file/get/" + kind, [&](u_int64_t iterations, Stopwatch& clock) {
+			for (u_int64_t i = 0; i < iterations; i++) {
+				SlottedPage* page = file->get(i % n_blocks + 1);
+				do_not_optimize(page);
+				delete page;
+			}
+		});
+
+		bench.micro("file/put/" + kind, [&](u_int64_t iterations, Stopwatch& clock) {
+			for (u_int64_t i = 0; i < iterations; i++) {
+				clock.stop();
+				SlottedPage* page = file->get_for_update(i % n_blocks + 1);
+				clock.start();
+				file->put(page);
+				clock.stop();
+				delete page;
+				clock.start();
+			}
+		});
+
+		file->drop();
+		delete file;
+	}
+}
+
+// Add a table to the catalog the way SQLExec::create does and create it.
+static DbRelation& create_table(Tables& tables, Identifier table_name, Identifier storage_engine) {
+	ColumnNames column_names;
+	ColumnAttributes column_attributes;
+	bench_columns(column_names, column_attributes);
+	ValueDict row;
+	row["table_name"] = Value(table_name);
+	row["storage_engine"] = Value(storage_engine);
+	tables.insert(&row);
+	DbRelation& columns = tables.get_table(Columns::TABLE_NAME);
+	for (uint i = 0; i < column_names.size(); i++) {
+		row["column_name"] = Value(column_names[i]);
+		row["data_type"] = Value(ColumnAttribute::type_name(column_attributes[i].get_data_type()));
+		columns.insert(&row);
+	}
+	DbRelation& table = tables.get_table(table_name);
+	table.create();
+	tables.save_snapshot();
+	return table;
+}
+
+// Drop a table made by create_table and take it back out of the catalog.
+static void drop_table(Tables& tables, Identifier table_name) {
+	tables.get_table(table_name).drop();
+	ValueDict where;
+	where["table_name"] = Value(table_name);
+	DbRelation& columns = tables.get_table(Columns::TABLE_NAME);
+	Handles* handles = columns.select(&where);
+	for (auto const& handle : *handles)
+		columns.del(handle);
+	delete handles;
+	handles = tables.select(&where);
+	for (auto const& handle : *handles)
+		tables.del(handle);  // also takes it out of the table cache
+	delete handles;
+	tables.save_snapshot();
+}
+
+// looking up a table's metadata in _tables and _columns
+static void bench_catalog(Bench& bench, Tables& tables) {
+	if (!bench.wanted("catalog/"))
+		return;
+	Identifier table_name = "_bench_catalog";
+	create_table(tables, table_name, "HEAP");
+
+	bench.micro("catalog/get_columns", [&](u_int64_t iterations, Stopwatch& clock) {
+		for (u_int64_t i = 0; i < iterations; i++) {
+			ColumnNames column_names;
+			ColumnAttributes column_attributes;
+			tables.get_columns(table_name, column_names, column_attributes);
+			do_not_optimize(column_names);
+		}
+	});
+
+	bench.micro("catalog/get_storage_engine", [&](u_int64_t iterations, Stopwatch& clock) {
+		for (u_int64_t i = 0; i < iterations; i++)
+			do_not_optimize(tables.get_storage_engine(table_name));
+	});
+
+	bench.micro("catalog/snapshot_get", [&](u_int64_t iterations, Stopwatch& clock) {
+		for (u_int64_t i = 0; i < iterations; i++) {
+			CatalogEntry entry;
+			Tables::snapshot->get(table_name, entry);
+			do_not_optimize(entry);
+		}
+	});
+
+	bench.micro("catalog/get_table", [&](u_int64_t iterations, Stopwatch& clock) {
+		for (u_int64_t i = 0; i < iterations; i++)
+			do_not_optimize(tables.get_table(table_name));  // cached after the first
+	});
+
+	drop_table(tables, table_name);
+}
+
+// taking row locks for a transaction and letting them go, with and without escalation
+static void bench_lock(Bench& bench) {
+	const uint per_transaction = 100;
+	bench.micro("lock/row", [&](u_int64_t iterations, Stopwatch& clock) {
+		LockManager lock_manager(per_transaction, per_transaction);
+		for (u_int64_t i = 0; i < iterations; i++) {
+			lock_manager.lock_row(i / per_transaction, "_bench_lock", Handle(i % per_transaction / 10 + 1, i % 10 + 1),
+								  LockManager::X);
+			if (i % per_transaction == per_transaction - 1)
+				lock_manager.release_all(i / per_transaction);
+		}
+		lock_manager.release_all(iterations / per_transaction);
+	});
+
+	bench.micro("lock/row_escalated", [&](u_int64_t iterations, Stopwatch& clock) {
+		LockManager lock_manager(4, 4);
+		for (u_int64_t i = 0; i < iterations; i++) {
+			lock_manager.lock_row(i / per_transaction, "_bench_lock", Handle(i % per_transaction / 10 + 1, i % 10 + 1),
+								  LockManager::X);
+			if (i % per_transaction == per_transaction - 1)
+				lock_manager.release_all(i / per_transaction);
+		}
+		lock_manager.release_all(iterations / per_transaction);
+	});
+}
+
+// whole workloads against a table with rows rows
+static void bench_macro(Bench& bench, Tables& tables, string engine, uint rows, uint ops) {
+	if (!bench.wanted("macro/"))
+		return;
+	Identifier table_name = "_bench_macro";
+	DbRelation& table = create_table(tables, table_name, engine);
+	mt19937 random(5300);  // same sequence every run so runs are comparable
+
+	bench.macro("macro/bulk_insert/" + engine, rows, [&](u_int64_t items, Stopwatch& clock) {
+		for (uint id = 0; id < rows; id++) {
+			ValueDict row = bench_row(id);
+			table.insert(&row);
+		}
+	});
+
+	bench.macro("macro/full_scan/" + engine, rows, [&](u_int64_t items, Stopwatch& clock) {
+		Handles* handles = table.select();
+		for (auto const& handle : *handles) {
+			ValueDict* row = table.project(handle);
+			do_not_optimize(row);
+			delete row;
+		}
+		delete handles;
+	});
+
+	bench.macro("macro/point_lookup/" + engine, ops, [&](u_int64_t items, Stopwatch& clock) {
+		for (uint i = 0; i < ops; i++) {
+			ValueDict where;
+			where["id"] = Value((int)(random() % rows));
+			Handles* handles = table.select(&where);
+			for (auto const& handle : *handles) {
+				ValueDict* row = table.project(handle);
+				do_not_optimize(row);
+				delete row;
+			}
+			delete handles;
+		}
+	});
+
+	// the same kind of lookup on score through an index, first going back to the table for the
+	// rows, then answered from the index alone
+	BTreeIndex index(table, "_bench_score", {"score"}, {"name"});
+	index.create();
+	ColumnNames wanted = {"score", "name"};
+	bench.macro("macro/index_lookup/" + engine, ops, [&](u_int64_t items, Stopwatch& clock) {
+		for (uint i = 0; i < ops; i++) {
+			ValueDict key;
+			key["score"] = Value((int)(random() % 1000));
+			Handles* handles = index.lookup(&key);
+			for (auto const& handle : *handles) {
+				ValueDict* row = table.project(handle, &wanted);
+				do_not_optimize(row);
+				delete row;
+			}
+			delete handles;
+		}
+	});
+
+	bench.macro("macro/index_only_lookup/" + engine, ops, [&](u_int64_t items, Stopwatch& clock) {
+		for (uint i = 0; i < ops; i++) {
+			Predicates where = {Predicate("score", Predicate::EQ, Value((int)(random() % 1000)))};
+			ValueDicts* rows = index.project(&where, &wanted);
+			for (auto const& row : *rows) {
+				do_not_optimize(row);
+				delete row;
+			}
+			delete rows;
+		}
+	});
+
+	// score in a range and id under a limit, each narrowed by its own index and the two bitmaps ANDed
+	BTreeIndex id_index(table, "_bench_id", {"id"}, {});
+	id_index.create();
+	vector<DbIndex*> indices = {&index, &id_index};
+	bench.macro("macro/bitmap_and/" + engine, ops, [&](u_int64_t items, Stopwatch& clock) {
+		for (uint i = 0; i < ops; i++) {
+			int low = random() % 990;
+			Predicates where = {Predicate("score", Predicate::GE, Value(low)),
+								Predicate("score", Predicate::LT, Value(low + 10)),
+								Predicate("id", Predicate::LT, Value((int)(random() % rows)))};
+			Handles* handles = BitmapScan::select(table, indices, &where);
+			do_not_optimize(handles);
+			delete handles;
+		}
+	});
+	id_index.drop();
+	index.drop();
+
+	// half lookups, a third inserts, the rest deletes
+	bench.macro("macro/mixed/" + engine, ops, [&](u_int64_t items, Stopwatch& clock) {
+		int next_id = rows;
+		for (uint i = 0; i < ops; i++) {
+			uint dice = random() % 6;
+			ValueDict where;
+			where["id"] = Value((int)(random() % next_id));
+			if (dice < 3) {
+				Handles* handles = table.select(&where);
+				for (auto const& handle : *handles) {
+					ValueDict* row = table.project(handle);
+					do_not_optimize(row);
+					delete row;
+				}
+				delete handles;
+			} else if (dice < 5) {
+				ValueDict row = bench_row(next_id++);
+				table.insert(&row);
+			} else {
+				Handles* handles = table.select(&where);
+				for (auto const& handle : *handles)
+					table.del(handle);
+				delete handles;
+			}
+		}
+	});
+
+	// inserts from several threads at once, which HeapTable spreads over several tail blocks (only
+	// the engines that do their own file I/O: a HEAP table's Berkeley DB handle isn't free-threaded)
+	if (engine == "FLAT" || engine == "DIRECT" || engine == "MMAP") {
+		const uint threads = 4;
+		bench.macro("macro/parallel_insert/" + engine, rows, [&](u_int64_t items, Stopwatch& clock) {
+			vector<thread> inserters;
+			for (uint t = 0; t < threads; t++)
+				inserters.push_back(thread([&, t] {
+					for (uint id = t; id < rows; id += threads) {
+						ValueDict row = bench_row(2 * rows + id);
+						table.insert(&row);
+					}
+				}));
+			for (auto& inserter : inserters)
+				inserter.join();
+		});
+	}
+
+	drop_table(tables, table_name);
+}
+
+/**
+ * Main entry point of the bench program
+ * @args dbenvpath  the path to the BerkeleyDB database environment (created if need be)
+ */
+int main(int argc, char *argv[]) {
+	const string usage = "Usage: bench [--rows N] [--ops N] [--engine E] [--filter S] [--min-time SECONDS] [--json FILE] dbenvpath";
+	uint rows = 10000, ops = 1000;
+	string engine = "HEAP", filter, json;
+	double min_time = 0.5;
+	char *envHome = nullptr;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--rows" && has_value)
+			rows = (uint)stoul(argv[++i]);
+		else if (arg == "--ops" && has_value)
+			ops = (uint)stoul(argv[++i]);
+		else if (arg == "--engine" && has_value)
+			engine = argv[++i];
+		else if (arg == "--filter" && has_value)
+			filter = argv[++i];
+		else if (arg == "--min-time" && has_value)
+			min_time = stod(argv[++i]);
+		else if (arg == "--json" && has_value)
+			json = argv[++i];
+		else if (arg[0] != '-' && envHome == nullptr)
+			envHome = argv[i];
+		else {
+			cerr << usage << endl;
+			return 1;
+		}
+	}
+	const vector<string> engines = {"HEAP", "COLUMNAR", "FLAT", "DIRECT", "MMAP"};
+	if (envHome == nullptr || rows == 0 || find(engines.begin(), engines.end(), engine) == engines.end()) {
+		cerr << usage << endl;
+		return 1;
+	}
+
+	mkdir(envHome, 0755);
+	DbEnv env(0U);
+	env.set_message_stream(&cout);
+	env.set_error_stream(&cerr);
+	try {
+		env.open(envHome, DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
+	} catch (DbException& exc) {
+		cerr << "(bench: " << exc.what() << ")" << endl;
+		return 1;
+	}
+	_DB_ENV = &env;
+	initialize_schema_tables();
+
+	Bench bench(filter, min_time);
+	try {
+		Tables tables;
+		bench_page(bench);
+		bench_record(bench);
+		bench_file(bench);
+		bench_catalog(bench, tables);
+		bench_lock(bench);
+		bench_macro(bench, tables, engine, rows, ops);
+	} catch (exception& e) {
+		cerr << "(bench: " << e.what() << ")" << endl;
+		return 1;
+	}
+
+	if (!json.empty()) {
+		vector<pair<string, string>> context = {{"executable", argv[0]}, {"engine", engine},
+												{"rows", to_string(rows)}, {"ops", to_string(ops)}};
+		if (json == "-") {
+			bench.write_json(cout, context);
+		} else {
+			ofstream out(json);
+			bench.write_json(out, context);
+		}
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,407 @@
+/**
+ * @file bitmap_scan.cpp - implementation of HandleBitmap and BitmapScan
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include "bitmap_scan.h"
+#include "btree.h"
+#include "heap_storage.h"
+#include "stats.h"
+
+using namespace std;
+
+static const uint BITMAP_WORDS = 65536 / 64;  // a bit for every possible record id
+
+static uint popcount(const vector<u_int64_t>& bits) {
+	uint n = 0;
+	for (auto const& word : bits)
+		n += __builtin_popcountll(word);
+	return n;
+}
+
+
+/*
+	PUBLIC
+*/
+
+void HandleBitmap::add(Handle handle) {
+	if (this->containers[handle.first].add(handle.second))
+		this->count++;
+}
+
+void HandleBitmap::add(const Handles* handles) {
+	for (auto const& handle : *handles)
+		add(handle);
+}
+
+bool HandleBitmap::contains(Handle handle) const {
+	auto it = this->containers.find(handle.first);
+	return it != this->containers.end() && it->second.contains(handle.second);
+}
+
+// Blocks only this set has go; blocks both have are intersected and go if that empties them.
+void HandleBitmap::intersect(const HandleBitmap& other) {
+	this->count = 0;
+	auto it = this->containers.begin();
+	while (it != this->containers.end()) {
+		auto theirs = other.containers.find(it->first);
+		if (theirs != other.containers.end())
+			it->second.intersect(theirs->second);
+		if (theirs == other.containers.end() || it->second.cardinality == 0) {
+			it = this->containers.erase(it);
+		}
+		else {
+			this->count += it->second.cardinality;
+			it++;
+		}
+	}
+}
+
+void HandleBitmap::unite(const HandleBitmap& other) {
+	for (auto const& theirs : other.containers) {
+		Container& mine = this->containers[theirs.first];
+		this->count -= mine.cardinality;
+		mine.unite(theirs.second);
+		this->count += mine.cardinality;
+	}
+}
+
+Handles* HandleBitmap::handles() const {
+	Handles* handles = new Handles();
+	handles->reserve(this->count);
+	RecordIDs record_ids;
+	for (auto const& container : this->containers) {
+		record_ids.clear();
+		container.second.append_to(record_ids);
+		for (auto const& record_id : record_ids)
+			handles->push_back(Handle(container.first, record_id));
+	}
+	return handles;
+}
+
+BlockIDs* HandleBitmap::block_ids() const {
+	BlockIDs* block_ids = new BlockIDs();
+	for (auto const& container : this->containers)
+		block_ids->push_back(container.first);
+	return block_ids;
+}
+
+RecordIDs* HandleBitmap::record_ids(BlockID block_id) const {
+	RecordIDs* record_ids = new RecordIDs();
+	auto it = this->containers.find(block_id);
+	if (it != this->containers.end())
+		it->second.append_to(*record_ids);
+	return record_ids;
+}
+
+
+/*
+	PROTECTED
+*/
+
+bool HandleBitmap::Container::contains(RecordID record_id) const {
+	if (is_bitmap())
+		return (this->bits[record_id / 64] >> (record_id % 64)) & 1;
+	return binary_search(this->array.begin(), this->array.end(), record_id);
+}
+
+// false if it was already there
+bool HandleBitmap::Container::add(RecordID record_id) {
+	if (is_bitmap()) {
+		u_int64_t bit = (u_int64_t)1 << (record_id % 64);
+		if (this->bits[record_id / 64] & bit)
+			return false;
+		this->bits[record_id / 64] |= bit;
+		this->cardinality++;
+		return true;
+	}
+	auto it = lower_bound(this->array.begin(), this->array.end(), record_id);
+	if (it != this->array.end() && *it == record_id)
+		return false;
+	this->array.insert(it, record_id);
+	this->cardinality++;
+	if (this->cardinality > ARRAY_MAX)
+		to_bitmap();
+	return true;
+}
+
+void HandleBitmap::Container::to_bitmap() {
+	this->bits.assign(BITMAP_WORDS, 0);
+	for (auto const& record_id : this->array)
+		this->bits[record_id / 64] |= (u_int64_t)1 << (record_id % 64);
+	this->array.clear();
+	this->array.shrink_to_fit();
+}
+
+void HandleBitmap::Container::to_array() {
+	this->array.clear();
+	this->array.reserve(this->cardinality);
+	append_to(this->array);
+	this->bits.clear();
+	this->bits.shrink_to_fit();
+}
+
+// array & array: merge; array & bitmap: test each array entry; bitmap & bitmap: AND the words.
+// A result small enough to be an array becomes one.
+void HandleBitmap::Container::intersect(const Container& other) {
+	if (!is_bitmap() && !other.is_bitmap()) {
+		RecordIDs both;
+		set_intersection(this->array.begin(), this->array.end(), other.array.begin(), other.array.end(),
+						 back_inserter(both));
+		this->array.swap(both);
+	}
+	else if (!is_bitmap()) {
+		this->array.erase(remove_if(this->array.begin(), this->array.end(),
+									[&other](RecordID record_id) {return !other.contains(record_id);}),
+						  this->array.end());
+	}
+	else if (!other.is_bitmap()) {
+		RecordIDs both;
+		for (auto const& record_id : other.array)
+			if (contains(record_id))
+				both.push_back(record_id);
+		this->bits.clear();
+		this->bits.shrink_to_fit();
+		this->array.swap(both);
+	}
+	else {
+		for (uint i = 0; i < BITMAP_WORDS; i++)
+			this->bits[i] &= other.bits[i];
+		this->cardinality = popcount(this->bits);
+		if (this->cardinality <= ARRAY_MAX)
+			to_array();
+		return;
+	}
+	this->cardinality = this->array.size();
+}
+
+// array | array: merge (a result too big for an array becomes a bitmap); otherwise OR into a bitmap.
+void HandleBitmap::Container::unite(const Container& other) {
+	if (!is_bitmap() && !other.is_bitmap()) {
+		RecordIDs either;
+		set_union(this->array.begin(), this->array.end(), other.array.begin(), other.array.end(),
+				  back_inserter(either));
+		this->array.swap(either);
+		this->cardinality = this->array.size();
+		if (this->cardinality > ARRAY_MAX)
+			to_bitmap();
+		return;
+	}
+	if (!is_bitmap())
+		to_bitmap();
+	if (other.is_bitmap()) {
+		for (uint i = 0; i < BITMAP_WORDS; i++)
+			this->bits[i] |= other.bits[i];
+	}
+	else {
+		for (auto const& record_id : other.array)
+			this->bits[record_id / 64] |= (u_int64_t)1 << (record_id % 64);
+	}
+	this->cardinality = popcount(this->bits);
+}
+
+void HandleBitmap::Container::append_to(RecordIDs& record_ids) const {
+	if (!is_bitmap()) {
+		record_ids.insert(record_ids.end(), this->array.begin(), this->array.end());
+		return;
+	}
+	for (uint i = 0; i < BITMAP_WORDS; i++)
+		for (u_int64_t word = this->bits[i]; word != 0; word &= word - 1)
+			record_ids.push_back((RecordID)(i * 64 + __builtin_ctzll(word)));
+}
+
+
+/*
+	PUBLIC
+*/
+
+Handles* BitmapScan::select(DbRelation& relation, const vector<DbIndex*>& indices, const Predicates* where) {
+	HandleBitmap* rows = matching(relation, indices, where == nullptr ? Predicates() : *where);
+	Handles* handles = rows->handles();
+	delete rows;
+	return handles;
+}
+
+Handles* BitmapScan::select(DbRelation& relation, const vector<DbIndex*>& indices, const vector<Predicates>& any_of) {
+	if (Stats::tracing)
+		Stats::trace("bitmap or " + relation.get_table_name() + " (" + to_string(any_of.size()) + " branches)");
+	HandleBitmap rows;
+	for (auto const& where : any_of) {
+		HandleBitmap* branch = matching(relation, indices, where);
+		rows.unite(*branch);
+		delete branch;
+	}
+	return rows.handles();
+}
+
+
+/*
+	PROTECTED
+*/
+
+// Exactly the rows satisfying every predicate: the intersection of the bitmaps of the indices that
+// narrow things down, checked against the relation if any predicate is on a column none of them has.
+HandleBitmap* BitmapScan::matching(DbRelation& relation, const vector<DbIndex*>& indices, const Predicates& where) {
+	vector<DbIndex*> used;
+	for (auto const& index : indices)
+		if (index->narrows(&where))
+			used.push_back(index);
+
+	HandleBitmap* rows = new HandleBitmap();
+	if (used.empty()) {
+		Handles* handles = relation.select(&where);
+		rows->add(handles);
+		delete handles;
+		return rows;
+	}
+
+	try {
+		string names;
+		for (uint i = 0; i < used.size(); i++) {
+			HandleBitmap* bitmap = used[i]->bitmap(&where);
+			if (i == 0)
+				swap(*rows, *bitmap);
+			else
+				rows->intersect(*bitmap);
+			delete bitmap;
+			names += (i == 0 ? "" : ", ") + used[i]->get_name();
+			if (rows->size() == 0)
+				break;  // the other indices can't bring any back
+		}
+		if (Stats::tracing)
+			Stats::trace("bitmap and " + relation.get_table_name() + " using " + names
+						 + " (" + to_string(rows->size()) + " rows)");
+
+		bool exact = true;
+		for (auto const& predicate : where) {
+			ColumnNames column_names = {predicate.column_name};
+			exact = exact && any_of(used.begin(), used.end(),
+									[&column_names](DbIndex* index) {return index->covers(&column_names, nullptr);});
+		}
+		if (!exact && rows->size() > 0) {
+			Handles* handles = relation.select(rows, &where);
+			HandleBitmap* checked = new HandleBitmap();
+			checked->add(handles);
+			delete handles;
+			delete rows;
+			rows = checked;
+		}
+	}
+	catch (exception& e) {
+		delete rows;
+		throw;
+	}
+	return rows;
+}
+
+
+/*
+	TESTS
+*/
+
+// handles spread over a few blocks, some crowded enough to need a bitmap container
+static set<Handle> some_handles(u_int32_t seed, uint n) {
+	set<Handle> handles;
+	for (uint i = 0; i < n; i++) {
+		seed = seed * 1103515245 + 12345;
+		BlockID block_id = 1 + (seed >> 8) % 4;
+		RecordID record_id = 1 + (seed >> 12) % (block_id == 1 ? 60000 : 9000);
+		handles.insert(Handle(block_id, record_id));
+	}
+	return handles;
+}
+
+static bool same_handles(const HandleBitmap& bitmap, const set<Handle>& expected) {
+	Handles* handles = bitmap.handles();
+	bool same = bitmap.size() == expected.size() && Handles(expected.begin(), expected.end()) == *handles;
+	delete handles;
+	return same;
+}
+
+static bool same_rows(Handles* found, Handles* scanned) {
+	bool same = *found == *scanned;  // both in block order
+	delete found;
+	delete scanned;
+	return same;
+}
+
+bool test_bitmap_scan() {
+	// AND and OR of every mix of array and bitmap containers, against std::set
+	for (auto const& sizes : vector<pair<uint, uint>>({{50, 60}, {50, 30000}, {30000, 40000}, {0, 500}})) {
+		set<Handle> a = some_handles(1, sizes.first), b = some_handles(2, sizes.second);
+		HandleBitmap and_bitmap, or_bitmap, other;
+		for (auto const& handle : a) {
+			and_bitmap.add(handle);
+			or_bitmap.add(handle);
+		}
+		Handles b_handles(b.begin(), b.end());
+		other.add(&b_handles);
+		and_bitmap.intersect(other);
+		or_bitmap.unite(other);
+		set<Handle> both, either(a);
+		set_intersection(a.begin(), a.end(), b.begin(), b.end(), inserter(both, both.end()));
+		either.insert(b.begin(), b.end());
+		if (!same_handles(and_bitmap, both) || !same_handles(or_bitmap, either))
+			return false;
+		for (auto const& handle : b)
+			if (!other.contains(handle))
+				return false;
+	}
+
+	// bitmap scans against full scans
+	ColumnNames column_names = {"a", "b", "c"};
+	ColumnAttributes column_attributes(3, ColumnAttribute(ColumnAttribute::INT));
+	HeapTable table("_test_bitmap_cpp", column_names, column_attributes);
+	table.create();
+	for (int i = 0; i < 3000; i++) {
+		ValueDict row;
+		row["a"] = Value(i % 100);
+		row["b"] = Value(i % 7);
+		row["c"] = Value(i);
+		table.insert(&row);
+	}
+	BTreeIndex on_a(table, "_test_bitmap_a", ColumnNames({"a"}), ColumnNames());
+	BTreeIndex on_b(table, "_test_bitmap_b", ColumnNames({"b"}), ColumnNames());
+	on_a.create();
+	on_b.create();
+	vector<DbIndex*> indices = {&on_a, &on_b};
+
+	Predicates a_and_b = {Predicate("a", Predicate::LT, Value(20)), Predicate("b", Predicate::EQ, Value(3))};
+	Predicates a_and_c = {Predicate("a", Predicate::GE, Value(90)), Predicate("c", Predicate::GT, Value(1500))};
+	Predicates only_c = {Predicate("c", Predicate::LT, Value(40))};
+	bool ok = same_rows(BitmapScan::select(table, indices, &a_and_b), table.select(&a_and_b))
+			  && same_rows(BitmapScan::select(table, indices, &a_and_c), table.select(&a_and_c))
+			  && same_rows(BitmapScan::select(table, indices, &only_c), table.select(&only_c));
+	if (ok) {
+		Handles* either = BitmapScan::select(table, indices, vector<Predicates>({a_and_b, a_and_c}));
+		set<Handle> expected;
+		for (auto const& where : {a_and_b, a_and_c}) {
+			Handles* handles = table.select(&where);
+			expected.insert(handles->begin(), handles->end());
+			delete handles;
+		}
+		ok = same_rows(either, new Handles(expected.begin(), expected.end()));
+	}
+
+	// candidates deleted after the index lookup are skipped
+	if (ok) {
+		HandleBitmap* candidates = on_a.bitmap(&a_and_c);
+		Handles* handles = candidates->handles();
+		for (uint i = 0; i < handles->size(); i += 2) {
+			on_a.del(handles->at(i));
+			on_b.del(handles->at(i));
+			table.del(handles->at(i));
+		}
+		Predicates on_a_only = {a_and_c[0]};  // what the index itself checked
+		ok = same_rows(table.select(candidates, &a_and_c), table.select(&a_and_c))
+			 && same_rows(table.select(candidates, nullptr), table.select(&on_a_only));
+		delete handles;
+		delete candidates;
+	}
+	on_a.drop();
+	on_b.drop();
+	table.drop();
+	return ok;
+}
@@ -0,0 +1,138 @@
+/**
+ * @file bitmap_scan.h - combining several indices' answers before going to the relation
+ * HandleBitmap
+ * BitmapScan
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <map>
+#include <vector>
+#include "storage_engine.h"
+
+/**
+ * @class HandleBitmap - a compressed set of handles, kept the way a roaring bitmap keeps 48-bit integers
+ *
+ *      The handles are grouped by block id. Each block's record ids are in a container of their
+        own: a sorted array while there are at most ARRAY_MAX of them, and a bitmap of all 65536
+        possible record ids (8 kB) once there are more. A block with a handful of rows costs a few
+        bytes, a crowded one costs no more than the bitmap, and intersecting or uniting two sets
+        only ever merges the containers of the blocks both (or either) of them have, each with the
+        cheapest loop for the kinds of container involved.
+
+        Handles come back out in block order, then record order, which is the order a scan would
+        read them from the relation.
+ */
+class HandleBitmap {
+public:
+	HandleBitmap() : count(0) {}
+	virtual ~HandleBitmap() {}
+
+	/**
+	 * Put a handle in the set (if it isn't already).
+	 */
+	virtual void add(Handle handle);
+
+	/**
+	 * Put each of these handles in the set.
+	 */
+	virtual void add(const Handles* handles);
+
+	/**
+	 * Is this handle in the set?
+	 */
+	virtual bool contains(Handle handle) const;
+
+	/**
+	 * Keep only the handles that are in other, too (AND).
+	 */
+	virtual void intersect(const HandleBitmap& other);
+
+	/**
+	 * Add all the handles in other (OR).
+	 */
+	virtual void unite(const HandleBitmap& other);
+
+	/**
+	 * @returns  how many handles are in the set
+	 */
+	virtual u_int64_t size() const {return count;}
+
+	/**
+	 * @returns  the handles, in block order (freed by caller)
+	 */
+	virtual Handles* handles() const;
+
+	/**
+	 * @returns  the blocks with at least one handle, in order (freed by caller)
+	 */
+	virtual BlockIDs* block_ids() const;
+
+	/**
+	 * @returns  the record ids of the handles in block block_id, in order (freed by caller)
+	 */
+	virtual RecordIDs* record_ids(BlockID block_id) const;
+
+	/**
+	 * most record ids a block's container keeps as a sorted array before switching to a bitmap
+	 */
+	static const uint ARRAY_MAX = 4096;
+
+protected:
+	struct Container {
+		std::vector<RecordID> array;  // sorted, while it's an array
+		std::vector<u_int64_t> bits;  // 1024 words, once it's a bitmap
+		uint cardinality;
+
+		Container() : cardinality(0) {}
+		bool is_bitmap() const {return !bits.empty();}
+		bool contains(RecordID record_id) const;
+		bool add(RecordID record_id);
+		void to_bitmap();
+		void to_array();
+		void intersect(const Container& other);
+		void unite(const Container& other);
+		void append_to(std::vector<RecordID>& record_ids) const;
+	};
+
+	std::map<BlockID, Container> containers;  // just the blocks with handles
+	u_int64_t count;
+};
+
+
+/**
+ * @class BitmapScan - answer a where-clause by combining what several of a relation's indices say
+ *
+ *      Every index that can narrow down the rows for a conjunction of predicates (see
+        DbIndex::narrows) hands back a HandleBitmap of the rows that satisfy the predicates on its
+        columns, and the bitmaps are intersected. If some predicate is on a column none of those
+        indices has, the relation is then visited for just the remaining rows, block by block in
+        order, to check them (DbRelation::select(candidates, where)). A disjunction of such
+        conjunctions unites their results. A conjunction no index can help with falls back to an
+        ordinary scan.
+ */
+class BitmapScan {
+public:
+	/**
+	 * Conceptually, execute: SELECT <handle> FROM <relation> WHERE <where>
+	 * @param indices  the relation's indices that may be used
+	 * @param where    predicates, all of which must be true (every row qualifies if null)
+	 * @returns        a pointer to a list of handles for qualifying rows, in block order (freed by caller)
+	 */
+	static Handles* select(DbRelation& relation, const std::vector<DbIndex*>& indices, const Predicates* where);
+
+	/**
+	 * Conceptually, execute: SELECT <handle> FROM <relation> WHERE <any_of[0]> OR <any_of[1]> OR ...
+	 * @param indices  the relation's indices that may be used
+	 * @param any_of   sets of predicates, at least one of which must hold completely
+	 * @returns        a pointer to a list of handles for qualifying rows, in block order (freed by caller)
+	 */
+	static Handles* select(DbRelation& relation, const std::vector<DbIndex*>& indices,
+						   const std::vector<Predicates>& any_of);
+
+protected:
+	static HandleBitmap* matching(DbRelation& relation, const std::vector<DbIndex*>& indices, const Predicates& where);
+};
+
+bool test_bitmap_scan();
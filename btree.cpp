@@ -0,0 +1,477 @@
+/**
+ * @file btree.cpp - implementation of BTreeIndex
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cstring>
+#include "btree.h"
+#include "bitmap_scan.h"
+#include "heap_storage.h"
+#include "stats.h"
+#include "trash.h"
+
+using namespace std;
+
+static const uint HANDLE_SIZE = sizeof(BlockID) + sizeof(RecordID);
+
+// big-endian, so that the bytes sort the way the number does
+static void append_big_endian(string& key, u_int64_t n, uint size) {
+	for (int shift = 8 * (size - 1); shift >= 0; shift -= 8)
+		key += (char)((n >> shift) & 0xff);
+}
+
+static u_int64_t get_big_endian(const char* bytes, uint size) {
+	u_int64_t n = 0;
+	for (uint i = 0; i < size; i++)
+		n = (n << 8) | (u_int8_t)bytes[i];
+	return n;
+}
+
+// entry data never goes out of line (its values are limited to MAX_ENTRY bytes)
+static string no_overflow(BlockID block_id, uint length) {
+	throw DbRelationError("index entry refers to an overflow block");
+}
+
+static BlockID refuse_overflow(const string& s) {
+	throw DbRelationError("value is too big to index");
+}
+
+
+/*
+	PUBLIC
+*/
+
+BTreeIndex::BTreeIndex(DbRelation& relation, Identifier name, ColumnNames key_columns, ColumnNames include_columns) :
+		DbIndex(relation, name, key_columns, include_columns), codec(nullptr),
+		dbfilename(relation.get_table_name() + "." + name + ".index.db"), closed(true), db(_DB_ENV, 0) {
+	this->covered = key_columns;
+	this->covered.insert(this->covered.end(), include_columns.begin(), include_columns.end());
+	const ColumnNames& column_names = relation.get_column_names();
+	for (auto const& column_name : this->covered) {
+		uint i = 0;
+		while (i < column_names.size() && column_names[i] != column_name)
+			i++;
+		if (i == column_names.size())
+			throw DbRelationError("table " + relation.get_table_name() + " does not have column named '"
+								  + column_name + "'");
+		this->covered_attributes.push_back(relation.get_column_attributes()[i]);
+	}
+	this->codec = RecordCodec::create(this->covered, this->covered_attributes);
+}
+
+BTreeIndex::~BTreeIndex() {
+	close();
+	delete this->codec;
+}
+
+// Make the file and add an entry for every row already in the relation.
+void BTreeIndex::create() {
+	db_open(DB_CREATE | DB_EXCL);
+	Handles* handles = this->relation.select();
+	try {
+		for (auto const& handle : *handles)
+			insert(handle);
+	}
+	catch (exception& e) {
+		delete handles;
+		drop();
+		throw;
+	}
+	delete handles;
+}
+
+void BTreeIndex::drop() {
+	close();
+	Db db(_DB_ENV, 0);
+	db.remove(this->dbfilename.c_str(), nullptr, 0);
+}
+
+void BTreeIndex::discard() {
+	close();
+	Trash::discard(this->dbfilename, Trash::BERKELEY_DB);
+}
+
+void BTreeIndex::open() {
+	db_open();
+}
+
+void BTreeIndex::close() {
+	if (this->closed)
+		return;
+	this->db.close(0);
+	this->closed = true;
+}
+
+void BTreeIndex::insert(Handle handle) {
+	open();
+	ValueDict* row = this->relation.project(handle, &this->covered);
+	static thread_local vector<char> data_bytes(MAX_ENTRY);
+	string key;
+	uint size;
+	try {
+		key = entry_key(row, handle);
+		size = this->codec->encode(row, data_bytes.data(), MAX_ENTRY, MAX_ENTRY, refuse_overflow);
+	}
+	catch (DbRelationError& e) {
+		delete row;
+		throw;
+	}
+	delete row;
+	Dbt key_dbt((void*)key.data(), key.size());
+	Dbt data(data_bytes.data(), size);
+	this->db.put(nullptr, &key_dbt, &data, 0);
+	Stats::count(Stats::BDB_PUTS);
+}
+
+void BTreeIndex::del(Handle handle) {
+	open();
+	ValueDict* row = this->relation.project(handle, &this->key_columns);
+	string key = entry_key(row, handle);
+	delete row;
+	Dbt key_dbt((void*)key.data(), key.size());
+	this->db.del(nullptr, &key_dbt, 0);
+}
+
+// Predicates on columns the index doesn't have are checked against the relation, one row at a time.
+Handles* BTreeIndex::select(const Predicates* where) {
+	OperatorTimer timer(Stats::SELECT);
+	if (Stats::tracing)
+		Stats::trace("index scan " + this->relation.get_table_name() + "." + this->name
+					 + (where == nullptr || where->empty() ? "" : " where " + Predicate::to_string(*where)));
+	Predicates covered_where, other_where;
+	ColumnNames other_columns;
+	if (where != nullptr) {
+		for (auto const& predicate : *where) {
+			if (this->codec->column_number(predicate.column_name) >= 0) {
+				covered_where.push_back(predicate);
+			}
+			else {
+				other_where.push_back(predicate);
+				other_columns.push_back(predicate.column_name);
+			}
+		}
+	}
+
+	Handles* handles = new Handles();
+	try {
+		scan(covered_where, [&](Handle handle, const char* data) {
+			if (!other_where.empty()) {
+				ValueDict* row = this->relation.project(handle, &other_columns);
+				bool match = true;
+				for (auto const& predicate : other_where) {
+					ValueDict::const_iterator column = row->find(predicate.column_name);
+					if (column == row->end() || !predicate.test(column->second)) {
+						match = false;
+						break;
+					}
+				}
+				delete row;
+				if (!match)
+					return;
+			}
+			handles->push_back(handle);
+		});
+	}
+	catch (exception& e) {
+		delete handles;
+		throw;
+	}
+	return handles;
+}
+
+// Only a scan that starts past the first entry does better than reading them all.
+bool BTreeIndex::narrows(const Predicates* where) const {
+	if (where == nullptr)
+		return false;
+	string low, high;
+	bounds(*where, low, high);
+	return !low.empty();
+}
+
+// Like select() without the predicates on other columns, so the relation isn't touched.
+HandleBitmap* BTreeIndex::bitmap(const Predicates* where) {
+	OperatorTimer timer(Stats::SELECT);
+	Predicates covered_where;
+	if (where != nullptr)
+		for (auto const& predicate : *where)
+			if (this->codec->column_number(predicate.column_name) >= 0)
+				covered_where.push_back(predicate);
+	if (Stats::tracing)
+		Stats::trace("bitmap index scan " + this->relation.get_table_name() + "." + this->name
+					 + (covered_where.empty() ? "" : " where " + Predicate::to_string(covered_where)));
+	HandleBitmap* rows = new HandleBitmap();
+	try {
+		scan(covered_where, [rows](Handle handle, const char* data) {rows->add(handle);});
+	}
+	catch (exception& e) {
+		delete rows;
+		throw;
+	}
+	return rows;
+}
+
+// The rows come straight out of the entries' data; the relation isn't touched.
+ValueDicts* BTreeIndex::project(const Predicates* where, const ColumnNames* column_names) {
+	OperatorTimer timer(Stats::PROJECT);
+	if (!covers(column_names, where))
+		throw DbRelationError("index " + this->name + " does not have all the columns the query needs");
+	if (Stats::tracing)
+		Stats::trace("index only scan " + this->relation.get_table_name() + "." + this->name
+					 + (where == nullptr || where->empty() ? "" : " where " + Predicate::to_string(*where)));
+	ValueDicts* rows = new ValueDicts();
+	try {
+		scan(where == nullptr ? Predicates() : *where, [&](Handle handle, const char* data) {
+			rows->push_back(this->codec->decode(data, column_names, no_overflow));
+		});
+	}
+	catch (exception& e) {
+		for (auto const& row : *rows)
+			delete row;
+		delete rows;
+		throw;
+	}
+	return rows;
+}
+
+
+/*
+	PROTECTED
+*/
+
+void BTreeIndex::db_open(uint flags) {
+	if (!this->closed)
+		return;
+	this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_BTREE, flags, 0644);
+	this->closed = false;
+}
+
+std::string BTreeIndex::entry_key(const ValueDict* row, Handle handle) {
+	string key;
+	for (uint i = 0; i < this->key_columns.size(); i++) {
+		ValueDict::const_iterator column = row->find(this->key_columns[i]);
+		append_value(key, column == row->end() ? nullptr : &column->second,
+					 this->covered_attributes[i].get_data_type());
+	}
+	append_big_endian(key, handle.first, sizeof(BlockID));
+	append_big_endian(key, handle.second, sizeof(RecordID));
+	return key;
+}
+
+// Visit each entry from the first that could satisfy the predicates (all on key and include
+// columns) to the last, skipping the ones that don't.
+void BTreeIndex::scan(const Predicates& where, const Visitor& visit) {
+	open();
+	string low, high;
+	bounds(where, low, high);
+
+	Dbc* cursor;
+	this->db.cursor(nullptr, &cursor, 0);
+	try {
+		Dbt key((void*)low.data(), low.size());
+		Dbt data;
+		int status = cursor->get(&key, &data, low.empty() ? DB_FIRST : DB_SET_RANGE);
+		while (status == 0) {
+			Stats::count(Stats::BDB_GETS);
+			Stats::count(Stats::INDEX_ENTRIES_READ);
+			const char* bytes = (const char*)key.get_data();
+			uint size = key.get_size();
+			if (!high.empty() && string(bytes, min(size, (uint)high.size())).compare(high) > 0)
+				break;  // past the last entry that could match
+			if (matches((const char*)data.get_data(), where)) {
+				const char* handle = bytes + size - HANDLE_SIZE;
+				visit(Handle((BlockID)get_big_endian(handle, sizeof(BlockID)),
+							 (RecordID)get_big_endian(handle + sizeof(BlockID), sizeof(RecordID))), (const char*)data.get_data());
+			}
+			status = cursor->get(&key, &data, DB_NEXT);
+		}
+	}
+	catch (exception& e) {
+		cursor->close();
+		throw;
+	}
+	cursor->close();
+}
+
+// The keys to start and stop at: equality predicates on leading key columns fix those columns'
+// values and a range on the next key column narrows things further. Only predicates whose
+// constant has the column's type can help (one of any other type matches nothing but NE anyway).
+// high is empty if there's nowhere to stop early; otherwise a key past every match is one whose
+// first high.size() bytes are greater than high.
+void BTreeIndex::bounds(const Predicates& where, std::string& low, std::string& high) const {
+	for (uint i = 0; i < this->key_columns.size(); i++) {
+		ColumnAttribute::DataType data_type = this->covered_attributes[i].get_data_type();
+		const Value* equal = nullptr;
+		const Value* lower = nullptr;
+		const Value* upper = nullptr;
+		for (auto const& predicate : where) {
+			if (predicate.column_name != this->key_columns[i] || predicate.value.data_type != data_type)
+				continue;
+			const Value* value = &predicate.value;
+			if (predicate.op == Predicate::EQ)
+				equal = value;
+			else if ((predicate.op == Predicate::GT || predicate.op == Predicate::GE) && (lower == nullptr || *lower < *value))
+				lower = value;
+			else if ((predicate.op == Predicate::LT || predicate.op == Predicate::LE) && (upper == nullptr || *value < *upper))
+				upper = value;
+		}
+		if (equal != nullptr) {
+			append_value(low, equal, data_type);
+			high = low;
+			continue;
+		}
+		if (lower == nullptr && upper == nullptr)
+			break;
+		uint prefix = low.size();
+		if (lower != nullptr)
+			append_value(low, lower, data_type);
+		else
+			low += '\x01';  // skip the NULLs, which no comparison matches
+		if (upper != nullptr)
+			append_value(high = low.substr(0, prefix), upper, data_type);
+		break;
+	}
+}
+
+bool BTreeIndex::matches(const char* data, const Predicates& where) {
+	for (auto const& predicate : where) {
+		Value value;
+		if (!this->codec->decode_column(data, this->codec->column_number(predicate.column_name), value, no_overflow)
+			|| !predicate.test(value))
+			return false;
+	}
+	return true;
+}
+
+// Append a value's key encoding (see the class comment); value is nullptr for NULL.
+void BTreeIndex::append_value(std::string& key, const Value* value, ColumnAttribute::DataType data_type) {
+	if (value == nullptr) {
+		key += '\x00';
+		return;
+	}
+	key += '\x01';
+	switch (data_type) {
+		case ColumnAttribute::INT:
+		case ColumnAttribute::DATE:
+			append_big_endian(key, (u_int32_t)value->n ^ 0x80000000U, sizeof(int32_t));
+			break;
+		case ColumnAttribute::BIGINT:
+		case ColumnAttribute::TIMESTAMP:
+			append_big_endian(key, (u_int64_t)value->l ^ 0x8000000000000000ULL, sizeof(int64_t));
+			break;
+		case ColumnAttribute::DOUBLE: {
+			double d = value->d == 0 ? 0.0 : value->d;  // -0.0 is the same value as 0.0
+			u_int64_t bits;
+			memcpy(&bits, &d, sizeof(bits));
+			append_big_endian(key, (bits & 0x8000000000000000ULL) ? ~bits : bits ^ 0x8000000000000000ULL, sizeof(bits));
+			break;
+		}
+		case ColumnAttribute::BOOLEAN:
+			key += (char)(value->n != 0);
+			break;
+		case ColumnAttribute::TEXT:
+			for (auto const& c : value->s) {
+				key += c;
+				if (c == '\0')
+					key += '\xff';
+			}
+			key += '\x00';
+			key += '\x00';
+			break;
+		default:
+			throw DbRelationError("Don't know how to index a column of this data type");
+	}
+}
+
+
+/*
+	TESTS
+*/
+
+// the rows' values, one string per row, sorted (so lists of rows can be compared whatever their order)
+static vector<string> row_strings(const ValueDicts& rows) {
+	vector<string> strings;
+	for (auto const& row : rows) {
+		string s;
+		for (auto const& column : *row)
+			s += column.first + "=" + column.second.to_string() + ";";
+		strings.push_back(s);
+	}
+	sort(strings.begin(), strings.end());
+	return strings;
+}
+
+// Does the index find the same rows as a scan of the table (and, if it covers the query, the same values)?
+static bool same_as_heap_scan(HeapTable& table, BTreeIndex& index, const Predicates& where, const ColumnNames& column_names) {
+	Handles* scanned = table.select(&where);
+	Handles* found = index.select(&where);
+	sort(scanned->begin(), scanned->end());
+	sort(found->begin(), found->end());
+	bool same = *scanned == *found;
+	if (same && index.covers(&column_names, &where)) {
+		ValueDicts expected;
+		for (auto const& handle : *scanned)
+			expected.push_back(table.project(handle, &column_names));
+		ValueDicts* rows = index.project(&where, &column_names);
+		same = row_strings(expected) == row_strings(*rows);
+		for (auto const& row : expected)
+			delete row;
+		for (auto const& row : *rows)
+			delete row;
+		delete rows;
+	}
+	delete scanned;
+	delete found;
+	return same;
+}
+
+bool test_btree() {
+	ColumnNames column_names = {"k", "s", "other"};
+	ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT),
+										  ColumnAttribute(ColumnAttribute::INT)};
+	HeapTable table("_test_btree_cpp", column_names, column_attributes);
+	table.create();
+	for (int i = 0; i < 2000; i++) {
+		ValueDict row;
+		if (i % 50 != 0)
+			row["k"] = Value((i * 37) % 500 - 250);
+		if (i % 9 != 0)
+			row["s"] = Value("s" + to_string(i % 13));
+		row["other"] = Value(i);
+		table.insert(&row);
+	}
+	BTreeIndex index(table, "_test_btree_ix", ColumnNames({"k"}), ColumnNames({"s"}));
+	index.create();
+
+	vector<Predicates> wheres = {
+		{},
+		{Predicate("k", Predicate::EQ, Value(17))},
+		{Predicate("k", Predicate::LT, Value(-200))},
+		{Predicate("k", Predicate::GE, Value(100)), Predicate("k", Predicate::LE, Value(120))},
+		{Predicate("k", Predicate::GT, Value(240))},
+		{Predicate("k", Predicate::LT, Value(-250))},
+		{Predicate("k", Predicate::GE, Value(INT32_MIN))},
+		{Predicate("k", Predicate::NE, Value(0))},
+		{Predicate("s", Predicate::EQ, Value("s3"))},
+		{Predicate("k", Predicate::GT, Value(-10)), Predicate("s", Predicate::EQ, Value("s5"))},
+		{Predicate("k", Predicate::LE, Value(0)), Predicate("other", Predicate::LT, Value(700))},  // not covered
+	};
+	ColumnNames covered = {"k", "s"};
+	bool ok = !index.covers(&column_names, nullptr) && index.covers(&covered, &wheres[9])
+			  && !index.covers(&covered, &wheres[10]);
+	for (uint pass = 0; ok && pass < 2; pass++) {
+		for (auto const& where : wheres)
+			if (!(ok = same_as_heap_scan(table, index, where, covered)))
+				break;
+		// then again after deleting a third of the rows
+		Predicates every_third = {Predicate("other", Predicate::LT, Value(2000))};
+		Handles* handles = table.select(&every_third);
+		for (uint i = 0; i < handles->size(); i += 3) {
+			index.del(handles->at(i));
+			table.del(handles->at(i));
+		}
+		delete handles;
+	}
+	index.drop();
+	table.drop();
+	return ok;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file btree.h - B+tree indexes, kept in Berkeley DB BTree files
+ * BTreeIndex
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <functional>
+#include "record_codec.h"
+#include "storage_engine.h"
+
+/**
+ * @class BTreeIndex - index whose entries are kept in key order in a Berkeley DB BTree, <table>.<index>.index.db
+ *
+ *      Each row of the relation has one entry. Its key is the row's key column values, each
+        encoded so that comparing the bytes compares the values, followed by the row's handle
+        (so entries are unique even when key values aren't, and rows with equal keys come out in
+        handle order):
+            per key column:  0x00 if NULL, else 0x01 and then the value:
+                               INT, DATE, BIGINT, TIMESTAMP: big-endian with the sign bit flipped
+                               DOUBLE: big-endian IEEE 754, sign bit flipped if positive, all bits if negative
+                               BOOLEAN: one byte, 0 or 1
+                               TEXT: the bytes, with 0x00 written as 0x00 0xFF, then 0x00 0x00
+            handle:          4-byte block id and 2-byte record id, big-endian
+        Its data is the row's key and include columns, in the record format RecordCodec makes for
+        them, so that they can be read without going back to the relation.
+
+        A scan starts at the first entry that could match the predicates, as far as equality
+        predicates on the leading key columns and a range on the one after them can tell, and stops
+        at the first one past them. Every entry in between is still checked against all the
+        predicates on key and include columns (a NULL never matches); only predicates on other
+        columns make select() visit the relation. bitmap() just leaves those out, for BitmapScan
+        to deal with.
+ */
+class BTreeIndex : public DbIndex {
+public:
+	BTreeIndex(DbRelation& relation, Identifier name, ColumnNames key_columns, ColumnNames include_columns);
+	virtual ~BTreeIndex();
+	BTreeIndex(const BTreeIndex& other) = delete;
+	BTreeIndex(BTreeIndex&& temp) = delete;
+	BTreeIndex& operator=(const BTreeIndex& other) = delete;
+	BTreeIndex& operator=(BTreeIndex&& temp) = delete;
+
+	virtual void create();
+	virtual void drop();
+	virtual void discard();
+	virtual void open();
+	virtual void close();
+
+	virtual void insert(Handle handle);
+	virtual void del(Handle handle);
+
+	virtual Handles* select(const Predicates* where);
+	virtual bool narrows(const Predicates* where) const;
+	virtual HandleBitmap* bitmap(const Predicates* where);
+	virtual ValueDicts* project(const Predicates* where, const ColumnNames* column_names);
+
+	/**
+	 * biggest entry data (key and include column values) allowed
+	 */
+	static const uint MAX_ENTRY = 65535;
+
+protected:
+	typedef std::function<void(Handle handle, const char* data)> Visitor;
+
+	ColumnNames covered;                 // key columns then include columns, as kept in entry data
+	ColumnAttributes covered_attributes;
+	RecordCodec* codec;                  // for the entry data
+	std::string dbfilename;
+	bool closed;
+	Db db;
+
+	virtual void db_open(uint flags=0);
+	virtual std::string entry_key(const ValueDict* row, Handle handle);
+	virtual void scan(const Predicates& where, const Visitor& visit);
+	virtual void bounds(const Predicates& where, std::string& low, std::string& high) const;
+	virtual bool matches(const char* data, const Predicates& where);
+
+	static void append_value(std::string& key, const Value* value, ColumnAttribute::DataType data_type);
+};
+
+bool test_btree();
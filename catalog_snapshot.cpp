@@ -0,0 +1,436 @@
+/**
+ * @file catalog_snapshot.cpp - implementation of CatalogSnapshot
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "catalog_snapshot.h"
+
+using namespace std;
+
+const char* const CatalogSnapshot::FILE_NAME = "_catalog.snapshot";
+
+static const size_t HEADER_SIZE = 4 * sizeof(u_int32_t);
+
+CatalogSnapshot::CatalogSnapshot(const string& path) : path(path), data(nullptr), size(0), n_tables(0), loaded(false),
+													  on_disk(false), changed(), unknown() {
+}
+
+CatalogSnapshot::~CatalogSnapshot() {
+	unmap();
+}
+
+bool CatalogSnapshot::load() {
+	unmap();
+	this->changed.clear();
+	this->unknown.clear();
+	this->loaded = this->on_disk = false;
+
+	int fd = ::open(this->path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void* map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= HEADER_SIZE)
+		map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+		return false;
+	this->data = (const char*)map;
+	this->size = st.st_size;
+
+	u_int32_t header[4];
+	memcpy(header, this->data, HEADER_SIZE);
+	if (header[0] != MAGIC || header[1] != FORMAT_VERSION || header[3] != this->size
+		|| header[2] > (this->size - HEADER_SIZE) / sizeof(u_int32_t)) {
+		unmap();
+		return false;
+	}
+	this->n_tables = header[2];
+	this->loaded = this->on_disk = true;
+	return true;
+}
+
+// Binary search of the directory, reading only the names it passes on the way.
+bool CatalogSnapshot::get(const Identifier& table_name, CatalogEntry& entry) const {
+	if (this->unknown.find(table_name) != this->unknown.end())
+		return false;
+	auto change = this->changed.find(table_name);
+	if (change != this->changed.end()) {
+		if (change->second.storage_engine.empty())
+			return false;
+		entry = change->second;
+		return true;
+	}
+
+	u_int32_t lo = 0, hi = this->n_tables;
+	while (lo < hi) {
+		u_int32_t mid = lo + (hi - lo) / 2;
+		Identifier name;
+		if (!name_at(mid, name))
+			return false;
+		if (name == table_name)
+			return entry_at(mid, name, entry);
+		if (name < table_name)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+void CatalogSnapshot::put(const Identifier& table_name, const CatalogEntry& entry) {
+	this->unknown.erase(table_name);
+	this->changed[table_name] = entry;
+}
+
+void CatalogSnapshot::remove(const Identifier& table_name) {
+	this->unknown.erase(table_name);
+	this->changed[table_name] = CatalogEntry();
+}
+
+// The mapping stays (a removed file's pages are still there), so the other tables are still answered for.
+void CatalogSnapshot::forget(const Identifier& table_name) {
+	this->changed.erase(table_name);
+	this->unknown.insert(table_name);
+	if (this->on_disk) {
+		if (unlink(this->path.c_str()) != 0 && errno != ENOENT)
+			throw DbException(("can't remove " + this->path).c_str(), errno);
+		this->on_disk = false;
+	}
+}
+
+// Merge the old file's entries (in name order) with the changes (also in name order).
+void CatalogSnapshot::save() {
+	if (!this->unknown.empty())
+		throw DbRelationError("catalog snapshot doesn't know about " + *this->unknown.begin());
+
+	vector<u_int32_t> offsets;
+	string entries;
+	auto change = this->changed.begin();
+	for (u_int32_t i = 0; i <= this->n_tables; i++) {
+		Identifier name;
+		CatalogEntry entry;
+		bool old = i < this->n_tables && entry_at(i, name, entry);
+		if (i < this->n_tables && !old)
+			continue;  // can't be read, so the table is looked up in the schema tables again
+		bool superseded = false;
+		for (; change != this->changed.end() && (!old || change->first <= name); change++) {
+			superseded = superseded || (old && change->first == name);
+			if (!change->second.storage_engine.empty()) {
+				offsets.push_back(entries.size());
+				write_entry(entries, change->first, change->second);
+			}
+		}
+		if (old && !superseded) {
+			offsets.push_back(entries.size());
+			write_entry(entries, name, entry);
+		}
+	}
+
+	size_t directory_size = offsets.size() * sizeof(u_int32_t);
+	string out;
+	write_u32(out, MAGIC);
+	write_u32(out, FORMAT_VERSION);
+	write_u32(out, offsets.size());
+	write_u32(out, HEADER_SIZE + directory_size + entries.size());
+	for (auto const& offset : offsets)
+		write_u32(out, HEADER_SIZE + directory_size + offset);
+	out += entries;
+
+	string temp = this->path + ".tmp";
+	int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		throw DbException(("can't write " + temp).c_str(), errno);
+	bool ok = ::write(fd, out.data(), out.size()) == (ssize_t)out.size() && fsync(fd) == 0;
+	int error = errno;
+	::close(fd);
+	if (!ok || rename(temp.c_str(), this->path.c_str()) != 0) {
+		error = ok ? errno : error;
+		unlink(temp.c_str());
+		throw DbException(("can't write " + this->path).c_str(), error);
+	}
+	if (!load())
+		throw DbException(("can't read " + this->path + " back").c_str(), EIO);
+}
+
+void CatalogSnapshot::reset(const map<Identifier, CatalogEntry>& entries) {
+	unmap();
+	this->unknown.clear();
+	this->changed = entries;
+	this->loaded = false;
+}
+
+
+/*
+	PROTECTED
+*/
+
+void CatalogSnapshot::unmap() {
+	if (this->data != nullptr)
+		munmap((void*)this->data, this->size);
+	this->data = nullptr;
+	this->size = 0;
+	this->n_tables = 0;
+}
+
+// Each entry starts with its table's name.
+bool CatalogSnapshot::name_at(u_int32_t i, Identifier& table_name) const {
+	u_int32_t offset;
+	memcpy(&offset, this->data + HEADER_SIZE + i * sizeof(u_int32_t), sizeof(offset));
+	size_t at = offset;
+	return read_string(at, table_name);
+}
+
+bool CatalogSnapshot::entry_at(u_int32_t i, Identifier& table_name, CatalogEntry& entry) const {
+	u_int32_t offset;
+	memcpy(&offset, this->data + HEADER_SIZE + i * sizeof(u_int32_t), sizeof(offset));
+	size_t at = offset;
+	u_int16_t n_columns;
+	if (!read_string(at, table_name) || !read_string(at, entry.storage_engine)
+		|| at + sizeof(n_columns) > this->size)
+		return false;
+	memcpy(&n_columns, this->data + at, sizeof(n_columns));
+	at += sizeof(n_columns);
+
+	entry.column_names.clear();
+	entry.column_attributes.clear();
+	for (uint column = 0; column < n_columns; column++) {
+		Identifier column_name;
+		if (!read_string(at, column_name) || at >= this->size
+			|| (u_char)this->data[at] > ColumnAttribute::TIMESTAMP)
+			return false;
+		entry.column_names.push_back(column_name);
+		entry.column_attributes.push_back(ColumnAttribute((ColumnAttribute::DataType)(u_char)this->data[at++]));
+	}
+	return !entry.storage_engine.empty();
+}
+
+bool CatalogSnapshot::read_string(size_t& offset, string& s) const {
+	u_int16_t length;
+	if (offset + sizeof(length) > this->size)
+		return false;
+	memcpy(&length, this->data + offset, sizeof(length));
+	offset += sizeof(length);
+	if (offset + length > this->size)
+		return false;
+	s.assign(this->data + offset, length);
+	offset += length;
+	return true;
+}
+
+void CatalogSnapshot::write_string(string& out, const string& s) {
+	u_int16_t length = s.size();
+	out.append((const char*)&length, sizeof(length));
+	out += s;
+}
+
+void CatalogSnapshot::write_entry(string& out, const Identifier& table_name, const CatalogEntry& entry) {
+	write_string(out, table_name);
+	write_string(out, entry.storage_engine);
+	u_int16_t n_columns = entry.column_names.size();
+	out.append((const char*)&n_columns, sizeof(n_columns));
+	for (uint column = 0; column < n_columns; column++) {
+		write_string(out, entry.column_names[column]);
+		out += (char)entry.column_attributes[column].get_data_type();
+	}
+}
+
+void CatalogSnapshot::write_u32(string& out, u_int32_t n) {
+	out.append((const char*)&n, sizeof(n));
+}
+
+
+/*
+	TESTS
+*/
+
+typedef map<Identifier, CatalogEntry> Catalog;  // what the schema tables say
+
+static bool same_entry(const CatalogEntry& a, const CatalogEntry& b) {
+	if (a.storage_engine != b.storage_engine || a.column_names != b.column_names
+		|| a.column_attributes.size() != b.column_attributes.size())
+		return false;
+	for (uint i = 0; i < a.column_attributes.size(); i++)
+		if (a.column_attributes[i].get_data_type() != b.column_attributes[i].get_data_type())
+			return false;
+	return true;
+}
+
+// The snapshot never says anything the schema tables don't, and if complete, it has every table in them.
+static bool answers(const CatalogSnapshot& snapshot, const Catalog& schema, const set<Identifier>& names,
+					bool complete) {
+	for (auto const& name : names) {
+		CatalogEntry entry;
+		bool found = snapshot.get(name, entry);
+		auto table = schema.find(name);
+		if (found && (table == schema.end() || !same_entry(entry, table->second)))
+			return false;
+		if (complete && !found && table != schema.end())
+			return false;
+	}
+	return true;
+}
+
+// Change a table in the schema tables the way Tables does (forget before the change, then save).
+static void change(CatalogSnapshot& snapshot, Catalog& schema, const Identifier& name, const CatalogEntry* entry) {
+	snapshot.forget(name);
+	if (entry == nullptr)
+		schema.erase(name);
+	else
+		schema[name] = *entry;
+}
+
+static void save(CatalogSnapshot& snapshot, const Catalog& schema) {
+	set<Identifier> unknown = snapshot.get_unknown();
+	for (auto const& name : unknown) {
+		auto table = schema.find(name);
+		if (table == schema.end())
+			snapshot.remove(name);
+		else
+			snapshot.put(name, table->second);
+	}
+	snapshot.save();
+}
+
+static bool exists(const string& path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0;
+}
+
+static bool rewrite(const string& path, const string& contents) {
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		return false;
+	bool ok = fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+	return fclose(file) == 0 && ok;
+}
+
+static string contents(const string& path) {
+	string bytes;
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return bytes;
+	char buffer[4096];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		bytes.append(buffer, n);
+	fclose(file);
+	return bytes;
+}
+
+bool test_catalog_snapshot() {
+	const char* home;
+	_DB_ENV->get_home(&home);
+	string path = string(home) + "/_test_catalog.snapshot";
+	unlink(path.c_str());
+
+	ColumnAttribute types[] = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT),
+							   ColumnAttribute(ColumnAttribute::BIGINT), ColumnAttribute(ColumnAttribute::TIMESTAMP)};
+	const char* engines[] = {"HEAP", "COLUMNAR", "FLAT", "MMAP"};
+	auto entry_for = [&](uint n) {
+		CatalogEntry entry;
+		entry.storage_engine = engines[n % 4];
+		for (uint column = 0; column <= n % 5; column++) {
+			entry.column_names.push_back("c" + to_string(column));
+			entry.column_attributes.push_back(types[(n + column) % 4]);
+		}
+		return entry;
+	};
+	Catalog schema;
+	set<Identifier> names;  // every table there has ever been
+	for (uint n = 0; n < 40; n++) {
+		Identifier name = "t" + to_string(n * 7 % 40);  // not in name order
+		schema[name] = entry_for(n);
+		names.insert(name);
+	}
+
+	// no file yet: nothing is answered for, so Tables goes to the schema tables
+	CatalogSnapshot snapshot(path);
+	if (snapshot.load() || snapshot.is_loaded() || !answers(snapshot, Catalog(), names, false))
+		return false;
+	snapshot.reset(schema);
+	snapshot.save();
+	if (!exists(path) || !snapshot.is_loaded() || !answers(snapshot, schema, names, true))
+		return false;
+
+	// create and drop tables, saving after each statement (names before, between and after the others)
+	for (uint round = 0; round < 6; round++) {
+		for (uint n = round; n < 40; n += 6) {
+			Identifier dropped = "t" + to_string(n);
+			change(snapshot, schema, dropped, nullptr);
+			if (exists(path))  // forget takes the file away at the first change
+				return false;
+			CatalogEntry created = entry_for(n + round + 1);
+			Identifier name = string(round % 2 ? "a" : "z") + to_string(n);
+			change(snapshot, schema, name, &created);
+			change(snapshot, schema, "t" + to_string(n) + "_", &created);
+			names.insert(name);
+			names.insert("t" + to_string(n) + "_");
+			// the tables that didn't change are still answered for, the changed ones aren't
+			if (!answers(snapshot, schema, names, false) || snapshot.get(name, created) || snapshot.get(dropped, created))
+				return false;
+		}
+		bool refused = false;
+		try {
+			snapshot.save();  // without what became of the forgotten tables
+		}
+		catch (DbRelationError& e) {
+			refused = true;
+		}
+		save(snapshot, schema);
+		if (!refused || !exists(path) || !answers(snapshot, schema, names, true))
+			return false;
+
+		// a new process gets the same definitions from the file
+		CatalogSnapshot reloaded(path);
+		if (!reloaded.load() || reloaded.n_tables != schema.size() || !answers(reloaded, schema, names, true))
+			return false;
+	}
+
+	// a file that is truncated, of another version, or garbage is not used (and then replaced by a fresh one)
+	string good = contents(path);
+	string other_version = good;
+	other_version[4]++;
+	string bad_files[] = {good.substr(0, good.size() - 1), good.substr(0, good.size() / 2), good.substr(0, 8),
+						  other_version, "nonsense", ""};
+	for (auto const& bad : bad_files) {
+		CatalogSnapshot reloaded(path);
+		if (!rewrite(path, bad) || reloaded.load() || reloaded.is_loaded() || !answers(reloaded, Catalog(), names, false))
+			return false;
+		reloaded.reset(schema);
+		reloaded.save();
+		if (!answers(reloaded, schema, names, true))
+			return false;
+	}
+
+	// an entry that can't be read isn't answered for, and isn't carried into the next file; once
+	// it's looked up in the schema tables (and put), it's back
+	string damaged = contents(path);
+	damaged[damaged.size() - 1] = (char)0x7f;  // the last column's data type
+	if (!rewrite(path, damaged))
+		return false;
+	CatalogSnapshot reloaded(path);
+	if (!reloaded.load() || !answers(reloaded, schema, names, false) || answers(reloaded, schema, names, true))
+		return false;
+	Identifier last;
+	for (auto const& name : names) {
+		CatalogEntry entry;
+		if (schema.find(name) != schema.end() && !reloaded.get(name, entry))
+			last = name;
+	}
+	reloaded.save();
+	if (last.empty() || !answers(reloaded, schema, names, false) || reloaded.n_tables != schema.size() - 1)
+		return false;
+	reloaded.put(last, schema[last]);
+	reloaded.save();
+	CatalogSnapshot fixed(path);
+	bool ok = fixed.load() && answers(fixed, schema, names, true);
+	unlink(path.c_str());
+	return ok;
+}
@@ -0,0 +1,141 @@
+/**
+ * @file catalog_snapshot.h - the definitions of all the tables, in one file read at startup
+ * CatalogEntry
+ * CatalogSnapshot
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include "storage_engine.h"
+
+/**
+ * @class CatalogEntry - what Tables::get_table needs to know about a table
+ */
+class CatalogEntry {
+public:
+	CatalogEntry() {}
+	CatalogEntry(Identifier storage_engine, ColumnNames column_names, ColumnAttributes column_attributes)
+			: storage_engine(storage_engine), column_names(column_names), column_attributes(column_attributes) {}
+
+	Identifier storage_engine;  // empty for a table that has been dropped
+	ColumnNames column_names;
+	ColumnAttributes column_attributes;
+};
+
+/**
+ * @class CatalogSnapshot - the _tables and _columns rows of every table, in a file of their own
+ *
+ *      Rebuilding a table's definition from the schema tables takes a scan of _columns (and one of
+        _tables), so a process that touches thousands of tables would do thousands of scans before it
+        was warm. Instead, Tables looks in the snapshot: a file, <env home>/_catalog.snapshot, mapped
+        into memory by load() and searched in place (its directory is in table name order), so
+        loading it takes the same time however many tables there are.
+
+        Layout (native byte order):
+            header:     u32 MAGIC, u32 FORMAT_VERSION, u32 number of tables, u32 file size
+            directory:  u32 offset of each entry, by table name
+            entry:      name, storage engine, u16 number of columns, then each column's name and
+                        u8 data type (strings are a u16 length followed by that many bytes)
+        A file of another FORMAT_VERSION is ignored (and replaced by the next save).
+
+        The file is never allowed to say something the schema tables don't: the first change to a
+        table's rows since the last save (forget) removes the file, and until the table is looked up
+        again it is unknown here. save() writes what the old file had plus what changed since, to a
+        temporary file renamed over the old one. So after a crash the snapshot is either right or
+        missing, and if it's missing, initialize_schema_tables builds it again from the schema tables.
+ */
+class CatalogSnapshot {
+public:
+	/**
+	 * @param path  of the snapshot file (not read until load)
+	 */
+	CatalogSnapshot(const std::string& path);
+	virtual ~CatalogSnapshot();
+	CatalogSnapshot(const CatalogSnapshot& other) = delete;
+	CatalogSnapshot(CatalogSnapshot&& temp) = delete;
+	CatalogSnapshot& operator=(const CatalogSnapshot& other) = delete;
+	CatalogSnapshot& operator=(CatalogSnapshot&& temp) = delete;
+
+	/**
+	 * Map the snapshot file into memory.
+	 * @returns  false if there isn't one, or it isn't one this version can read
+	 */
+	virtual bool load();
+
+	/**
+	 * @returns  true if the snapshot has every table in it (load or save has succeeded)
+	 */
+	virtual bool is_loaded() const {return loaded;}
+
+	/**
+	 * Look up a table's definition.
+	 * @param entry  returned by reference: its storage engine, columns and their attributes
+	 * @returns      false if the snapshot can't say (the table isn't there, or has changed since)
+	 */
+	virtual bool get(const Identifier& table_name, CatalogEntry& entry) const;
+
+	/**
+	 * Record a table's definition as it is now in the schema tables (for the next save).
+	 */
+	virtual void put(const Identifier& table_name, const CatalogEntry& entry);
+
+	/**
+	 * Record that a table is gone (for the next save).
+	 */
+	virtual void remove(const Identifier& table_name);
+
+	/**
+	 * A table's rows in the schema tables are changing: don't answer for it until it's put or
+	 * removed, and take the file away until the next save.
+	 * @throws  DbException if the file can't be removed
+	 */
+	virtual void forget(const Identifier& table_name);
+
+	/**
+	 * @returns  the tables forgotten and not put or removed since
+	 */
+	virtual const std::set<Identifier>& get_unknown() const {return unknown;}
+
+	/**
+	 * Write the snapshot file again, with the changes put and removed since it was loaded or last
+	 * saved, and map the new one. Every table forgotten must have been put or removed first.
+	 * @throws  DbException if the file can't be written (the snapshot is left without one)
+	 */
+	virtual void save();
+
+	/**
+	 * Start over with nothing but the given definitions (to be written by save).
+	 */
+	virtual void reset(const std::map<Identifier, CatalogEntry>& entries);
+
+	static const char* const FILE_NAME;
+	static const u_int32_t MAGIC = 0x43355153;  // "SQ5C"
+	static const u_int32_t FORMAT_VERSION = 1;
+
+	friend bool test_catalog_snapshot();
+
+protected:
+	std::string path;
+	const char* data;   // the mapped file (nullptr if none)
+	size_t size;
+	u_int32_t n_tables;
+	bool loaded;
+	bool on_disk;       // the file is still there (nothing has been forgotten since it was written)
+	std::map<Identifier, CatalogEntry> changed;  // since the file was written
+	std::set<Identifier> unknown;
+
+	virtual void unmap();
+	virtual bool name_at(u_int32_t i, Identifier& table_name) const;
+	virtual bool entry_at(u_int32_t i, Identifier& table_name, CatalogEntry& entry) const;
+	virtual bool read_string(size_t& offset, std::string& s) const;
+
+	static void write_string(std::string& out, const std::string& s);
+	static void write_entry(std::string& out, const Identifier& table_name, const CatalogEntry& entry);
+	static void write_u32(std::string& out, u_int32_t n);
+};
+
+bool test_catalog_snapshot();
@@ -0,0 +1,738 @@
+/**
+ * @file column_encoding.cpp - implementation of ColumnEncoding
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "column_encoding.h"
+
+using namespace std;
+
+typedef u_int16_t u16;
+
+// offsets within a column vector
+static const uint COUNT_OFFSET = 0;
+static const uint ENCODING_OFFSET = 2;
+static const uint MIN_OFFSET = 3;
+static const uint MAX_OFFSET = 7;
+static const uint INT_VALUES_OFFSET = 11;
+static const uint TEXT_VALUES_OFFSET = 3;
+
+// append the raw bytes of n to bytes
+template <typename T>
+static void put(string& bytes, T n) {
+	bytes.append((const char*)&n, sizeof(n));
+}
+
+// the start of a vector: count, encoding, and for INT vectors the range
+static string header(u16 count, ColumnEncoding::Encoding encoding) {
+	string bytes;
+	put(bytes, count);
+	put(bytes, (uint8_t)encoding);
+	return bytes;
+}
+
+static uint64_t zigzag(int64_t n) {
+	return ((uint64_t)n << 1) ^ (uint64_t)(n >> 63);
+}
+
+static int64_t unzigzag(uint64_t n) {
+	return (int64_t)(n >> 1) ^ -(int64_t)(n & 1);
+}
+
+// how the size bytes at text compare to constant: < 0, 0 or > 0
+static int compare_text(const char* text, u16 size, const string& constant) {
+	int comparison = constant.compare(0, string::npos, text, size);
+	return comparison < 0 ? 1 : comparison > 0 ? -1 : 0;
+}
+
+
+/*
+	PUBLIC
+*/
+
+Dbt* ColumnEncoding::empty(ColumnAttribute::DataType data_type) {
+	if (data_type == ColumnAttribute::INT)
+		return to_dbt(encode_ints(vector<int32_t>(), PLAIN));
+	return to_dbt(encode_texts(vector<string>(), PLAIN));
+}
+
+Dbt* ColumnEncoding::append(const Dbt* column_vector, ColumnAttribute::DataType data_type, const Value& value) {
+	if (get_encoding(column_vector) != PLAIN)
+		throw DbRelationError("can only append to an uncompressed column vector");
+	uint old_size = column_vector->get_size();
+	uint size;
+	if (data_type == ColumnAttribute::INT)
+		size = old_size + sizeof(int32_t);
+	else if (data_type == ColumnAttribute::TEXT)
+		size = old_size + sizeof(u16) + value.s.length();
+	else
+		throw DbRelationError("Only know how to store INT and TEXT columns");
+
+	char* bytes = new char[size];
+	memcpy(bytes, column_vector->get_data(), old_size);
+	*(u16*)(bytes + COUNT_OFFSET) += 1;
+	if (data_type == ColumnAttribute::INT) {
+		*(int32_t*)(bytes + old_size) = value.n;
+		if (value.n < *(int32_t*)(bytes + MIN_OFFSET))
+			*(int32_t*)(bytes + MIN_OFFSET) = value.n;
+		if (value.n > *(int32_t*)(bytes + MAX_OFFSET))
+			*(int32_t*)(bytes + MAX_OFFSET) = value.n;
+	}
+	else {
+		*(u16*)(bytes + old_size) = value.s.length();
+		memcpy(bytes + old_size + sizeof(u16), value.s.c_str(), value.s.length()); // assume ascii for now
+	}
+	return new Dbt(bytes, size);
+}
+
+Dbt* ColumnEncoding::compress(const Dbt* column_vector, ColumnAttribute::DataType data_type) {
+	string best;
+	if (data_type == ColumnAttribute::INT) {
+		vector<int32_t> values;
+		decode_ints((const char*)column_vector->get_data(), values);
+		for (auto const& encoding : {PLAIN, RLE, PACKED, DELTA}) {
+			string bytes = encode_ints(values, encoding);
+			if (!bytes.empty() && (best.empty() || bytes.size() < best.size()))
+				best = bytes;
+		}
+	}
+	else {
+		vector<string> values;
+		decode_texts((const char*)column_vector->get_data(), values);
+		for (auto const& encoding : {PLAIN, DICTIONARY}) {
+			string bytes = encode_texts(values, encoding);
+			if (!bytes.empty() && (best.empty() || bytes.size() < best.size()))
+				best = bytes;
+		}
+	}
+	return to_dbt(best);
+}
+
+u16 ColumnEncoding::get_count(const Dbt* column_vector) {
+	return *(u16*)((char*)column_vector->get_data() + COUNT_OFFSET);
+}
+
+ColumnEncoding::Encoding ColumnEncoding::get_encoding(const Dbt* column_vector) {
+	return (Encoding)*(uint8_t*)((char*)column_vector->get_data() + ENCODING_OFFSET);
+}
+
+void ColumnEncoding::get_range(const Dbt* column_vector, int32_t& min, int32_t& max) {
+	char* bytes = (char*)column_vector->get_data();
+	min = *(int32_t*)(bytes + MIN_OFFSET);
+	max = *(int32_t*)(bytes + MAX_OFFSET);
+}
+
+Value ColumnEncoding::value_at(const Dbt* column_vector, ColumnAttribute::DataType data_type, RecordID record_id) {
+	const char* bytes = (const char*)column_vector->get_data();
+	if (record_id == 0 || record_id > get_count(column_vector))
+		throw DbRelationError("no such row in column vector");
+	uint index = record_id - 1;
+	const char* values = bytes + (data_type == ColumnAttribute::INT ? INT_VALUES_OFFSET : TEXT_VALUES_OFFSET);
+
+	switch (get_encoding(column_vector)) {
+		case PLAIN:
+			if (data_type == ColumnAttribute::INT)
+				return Value(*(int32_t*)(values + index * sizeof(int32_t)));
+			for (uint i = 0; i < index; i++)
+				values += sizeof(u16) + *(u16*)values;
+			return Value(string(values + sizeof(u16), *(u16*)values));
+		case PACKED:
+			return Value((int32_t)(*(int32_t*)(bytes + MIN_OFFSET) + (int64_t)unpack(values + 1, *(uint8_t*)values, index)));
+		case RLE: {
+			const char* run = values + sizeof(u16);
+			for (;; run += sizeof(int32_t) + sizeof(u16)) {
+				u16 length = *(u16*)(run + sizeof(int32_t));
+				if (index < length)
+					return Value(*(int32_t*)run);
+				index -= length;
+			}
+		}
+		case DELTA: {
+			uint8_t width = *(uint8_t*)values;
+			int64_t n = *(int32_t*)(values + 1);
+			for (uint i = 1; i <= index; i++)
+				n += unzigzag(unpack(values + 1 + sizeof(int32_t), width, i - 1));
+			return Value((int32_t)n);
+		}
+		case DICTIONARY: {
+			u16 size = *(u16*)values;
+			const char* entry = values + sizeof(u16);
+			vector<const char*> entries;
+			for (u16 i = 0; i < size; i++) {
+				entries.push_back(entry);
+				entry += sizeof(u16) + *(u16*)entry;
+			}
+			uint32_t code = unpack(entry + 1, *(uint8_t*)entry, index);
+			return Value(string(entries[code] + sizeof(u16), *(u16*)entries[code]));
+		}
+		default:
+			throw DbRelationError("unknown column encoding");
+	}
+}
+
+void ColumnEncoding::decode(const Dbt* column_vector, ColumnAttribute::DataType data_type, vector<Value>& values) {
+	values.reserve(get_count(column_vector));
+	if (data_type == ColumnAttribute::INT) {
+		vector<int32_t> ints;
+		decode_ints((const char*)column_vector->get_data(), ints);
+		for (auto const& n : ints)
+			values.push_back(Value(n));
+	}
+	else {
+		vector<string> texts;
+		decode_texts((const char*)column_vector->get_data(), texts);
+		for (auto const& s : texts)
+			values.push_back(Value(s));
+	}
+}
+
+bool ColumnEncoding::match(const Dbt* column_vector, ColumnAttribute::DataType data_type, Predicate::Operator op,
+						   const Value& constant, PredicateKernels::Selection& selection) {
+	const char* bytes = (const char*)column_vector->get_data();
+	u16 count = get_count(column_vector);
+	selection.assign((count + 63) / 64, 0);
+	if (constant.data_type != data_type) {
+		if (op == Predicate::NE)  // values of a different type only satisfy NE
+			PredicateKernels::set(selection, 0, count);
+		return op == Predicate::NE && count > 0;
+	}
+	static thread_local vector<int32_t> unpacked;  // reused from vector to vector
+
+	if (data_type == ColumnAttribute::INT) {
+		int32_t min, max;
+		get_range(column_vector, min, max);
+		if (!PredicateKernels::could_match(op, constant.n, min, max))
+			return false;
+		const char* values = bytes + INT_VALUES_OFFSET;
+		switch (get_encoding(column_vector)) {
+			case PLAIN:
+				PredicateKernels::compare((const int32_t*)values, count, op, constant.n, selection);
+				break;
+			case PACKED:
+			case DELTA:
+				decode_ints(bytes, unpacked);
+				PredicateKernels::compare(unpacked.data(), count, op, constant.n, selection);
+				break;
+			case RLE: {
+				u16 runs = *(u16*)values;
+				const char* run = values + sizeof(u16);
+				uint i = 0;
+				for (u16 r = 0; r < runs; r++, run += sizeof(int32_t) + sizeof(u16)) {
+					u16 length = *(u16*)(run + sizeof(int32_t));
+					int32_t n = *(int32_t*)run;
+					if (PredicateKernels::satisfies(n < constant.n ? -1 : n > constant.n ? 1 : 0, op))
+						PredicateKernels::set(selection, i, length);
+					i += length;
+				}
+				break;
+			}
+			default:
+				throw DbRelationError("unknown column encoding");
+		}
+		return PredicateKernels::any(selection);
+	}
+
+	const char* values = bytes + TEXT_VALUES_OFFSET;
+	switch (get_encoding(column_vector)) {
+		case PLAIN:
+			if (op == Predicate::EQ || op == Predicate::NE) {
+				PredicateKernels::equal_texts(values, count, constant.s, op == Predicate::NE, selection);
+				break;
+			}
+			for (u16 i = 0; i < count; i++) {
+				u16 size = *(u16*)values;
+				if (PredicateKernels::satisfies(compare_text(values + sizeof(u16), size, constant.s), op))
+					selection[i / 64] |= 1ULL << (i % 64);
+				values += sizeof(u16) + size;
+			}
+			break;
+		case DICTIONARY: {
+			// the dictionary is sorted, so find where the constant would go: codes below it are the
+			// smaller values, and it's the entry at that position if it's there at all
+			u16 size = *(u16*)values;
+			const char* entry = values + sizeof(u16);
+			int32_t position = size;
+			bool found = false;
+			for (u16 i = 0; i < size; i++) {
+				u16 entry_size = *(u16*)entry;
+				int comparison = compare_text(entry + sizeof(u16), entry_size, constant.s);
+				if (comparison >= 0 && position == size) {
+					position = i;
+					found = comparison == 0;
+				}
+				entry += sizeof(u16) + entry_size;
+			}
+			Predicate::Operator code_op = op;
+			if (!found) {
+				if (op == Predicate::EQ)
+					return false;
+				if (op == Predicate::NE) {
+					PredicateKernels::set(selection, 0, count);
+					return count > 0;
+				}
+				if (op == Predicate::LE)
+					code_op = Predicate::LT;
+				if (op == Predicate::GT)
+					code_op = Predicate::GE;
+			}
+			uint8_t width = *(uint8_t*)entry;
+			unpacked.resize(count);
+			for (u16 i = 0; i < count; i++)
+				unpacked[i] = (int32_t)unpack(entry + 1, width, i);
+			PredicateKernels::compare(unpacked.data(), count, code_op, position, selection);
+			break;
+		}
+		default:
+			throw DbRelationError("unknown column encoding");
+	}
+	return PredicateKernels::any(selection);
+}
+
+
+/*
+	PROTECTED
+*/
+
+void ColumnEncoding::decode_ints(const char* bytes, vector<int32_t>& values) {
+	u16 count = *(u16*)(bytes + COUNT_OFFSET);
+	const char* encoded = bytes + INT_VALUES_OFFSET;
+	values.clear();
+	values.reserve(count);
+	switch ((Encoding)*(uint8_t*)(bytes + ENCODING_OFFSET)) {
+		case PLAIN:
+			values.assign((const int32_t*)encoded, (const int32_t*)encoded + count);
+			break;
+		case PACKED: {
+			int64_t min = *(int32_t*)(bytes + MIN_OFFSET);
+			for (u16 i = 0; i < count; i++)
+				values.push_back((int32_t)(min + unpack(encoded + 1, *(uint8_t*)encoded, i)));
+			break;
+		}
+		case RLE: {
+			u16 runs = *(u16*)encoded;
+			const char* run = encoded + sizeof(u16);
+			for (u16 r = 0; r < runs; r++, run += sizeof(int32_t) + sizeof(u16))
+				values.insert(values.end(), *(u16*)(run + sizeof(int32_t)), *(int32_t*)run);
+			break;
+		}
+		case DELTA: {
+			int64_t n = *(int32_t*)(encoded + 1);
+			for (u16 i = 0; i < count; i++) {
+				if (i > 0)
+					n += unzigzag(unpack(encoded + 1 + sizeof(int32_t), *(uint8_t*)encoded, i - 1));
+				values.push_back((int32_t)n);
+			}
+			break;
+		}
+		default:
+			throw DbRelationError("unknown column encoding");
+	}
+}
+
+void ColumnEncoding::decode_texts(const char* bytes, vector<string>& values) {
+	u16 count = *(u16*)(bytes + COUNT_OFFSET);
+	const char* encoded = bytes + TEXT_VALUES_OFFSET;
+	values.clear();
+	values.reserve(count);
+	switch ((Encoding)*(uint8_t*)(bytes + ENCODING_OFFSET)) {
+		case PLAIN:
+			for (u16 i = 0; i < count; i++) {
+				values.push_back(string(encoded + sizeof(u16), *(u16*)encoded));
+				encoded += sizeof(u16) + *(u16*)encoded;
+			}
+			break;
+		case DICTIONARY: {
+			vector<string> dictionary;
+			u16 size = *(u16*)encoded;
+			encoded += sizeof(u16);
+			for (u16 i = 0; i < size; i++) {
+				dictionary.push_back(string(encoded + sizeof(u16), *(u16*)encoded));
+				encoded += sizeof(u16) + *(u16*)encoded;
+			}
+			for (u16 i = 0; i < count; i++)
+				values.push_back(dictionary[unpack(encoded + 1, *(uint8_t*)encoded, i)]);
+			break;
+		}
+		default:
+			throw DbRelationError("unknown column encoding");
+	}
+}
+
+// The whole vector in the given encoding (empty string if the encoding can't hold these values).
+string ColumnEncoding::encode_ints(const vector<int32_t>& values, Encoding encoding) {
+	string bytes = header((u16)values.size(), encoding);
+	int32_t min = INT32_MAX, max = INT32_MIN;  // empty range, so no predicate can match an empty vector
+	for (auto const& n : values) {
+		min = std::min(min, n);
+		max = std::max(max, n);
+	}
+	put(bytes, min);
+	put(bytes, max);
+
+	switch (encoding) {
+		case PLAIN:
+			for (auto const& n : values)
+				put(bytes, n);
+			break;
+		case RLE: {
+			string runs;
+			u16 count = 0;
+			for (uint i = 0; i < values.size(); ) {
+				uint j = i;
+				while (j < values.size() && values[j] == values[i])
+					j++;
+				put(runs, values[i]);
+				put(runs, (u16)(j - i));
+				count++;
+				i = j;
+			}
+			put(bytes, count);
+			bytes += runs;
+			break;
+		}
+		case PACKED: {
+			vector<uint32_t> offsets;
+			for (auto const& n : values)
+				offsets.push_back((uint32_t)((int64_t)n - min));
+			uint width = values.empty() ? 0 : bit_width((uint32_t)((int64_t)max - min));
+			put(bytes, (uint8_t)width);
+			pack(offsets, width, bytes);
+			break;
+		}
+		case DELTA: {
+			vector<uint32_t> deltas;
+			uint64_t largest = 0;
+			for (uint i = 1; i < values.size(); i++) {
+				uint64_t delta = zigzag((int64_t)values[i] - values[i - 1]);
+				if (delta > UINT32_MAX)
+					return "";
+				largest = std::max(largest, delta);
+				deltas.push_back((uint32_t)delta);
+			}
+			uint width = bit_width(largest);
+			put(bytes, (uint8_t)width);
+			put(bytes, values.empty() ? (int32_t)0 : values[0]);
+			pack(deltas, width, bytes);
+			break;
+		}
+		default:
+			return "";
+	}
+	return bytes;
+}
+
+// The whole vector in the given encoding (empty string if the encoding can't hold these values).
+string ColumnEncoding::encode_texts(const vector<string>& values, Encoding encoding) {
+	string bytes = header((u16)values.size(), encoding);
+	switch (encoding) {
+		case PLAIN:
+			for (auto const& s : values) {
+				put(bytes, (u16)s.length());
+				bytes += s;
+			}
+			break;
+		case DICTIONARY: {
+			vector<string> dictionary(values);
+			sort(dictionary.begin(), dictionary.end());
+			dictionary.erase(unique(dictionary.begin(), dictionary.end()), dictionary.end());
+			put(bytes, (u16)dictionary.size());
+			for (auto const& s : dictionary) {
+				put(bytes, (u16)s.length());
+				bytes += s;
+			}
+			vector<uint32_t> codes;
+			for (auto const& s : values)
+				codes.push_back(lower_bound(dictionary.begin(), dictionary.end(), s) - dictionary.begin());
+			uint width = dictionary.empty() ? 0 : bit_width(dictionary.size() - 1);
+			put(bytes, (uint8_t)width);
+			pack(codes, width, bytes);
+			break;
+		}
+		default:
+			return "";
+	}
+	return bytes;
+}
+
+// caller responsible for freeing the returned Dbt and its enclosed ret->get_data().
+Dbt* ColumnEncoding::to_dbt(const string& bytes) {
+	char* data = new char[bytes.size()];
+	memcpy(data, bytes.data(), bytes.size());
+	return new Dbt(data, bytes.size());
+}
+
+// How many bits it takes to hold max.
+uint ColumnEncoding::bit_width(uint64_t max) {
+	uint width = 0;
+	while (max != 0) {
+		width++;
+		max >>= 1;
+	}
+	return width;
+}
+
+// Append the values to bytes, width bits each, least significant bit first.
+void ColumnEncoding::pack(const vector<uint32_t>& values, uint width, string& bytes) {
+	uint64_t buffer = 0;
+	uint bits = 0;
+	for (auto const& n : values) {
+		buffer |= (uint64_t)n << bits;
+		bits += width;
+		while (bits >= 8) {
+			bytes += (char)(buffer & 0xff);
+			buffer >>= 8;
+			bits -= 8;
+		}
+	}
+	if (bits > 0)
+		bytes += (char)(buffer & 0xff);
+}
+
+// The index'th value packed by pack().
+uint32_t ColumnEncoding::unpack(const char* bytes, uint width, uint index) {
+	if (width == 0)
+		return 0;
+	uint64_t bit = (uint64_t)index * width;
+	const unsigned char* p = (const unsigned char*)bytes + bit / 8;
+	uint shift = bit % 8;
+	uint64_t word = 0;
+	for (uint b = 0; b * 8 < shift + width; b++)
+		word |= (uint64_t)p[b] << (8 * b);
+	return (uint32_t)((word >> shift) & ((1ULL << width) - 1));
+}
+
+
+/*
+	TESTS
+*/
+
+// Every encoding that can hold the values has to give them back, through decode and value_at.
+static bool ints_round_trip(const vector<int32_t>& values, const vector<string>& encoded) {
+	for (uint e = 0; e < encoded.size(); e++) {
+		if (encoded[e].empty())
+			continue;
+		Dbt column_vector((void*)encoded[e].data(), encoded[e].size());
+		vector<Value> decoded;
+		ColumnEncoding::decode(&column_vector, ColumnAttribute::INT, decoded);
+		if (ColumnEncoding::get_encoding(&column_vector) != (ColumnEncoding::Encoding)e
+			|| ColumnEncoding::get_count(&column_vector) != values.size() || decoded.size() != values.size())
+			return false;
+		for (uint i = 0; i < values.size(); i++)
+			if (decoded[i].n != values[i]
+				|| ColumnEncoding::value_at(&column_vector, ColumnAttribute::INT, i + 1).n != values[i])
+				return false;
+	}
+	return true;
+}
+
+static bool texts_round_trip(const vector<string>& values, const vector<string>& encoded) {
+	for (auto const& bytes : encoded) {
+		Dbt column_vector((void*)bytes.data(), bytes.size());
+		vector<Value> decoded;
+		ColumnEncoding::decode(&column_vector, ColumnAttribute::TEXT, decoded);
+		if (decoded.size() != values.size())
+			return false;
+		for (uint i = 0; i < values.size(); i++)
+			if (decoded[i].s != values[i]
+				|| ColumnEncoding::value_at(&column_vector, ColumnAttribute::TEXT, i + 1).s != values[i])
+				return false;
+	}
+	return true;
+}
+
+// the encoding compress() picks for the values, appended one at a time to a PLAIN vector
+static ColumnEncoding::Encoding compressed_as(const vector<Value>& values, ColumnAttribute::DataType data_type) {
+	Dbt* column_vector = ColumnEncoding::empty(data_type);
+	for (auto const& value : values) {
+		Dbt* longer = ColumnEncoding::append(column_vector, data_type, value);
+		delete[](char*)column_vector->get_data();
+		delete column_vector;
+		column_vector = longer;
+	}
+	Dbt* compressed = ColumnEncoding::compress(column_vector, data_type);
+	ColumnEncoding::Encoding encoding = ColumnEncoding::get_encoding(compressed);
+	delete[](char*)column_vector->get_data();
+	delete column_vector;
+	delete[](char*)compressed->get_data();
+	delete compressed;
+	return encoding;
+}
+
+// Does the selection have exactly the values that satisfy the predicate (and no bits past the last one)?
+static bool selects(const PredicateKernels::Selection& selection, const vector<Value>& values,
+					const Predicate& predicate) {
+	if (selection.size() != (values.size() + 63) / 64)
+		return false;
+	for (uint i = 0; i < selection.size() * 64; i++) {
+		bool selected = (selection[i / 64] >> (i % 64)) & 1;
+		if (selected != (i < values.size() && predicate.test(values[i])))
+			return false;
+	}
+	return true;
+}
+
+// The constants worth comparing INT values with: the extremes, and each value and its neighbours.
+static vector<int32_t> int_constants(const vector<int32_t>& values) {
+	vector<int32_t> constants = {INT32_MIN, INT32_MIN + 1, -1, 0, 1, INT32_MAX - 1, INT32_MAX};
+	for (uint i = 0; i < values.size() && i < 20; i++)
+		for (int64_t n : {(int64_t)values[i] - 1, (int64_t)values[i], (int64_t)values[i] + 1})
+			if (n >= INT32_MIN && n <= INT32_MAX)
+				constants.push_back((int32_t)n);
+	return constants;
+}
+
+static const Predicate::Operator OPS[] = {Predicate::EQ, Predicate::NE, Predicate::LT, Predicate::LE,
+										  Predicate::GT, Predicate::GE};
+
+// The kernels, whichever implementation runs here, have to agree with Predicate::test.
+static bool kernels_agree(const vector<int32_t>& ints) {
+	vector<Value> values(ints.begin(), ints.end());
+	PredicateKernels::Selection selection;
+	vector<int32_t> constants = int_constants(ints);
+	for (auto const& constant : constants)
+		for (auto const& op : OPS) {
+			PredicateKernels::compare(ints.data(), ints.size(), op, constant, selection);
+			if (!selects(selection, values, Predicate("x", op, Value(constant))))
+				return false;
+		}
+	for (auto const& low : constants)
+		for (auto const& high : {INT32_MIN, low, low == INT32_MAX ? low : low + 1, INT32_MAX}) {
+			PredicateKernels::range(ints.data(), ints.size(), low, high, selection);
+			for (uint i = 0; i < selection.size() * 64; i++)
+				if (((selection[i / 64] >> (i % 64)) & 1) != (i < ints.size() && low <= ints[i] && ints[i] <= high))
+					return false;
+		}
+	return true;
+}
+
+static bool text_kernels_agree(const vector<string>& texts, const vector<string>& constants) {
+	string bytes;
+	vector<Value> values;
+	for (auto const& text : texts) {
+		u16 size = text.size();
+		bytes.append((const char*)&size, sizeof(size));
+		bytes += text;
+		values.push_back(Value(text));
+	}
+	PredicateKernels::Selection selection;
+	for (auto const& constant : constants)
+		for (bool invert : {false, true}) {
+			PredicateKernels::equal_texts(bytes.data(), texts.size(), constant, invert, selection);
+			if (!selects(selection, values, Predicate("x", invert ? Predicate::NE : Predicate::EQ, Value(constant))))
+				return false;
+		}
+	return true;
+}
+
+// match() on a vector, in whatever encoding it's in, has to agree with Predicate::test too.
+static bool match_agrees(const string& encoded, ColumnAttribute::DataType data_type, const vector<Value>& values,
+						 const vector<Value>& constants) {
+	Dbt column_vector((void*)encoded.data(), encoded.size());
+	PredicateKernels::Selection selection;
+	for (auto const& constant : constants)
+		for (auto const& op : OPS) {
+			Predicate predicate("x", op, constant);
+			bool matched = ColumnEncoding::match(&column_vector, data_type, op, constant, selection);
+			if (!selects(selection, values, predicate) || matched != PredicateKernels::any(selection))
+				return false;
+		}
+	return true;
+}
+
+bool test_column_encoding() {
+	vector<vector<int32_t>> int_cases = {
+		{},                                  // an empty row group
+		{42},                                // one value
+		vector<int32_t>(1000, -7),           // all equal: one run
+		{INT32_MIN, INT32_MAX},              // widest range; the delta doesn't fit in 32 bits
+		{INT32_MAX, INT32_MIN, INT32_MAX},
+		{0, INT32_MAX, 0, -INT32_MAX},       // the widest deltas that do fit
+		{INT32_MIN, INT32_MIN + 1, INT32_MIN},
+	};
+	vector<int32_t> mixed;
+	for (int i = 0; i < 1000; i++)
+		mixed.push_back(i % 10 == 0 ? 5 : (i * 7919) % 300 - 150);
+	int_cases.push_back(mixed);
+	for (auto const& values : int_cases) {
+		vector<string> encoded;
+		for (auto const& encoding : {ColumnEncoding::PLAIN, ColumnEncoding::RLE, ColumnEncoding::PACKED,
+									 ColumnEncoding::DELTA})
+			encoded.push_back(ColumnEncoding::encode_ints(values, encoding));
+		if (encoded[ColumnEncoding::PLAIN].empty() || encoded[ColumnEncoding::RLE].empty()
+			|| encoded[ColumnEncoding::PACKED].empty() || !ints_round_trip(values, encoded))
+			return false;
+		vector<Value> as_values(values.begin(), values.end());
+		vector<Value> constants;
+		for (auto const& n : int_constants(values))
+			constants.push_back(Value(n));
+		constants.push_back(Value("not an INT"));
+		for (auto const& bytes : encoded)
+			if (!bytes.empty() && !match_agrees(bytes, ColumnAttribute::INT, as_values, constants))
+				return false;
+	}
+
+	// counts on either side of a whole number of 64-value words, and of the vector widths within one
+	vector<int32_t> counting;
+	for (int i = 0; i < 131; i++) {
+		counting.push_back(i % 7 == 0 ? INT32_MIN : i % 11 == 0 ? INT32_MAX : (i * 7919) % 41 - 20);
+		if (i < 10 || i % 64 < 2 || i % 64 > 61)
+			if (!kernels_agree(counting))
+				return false;
+	}
+	if (!kernels_agree(mixed))
+		return false;
+	if (!ColumnEncoding::encode_ints(int_cases[3], ColumnEncoding::DELTA).empty()
+		|| ColumnEncoding::encode_ints(int_cases[5], ColumnEncoding::DELTA).empty())
+		return false;
+
+	vector<vector<string>> text_cases = {
+		{},
+		{""},
+		{"one"},
+		vector<string>(500, "same"),
+		{"b", "", "a", "b", string(1000, 'z'), "a"},
+	};
+	for (auto const& values : text_cases) {
+		vector<string> encoded = {ColumnEncoding::encode_texts(values, ColumnEncoding::PLAIN),
+								  ColumnEncoding::encode_texts(values, ColumnEncoding::DICTIONARY)};
+		if (!texts_round_trip(values, encoded))
+			return false;
+		vector<Value> as_values, constants = {Value(""), Value("a"), Value("b"), Value("same"), Value("zz"), Value(0)};
+		for (auto const& text : values)
+			as_values.push_back(Value(text));
+		for (auto const& bytes : encoded)
+			if (!match_agrees(bytes, ColumnAttribute::TEXT, as_values, constants))
+				return false;
+	}
+	// a constant longer than a value's 2-byte length can say, which starts like one of them, matches none
+	vector<string> texts;
+	for (int i = 0; i < 70; i++)
+		texts.push_back(i % 3 == 0 ? "abc" : string(i, 'a'));
+	if (!text_kernels_agree(texts, {"", "abc", "ab", string(69, 'a'), string(70, 'a'),
+									"abc" + string(65536, 'x'), string(65536 + 1, 'a')}))
+		return false;
+
+	// compress() picks the encoding that suits the values
+	vector<Value> runs, narrow, steps, repeated;
+	for (int i = 0; i < 1000; i++) {
+		runs.push_back(Value(i / 250));
+		narrow.push_back(Value((i * 7919) % 16));
+		steps.push_back(Value(1000000000 + 3 * i));
+		repeated.push_back(Value(string(i % 3 == 0 ? "red" : i % 3 == 1 ? "green" : "blue")));
+	}
+	if (compressed_as(runs, ColumnAttribute::INT) != ColumnEncoding::RLE
+		|| compressed_as(narrow, ColumnAttribute::INT) != ColumnEncoding::PACKED
+		|| compressed_as(steps, ColumnAttribute::INT) != ColumnEncoding::DELTA
+		|| compressed_as(repeated, ColumnAttribute::TEXT) != ColumnEncoding::DICTIONARY)
+		return false;
+
+	// an empty vector matches nothing, whatever its (empty) range
+	Dbt* empty = ColumnEncoding::empty(ColumnAttribute::INT);
+	PredicateKernels::Selection selection;
+	bool matched = ColumnEncoding::match(empty, ColumnAttribute::INT, Predicate::GE, Value(INT32_MIN), selection);
+	delete[](char*)empty->get_data();
+	delete empty;
+	return !matched;
+}
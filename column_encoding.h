@@ -0,0 +1,111 @@
+/**
+ * @file column_encoding.h - encodings for the column vectors of a ColumnTable
+ * ColumnEncoding
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include "db_cxx.h"
+#include "predicate_kernels.h"
+#include "storage_engine.h"
+
+/**
+ * @class ColumnEncoding - reading, writing and compressing column vectors
+ *
+ *      A column vector holds the values of one column for the rows of one row group:
+            Bytes 0x00 - 0x01: number of values
+            Byte  0x02:        encoding
+            INT columns:
+                Bytes 0x03 - 0x06: minimum value
+                Bytes 0x07 - 0x0A: maximum value
+                PLAIN:      4 bytes per value
+                RLE:        2-byte number of runs, then for each run the 4-byte value and a 2-byte run length
+                PACKED:     1-byte bit width w, then each (value - minimum) in w bits
+                DELTA:      1-byte bit width w, 4-byte first value, then each difference from the
+                            previous value, zigzag-encoded, in w bits
+            TEXT columns:
+                PLAIN:      for each value, a 2-byte length followed by the bytes
+                DICTIONARY: 2-byte number of distinct values, each as a 2-byte length followed by the
+                            bytes (in sorted order), then a 1-byte bit width w and each value's index
+                            into the dictionary in w bits
+
+        Vectors are built up with append() in the PLAIN encoding, and when their row group is full,
+        compress() picks whichever encoding is smallest for the values it ended up with. match()
+        evaluates a comparison with PredicateKernels on arrays of values: PLAIN INT vectors as they
+        are, PACKED and DELTA ones once unpacked, and DICTIONARY ones as their unpacked codes (the
+        dictionary is sorted, so the constant turns into a code bound with one lookup per vector).
+        A run is checked once for all its rows. The min/max in the header rules out whole vectors.
+ */
+class ColumnEncoding {
+public:
+	enum Encoding {
+		PLAIN,
+		RLE,
+		PACKED,
+		DELTA,
+		DICTIONARY
+	};
+
+	/**
+	 * A new vector with no values in it.
+	 * @returns  the vector (caller frees the Dbt and its enclosed get_data())
+	 */
+	static Dbt* empty(ColumnAttribute::DataType data_type);
+
+	/**
+	 * Add a value to the end of a PLAIN vector.
+	 * @returns  copy of column_vector with value appended (caller frees the Dbt and its get_data())
+	 */
+	static Dbt* append(const Dbt* column_vector, ColumnAttribute::DataType data_type, const Value& value);
+
+	/**
+	 * Re-encode a vector with whichever encoding makes it smallest.
+	 * @returns  the vector (caller frees the Dbt and its enclosed get_data())
+	 */
+	static Dbt* compress(const Dbt* column_vector, ColumnAttribute::DataType data_type);
+
+	static u_int16_t get_count(const Dbt* column_vector);
+	static Encoding get_encoding(const Dbt* column_vector);
+
+	/**
+	 * Smallest and largest values in an INT vector (min > max if it is empty).
+	 */
+	static void get_range(const Dbt* column_vector, int32_t& min, int32_t& max);
+
+	/**
+	 * Value for the given row (record ids start at 1).
+	 */
+	static Value value_at(const Dbt* column_vector, ColumnAttribute::DataType data_type, RecordID record_id);
+
+	/**
+	 * All the values in the vector, in row order.
+	 */
+	static void decode(const Dbt* column_vector, ColumnAttribute::DataType data_type, std::vector<Value>& values);
+
+	/**
+	 * Check every value in the vector against <value> <op> <constant>.
+	 * @param selection  returned by reference: bit i is set if row i+1 satisfies it (see PredicateKernels)
+	 * @returns          true if any row did
+	 */
+	static bool match(const Dbt* column_vector, ColumnAttribute::DataType data_type, Predicate::Operator op,
+					  const Value& constant, PredicateKernels::Selection& selection);
+
+	friend bool test_column_encoding();
+
+protected:
+	static void decode_ints(const char* bytes, std::vector<int32_t>& values);
+	static void decode_texts(const char* bytes, std::vector<std::string>& values);
+	static std::string encode_ints(const std::vector<int32_t>& values, Encoding encoding);
+	static std::string encode_texts(const std::vector<std::string>& values, Encoding encoding);
+	static Dbt* to_dbt(const std::string& bytes);
+
+	// bit packing
+	static uint bit_width(uint64_t max);
+	static void pack(const std::vector<uint32_t>& values, uint width, std::string& bytes);
+	static uint32_t unpack(const char* bytes, uint width, uint index);
+};
+
+bool test_column_encoding();
@@ -0,0 +1,320 @@
+/**
+ * @file column_storage.cpp - implementation of ColumnTable
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "column_storage.h"
+#include "stats.h"
+
+using namespace std;
+
+/*
+	PUBLIC
+*/
+
+ColumnTable::ColumnTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes) :
+	DbRelation(table_name, column_names, column_attributes), directory(table_name) {
+	for (auto const& column_name : this->column_names)
+		this->column_files.push_back(new HeapFile(table_name + "." + column_name));
+}
+
+ColumnTable::~ColumnTable() {
+	for (auto const& file : this->column_files)
+		delete file;
+}
+
+void ColumnTable::create() {
+	this->directory.create();
+	for (uint i = 0; i < this->column_files.size(); i++) {
+		this->column_files[i]->create();
+		SlottedPage* block = this->column_files[i]->get(1);
+		init_column_block(i, block);
+		delete block;
+	}
+}
+
+void ColumnTable::create_if_not_exists() {
+	try {
+		open();
+	}
+	catch (DbException& e) {
+		create();
+	}
+}
+
+void ColumnTable::drop() {
+	this->directory.drop();
+	for (auto const& file : this->column_files)
+		file->drop();
+}
+
+void ColumnTable::discard() {
+	this->directory.discard();
+	for (auto const& file : this->column_files)
+		file->discard();
+}
+
+void ColumnTable::open() {
+	this->directory.open();
+	for (auto const& file : this->column_files)
+		file->open();
+}
+
+void ColumnTable::close() {
+	this->directory.close();
+	for (auto const& file : this->column_files)
+		file->close();
+}
+
+void ColumnTable::set_block_size(uint block_size) {
+	this->directory.set_block_size(block_size);
+	for (auto const& file : this->column_files)
+		file->set_block_size(block_size);
+}
+
+Handle ColumnTable::insert(const ValueDict* row) {
+	OperatorTimer timer(Stats::INSERT);
+	if (Stats::tracing)
+		Stats::trace("insert into " + table_name);
+	open();
+	ValueDict* full_row = validate(row);
+	Handle handle = append(full_row);
+	delete full_row;
+	return handle;
+}
+
+void ColumnTable::update(const Handle handle, const ValueDict* new_values) {
+	throw DbRelationError("Not implemented");
+}
+
+// Only the row directory changes; the row's values stay behind in the column vectors.
+void ColumnTable::del(const Handle handle) {
+	OperatorTimer timer(Stats::DELETE);
+	if (Stats::tracing)
+		Stats::trace("delete from " + table_name);
+	open();
+	SlottedPage* block = this->directory.get(handle.first);
+	block->del(handle.second);
+	this->directory.put(block);
+	delete block;
+}
+
+Handles* ColumnTable::select() {
+	return select((const Predicates*)nullptr);
+}
+
+Handles* ColumnTable::select(const ValueDict* where) {
+	if (where == nullptr)
+		return select((const Predicates*)nullptr);
+	Predicates predicates;
+	for (auto const& column : *where)
+		predicates.push_back(Predicate(column.first, Predicate::EQ, column.second));
+	return select(&predicates);
+}
+
+Handles* ColumnTable::select(const Predicates* where) {
+	OperatorTimer timer(Stats::SELECT);
+	open();
+
+	// columns the where-clause looks at, INT ones first so their min/max can rule out a row group early
+	vector<pair<uint, const Predicate*>> conditions;
+	if (where != nullptr) {
+		for (auto const& predicate : *where)
+			if (this->column_attributes[column_index(predicate.column_name)].get_data_type() == ColumnAttribute::INT)
+				conditions.push_back(make_pair(column_index(predicate.column_name), &predicate));
+		for (auto const& predicate : *where)
+			if (this->column_attributes[column_index(predicate.column_name)].get_data_type() != ColumnAttribute::INT)
+				conditions.push_back(make_pair(column_index(predicate.column_name), &predicate));
+	}
+
+	Handles* handles = new Handles();
+	BlockIDs* block_ids = this->directory.block_ids();
+	uint skipped = 0;
+	PredicateKernels::Selection selected, selection;
+	for (auto const& block_id : *block_ids) {
+		bool skip = false;
+		for (uint c = 0; c < conditions.size() && !skip; c++) {
+			uint i = conditions[c].first;
+			SlottedPage* block = this->column_files[i]->get(block_id);
+			Dbt* column_vector = block->get(VECTOR_ID);
+			skip = !ColumnEncoding::match(column_vector, this->column_attributes[i].get_data_type(),
+										  conditions[c].second->op, conditions[c].second->value,
+										  c == 0 ? selected : selection);
+			if (!skip && c > 0) {
+				bool any = false;
+				for (uint w = 0; w < selected.size(); w++)
+					any |= (selected[w] &= selection[w]) != 0;
+				skip = !any;
+			}
+			delete column_vector;
+			delete block;
+		}
+		if (skip) {
+			Stats::count(Stats::PAGES_SKIPPED);
+			skipped++;
+			continue;
+		}
+
+		SlottedPage* block = this->directory.get(block_id);
+		RecordIDs* record_ids = block->ids();
+		for (auto const& record_id : *record_ids) {
+			uint i = record_id - 1;
+			if (conditions.empty() || (selected[i / 64] >> (i % 64)) & 1)
+				handles->push_back(Handle(block_id, record_id));
+			else
+				Stats::count(Stats::ROWS_FILTERED);
+		}
+		Stats::count(Stats::ROWS_SCANNED, record_ids->size());
+		delete record_ids;
+		delete block;
+	}
+	if (Stats::tracing)
+		Stats::trace("column scan " + table_name + (where == nullptr || where->empty() ? "" : " where " + Predicate::to_string(*where))
+					 + " (" + to_string(block_ids->size() - skipped) + " of " + to_string(block_ids->size())
+					 + " row groups past min/max, " + PredicateKernels::implementation() + ")");
+	delete block_ids;
+	return handles;
+}
+
+ValueDict* ColumnTable::project(Handle handle) {
+	return project(handle, &this->column_names);
+}
+
+// Only reads the blocks of the requested columns.
+ValueDict* ColumnTable::project(Handle handle, const ColumnNames* column_names) {
+	OperatorTimer timer(Stats::PROJECT);
+	if (Stats::tracing)
+		Stats::trace("project " + table_name);
+	open();
+	if (column_names->empty())
+		column_names = &this->column_names;
+	ValueDict* row = new ValueDict();
+	for (auto const& column_name : *column_names) {
+		uint i;
+		try {
+			i = column_index(column_name);
+		}
+		catch (DbRelationError& e) {
+			delete row;
+			throw;
+		}
+		SlottedPage* block = this->column_files[i]->get(handle.first);
+		Dbt* column_vector = block->get(VECTOR_ID);
+		(*row)[column_name] = ColumnEncoding::value_at(column_vector, this->column_attributes[i].get_data_type(), handle.second);
+		delete column_vector;
+		delete block;
+	}
+	return row;
+}
+
+
+/*
+	PROTECTED
+*/
+
+ValueDict* ColumnTable::validate(const ValueDict* row) {
+	ValueDict* full_row = new ValueDict();
+	for (uint i = 0; i < this->column_names.size(); i++) {
+		const Identifier& column_name = this->column_names[i];
+		ValueDict::const_iterator column = row->find(column_name);
+		if (column == row->end()) {
+			delete full_row;
+			throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
+		}
+		if (column->second.s.length() > this->column_files[i]->get_block_size()) {
+			delete full_row;
+			throw DbRelationError("value for column '" + column_name + "' does not fit in a block");
+		}
+		(*full_row)[column_name] = column->second;
+	}
+	return full_row;
+}
+
+// Add the row to the last row group, or to a new one if it doesn't fit there. Nothing is written
+// back unless the row fits in the directory block and every column block.
+Handle ColumnTable::append(const ValueDict* row) {
+	char marker = 0;
+	Dbt live(&marker, sizeof(marker));
+	for (bool new_group = false; ; new_group = true) {
+		BlockID block_id = this->directory.get_last_block_id();
+		SlottedPage* dir_block = this->directory.get(block_id);
+		vector<SlottedPage*> blocks;
+		RecordID record_id = 0;
+		bool fits = true;
+		try {
+			record_id = dir_block->add(&live);
+			for (uint i = 0; i < this->column_files.size(); i++) {
+				SlottedPage* block = this->column_files[i]->get(block_id);
+				blocks.push_back(block);
+				Dbt* column_vector = block->get(VECTOR_ID);
+				Dbt* new_column_vector = ColumnEncoding::append(column_vector, this->column_attributes[i].get_data_type(),
+																row->at(this->column_names[i]));
+				delete column_vector;
+				try {
+					block->put(VECTOR_ID, *new_column_vector);
+				}
+				catch (DbBlockNoRoomError& e) {
+					delete[](char*)new_column_vector->get_data();
+					delete new_column_vector;
+					throw;
+				}
+				delete[](char*)new_column_vector->get_data();
+				delete new_column_vector;
+			}
+		}
+		catch (DbBlockNoRoomError& e) {
+			fits = false;
+		}
+		if (fits) {
+			this->directory.put(dir_block);
+			for (uint i = 0; i < blocks.size(); i++)
+				this->column_files[i]->put(blocks[i]);
+		}
+		delete dir_block;
+		for (auto const& block : blocks)
+			delete block;
+		if (fits)
+			return Handle(block_id, record_id);
+		if (new_group)
+			throw DbRelationError("row does not fit in an empty row group");
+		new_row_group();
+	}
+}
+
+uint ColumnTable::column_index(const Identifier& column_name) {
+	for (uint i = 0; i < this->column_names.size(); i++)
+		if (this->column_names[i] == column_name)
+			return i;
+	throw DbRelationError("table does not have column named '" + column_name + "'");
+}
+
+// Seal the last row group by compressing its column vectors, then start a new block in the directory
+// and in every column file.
+void ColumnTable::new_row_group() {
+	BlockID block_id = this->directory.get_last_block_id();
+	for (uint i = 0; i < this->column_files.size(); i++) {
+		SlottedPage* block = this->column_files[i]->get(block_id);
+		Dbt* column_vector = block->get(VECTOR_ID);
+		Dbt* compressed = ColumnEncoding::compress(column_vector, this->column_attributes[i].get_data_type());
+		block->put(VECTOR_ID, *compressed);  // never bigger than the PLAIN vector it replaces
+		this->column_files[i]->put(block);
+		delete[](char*)compressed->get_data();
+		delete compressed;
+		delete column_vector;
+		delete block;
+	}
+	delete this->directory.get_new();
+	for (uint i = 0; i < this->column_files.size(); i++) {
+		SlottedPage* block = this->column_files[i]->get_new();
+		init_column_block(i, block);
+		delete block;
+	}
+}
+
+// Put an empty column vector into a new column block.
+void ColumnTable::init_column_block(uint column, SlottedPage* block) {
+	Dbt* column_vector = ColumnEncoding::empty(this->column_attributes[column].get_data_type());
+	block->add(column_vector);
+	this->column_files[column]->put(block);
+	delete[](char*)column_vector->get_data();
+	delete column_vector;
+}
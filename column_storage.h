@@ -0,0 +1,77 @@
+/**
+ * @file column_storage.h - Implementation of storage_engine with one file per column.
+ * ColumnTable: DbRelation
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "storage_engine.h"
+#include "heap_storage.h"
+#include "column_encoding.h"
+
+/**
+ * @class ColumnTable - Columnar storage engine (implementation of DbRelation)
+ *
+ *      Each column is stored in its own HeapFile, named <table>.<column>. Rows are grouped into
+        row groups: block k of every column file holds the values for the rows of row group k.
+        Each column block has a single record (record id 1), the column vector (see ColumnEncoding
+        for its format).
+
+        Which rows of a row group are live is kept in the row directory, a HeapFile named after the
+        table with one tiny record per row in block k. The row's handle is its (block, record) in the
+        row directory, and its values are at index record_id - 1 of each column vector (deleting a
+        row only removes it from the directory). A row group is closed once the directory block or
+        any column block runs out of room, and its column vectors are then compressed.
+
+        Queries only read the blocks of the columns they mention, and select() checks an INT
+        column's min/max before looking at anything else in a row group, so whole row groups whose
+        range can't match are skipped. Predicates are evaluated a whole column vector at a time
+        with the PredicateKernels, and their selection bitmaps are AND'ed together.
+ */
+class ColumnTable : public DbRelation {
+public:
+	ColumnTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes);
+	virtual ~ColumnTable();
+	ColumnTable(const ColumnTable& other) = delete;
+	ColumnTable(ColumnTable&& temp) = delete;
+	ColumnTable& operator=(const ColumnTable& other) = delete;
+	ColumnTable& operator=(ColumnTable&& temp) = delete;
+
+	virtual void create();
+	virtual void create_if_not_exists();
+	virtual void drop();
+	virtual void discard();
+
+	virtual void open();
+	virtual void close();
+
+	virtual void set_block_size(uint block_size);
+
+	virtual Handle insert(const ValueDict* row);
+	virtual void update(const Handle handle, const ValueDict* new_values);
+	virtual void del(const Handle handle);
+
+	virtual Handles* select();
+	virtual Handles* select(const ValueDict* where);
+	virtual Handles* select(const Predicates* where);
+	virtual ValueDict* project(Handle handle);
+	virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
+	using DbRelation::project;
+
+	/**
+	 * Record id of the column vector within each column block.
+	 */
+	static const RecordID VECTOR_ID = 1;
+
+protected:
+	HeapFile directory;
+	std::vector<HeapFile*> column_files;  // parallel to column_names
+
+	virtual ValueDict* validate(const ValueDict* row);
+	virtual Handle append(const ValueDict* row);
+	virtual uint column_index(const Identifier& column_name);
+	virtual void new_row_group();
+	virtual void init_column_block(uint column, SlottedPage* block);
+};
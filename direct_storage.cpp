@@ -0,0 +1,357 @@
+/**
+ * @file direct_storage.cpp - implementation of DirectPage and DirectFile
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "direct_storage.h"
+#include "memory_pool.h"
+#include "metrics.h"
+#include "stats.h"
+#include "trash.h"
+
+using namespace std;
+
+static const char MAGIC[] = "DIRECT01";
+
+DirectPage::~DirectPage() {
+	MemoryPool::release(this->block.get_data(), this->block.get_size());
+}
+
+
+/*
+	PUBLIC
+*/
+
+DirectFile::~DirectFile() {
+	close();
+}
+
+void DirectFile::create(void) {
+	file_open(O_CREAT | O_EXCL);
+	char* header = new_buffer(HEADER_SZ);
+	memset(header, 0, HEADER_SZ);
+	memcpy(header, MAGIC, sizeof(MAGIC) - 1);
+	*(u_int32_t*)(header + sizeof(MAGIC) - 1) = this->block_size;
+	write(header, HEADER_SZ, 0);
+	MemoryPool::release(header, HEADER_SZ);
+	this->last = 0;
+	delete get_new();
+}
+
+void DirectFile::drop(void) {
+	close();
+	if (unlink(path().c_str()) != 0)
+		throw DbException(("can't remove " + path()).c_str(), errno);
+}
+
+void DirectFile::discard(void) {
+	close();
+	Trash::discard(this->name + ".dat", Trash::PLAIN);
+}
+
+void DirectFile::open(void) {
+	if (!this->closed)
+		return;
+	file_open(0);
+	char* header = new_buffer(HEADER_SZ);
+	if (pread(this->fd, header, HEADER_SZ, 0) != HEADER_SZ || memcmp(header, MAGIC, sizeof(MAGIC) - 1) != 0) {
+		MemoryPool::release(header, HEADER_SZ);
+		close();
+		throw DbException(("not a direct storage file: " + path()).c_str(), EINVAL);
+	}
+	this->block_size = *(u_int32_t*)(header + sizeof(MAGIC) - 1);
+	MemoryPool::release(header, HEADER_SZ);
+
+	struct stat st;
+	fstat(this->fd, &st);
+	this->last = (st.st_size - HEADER_SZ) / this->block_size;
+
+	if (this->mode == MMAP) {
+		void* map = mmap(nullptr, MMAP_RESERVE, PROT_READ, MAP_SHARED | MAP_NORESERVE, this->fd, 0);
+		this->map = map == MAP_FAILED ? nullptr : (char*)map;  // without it, we just read like BUFFERED
+	}
+}
+
+void DirectFile::close(void) {
+	{
+		lock_guard<mutex> guard(this->prefetch_mutex);
+		if (this->reader != nullptr) {
+			this->reader->drain();
+			delete this->reader;
+		}
+		this->reader = nullptr;
+		for (auto const& buffer : this->prefetched)
+			MemoryPool::release(buffer.second, this->block_size);
+		this->prefetched.clear();
+	}
+	if (this->map != nullptr)
+		munmap(this->map, MMAP_RESERVE);
+	this->map = nullptr;
+	if (this->fd >= 0)
+		::close(this->fd);
+	this->fd = -1;
+	this->closed = true;
+}
+
+// Append a new, empty block to the file (get() says there's no such block until it's written).
+SlottedPage* DirectFile::get_new(void) {
+	char* buffer = new_buffer(this->block_size);
+	memset(buffer, 0, this->block_size);
+	Dbt data(buffer, this->block_size);
+	lock_guard<mutex> extending(this->extend_mutex);
+	DirectPage* page = new DirectPage(data, this->last + 1, true);
+	try {
+		put(page);
+	}
+	catch (DbException& e) {
+		delete page;
+		throw;
+	}
+	this->last = page->get_block_id();
+	return page;
+}
+
+SlottedPage* DirectFile::get(BlockID block_id) {
+	if (block_id == 0 || block_id > this->last)
+		throw DbRelationError("no block " + to_string(block_id) + " in " + path());
+	Stats::count(Stats::PAGES_READ);
+	if (this->map != nullptr && (u_int64_t)offset(block_id) + this->block_size <= MMAP_RESERVE) {
+		Dbt data(this->map + offset(block_id), this->block_size);
+		return new SlottedPage(data, block_id);
+	}
+	DirectPage* page = take_prefetched(block_id);
+	return page != nullptr ? page : read_block(block_id);
+}
+
+// Pages from the mapping are read-only, so hand out a copy that can be changed and put() back.
+SlottedPage* DirectFile::get_for_update(BlockID block_id) {
+	if (block_id == 0 || block_id > this->last)
+		throw DbRelationError("no block " + to_string(block_id) + " in " + path());
+	Stats::count(Stats::PAGES_READ);
+	DirectPage* page = take_prefetched(block_id);
+	return page != nullptr ? page : read_block(block_id);
+}
+
+// Only pages from the mapping change under whoever has them, so only they need copying.
+SlottedPage* DirectFile::get_copy(BlockID block_id) {
+	if (this->map == nullptr || (u_int64_t)offset(block_id) + this->block_size > MMAP_RESERVE)
+		return get(block_id);
+	if (block_id == 0 || block_id > this->last)
+		throw DbRelationError("no block " + to_string(block_id) + " in " + path());
+	Stats::count(Stats::PAGES_READ);
+	char* buffer = new_buffer(this->block_size);
+	memcpy(buffer, this->map + offset(block_id), this->block_size);
+	Dbt data(buffer, this->block_size);
+	return new DirectPage(data, block_id);
+}
+
+void DirectFile::put(DbBlock* block) {
+	delete take_prefetched(block->get_block_id());  // about to be out of date
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	write(block->get_data(), this->block_size, offset(block->get_block_id()));
+	Metrics::page_write(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+	Stats::count(Stats::PAGES_WRITTEN);
+}
+
+void DirectFile::prefetch(BlockID block_id) {
+	if (this->closed || block_id == 0 || block_id > this->last)
+		return;
+	if (this->map != nullptr) {
+		if ((u_int64_t)offset(block_id) + this->block_size <= MMAP_RESERVE) {
+			madvise(this->map + offset(block_id), this->block_size, MADV_WILLNEED);
+			Stats::count(Stats::PAGES_PREFETCHED);
+		}
+		return;
+	}
+	lock_guard<mutex> guard(this->prefetch_mutex);
+	if (this->reader == nullptr || this->prefetched.size() >= MAX_PREFETCH
+		|| this->prefetched.find(block_id) != this->prefetched.end())
+		return;
+	char* buffer = new_buffer(this->block_size);
+	if (this->reader->submit(block_id, buffer, this->block_size, offset(block_id))) {
+		this->prefetched[block_id] = buffer;
+		Stats::count(Stats::PAGES_PREFETCHED);
+	}
+	else
+		MemoryPool::release(buffer, this->block_size);
+}
+
+
+/*
+	PROTECTED
+*/
+
+void DirectFile::file_open(int flags) {
+	if (!this->closed)
+		return;
+	flags |= O_RDWR;
+	this->fd = -1;
+	if (this->mode == DIRECT) {
+		this->fd = ::open(path().c_str(), flags | O_DIRECT, 0644);
+		if (this->fd < 0 && errno == EINVAL)
+			this->fd = ::open(path().c_str(), flags, 0644);  // file system doesn't do O_DIRECT
+	}
+	else {
+		this->fd = ::open(path().c_str(), flags, 0644);
+	}
+	if (this->fd < 0)
+		throw DbException(("can't open " + path()).c_str(), errno);
+	this->closed = false;
+	if (this->mode != MMAP)
+		this->reader = AsyncReader::create(this->fd, MAX_PREFETCH);
+}
+
+// Put the file in the same directory Berkeley DB keeps its files.
+string DirectFile::path() {
+	const char* home;
+	_DB_ENV->get_home(&home);
+	return string(home) + "/" + this->name + ".dat";
+}
+
+off_t DirectFile::offset(BlockID block_id) {
+	return HEADER_SZ + (off_t)(block_id - 1) * this->block_size;
+}
+
+// Memory aligned well enough for O_DIRECT (caller gives it back with MemoryPool::release).
+char* DirectFile::new_buffer(uint size) {
+	return (char*)MemoryPool::allocate(size);
+}
+
+DirectPage* DirectFile::read_block(BlockID block_id) {
+	char* buffer = new_buffer(this->block_size);
+	if (pread(this->fd, buffer, this->block_size, offset(block_id)) != (ssize_t)this->block_size) {
+		MemoryPool::release(buffer, this->block_size);
+		throw DbException(("can't read block " + to_string(block_id) + " of " + path()).c_str(), errno);
+	}
+	Dbt data(buffer, this->block_size);
+	return new DirectPage(data, block_id);
+}
+
+// The block, if it was prefetched and the read worked (otherwise nullptr and the caller reads it).
+// The wait is under prefetch_mutex too: an AsyncReader is used by one thread at a time.
+DirectPage* DirectFile::take_prefetched(BlockID block_id) {
+	lock_guard<mutex> guard(this->prefetch_mutex);
+	auto prefetched = this->prefetched.find(block_id);
+	if (prefetched == this->prefetched.end())
+		return nullptr;
+	char* buffer = prefetched->second;
+	this->prefetched.erase(prefetched);
+	if (this->reader->wait(block_id) != (ssize_t)this->block_size) {
+		MemoryPool::release(buffer, this->block_size);
+		return nullptr;
+	}
+	Dbt data(buffer, this->block_size);
+	return new DirectPage(data, block_id);
+}
+
+void DirectFile::write(const void* data, uint size, off_t offset) {
+	if (pwrite(this->fd, data, size, offset) != (ssize_t)size)
+		throw DbException(("can't write " + path()).c_str(), errno);
+}
+
+
+/*
+	TESTS
+*/
+
+// What block_id holds after its round'th write (long enough to vary the record sizes a bit).
+static string test_contents(BlockID block_id, int round) {
+	return "block " + to_string(block_id) + " round " + to_string(round) + " "
+		+ string(block_id * 37 % 900, (char)('a' + block_id % 26));
+}
+
+// Check the page's only record and delete the page.
+static bool test_holds(SlottedPage* page, BlockID block_id, int round) {
+	Dbt* data = page->get(1);
+	bool ok = data != nullptr && string((char*)data->get_data(), data->get_size()) == test_contents(block_id, round);
+	delete data;
+	delete page;
+	return ok;
+}
+
+// Read every block back with get, get_copy, and get_for_update, prefetching read_ahead blocks ahead (0 for none).
+static bool test_reads_back(DirectFile& file, const vector<int>& rounds, uint read_ahead) {
+	BlockID last = file.get_last_block_id();
+	if (last != rounds.size() - 1)
+		return false;
+	for (BlockID block_id = 1; block_id <= last; block_id++) {
+		for (BlockID ahead = block_id; ahead <= block_id + read_ahead && ahead <= last; ahead++)
+			file.prefetch(ahead);
+		if (!test_holds(file.get(block_id), block_id, rounds[block_id])
+			|| !test_holds(file.get_copy(block_id), block_id, rounds[block_id])
+			|| !test_holds(file.get_for_update(block_id), block_id, rounds[block_id]))
+			return false;
+	}
+	return true;
+}
+
+// Overwrite block_id with its next round while a prefetch of it is (probably) still under way.
+static void test_rewrite(DirectFile& file, BlockID block_id, vector<int>& rounds) {
+	SlottedPage* page = file.get_for_update(block_id);
+	file.prefetch(block_id);
+	string contents = test_contents(block_id, ++rounds[block_id]);
+	Dbt data((void*)contents.c_str(), contents.size());
+	page->put(1, data);
+	file.put(page);
+	delete page;
+}
+
+bool test_direct_storage() {
+	const BlockID BLOCKS = 3 * DirectFile::MAX_PREFETCH;
+	const DirectFile::Mode modes[] = {DirectFile::BUFFERED, DirectFile::DIRECT, DirectFile::MMAP};
+	// prefetch with a thread pool even where io_uring is there, so both AsyncReaders get a turn
+	auto use_thread_pool = [](DirectFile& file) {
+		if (file.reader == nullptr)
+			return;
+		delete file.reader;
+		file.reader = new ThreadPoolReader(file.fd, 4);
+	};
+	for (DirectFile::Mode mode : modes) {
+		for (bool thread_pool : {false, true}) {
+			vector<int> rounds(BLOCKS + 1, 0);
+			{
+				DirectFile file("_test_direct", mode);
+				file.create();
+				if (thread_pool)
+					use_thread_pool(file);
+				for (BlockID block_id = 1; block_id <= BLOCKS; block_id++) {
+					SlottedPage* page = block_id == 1 ? file.get_for_update(1) : file.get_new();
+					string contents = test_contents(block_id, 0);
+					Dbt data((void*)contents.c_str(), contents.size());
+					page->add(&data);
+					file.put(page);
+					delete page;
+				}
+				if (!test_reads_back(file, rounds, 0) || !test_reads_back(file, rounds, DirectFile::MAX_PREFETCH / 2))
+					return false;
+
+				// a put of a block being prefetched has to win over the prefetch
+				for (BlockID block_id = 1; block_id <= BLOCKS; block_id += 3)
+					test_rewrite(file, block_id, rounds);
+				if (!test_reads_back(file, rounds, DirectFile::MAX_PREFETCH / 2))
+					return false;
+				file.close();
+			}
+
+			// and everything is still there for a fresh DirectFile, prefetching more than it ever holds at once
+			DirectFile file("_test_direct", mode);
+			file.open();
+			if (thread_pool)
+				use_thread_pool(file);
+			if (file.get_block_size() != DbBlock::BLOCK_SZ
+				|| !test_reads_back(file, rounds, 0) || !test_reads_back(file, rounds, 2 * DirectFile::MAX_PREFETCH))
+				return false;
+			for (BlockID block_id = 2; block_id <= BLOCKS; block_id += 5)
+				test_rewrite(file, block_id, rounds);
+			if (!test_reads_back(file, rounds, DirectFile::MAX_PREFETCH))
+				return false;
+			file.drop();
+		}
+	}
+	return true;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file direct_storage.h - heap files kept in flat files of our own instead of Berkeley DB
+ * DirectPage: SlottedPage
+ * DirectFile: HeapFile
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "heap_storage.h"
+#include "async_io.h"
+
+/**
+ * @class DirectPage - a SlottedPage that owns the (aligned) memory it manages, which it gives back
+ * to MemoryPool when it is deleted
+ */
+class DirectPage : public SlottedPage {
+public:
+	DirectPage(Dbt &block, BlockID block_id, bool is_new=false) : SlottedPage(block, block_id, is_new) {}
+	virtual ~DirectPage();
+	DirectPage(const DirectPage& other) = delete;
+	DirectPage(DirectPage&& temp) = delete;
+	DirectPage& operator=(const DirectPage& other) = delete;
+	DirectPage& operator=(DirectPage&& temp) = delete;
+};
+
+/**
+ * @class DirectFile - heap file stored directly in a flat file (implementation of DbFile)
+ *
+ *      Same blocks as HeapFile, but read and written with pread/pwrite at fixed offsets in
+        <env home>/<name>.dat instead of going through a Berkeley DB RecNo file:
+            Bytes 0x0000 - 0x0007: "DIRECT01"
+            Bytes 0x0008 - 0x000B: block size
+            Bytes 0x1000 - ...:    block 1, then block 2, etc.
+        The header takes up a whole HEADER_SZ so every block starts on a 4kB boundary.
+
+        Modes:
+            BUFFERED: each get() reads the block into its own buffer (returned as a DirectPage)
+            DIRECT:   same, but the file is opened O_DIRECT so reads bypass the OS page cache
+                      (falls back to BUFFERED on file systems that don't allow O_DIRECT)
+            MMAP:     the file is mapped read-only and get() hands out pages that point straight
+                      into the mapping, so get() copies nothing; get_for_update() still reads a copy,
+                      get_copy() copies the block out of the mapping, and put() writes with pwrite
+                      (which the shared mapping then sees)
+
+        prefetch() starts reading a block in the background (with an AsyncReader, or madvise in MMAP
+        mode) and the get() for it picks up the result, so a scan's reads overlap its processing.
+        Threads sharing the file share its prefetched blocks, under prefetch_mutex.
+ */
+class DirectFile : public HeapFile {
+public:
+	enum Mode {
+		BUFFERED,
+		DIRECT,
+		MMAP
+	};
+
+	DirectFile(std::string name, Mode mode) : HeapFile(name), mode(mode), fd(-1), map(nullptr), reader(nullptr) {}
+	virtual ~DirectFile();
+	DirectFile(const DirectFile& other) = delete;
+	DirectFile(DirectFile&& temp) = delete;
+	DirectFile& operator=(const DirectFile& other) = delete;
+	DirectFile& operator=(DirectFile&& temp) = delete;
+
+	virtual void create(void);
+	virtual void drop(void);
+	virtual void discard(void);
+	virtual void open(void);
+	virtual void close(void);
+	virtual SlottedPage* get_new(void);
+	virtual SlottedPage* get(BlockID block_id);
+	virtual SlottedPage* get_for_update(BlockID block_id);
+	virtual SlottedPage* get_copy(BlockID block_id);
+	virtual void put(DbBlock* block);
+	virtual void prefetch(BlockID block_id);
+
+	/**
+	 * bytes at the front of the file before block 1
+	 */
+	static const uint HEADER_SZ = 4096;
+
+	/**
+	 * address space set aside for the mapping in MMAP mode (blocks past it are read with pread)
+	 */
+	static const u_int64_t MMAP_RESERVE = 1ULL << 36;
+
+	/**
+	 * most blocks read ahead at once
+	 */
+	static const uint MAX_PREFETCH = 16;
+
+	friend bool test_direct_storage();
+
+protected:
+	Mode mode;
+	int fd;
+	char* map;
+	AsyncReader* reader;
+	std::map<BlockID, char*> prefetched;  // buffers being read into by reader
+	std::mutex prefetch_mutex;            // for reader and prefetched
+
+	virtual void file_open(int flags);
+	virtual std::string path();
+	virtual off_t offset(BlockID block_id);
+	virtual char* new_buffer(uint size);
+	virtual DirectPage* read_block(BlockID block_id);
+	virtual DirectPage* take_prefetched(BlockID block_id);
+	virtual void write(const void* data, uint size, off_t offset);
+};
+
+bool test_direct_storage();
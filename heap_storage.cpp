@@ -1,7 +1,16 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <cstdint>
 #include <cstring>
+#include <algorithm>
+#include <map>
+#include <thread>
 #include "heap_storage.h";
+#include "bitmap_scan.h"
+#include "memory_pool.h"
+#include "metrics.h"
+#include "stats.h"
+#include "trash.h"
 
 using namespace std;
 
@@ -18,7 +27,7 @@ typedef u_int16_t u16;
 SlottedPage::SlottedPage(Dbt &block, BlockID block_id, bool is_new) : DbBlock(block, block_id, is_new) {
 	if (is_new) {
 		this->num_records = 0;
-		this->end_free = DbBlock::BLOCK_SZ - 1;
+		this->end_free = get_block_size() - 1;
 		put_header();
 	}
 	else {
@@ -37,6 +46,7 @@ RecordID SlottedPage::add(const Dbt* data) throw(DbBlockNoRoomError) {
 	put_header();
 	put_header(id, size, loc);
 	memcpy(this->address(loc), data->get_data(), size);
+	Stats::count(Stats::RECORDS_WRITTEN);
 	return id;
 }
 
@@ -45,6 +55,7 @@ Dbt* SlottedPage::get(RecordID record_id) {
 	get_header(size, loc, record_id);
 	if (loc == NULL)
 		return NULL;
+	Stats::count(Stats::RECORDS_READ);
 	Dbt* temp = new Dbt(this->address(loc), size);
 	return temp;
 }
@@ -62,17 +73,26 @@ void SlottedPage::put(RecordID record_id, const Dbt &data) throw(DbBlockNoRoomEr
 	}
 	else {
 		memcpy(this->address(loc), data.get_data(), new_size);
-		slide(loc + new_size, loc + size);
+		slide((u_int32_t)loc + new_size, (u_int32_t)loc + size);
 	}
 	get_header(size, loc, record_id);
 	put_header(record_id, new_size, loc);
+	Stats::count(Stats::RECORDS_WRITTEN);
 }
 
 void SlottedPage::del(RecordID record_id) {
 	u16 size, loc;
 	get_header(size, loc, record_id);
 	put_header(record_id, 0, 0);
-	slide(loc, loc + size);
+	slide(loc, (u_int32_t)loc + size);
+}
+
+void* SlottedPage::operator new(size_t size) {
+	return MemoryPool::allocate(size);
+}
+
+void SlottedPage::operator delete(void* p, size_t size) {
+	MemoryPool::release(p, size);
 }
 
 RecordIDs* SlottedPage::ids(void) {
@@ -106,46 +126,53 @@ void SlottedPage::put_header(RecordID id, u16 size, u16 loc) {
 	put_n(4 * id + 2, loc);
 }
 
+// Is there room for a record of the given size, along with a new header for it?
 bool SlottedPage::has_room(u_int16_t size) {
-	u16 free = this->end_free - ((this->num_records + 1) * 4);
+	int free = this->end_free + 1 - (this->num_records + 2) * 4;  // signed, so a full block doesn't wrap around
 	return (size <= free);
 }
 
-void SlottedPage::slide(u_int16_t start, u_int16_t end) {
-	u16 shift = end - start;
+// Move the data between end_free and start over by (end - start) bytes (toward the end of the block
+// if positive, toward the headers if negative), and fix up the locations of the records we moved.
+// Offsets are 32 bits here: in a 64kB block, the first record added ends at 65536.
+void SlottedPage::slide(u_int32_t start, u_int32_t end) {
+	int shift = (int)end - (int)start;
 
 	if (shift == 0)
 		return;
 
-	memcpy(this->address(end_free + 1), this->address(end_free + 1 + shift), shift);
+	uint free_end = this->end_free + 1;  // 64kB blocks: an empty block's free space ends past the last u16
+	memmove(this->address(free_end + shift), this->address(free_end), start - free_end);
+	Stats::count(Stats::BYTES_SLID, start - free_end);
 
 	u16 size, loc;
 	RecordIDs* recID = ids();
 	for (unsigned int i = 0; i < recID->size(); i++) {
-		RecordID id = recID->at(id);
+		RecordID id = recID->at(i);
 		get_header(size, loc, id);
 		if (loc <= start) {
 			loc += shift;
 			put_header(id, size, loc);
 		}
 	}
+	delete recID;
 
 	end_free += shift;
 	put_header();
 }
 
 // Get 2-byte integer at given offset in block.
-u16 SlottedPage::get_n(u16 offset) {
+u16 SlottedPage::get_n(u_int32_t offset) {
 	return *(u16*)this->address(offset);
 }
 
 // Put a 2-byte integer at given offset in block.
-void SlottedPage::put_n(u16 offset, u16 n) {
+void SlottedPage::put_n(u_int32_t offset, u16 n) {
 	*(u16*)this->address(offset) = n;
 }
 
 // Make a void* pointer for a given offset into the data block.
-void* SlottedPage::address(u16 offset) {
+void* SlottedPage::address(u_int32_t offset) {
 	return (void*)((char*)this->block.get_data() + offset);
 }
 
@@ -176,6 +203,11 @@ void HeapFile::drop(void) {
 	db.remove(this->dbfilename.c_str(), nullptr, 0);
 }
 
+void HeapFile::discard(void) {
+	close();
+	Trash::discard(this->name + ".db", Trash::BERKELEY_DB);
+}
+
 void HeapFile::open(void) {
 	//Open physical file
 	db_open();
@@ -190,24 +222,33 @@ void HeapFile::close(void) {
 // Allocate a new block for the database file.
 // Returns the new empty DbBlock that is managing the records in this block and its block id.
 SlottedPage* HeapFile::get_new(void) {
-	char block[DbBlock::BLOCK_SZ];
-	std::memset(block, 0, sizeof(block));
-	Dbt data(block, sizeof(block));
-
-	int block_id = ++this->last;
-	Dbt key(&block_id, sizeof(block_id));
+	char* block = (char*)MemoryPool::allocate(this->block_size);
+	std::memset(block, 0, this->block_size);
+	Dbt data(block, this->block_size);
 
 	// write out an empty block and read it back in so Berkeley DB is managing the memory
-	SlottedPage* page = new SlottedPage(data, this->last, true);
+	unique_lock<mutex> extending(this->extend_mutex);
+	int block_id = this->last + 1;
+	Dbt key(&block_id, sizeof(block_id));
+	SlottedPage* page = new SlottedPage(data, block_id, true);
 	this->db.put(nullptr, &key, &data, 0); // write it out with initialization applied
+	this->last = block_id;  // only now that it can be read
+	extending.unlock();
+	delete page;
+	MemoryPool::release(block, this->block_size);
 	this->db.get(nullptr, &key, &data, 0);
-	return page;
+	Stats::count(Stats::PAGES_WRITTEN);
+	Stats::count(Stats::BDB_PUTS);
+	Stats::count(Stats::BDB_GETS);
+	return new SlottedPage(data, block_id);
 }
 
 SlottedPage* HeapFile::get(BlockID block_id) {
 	Dbt key(&block_id, sizeof(block_id));
 	Dbt data;
 	this->db.get(nullptr, &key, &data, 0);
+	Stats::count(Stats::PAGES_READ);
+	Stats::count(Stats::BDB_GETS);
 	return new SlottedPage(data, block_id, false);
 }
 
@@ -215,7 +256,18 @@ void HeapFile::put(DbBlock* block) {
 
 	int block_id = block->get_block_id();
 	Dbt key(&block_id, sizeof(block_id));
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
 	this->db.put(nullptr, &key, block->get_block(), 0);
+	Metrics::page_write(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+	Stats::count(Stats::PAGES_WRITTEN);
+	Stats::count(Stats::BDB_PUTS);
+}
+
+void HeapFile::set_block_size(uint block_size) {
+	if (!DbBlock::is_valid_block_size(block_size))
+		throw DbRelationError("page size must be a power of 2 from " + std::to_string(DbBlock::MIN_BLOCK_SZ)
+							  + " to " + std::to_string(DbBlock::MAX_BLOCK_SZ));
+	this->block_size = block_size;
 }
 
 BlockIDs* HeapFile::block_ids() {
@@ -240,9 +292,16 @@ uint32_t HeapFile::get_block_count() {
 void HeapFile::db_open(uint flags) {
 	if (!this->closed)
 		return;
-	this->db.set_re_len(DbBlock::BLOCK_SZ); // record length - will be ignored if file already exists
+	this->db.set_re_len(this->block_size); // record length - will be ignored if file already exists
+	// Each block is bigger than Berkeley DB keeps on a leaf page, so it is stored on a chain of overflow
+	// pages; pages as big as a block keep that chain to two pages instead of one per default-sized page.
+	if (flags & DB_CREATE)
+		this->db.set_pagesize(this->block_size);
 	this->dbfilename = this->name + ".db";
 	this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags, 0644);
+	u_int32_t re_len;
+	this->db.get_re_len(&re_len);
+	this->block_size = re_len;
 	this->last = flags ? 0 : get_block_count();
 	this->closed = false;
 }
@@ -258,11 +317,27 @@ void HeapFile::db_open(uint flags) {
 */
 
 HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes) :
-	DbRelation(table_name, column_names, column_attributes), file(table_name) {
+	DbRelation(table_name, column_names, column_attributes), file(new HeapFile(table_name)),
+	overflow(table_name + ".overflow"), zone_map(table_name, column_names, column_attributes),
+	codec(RecordCodec::create(column_names, column_attributes)), tails() {
+}
+
+HeapTable::HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+					 HeapFile* file) :
+	DbRelation(table_name, column_names, column_attributes), file(file),
+	overflow(table_name + ".overflow"), zone_map(table_name, column_names, column_attributes),
+	codec(RecordCodec::create(column_names, column_attributes)), tails() {
+}
+
+HeapTable::~HeapTable() {
+	delete codec;
+	delete file;
 }
 
 void HeapTable::create() {
-	file.create();
+	file->create();
+	zone_map.create();
+	std::fill(tails, tails + TAILS, 0);
 }
 
 void HeapTable::create_if_not_exists() {
@@ -275,18 +350,49 @@ void HeapTable::create_if_not_exists() {
 }
 
 void HeapTable::drop() {
-	file.drop();
+	file->drop();
+	zone_map.drop();
+	std::fill(tails, tails + TAILS, 0);
+	try {
+		overflow.drop();
+	}
+	catch (DbException& e) {
+		// never had any values big enough to need it
+	}
+}
+
+// The same as drop(), but the files are only renamed here.
+void HeapTable::discard() {
+	file->discard();
+	zone_map.discard();
+	std::fill(tails, tails + TAILS, 0);
+	try {
+		overflow.discard();
+	}
+	catch (DbException& e) {
+		// never had any values big enough to need it
+	}
 }
 
 void HeapTable::open() {
-	file.open();
+	file->open();
+	zone_map.open();
 }
 
 void HeapTable::close() {
-	file.close();
+	file->close();
+	zone_map.close();
+}
+
+void HeapTable::set_block_size(uint block_size) {
+	file->set_block_size(block_size);
+	overflow.set_block_size(block_size);
 }
 
 Handle HeapTable::insert(const ValueDict* row) {
+	OperatorTimer timer(Stats::INSERT);
+	if (Stats::tracing)
+		Stats::trace("insert into " + table_name);
 	open();
 	ValueDict* full_row = validate(row);
 	Handle handle = append(full_row);
@@ -294,34 +400,170 @@ Handle HeapTable::insert(const ValueDict* row) {
 	return handle;
 }
 
+// All the rows are checked before any goes in.
+Handles* HeapTable::insert(const ValueDicts* rows) {
+	OperatorTimer timer(Stats::INSERT);
+	if (Stats::tracing)
+		Stats::trace("insert into " + table_name + " (" + to_string(rows->size()) + " rows)");
+	open();
+	ValueDicts full_rows;
+	try {
+		for (auto const& row : *rows)
+			full_rows.push_back(validate(row));
+	}
+	catch (DbRelationError& e) {
+		for (auto const& row : full_rows)
+			delete row;
+		throw;
+	}
+	Handles* handles = append(&full_rows);
+	for (auto const& row : full_rows)
+		delete row;
+	return handles;
+}
+
 void HeapTable::update(const Handle handle, const ValueDict* new_values) {
 	throw DbRelationError("Not implemented");
 }
 
 void HeapTable::del(const Handle handle) {
+	OperatorTimer timer(Stats::DELETE);
+	if (Stats::tracing)
+		Stats::trace("delete from " + table_name);
 	open();
-	BlockID block_id = handle.first;
-	RecordID record_id = handle.second;
-	SlottedPage* block = this->file.get(block_id);
-	block->del(record_id);
-	this->file.put(block);
-	delete block;
+	del_records(handle.first, RecordIDs(1, handle.second));
+}
+
+// One get and put of each block, however many of its rows go.
+void HeapTable::del(const Handles* handles) {
+	OperatorTimer timer(Stats::DELETE);
+	map<BlockID, RecordIDs> blocks;
+	for (auto const& handle : *handles)
+		blocks[handle.first].push_back(handle.second);
+	if (Stats::tracing)
+		Stats::trace("delete from " + table_name + " (" + to_string(handles->size()) + " rows in "
+					 + to_string(blocks.size()) + " blocks)");
+	open();
+	for (auto const& block : blocks)
+		del_records(block.first, block.second);
 }
 
 Handles* HeapTable::select() {
-	return select(nullptr);
+	return select((const Predicates*)nullptr);
 }
 
 Handles* HeapTable::select(const ValueDict* where) {
+	if (where == nullptr)
+		return select((const Predicates*)nullptr);
+	Predicates predicates;
+	for (auto const& column : *where)
+		predicates.push_back(Predicate(column.first, Predicate::EQ, column.second));
+	return select(&predicates);
+}
+
+// Only reads the blocks whose zone map says they might have qualifying rows, and asks the file to
+// read ahead READ_AHEAD of those blocks while we work through the current one.
+Handles* HeapTable::select(const Predicates* where) {
+	OperatorTimer timer(Stats::SELECT);
 	Handles* handles = new Handles();
-	BlockIDs* block_ids = file.block_ids();
-	for (auto const& block_id : *block_ids) {
-		SlottedPage* block = file.get(block_id);
-		RecordIDs* record_ids = block->ids();
-		for (auto const& record_id : *record_ids)
-			handles->push_back(Handle(block_id, record_id));
-		delete record_ids;
-		delete block;
+	BlockIDs* block_ids = new BlockIDs();
+	BlockIDs* all_block_ids = file->block_ids();
+	for (auto const& block_id : *all_block_ids)
+		if (zone_map.may_match(block_id, where))
+			block_ids->push_back(block_id);
+	Stats::count(Stats::PAGES_SKIPPED, all_block_ids->size() - block_ids->size());
+	if (Stats::tracing)
+		Stats::trace("heap scan " + table_name + (where == nullptr || where->empty() ? "" : " where " + Predicate::to_string(*where))
+					 + " (" + to_string(block_ids->size()) + " of " + to_string(all_block_ids->size()) + " blocks past zone map)");
+	delete all_block_ids;
+
+	for (uint i = 0; i < READ_AHEAD && i < block_ids->size(); i++)
+		file->prefetch(block_ids->at(i));
+	for (uint i = 0; i < block_ids->size(); i++) {
+		if (i + READ_AHEAD < block_ids->size())
+			file->prefetch(block_ids->at(i + READ_AHEAD));
+		scan_block(block_ids->at(i), where, handles);
+	}
+	delete block_ids;
+	return handles;
+}
+
+// Reads blocks from position on until one has a qualifying row, or READ_AHEAD of them have been
+// read, so the caller gets its first rows after a few blocks however big the table is. Blocks
+// added by inserts while the scan is going are scanned too if it hasn't finished yet.
+bool HeapTable::select_more(const Predicates* where, u_int64_t& position, Handles* handles) {
+	OperatorTimer timer(Stats::SELECT);
+	BlockID last = file->get_last_block_id();
+	BlockID block_id = position == 0 ? 1 : (BlockID)position;
+	if (position == 0) {
+		if (Stats::tracing)
+			Stats::trace("heap scan " + table_name + (where == nullptr || where->empty() ? "" : " where " + Predicate::to_string(*where))
+						 + " (incremental, " + to_string(last) + " blocks)");
+		for (BlockID ahead = 1; ahead <= READ_AHEAD && ahead <= last; ahead++)
+			if (zone_map.may_match(ahead, where))
+				file->prefetch(ahead);
+	}
+	uint before = handles->size();
+	for (uint read = 0; block_id <= last && read < READ_AHEAD && handles->size() == before; block_id++) {
+		if (!zone_map.may_match(block_id, where)) {
+			Stats::count(Stats::PAGES_SKIPPED, 1);
+			continue;
+		}
+		if (block_id + READ_AHEAD <= last && zone_map.may_match(block_id + READ_AHEAD, where))
+			file->prefetch(block_id + READ_AHEAD);
+		scan_block(block_id, where, handles);
+		read++;
+	}
+	position = block_id;
+	return block_id <= last;
+}
+
+// A bitmap heap scan: each block with a candidate is read once, in block order, and only the
+// candidates still in it are checked.
+Handles* HeapTable::select(const HandleBitmap* candidates, const Predicates* where) {
+	OperatorTimer timer(Stats::SELECT);
+	Handles* handles = new Handles();
+	BlockIDs* block_ids = candidates->block_ids();
+	if (Stats::tracing)
+		Stats::trace("bitmap heap scan " + table_name + (where == nullptr || where->empty() ? "" : " where " + Predicate::to_string(*where))
+					 + " (" + to_string(candidates->size()) + " rows in " + to_string(block_ids->size()) + " blocks)");
+
+	for (uint i = 0; i < READ_AHEAD && i < block_ids->size(); i++)
+		file->prefetch(block_ids->at(i));
+	for (uint i = 0; i < block_ids->size(); i++) {
+		BlockID block_id = block_ids->at(i);
+		if (i + READ_AHEAD < block_ids->size())
+			file->prefetch(block_ids->at(i + READ_AHEAD));
+		RecordIDs* wanted = candidates->record_ids(block_id);
+		uint before = handles->size(), scanned = 0;
+		read_block(block_id, [&](SlottedPage* block) {
+			handles->resize(before);
+			scanned = 0;
+			RecordIDs* record_ids = block->ids();
+			try {
+				// both are in order, so one pass drops the candidates that have since been deleted
+				auto record_id = record_ids->begin();
+				for (auto const& candidate : *wanted) {
+					while (record_id != record_ids->end() && *record_id < candidate)
+						record_id++;
+					if (record_id == record_ids->end())
+						break;
+					if (*record_id != candidate)
+						continue;
+					scanned++;
+					if (selected(block, candidate, where))
+						handles->push_back(Handle(block_id, candidate));
+				}
+			}
+			catch (exception& e) {
+				delete record_ids;
+				throw;
+			}
+			delete record_ids;
+		});
+		Stats::count(Stats::ROWS_SCANNED, scanned);
+		Stats::count(Stats::ROWS_FILTERED, scanned - (handles->size() - before));
+		delete wanted;
 	}
 	delete block_ids;
 	return handles;
@@ -332,22 +574,26 @@ ValueDict* HeapTable::project(Handle handle) {
 }
 
 ValueDict* HeapTable::project(Handle handle, const ColumnNames* column_names) {
-	BlockID block_id = handle.first;
+	OperatorTimer timer(Stats::PROJECT);
+	if (Stats::tracing)
+		Stats::trace("project " + table_name);
 	RecordID record_id = handle.second;
-	SlottedPage* block = file.get(block_id);
-	Dbt* data = block->get(record_id);
-	ValueDict* row = unmarshal(data);
-	delete data;
-	delete block;
-	if (column_names->empty())
-		return row;
-	ValueDict* result = new ValueDict();
-	for (auto const& column_name : *column_names) {
-		if (row->find(column_name) == row->end())
-			throw DbRelationError("table does not have column named '" + column_name + "'");
-		(*result)[column_name] = (*row)[column_name];
-	}
-	return result;
+	ValueDict* row = nullptr;
+	read_block(handle.first, [&](SlottedPage* block) {
+		delete row;
+		row = nullptr;
+		Dbt* data = block->get(record_id);
+		try {
+			// just the columns asked for, read straight from their places in the record
+			row = column_names->empty() ? unmarshal(data) : unmarshal(data, column_names);
+		}
+		catch (DbRelationError& e) {
+			delete data;
+			throw;
+		}
+		delete data;
+	});
+	return row;
 }
 
 
@@ -357,96 +603,409 @@ ValueDict* HeapTable::project(Handle handle, const ColumnNames* column_names) {
 
 ValueDict* HeapTable::validate(const ValueDict* row) {
 	ValueDict* full_row = new ValueDict();
-	for (auto const& column_name : this->column_names) {
-		Value value;
+	for (uint i = 0; i < this->column_names.size(); i++) {
+		const Identifier& column_name = this->column_names[i];
 		ValueDict::const_iterator column = row->find(column_name);
 		if (column == row->end())
-			throw DbRelationError("don't know how to handle NULLs, defaults, etc. yet");
-		else
-			value = column->second;
+			continue;  // it's NULL
+		Value value = column->second;
+		ColumnAttribute::DataType data_type = this->column_attributes[i].get_data_type();
+		if (value.data_type == ColumnAttribute::INT && data_type == ColumnAttribute::BIGINT)
+			value = Value::bigint(value.n);
+		else if (value.data_type == ColumnAttribute::INT && data_type == ColumnAttribute::DOUBLE)
+			value = Value::double_value(value.n);
+		else if (value.data_type != data_type) {
+			delete full_row;
+			throw DbRelationError("a " + ColumnAttribute::type_name(value.data_type) + " value can't go in "
+								  + ColumnAttribute::type_name(data_type) + " column '" + column_name + "'");
+		}
 		(*full_row)[column_name] = value;
 	}
 	return full_row;
 }
 
+// See if the record in this block satisfies the given where-clause (every row does if where is null).
+bool HeapTable::selected(SlottedPage* block, RecordID record_id, const Predicates* where) {
+	if (where == nullptr)
+		return true;
+	Dbt* data = block->get(record_id);
+	const char* bytes = (const char*)data->get_data();
+	RecordCodec::OverflowReader get_overflow =
+			[this](BlockID block_id, uint length) {return this->get_overflow(block_id, length);};
+	bool match = true;
+	Value value;
+	for (auto const& predicate : *where) {
+		// only the predicate's column is read out of the record
+		int column = this->codec->column_number(predicate.column_name);
+		if (column < 0) {
+			delete data;
+			throw DbRelationError("table does not have column named '" + predicate.column_name + "'");
+		}
+		if (!this->codec->decode_column(bytes, column, value, get_overflow) || !predicate.test(value)) {
+			match = false;  // NULL satisfies nothing
+			break;
+		}
+	}
+	delete data;
+	return match;
+}
+
+// Appends to this thread's tail block, holding its latch. If that's full, the tail moves on to a
+// new block.
 Handle HeapTable::append(const ValueDict* row) {
-	Dbt* data = marshal(row);
-	SlottedPage* block = this->file.get(this->file.get_last_block_id());
+	Dbt data;
+	marshal(row, data);
+	uint tail = hash<thread::id>()(this_thread::get_id()) % TAILS;
+	BlockID block_id = next_tail(tail, 0);
 	RecordID record_id;
+	while (true) {
+		{
+			lock_guard<PageLatch> latch(this->file->latch(block_id));
+			SlottedPage* block = this->file->get_for_update(block_id);
+			bool added = true;
+			try {
+				record_id = block->add(&data);
+			}
+			catch (DbBlockNoRoomError& e) {
+				added = false;
+			}
+			if (added) {
+				this->file->put(block);
+				this->zone_map.add(block_id, row);
+			}
+			delete block;
+			if (added)
+				break;
+		}
+		block_id = next_tail(tail, block_id);
+	}
+	MemoryPool::release(data.get_data(), this->file->get_block_size());
+	return Handle(block_id, record_id);
+}
+
+// Like appending each row, but each block's latch is taken, and the block written, once for all the
+// rows that fit in it. If a row can't be marshaled, the rows already written are deleted again.
+Handles* HeapTable::append(const ValueDicts* rows) {
+	Handles* handles = new Handles();
+	uint tail = hash<thread::id>()(this_thread::get_id()) % TAILS;
+	BlockID block_id = next_tail(tail, 0);
+	size_t next = 0;
+	Dbt data;
+	bool marshaled = false;
 	try {
-		record_id = block->add(data);
+		while (true) {
+			{
+				lock_guard<PageLatch> latch(this->file->latch(block_id));
+				SlottedPage* block = this->file->get_for_update(block_id);
+				size_t first = next;
+				try {
+					for (; next < rows->size(); next++) {
+						if (!marshaled)
+							marshal(rows->at(next), data);
+						marshaled = true;
+						RecordID record_id;
+						try {
+							record_id = block->add(&data);
+						}
+						catch (DbBlockNoRoomError& e) {
+							break;
+						}
+						handles->push_back(Handle(block_id, record_id));
+						MemoryPool::release(data.get_data(), this->file->get_block_size());
+						marshaled = false;
+					}
+					if (next > first)
+						this->file->put(block);
+				}
+				catch (...) {
+					handles->resize(first);  // this block's rows were never written
+					delete block;
+					throw;
+				}
+				for (size_t i = first; i < next; i++)
+					this->zone_map.add(block_id, rows->at(i));
+				delete block;
+				if (next == rows->size())
+					break;
+			}
+			block_id = next_tail(tail, block_id);
+		}
 	}
-	catch (DbBlockNoRoomError& e) {
-		// need a new block
-		block = this->file.get_new();
-		record_id = block->add(data);
+	catch (...) {
+		if (marshaled)
+			MemoryPool::release(data.get_data(), this->file->get_block_size());
+		if (!handles->empty())
+			del(handles);
+		delete handles;
+		throw;
 	}
-	this->file.put(block);
-	delete[](char*)data->get_data();
-	delete data;
-	return Handle(this->file.get_last_block_id(), record_id);
+	return handles;
 }
 
-// return the bits to go into the file
-// caller responsible for freeing the returned Dbt and its enclosed ret->get_data().
-Dbt* HeapTable::marshal(const ValueDict* row) {
-	char *bytes = new char[DbBlock::BLOCK_SZ]; // more than we need (we insist that one row fits into DbBlock::BLOCK_SZ)
-	uint offset = 0;
-	uint col_num = 0;
-	for (auto const& column_name : this->column_names) {
-		ColumnAttribute ca = this->column_attributes[col_num++];
-		ValueDict::const_iterator column = row->find(column_name);
-		Value value = column->second;
-		if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-			*(int32_t*)(bytes + offset) = value.n;
-			offset += sizeof(int32_t);
-		}
-		else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-			uint size = value.s.length();
-			*(u16*)(bytes + offset) = size;
-			offset += sizeof(u16);
-			memcpy(bytes + offset, value.s.c_str(), size); // assume ascii for now
-			offset += size;
-		}
-		else {
-			throw DbRelationError("Only know how to marshal INT and TEXT");
+// Take rows out of a block, under its latch.
+void HeapTable::del_records(BlockID block_id, const RecordIDs& record_ids) {
+	lock_guard<PageLatch> latch(this->file->latch(block_id));
+	SlottedPage* block = this->file->get_for_update(block_id);
+	vector<BlockID> chains;
+	for (auto const& record_id : record_ids) {
+		Dbt* data = block->get(record_id);
+		if (data != nullptr)
+			this->codec->overflow_chains((const char*)data->get_data(), chains);
+		delete data;
+		block->del(record_id);
+	}
+	this->file->put(block);
+	for (auto const& chain : chains)
+		free_overflow(chain);
+
+	// the deleted rows may have been what set the block's min or max, so start over from what's left,
+	// reading just the columns the zone map keeps anything for out of each record
+	RecordCodec::OverflowReader get_overflow =
+			[this](BlockID block_id, uint length) {return this->get_overflow(block_id, length);};
+	ValueDicts rows;
+	RecordIDs* remaining = block->ids();
+	for (auto const& id : *remaining) {
+		Dbt* data = block->get(id);
+		ValueDict* row = new ValueDict();
+		Value value;
+		for (uint column = 0; column < this->column_names.size(); column++) {
+			ColumnAttribute::DataType data_type = this->column_attributes[column].get_data_type();
+			if ((data_type == ColumnAttribute::INT || data_type == ColumnAttribute::TEXT)
+				&& this->codec->decode_column((const char*)data->get_data(), column, value, get_overflow))
+				(*row)[this->column_names[column]] = value;
 		}
+		rows.push_back(row);
+		delete data;
 	}
-	char *right_size_bytes = new char[offset];
-	memcpy(right_size_bytes, bytes, offset);
-	delete[] bytes;
-	Dbt *data = new Dbt(right_size_bytes, offset);
-	return data;
+	this->zone_map.rebuild(block_id, rows);
+	for (auto const& row : rows)
+		delete row;
+	delete remaining;
+	delete block;
 }
 
-ValueDict* HeapTable::unmarshal(Dbt* data) {
-	ValueDict *row = new ValueDict();
-	Value value;
-	char *bytes = (char*)data->get_data();
-	uint offset = 0;
-	uint col_num = 0;
-	for (auto const& column_name : this->column_names) {
-		ColumnAttribute ca = this->column_attributes[col_num++];
-		value.data_type = ca.get_data_type();
-		if (ca.get_data_type() == ColumnAttribute::DataType::INT) {
-			value.n = *(int32_t*)(bytes + offset);
-			offset += sizeof(int32_t);
+// The block a tail appends to. full is one the caller just found full (0 if none): unless another
+// thread on the same tail has already moved it on, the tail gets a new block.
+BlockID HeapTable::next_tail(uint tail, BlockID full) {
+	lock_guard<mutex> guard(this->tails_mutex);
+	if (this->tails[tail] == 0)
+		this->tails[tail] = this->file->get_last_block_id();
+	if (full != 0 && this->tails[tail] == full) {
+		SlottedPage* block = this->file->get_new();
+		this->tails[tail] = block->get_block_id();
+		delete block;
+	}
+	return this->tails[tail];
+}
+
+// Appends the block's qualifying rows to handles.
+void HeapTable::scan_block(BlockID block_id, const Predicates* where, Handles* handles) {
+	uint before = handles->size(), scanned = 0;
+	read_block(block_id, [&](SlottedPage* block) {
+		handles->resize(before);
+		RecordIDs* record_ids = block->ids();
+		scanned = record_ids->size();
+		try {
+			for (auto const& record_id : *record_ids)
+				if (selected(block, record_id, where))
+					handles->push_back(Handle(block_id, record_id));
 		}
-		else if (ca.get_data_type() == ColumnAttribute::DataType::TEXT) {
-			u16 size = *(u16*)(bytes + offset);
-			offset += sizeof(u16);
-			char buffer[DbBlock::BLOCK_SZ];
-			memcpy(buffer, bytes + offset, size);
-			buffer[size] = '\0';
-			value.s = std::string(buffer);  // assume ascii for now
-			offset += size;
+		catch (exception& e) {
+			delete record_ids;
+			throw;
 		}
-		else {
-			throw DbRelationError("Only know how to unmarshal INT and TEXT");
+		delete record_ids;
+	});
+	Stats::count(Stats::ROWS_SCANNED, scanned);
+	Stats::count(Stats::ROWS_FILTERED, scanned - (handles->size() - before));
+}
+
+// Optimistically first, without the block's latch: the copy is only looked at if no writer had the
+// latch at any point while it was being made (a half-changed block could send the record decoding
+// anywhere). Otherwise read does it with the latch held shared.
+void HeapTable::read_block(BlockID block_id, const function<void(SlottedPage* block)>& read) {
+	auto read_and_delete = [&read](SlottedPage* block) {
+		try {
+			read(block);
 		}
-		(*row)[column_name] = value;
+		catch (exception& e) {
+			delete block;
+			throw;
+		}
+		delete block;
+	};
+	PageLatch& latch = this->file->latch(block_id);
+	u_int64_t version = latch.read_begin();
+	SlottedPage* block = this->file->get_copy(block_id);
+	if (latch.validate(version)) {
+		read_and_delete(block);
+		return;
 	}
-	return row;
+	delete block;
+
+	SharedPageLatch shared(latch);
+	read_and_delete(this->file->get(block_id));
+}
+
+// set data to the bits to go into the file
+// data's get_data() is a block-sized chunk from MemoryPool, so the caller gives it back with
+// MemoryPool::release(data.get_data(), file->get_block_size()).
+void HeapTable::marshal(const ValueDict* row, Dbt& data) {
+	// TEXT values longer than this go in the overflow file
+	uint max_inline = this->file->get_block_size() / 4;
+	// one row has to fit into an empty block along with the block header and its record header
+	uint max_size = this->file->get_block_size() - 8;
+
+	char *bytes = (char*)MemoryPool::allocate(this->file->get_block_size());  // always the same size, so it recycles well
+	uint size;
+	try {
+		size = this->codec->encode(row, bytes, max_inline, max_size,
+								   [this](const std::string& s) {return put_overflow(s);});
+	}
+	catch (...) {
+		MemoryPool::release(bytes, this->file->get_block_size());
+		throw;
+	}
+	data.set_data(bytes);
+	data.set_size(size);
+	Stats::count(Stats::BYTES_MARSHALED, size);
+}
+
+ValueDict* HeapTable::unmarshal(Dbt* data) {
+	Stats::count(Stats::BYTES_UNMARSHALED, data->get_size());
+	return this->codec->decode((const char*)data->get_data(),
+							   [this](BlockID block_id, uint length) {return get_overflow(block_id, length);});
+}
+
+// just the given columns of the row (throws if the table doesn't have one of them)
+ValueDict* HeapTable::unmarshal(Dbt* data, const ColumnNames* column_names) {
+	Stats::count(Stats::BYTES_UNMARSHALED, data->get_size());
+	return this->codec->decode((const char*)data->get_data(), column_names,
+							   [this](BlockID block_id, uint length) {return get_overflow(block_id, length);});
+}
+
+// The overflow file is made the first time it's needed.
+void HeapTable::open_overflow() {
+	try {
+		overflow.open();
+	}
+	catch (DbException& e) {
+		overflow.create();
+	}
+}
+
+// Store s in a new chain of overflow blocks. Returns the block id of the start of the chain.
+// Each block is built in memory of our own, since the next one is found before it's written.
+BlockID HeapTable::put_overflow(const std::string& s) {
+	open_overflow();
+	uint block_size = overflow.get_block_size();
+	uint chunk_size = block_size - 8 - sizeof(u_int32_t);
+	vector<BlockID> block_ids = new_overflow_blocks(std::max((uint)1, ((uint)s.length() + chunk_size - 1) / chunk_size));
+	char* chunk = new char[sizeof(u_int32_t) + chunk_size];
+	char* bytes = (char*)MemoryPool::allocate(block_size);
+	for (uint i = 0; i < block_ids.size(); i++) {
+		uint start = i * chunk_size;
+		uint size = std::min(chunk_size, (uint)s.length() - start);
+		*(u_int32_t*)chunk = i + 1 < block_ids.size() ? block_ids[i + 1] : 0;
+		memcpy(chunk + sizeof(u_int32_t), s.data() + start, size);
+		memset(bytes, 0, block_size);
+		Dbt block_data(bytes, block_size);
+		SlottedPage block(block_data, block_ids[i], true);
+		Dbt data(chunk, sizeof(u_int32_t) + size);
+		block.add(&data);
+		overflow.put(&block);
+	}
+	MemoryPool::release(bytes, block_size);
+	delete[] chunk;
+	return block_ids.front();
+}
+
+// Follow the chain of overflow blocks starting at block_id to get back a value of the given length.
+std::string HeapTable::get_overflow(BlockID block_id, uint length) {
+	open_overflow();
+	std::string s;
+	s.reserve(length);
+	while (block_id != 0) {
+		SlottedPage* block = overflow.get(block_id);
+		Dbt* data = block->get(1);
+		block_id = *(u_int32_t*)data->get_data();
+		s.append((char*)data->get_data() + sizeof(u_int32_t), data->get_size() - sizeof(u_int32_t));
+		delete data;
+		delete block;
+	}
+	if (s.length() != length)
+		throw DbRelationError("overflow chain for a value is the wrong length");
+	return s;
+}
+
+// Put a chain on the front of the free list: the end of it is pointed at what the list started with.
+void HeapTable::free_overflow(BlockID block_id) {
+	open_overflow();
+	BlockID last = block_id;
+	for (BlockID next = next_overflow_block(last); next != 0; next = next_overflow_block(last))
+		last = next;
+	BlockID free = get_free_overflow();  // before the get below: the next get on the file reuses its memory
+	SlottedPage* block = overflow.get_for_update(last);
+	Dbt* data = block->get(1);
+	string record((char*)data->get_data(), data->get_size());
+	delete data;
+	*(u_int32_t*)&record[0] = free;
+	Dbt new_data(&record[0], record.size());
+	block->put(1, new_data);
+	overflow.put(block);
+	delete block;
+	put_free_overflow(block_id);
+}
+
+// n blocks for a new chain, off the free list first, then new ones.
+vector<BlockID> HeapTable::new_overflow_blocks(uint n) {
+	vector<BlockID> block_ids;
+	BlockID free = get_free_overflow(), was_free = free;
+	while (block_ids.size() < n && free != 0) {
+		block_ids.push_back(free);
+		free = next_overflow_block(free);
+	}
+	if (free != was_free)
+		put_free_overflow(free);
+	while (block_ids.size() < n) {
+		SlottedPage* block = overflow.get_new();
+		block_ids.push_back(block->get_block_id());
+		delete block;
+	}
+	return block_ids;
+}
+
+BlockID HeapTable::next_overflow_block(BlockID block_id) {
+	SlottedPage* block = overflow.get(block_id);
+	Dbt* data = block->get(1);
+	BlockID next = *(u_int32_t*)data->get_data();
+	delete data;
+	delete block;
+	return next;
+}
+
+// The start of the free list (0 if it's empty).
+BlockID HeapTable::get_free_overflow() {
+	SlottedPage* block = overflow.get(1);
+	Dbt* data = block->get(1);
+	BlockID free = data == nullptr ? 0 : *(u_int32_t*)data->get_data();
+	delete data;
+	delete block;
+	return free;
+}
+
+void HeapTable::put_free_overflow(BlockID block_id) {
+	SlottedPage* block = overflow.get_for_update(1);
+	u_int32_t free = block_id;
+	Dbt data(&free, sizeof(free));
+	RecordIDs* record_ids = block->ids();
+	if (record_ids->empty())
+		block->add(&data);
+	else
+		block->put(1, data);
+	delete record_ids;
+	overflow.put(block);
+	delete block;
 }
 
 #pragma endregion
@@ -454,7 +1013,166 @@ ValueDict* HeapTable::unmarshal(Dbt* data) {
 
 
 // test function -- returns true if all tests pass
+// Does record record_id of the block hold exactly expected?
+static bool holds(SlottedPage& page, RecordID record_id, const string& expected) {
+	Dbt* data = page.get(record_id);
+	bool same = data != nullptr && string((char*)data->get_data(), data->get_size()) == expected;
+	delete data;
+	return same;
+}
+
+// The first record added to a 64kB block ends at 65536, one past what a u16 offset can hold, so
+// deleting or shrinking it slides data right up to the end of the block.
+static bool test_max_size_block() {
+	string a(1000, 'a'), b(2000, 'b'), c(300, 'c'), x(10, 'x');
+	Dbt da(&a[0], a.size()), db(&b[0], b.size()), dc(&c[0], c.size()), dx(&x[0], x.size());
+
+	vector<char> bytes(DbBlock::MAX_BLOCK_SZ);
+	Dbt block(&bytes[0], bytes.size());
+	SlottedPage page(block, 1, true);
+	RecordID first = page.add(&da), second = page.add(&db), third = page.add(&dc);
+	page.del(first);
+	if (page.get(first) != nullptr || !holds(page, second, b) || !holds(page, third, c))
+		return false;
+	page.del(second);
+	page.del(third);
+	string most(DbBlock::MAX_BLOCK_SZ - 5 * 4, 'm');  // all the room left for a fourth record and its header
+	Dbt dmost(&most[0], most.size());
+	if (!holds(page, page.add(&dmost), most))
+		return false;
+
+	vector<char> more_bytes(DbBlock::MAX_BLOCK_SZ);
+	Dbt more_block(&more_bytes[0], more_bytes.size());
+	SlottedPage shrinking(more_block, 2, true);
+	first = shrinking.add(&da);
+	second = shrinking.add(&db);
+	shrinking.put(first, dx);
+	if (!holds(shrinking, first, x) || !holds(shrinking, second, b))
+		return false;
+	shrinking.put(first, da);
+	return holds(shrinking, first, a) && holds(shrinking, second, b);
+}
+
+// Insert the rows, then check each comes back the same, whole and as just some of its columns.
+static bool round_trip(HeapTable& table, const vector<ValueDict>& rows, const ColumnNames& some) {
+	for (auto const& row : rows) {
+		Handle handle = table.insert(&row);
+		ValueDict* whole = table.project(handle);
+		ValueDict* part = table.project(handle, &some);
+		ValueDict expected_part;
+		for (auto const& column_name : some)
+			if (row.find(column_name) != row.end())
+				expected_part[column_name] = row.at(column_name);
+		bool same = *whole == row && *part == expected_part;
+		delete whole;
+		delete part;
+		if (!same)
+			return false;
+	}
+	return true;
+}
+
+// Rows of every type, with NULLs (missing from the ValueDict) and a TEXT value too long to keep in the
+// record, through both the general RecordCodec and the one for tables of a few INT columns.
+static bool test_record_formats() {
+	ColumnNames column_names = {"i", "l", "d", "b", "day", "ts", "s", "t"};
+	ColumnAttributes column_attributes;
+	for (auto const& data_type : {ColumnAttribute::INT, ColumnAttribute::BIGINT, ColumnAttribute::DOUBLE,
+								  ColumnAttribute::BOOLEAN, ColumnAttribute::DATE, ColumnAttribute::TIMESTAMP,
+								  ColumnAttribute::TEXT, ColumnAttribute::TEXT})
+		column_attributes.push_back(ColumnAttribute(data_type));
+	vector<ValueDict> rows(4);
+	rows[0]["i"] = Value(-12);
+	rows[0]["l"] = Value::bigint(1LL << 40);
+	rows[0]["d"] = Value::double_value(3.25);
+	rows[0]["b"] = Value::boolean(true);
+	rows[0]["day"] = Value::date(17732);
+	rows[0]["ts"] = Value::timestamp(1532044800000000LL);
+	rows[0]["s"] = Value("short");
+	rows[0]["t"] = Value(string(3 * DbBlock::BLOCK_SZ, 'L'));  // out of line
+	rows[1]["i"] = Value(7);                                     // and nothing else
+	rows[2]["t"] = Value("");                                    // empty, which isn't NULL
+	rows[2]["b"] = Value::boolean(false);
+	rows[2]["l"] = Value::bigint(INT64_MIN);
+	rows[2]["day"] = Value::date(-1);
+	// rows[3] is all NULLs
+	HeapTable table("_test_types_cpp", column_names, column_attributes);
+	table.create_if_not_exists();
+	bool ok = round_trip(table, rows, ColumnNames({"t", "i", "b"}));
+	table.drop();
+	if (!ok)
+		return false;
+
+	ColumnNames int_names = {"x", "y"};
+	ColumnAttributes int_attributes(2, ColumnAttribute(ColumnAttribute::INT));
+	vector<ValueDict> int_rows(3);
+	int_rows[0]["x"] = Value(1);
+	int_rows[1]["y"] = Value(-2);
+	HeapTable ints("_test_ints_cpp", int_names, int_attributes);
+	ints.create_if_not_exists();
+	ok = round_trip(ints, int_rows, ColumnNames({"y"}));
+	ints.drop();
+	return ok;
+}
+
+// Five 1000-byte TEXT values are each short enough to keep in the record, but not all together in a
+// 4kB block, so the longest of them go out of line until the row fits.
+static bool test_spilled_row() {
+	ColumnNames column_names = {"t1", "t2", "t3", "t4", "t5"};
+	ColumnAttributes column_attributes(5, ColumnAttribute(ColumnAttribute::TEXT));
+	vector<ValueDict> rows(2);
+	for (uint i = 0; i < column_names.size(); i++) {
+		rows[0][column_names[i]] = Value(string(1000, 'a' + i));
+		rows[1][column_names[i]] = Value(string(996 + 2 * i, 'A' + i));  // not all the same length
+	}
+	HeapTable table("_test_spilled_cpp", column_names, column_attributes);
+	table.set_block_size(4096);
+	table.create_if_not_exists();
+	bool ok = round_trip(table, rows, ColumnNames({"t5", "t1"}));
+	table.drop();
+	return ok;
+}
+
 bool test_heap_storage() {
+	if (!test_max_size_block())
+		return false;
+	std::cout << "max size block ok" << std::endl;
+	if (!test_record_formats())
+		return false;
+	std::cout << "record formats ok" << std::endl;
+	if (!test_spilled_row())
+		return false;
+	std::cout << "spilled row ok" << std::endl;
+
+	// deleted rows give their overflow blocks back, so the same rows again take no new ones
+	ColumnNames long_names = {"id", "t"};
+	ColumnAttributes long_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT)};
+	HeapTable churn("_test_churn_cpp", long_names, long_attributes);
+	churn.create_if_not_exists();
+	vector<ValueDict> long_rows(3);
+	for (uint i = 0; i < long_rows.size(); i++) {
+		long_rows[i]["id"] = Value(i);
+		long_rows[i]["t"] = Value(string((i + 1) * DbBlock::BLOCK_SZ + i, 'x' + i));  // chains of 2, 3 and 4 blocks
+	}
+	BlockID overflow_blocks = 0;
+	for (int round = 0; round < 3; round++) {
+		if (!round_trip(churn, long_rows, ColumnNames({"t"}))) {
+			churn.drop();
+			return false;
+		}
+		if (round == 0)
+			overflow_blocks = churn.overflow.get_last_block_id();
+		else if (churn.overflow.get_last_block_id() != overflow_blocks) {
+			churn.drop();
+			return false;
+		}
+		Handles* handles = churn.select();
+		churn.del(handles);
+		delete handles;
+	}
+	churn.drop();
+	std::cout << "overflow reuse ok" << std::endl;
+
 	ColumnNames column_names;
 	column_names.push_back("a");
 	column_names.push_back("b");
@@ -481,6 +1199,13 @@ bool test_heap_storage() {
     std::cout << "insert ok" << std::endl;
     Handles* handles = table.select();
     std::cout << "select ok " << handles->size() << std::endl;
+    Handles scanned;
+    u_int64_t position = 0;
+    while (table.select_more(nullptr, position, &scanned))
+        continue;
+    if (scanned != *handles)
+        return false;
+    std::cout << "select_more ok" << std::endl;
     ValueDict *result = table.project((*handles)[0]);
     std::cout << "project ok" << std::endl;
     Value value = (*result)["a"];
@@ -9,8 +9,14 @@
  */
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <mutex>
 #include "db_cxx.h"
+#include "page_latch.h"
+#include "record_codec.h"
 #include "storage_engine.h"
+#include "zone_map.h"
 
 /**
  * @class SlottedPage - heap file implementation of DbBlock.
@@ -44,6 +50,10 @@ public:
 	virtual void del(RecordID record_id);
 	virtual RecordIDs* ids(void);
 
+	// pages come and go with every block we touch, so recycle their memory (see MemoryPool)
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
+
 protected:
 	u_int16_t num_records;
 	u_int16_t end_free;
@@ -51,10 +61,10 @@ protected:
 	virtual void get_header(u_int16_t &size, u_int16_t &loc, RecordID id=0);
 	virtual void put_header(RecordID id=0, u_int16_t size=0, u_int16_t loc=0);
 	virtual bool has_room(u_int16_t size);
-	virtual void slide(u_int16_t start, u_int16_t end);
-	virtual u_int16_t get_n(u_int16_t offset);
-	virtual void put_n(u_int16_t offset, u_int16_t n);
-	virtual void* address(u_int16_t offset);
+	virtual void slide(u_int32_t start, u_int32_t end);
+	virtual u_int16_t get_n(u_int32_t offset);
+	virtual void put_n(u_int32_t offset, u_int16_t n);
+	virtual void* address(u_int32_t offset);
 };
 
 /**
@@ -64,10 +74,19 @@ protected:
         database blocks for each Berkeley DB record in the RecNo file. In this way we are using Berkeley DB
         for buffer management and file management.
         Uses SlottedPage for storing records within blocks.
+
+        The Berkeley DB handle isn't opened DB_THREAD, and get() hands out memory the handle owns
+        (good until its next call), so only one thread at a time may use a HeapFile itself.
+        Subclasses that read into buffers of their own (DirectFile) can be shared, and then threads
+        coordinate through the block latches (see PageLatch): whoever changes a block holds its
+        latch from get_for_update() through put(). get_new() may be called from several threads at
+        once; each gets a block of its own, which doesn't count in get_last_block_id() until it
+        has been written.
  */
 class HeapFile : public DbFile {
 public:
-	HeapFile(std::string name) : DbFile(name), dbfilename(""), last(0), closed(true), db(_DB_ENV, 0) {}
+	HeapFile(std::string name) : DbFile(name), dbfilename(""), last(0), block_size(DbBlock::BLOCK_SZ), closed(true),
+		db(_DB_ENV, 0) {}
 	virtual ~HeapFile() {}
 	HeapFile(const HeapFile& other) = delete;
 	HeapFile(HeapFile&& temp) = delete;
@@ -76,6 +95,7 @@ public:
 
 	virtual void create(void);
 	virtual void drop(void);
+	virtual void discard(void);
 	virtual void open(void);
 	virtual void close(void);
 	virtual SlottedPage* get_new(void);
@@ -83,11 +103,38 @@ public:
 	virtual void put(DbBlock* block);
 	virtual BlockIDs* block_ids();
 
+	/**
+	 * Get a block in order to change it and put() it back. Same as get() here, but a subclass
+	 * whose get() returns read-only memory hands out a copy instead.
+	 */
+	virtual SlottedPage* get_for_update(BlockID block_id) {return get(block_id);}
+
+	/**
+	 * Get a block that later changes to the file don't show through. Same as get() here, but a
+	 * subclass whose get() returns the file's own memory hands out a copy instead.
+	 */
+	virtual SlottedPage* get_copy(BlockID block_id) {return get(block_id);}
+
 	virtual u_int32_t get_last_block_id() {return last;}
 
+	/**
+	 * @returns  the latch for the block (shared with some other blocks, see PageLatches)
+	 */
+	virtual PageLatch& latch(BlockID block_id) {return latches.get(block_id);}
+
+	/**
+	 * Block size to create the file with. Once the file is open, its block size is whatever it
+	 * was created with (Berkeley DB keeps it as the RecNo record length in the file's metadata).
+	 */
+	virtual void set_block_size(uint block_size);
+	virtual uint get_block_size() {return block_size;}
+
 protected:
 	std::string dbfilename;
-	u_int32_t last;
+	std::atomic<u_int32_t> last;
+	std::mutex extend_mutex;  // for get_new
+	PageLatches latches;
+	uint block_size;
 	bool closed;
 	Db db;
 	virtual uint32_t get_block_count();
@@ -96,12 +143,35 @@ protected:
 
 /**
  * @class HeapTable - Heap storage engine (implementation of DbRelation)
+ *
+ *      Keeps a ZoneMap alongside the heap file so that scans can skip blocks that can't have any
+        qualifying rows. Rows are turned into records and back by a RecordCodec made for the table's
+        columns when the table object is constructed. A column left out of an inserted row is NULL;
+        NULLs are left out of the rows handed back and never satisfy a predicate.
+
+        TEXT values longer than a quarter of a block (and, in a row that would still be too big for a
+        block, its longest other TEXT values) are kept out of line in the overflow file,
+        <table>.overflow, as a chain of blocks each holding one record: a 4-byte block id of the next
+        block in the chain (0 for the last one) followed by as much of the value as fits. In the row,
+        such a value is flagged as out of line and kept as its 4-byte length and the 4-byte block id
+        of the start of its chain (see RecordCodec). When a row is deleted, its chains go on the
+        overflow file's free list, itself a chain of the same kind, whose start is kept in the one
+        record of block 1 (empty until something is freed). New chains take blocks from it first.
+
+        Each block is changed only under its latch. Readers (select, project) copy a block
+        optimistically, and look at the copy only if no writer got to the block meanwhile
+        (otherwise they read it again under the latch, shared). Inserting threads are spread over
+        TAILS tail blocks (by thread), each getting a new block of its own when it fills up, so
+        they don't all queue up for the last block. Threads can share a table only if its file can
+        be shared (see HeapFile) and none of its TEXT values is out of line (the overflow file is a
+        Berkeley DB HeapFile).
  */
 
 class HeapTable : public DbRelation {
 public:
 	HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes );
-	virtual ~HeapTable() {}
+	HeapTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes, HeapFile* file);
+	virtual ~HeapTable();
 	HeapTable(const HeapTable& other) = delete;
 	HeapTable(HeapTable&& temp) = delete;
 	HeapTable& operator=(const HeapTable& other) = delete;
@@ -110,25 +180,67 @@ public:
 	virtual void create();
 	virtual void create_if_not_exists();
 	virtual void drop();
+	virtual void discard();
 
 	virtual void open();
 	virtual void close();
 
+	virtual void set_block_size(uint block_size);
+	virtual uint get_block_size() {return file->get_block_size();}  // the file's own once it's open
+
 	virtual Handle insert(const ValueDict* row);
+	virtual Handles* insert(const ValueDicts* rows);
 	virtual void update(const Handle handle, const ValueDict* new_values);
 	virtual void del(const Handle handle);
+	virtual void del(const Handles* handles);
 
 	virtual Handles* select();
 	virtual Handles* select(const ValueDict* where);
+	virtual Handles* select(const Predicates* where);
+	virtual bool select_more(const Predicates* where, u_int64_t& position, Handles* handles);
+	virtual Handles* select(const HandleBitmap* candidates, const Predicates* where);
 	virtual ValueDict* project(Handle handle);
 	virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
+	using DbRelation::project;
+
+	/**
+	 * how many blocks ahead of itself a scan asks the file to prefetch
+	 */
+	static const uint READ_AHEAD = 8;
+
+	/**
+	 * how many blocks inserts are spread over
+	 */
+	static const uint TAILS = 4;
+
+	friend bool test_heap_storage();
 
 protected:
-	HeapFile file;
+	HeapFile* file;  // HeapFile, or one of its subclasses that skips Berkeley DB (owned by the table)
+	HeapFile overflow;
+	ZoneMap zone_map;
+	RecordCodec* codec;  // built once from the columns; lives as long as the table does in Tables::table_cache
+	std::mutex tails_mutex;
+	BlockID tails[TAILS];  // the block each tail appends to (0 until first used)
 	virtual ValueDict* validate(const ValueDict* row);
+	virtual bool selected(SlottedPage* block, RecordID record_id, const Predicates* where);
 	virtual Handle append(const ValueDict* row);
-	virtual Dbt* marshal(const ValueDict* row);
+	virtual Handles* append(const ValueDicts* rows);
+	virtual void del_records(BlockID block_id, const RecordIDs& record_ids);
+	virtual BlockID next_tail(uint tail, BlockID full);
+	virtual void scan_block(BlockID block_id, const Predicates* where, Handles* handles);
+	virtual void read_block(BlockID block_id, const std::function<void(SlottedPage* block)>& read);
+	virtual void marshal(const ValueDict* row, Dbt& data);
 	virtual ValueDict* unmarshal(Dbt* data);
+	virtual ValueDict* unmarshal(Dbt* data, const ColumnNames* column_names);
+	virtual void open_overflow();
+	virtual BlockID put_overflow(const std::string& s);
+	virtual std::string get_overflow(BlockID block_id, uint length);
+	virtual void free_overflow(BlockID block_id);
+	virtual std::vector<BlockID> new_overflow_blocks(uint n);
+	virtual BlockID next_overflow_block(BlockID block_id);
+	virtual BlockID get_free_overflow();
+	virtual void put_free_overflow(BlockID block_id);
 };
 
 bool test_heap_storage();
@@ -0,0 +1,361 @@
+/**
+ * @file lock_manager.cpp - implementation of LockTarget and LockManager
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <tuple>
+#include "lock_manager.h"
+
+using namespace std;
+
+/*
+	LockTarget
+*/
+
+// table first, then its pages, each followed by its rows
+bool LockTarget::operator<(const LockTarget& other) const {
+	bool in_table = level != TABLE, other_in_table = other.level != TABLE;
+	return tie(table_name, in_table, block_id, level, record_id)
+		   < tie(other.table_name, other_in_table, other.block_id, other.level, other.record_id);
+}
+
+string LockTarget::to_string() const {
+	switch (level) {
+		case TABLE:
+			return "table " + table_name;
+		case PAGE:
+			return "page " + std::to_string(block_id) + " of " + table_name;
+		default:
+			return "row (" + std::to_string(block_id) + ", " + std::to_string(record_id) + ") of " + table_name;
+	}
+}
+
+
+/*
+	LockManager PUBLIC
+*/
+
+void LockManager::lock(TransactionID transaction, const LockTarget& target, LockMode mode) {
+	unique_lock<mutex> guard(this->latch);
+	acquire(guard, transaction, target, mode);
+}
+
+void LockManager::release_all(TransactionID transaction) {
+	{
+		lock_guard<mutex> guard(this->latch);
+		auto held = this->held_locks.find(transaction);
+		if (held == this->held_locks.end())
+			return;
+		for (auto const& target : held->second) {
+			auto queue = this->queues.find(target);
+			queue->second.granted.erase(transaction);
+			if (queue->second.granted.empty() && queue->second.waiting.empty())
+				this->queues.erase(queue);
+		}
+		this->held_locks.erase(held);
+		auto first = this->child_locks.lower_bound(make_pair(transaction, LockTarget::table("")));
+		auto last = first;
+		while (last != this->child_locks.end() && last->first.first == transaction)
+			last++;
+		this->child_locks.erase(first, last);
+	}
+	this->released.notify_all();
+}
+
+LockManager::LockMode LockManager::held(TransactionID transaction, const LockTarget& target) {
+	lock_guard<mutex> guard(this->latch);
+	auto queue = this->queues.find(target);
+	if (queue == this->queues.end())
+		return NONE;
+	auto granted = queue->second.granted.find(transaction);
+	return granted == queue->second.granted.end() ? NONE : granted->second;
+}
+
+bool LockManager::compatible(LockMode a, LockMode b) {
+	static const bool matrix[6][6] = {
+		//          NONE   IS     IX     S      SIX    X
+		/* NONE */ {true,  true,  true,  true,  true,  true},
+		/* IS   */ {true,  true,  true,  true,  true,  false},
+		/* IX   */ {true,  true,  true,  false, false, false},
+		/* S    */ {true,  true,  false, true,  false, false},
+		/* SIX  */ {true,  true,  false, false, false, false},
+		/* X    */ {true,  false, false, false, false, false}
+	};
+	return matrix[a][b];
+}
+
+// The modes form a lattice: NONE < IS < IX, S < SIX < X, with IX and S the only pair that aren't ordered.
+LockManager::LockMode LockManager::supremum(LockMode a, LockMode b) {
+	if ((a == IX && b == S) || (a == S && b == IX))
+		return SIX;
+	return max(a, b);
+}
+
+const char* LockManager::name(LockMode mode) {
+	static const char* names[] = {"NONE", "IS", "IX", "S", "SIX", "X"};
+	return names[mode];
+}
+
+
+/*
+	LockManager PROTECTED
+*/
+
+// Takes the intention locks on the way down, so a transaction never holds a lock its ancestors don't allow.
+void LockManager::acquire(unique_lock<mutex>& guard, TransactionID transaction, const LockTarget& target, LockMode mode) {
+	if (mode == NONE || covered(transaction, target, mode))
+		return;
+	if (target.level != LockTarget::TABLE) {
+		acquire(guard, transaction, target.parent(), mode == IS || mode == S ? IS : IX);
+		if (covered(transaction, target, mode))
+			return;  // that escalated
+	}
+
+	Queue& queue = this->queues[target];  // stays put: the map only drops targets nobody holds or wants
+	auto granted = queue.granted.find(transaction);
+	LockMode current = granted == queue.granted.end() ? NONE : granted->second;
+	LockMode wanted = supremum(current, mode);
+	if (wanted == current)
+		return;
+
+	bool upgrade = current != NONE;
+	if (!grantable(queue, transaction, wanted, upgrade ? 0 : queue.waiting.size())) {
+		auto position = queue.waiting.end();
+		if (upgrade)
+			position = find_if(queue.waiting.begin(), queue.waiting.end(), [&queue](const Request& request) {
+				return queue.granted.find(request.transaction) == queue.granted.end();
+			});
+		queue.waiting.insert(position, Request{transaction, wanted});
+		this->waiting_for.emplace(transaction, target);
+		this->waits++;
+		while (true) {
+			uint ahead = find_if(queue.waiting.begin(), queue.waiting.end(), [transaction](const Request& request) {
+				return request.transaction == transaction;
+			}) - queue.waiting.begin();
+			if (grantable(queue, transaction, wanted, ahead)) {
+				queue.waiting.erase(queue.waiting.begin() + ahead);
+				break;
+			}
+			if (deadlocked(transaction)) {
+				queue.waiting.erase(queue.waiting.begin() + ahead);
+				this->waiting_for.erase(transaction);
+				if (queue.granted.empty() && queue.waiting.empty())
+					this->queues.erase(target);
+				this->deadlocks++;
+				this->released.notify_all();  // whoever was waiting behind us may go now
+				throw DeadlockError("deadlock: transaction " + to_string(transaction) + " can't get a "
+									+ name(wanted) + " lock on " + target.to_string());
+			}
+			this->released.wait(guard);
+		}
+		this->waiting_for.erase(transaction);
+		this->released.notify_all();
+	}
+
+	queue.granted[transaction] = wanted;
+	if (upgrade)
+		return;
+	this->held_locks[transaction].insert(target);
+	if (target.level != LockTarget::TABLE) {
+		uint& n = this->child_locks[make_pair(transaction, target.parent())];
+		if (++n > (target.level == LockTarget::ROW ? this->page_escalation : this->table_escalation))
+			escalate(transaction, target.parent());
+	}
+}
+
+// S, SIX or X on an ancestor covers reading; only X covers writing.
+bool LockManager::covered(TransactionID transaction, const LockTarget& target, LockMode mode) {
+	LockTarget ancestor = target;
+	while (ancestor.level != LockTarget::TABLE) {
+		ancestor = ancestor.parent();
+		auto queue = this->queues.find(ancestor);
+		if (queue == this->queues.end())
+			continue;
+		auto granted = queue->second.granted.find(transaction);
+		if (granted == queue->second.granted.end())
+			continue;
+		LockMode held = granted->second;
+		if (held == X || ((mode == IS || mode == S) && (held == S || held == SIX)))
+			return true;
+	}
+	return false;
+}
+
+// Compatible with what the others hold and with the first ahead requests in the queue.
+bool LockManager::grantable(const Queue& queue, TransactionID transaction, LockMode mode, uint ahead) {
+	for (auto const& granted : queue.granted)
+		if (granted.first != transaction && !compatible(mode, granted.second))
+			return false;
+	for (uint i = 0; i < ahead && i < queue.waiting.size(); i++)
+		if (queue.waiting[i].transaction != transaction && !compatible(mode, queue.waiting[i].mode))
+			return false;
+	return true;
+}
+
+// Is transaction, by way of whoever it's waiting on, waiting on itself?
+bool LockManager::deadlocked(TransactionID transaction) {
+	vector<TransactionID> to_visit;
+	set<TransactionID> visited;
+	blockers(transaction, to_visit);
+	while (!to_visit.empty()) {
+		TransactionID next = to_visit.back();
+		to_visit.pop_back();
+		if (next == transaction)
+			return true;
+		if (visited.insert(next).second)
+			blockers(next, to_visit);
+	}
+	return false;
+}
+
+// The wait-for graph's edges out of transaction: the others holding or asking ahead of it for a conflicting lock.
+void LockManager::blockers(TransactionID transaction, vector<TransactionID>& found) {
+	auto waiting = this->waiting_for.find(transaction);
+	if (waiting == this->waiting_for.end())
+		return;
+	const Queue& queue = this->queues.at(waiting->second);
+	uint ahead = 0;
+	while (queue.waiting[ahead].transaction != transaction)
+		ahead++;
+	LockMode mode = queue.waiting[ahead].mode;
+	for (auto const& granted : queue.granted)
+		if (granted.first != transaction && !compatible(mode, granted.second))
+			found.push_back(granted.first);
+	for (uint i = 0; i < ahead; i++)
+		if (!compatible(mode, queue.waiting[i].mode))
+			found.push_back(queue.waiting[i].transaction);
+}
+
+// Trade the transaction's locks under target for one lock on target, if that can be had without waiting.
+void LockManager::escalate(TransactionID transaction, const LockTarget& target) {
+	set<LockTarget>& held = this->held_locks[transaction];
+	vector<LockTarget> under;
+	bool writing = false;
+	for (auto it = held.upper_bound(target); it != held.end() && it->table_name == target.table_name; it++) {
+		if (target.level == LockTarget::PAGE && (it->level != LockTarget::ROW || it->block_id != target.block_id))
+			break;
+		under.push_back(*it);
+		LockMode mode = this->queues.at(*it).granted.at(transaction);
+		writing = writing || mode == IX || mode == SIX || mode == X;
+	}
+
+	Queue& queue = this->queues.at(target);
+	LockMode wanted = supremum(queue.granted.at(transaction), writing ? X : S);
+	if (!grantable(queue, transaction, wanted, 0))
+		return;
+	queue.granted[transaction] = wanted;
+	for (auto const& lock : under)
+		forget(transaction, lock);
+	this->escalations++;
+	this->released.notify_all();
+}
+
+// Drop one of transaction's locks (its parent's stays).
+void LockManager::forget(TransactionID transaction, const LockTarget& target) {
+	auto queue = this->queues.find(target);
+	queue->second.granted.erase(transaction);
+	if (queue->second.granted.empty() && queue->second.waiting.empty())
+		this->queues.erase(queue);
+	this->held_locks[transaction].erase(target);
+	if (target.level != LockTarget::TABLE) {
+		auto n = this->child_locks.find(make_pair(transaction, target.parent()));
+		if (--n->second == 0)
+			this->child_locks.erase(n);
+	}
+}
+
+
+/*
+	TESTS
+*/
+
+// Returns once n waits have begun. A transaction counts its wait before it sleeps, under the
+// manager's latch, so after this it is certainly waiting (or about to be).
+static void until_waiting(LockManager& lock_manager, u_int64_t n) {
+	while (lock_manager.get_waits() < n)
+		this_thread::yield();
+}
+
+bool test_lock_manager() {
+	typedef LockManager LM;
+	LockTarget table = LockTarget::table("t");
+
+	// S on a table the transaction has IX on upgrades it to SIX, which others can still read under
+	LM upgrading;
+	upgrading.lock_row(1, "t", Handle(3, 7), LM::X);
+	upgrading.lock_row(2, "t", Handle(3, 8), LM::S);
+	upgrading.lock_table(1, "t", LM::S);
+	upgrading.lock_row(1, "t", Handle(4, 1), LM::S);  // covered by the SIX
+	if (upgrading.held(1, table) != LM::SIX || upgrading.held(1, LockTarget::page("t", 3)) != LM::IX
+		|| upgrading.held(2, table) != LM::IS || upgrading.held(1, LockTarget::row("t", Handle(4, 1))) != LM::NONE
+		|| upgrading.get_waits() != 0)
+		return false;
+	upgrading.release_all(1);
+	upgrading.release_all(2);
+
+	// releasing a lock wakes up whoever is waiting for it
+	LM releasing;
+	atomic<bool> got(false);
+	releasing.lock_row(1, "t", Handle(1, 1), LM::X);
+	thread waiter([&]() {
+		releasing.lock_row(2, "t", Handle(1, 1), LM::S);
+		got = true;
+	});
+	until_waiting(releasing, 1);
+	bool waited = !got;
+	releasing.release_all(1);
+	waiter.join();
+	if (!waited || !got || releasing.held(2, LockTarget::row("t", Handle(1, 1))) != LM::S)
+		return false;
+	releasing.release_all(2);
+
+	// 1 holds a and waits for b; 2 holds b and asks for a, which would close the cycle
+	LM deadlocking;
+	atomic<bool> first_failed(false);
+	deadlocking.lock_row(1, "t", Handle(1, 1), LM::X);
+	deadlocking.lock_row(2, "t", Handle(1, 2), LM::X);
+	thread first([&]() {
+		try {
+			deadlocking.lock_row(1, "t", Handle(1, 2), LM::X);
+		}
+		catch (DeadlockError& e) {
+			first_failed = true;
+		}
+	});
+	until_waiting(deadlocking, 1);
+	bool detected = false;
+	try {
+		deadlocking.lock_row(2, "t", Handle(1, 1), LM::X);
+	}
+	catch (DeadlockError& e) {
+		detected = true;
+	}
+	deadlocking.release_all(2);
+	first.join();
+	if (!detected || first_failed || deadlocking.get_deadlocks() != 1
+		|| deadlocking.held(1, LockTarget::row("t", Handle(1, 2))) != LM::X)
+		return false;
+	deadlocking.release_all(1);
+
+	// more than 4 rows of a page make a page lock, and more than 3 pages a table lock
+	LM escalating(4, 3);
+	for (RecordID record_id = 1; record_id <= 5; record_id++)
+		escalating.lock_row(1, "t", Handle(1, record_id), LM::S);
+	if (escalating.held(1, LockTarget::page("t", 1)) != LM::S || escalating.get_escalations() != 1
+		|| escalating.held(1, LockTarget::row("t", Handle(1, 1))) != LM::NONE)
+		return false;
+	escalating.lock_row(2, "t", Handle(9, 1), LM::S);  // 2's IS on the table is in the way of an X
+	escalating.lock_row(1, "t", Handle(2, 1), LM::X);
+	escalating.lock_row(1, "t", Handle(3, 1), LM::S);
+	escalating.lock_row(1, "t", Handle(4, 1), LM::S);  // a fourth page, but escalating would have to wait
+	if (escalating.get_escalations() != 1 || escalating.held(1, table) != LM::IX)
+		return false;
+	escalating.release_all(2);
+	escalating.lock_row(1, "t", Handle(5, 1), LM::S);
+	bool escalated = escalating.get_escalations() == 2 && escalating.held(1, table) == LM::X
+					 && escalating.held(1, LockTarget::page("t", 2)) == LM::NONE;
+	escalating.release_all(1);
+	return escalated && escalating.get_waits() == 0;
+}
@@ -0,0 +1,201 @@
+/**
+ * @file lock_manager.h - hierarchical two-phase locking of tables, pages and rows
+ * LockTarget
+ * LockManager
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include "storage_engine.h"
+
+/*
+ * Convenient aliases for types
+ */
+typedef u_int64_t TransactionID;
+
+/**
+ * @class DeadlockError - thrown to the transaction that would have closed a cycle of waits
+ *
+ *      Its request is withdrawn but the locks it already had are kept; it should roll back and
+        release_all().
+ */
+class DeadlockError : public std::runtime_error {
+public:
+	explicit DeadlockError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class LockTarget - something that can be locked: a whole table, one of its blocks, or one row (by its Handle)
+ *
+ *      A row's parent is its block and a block's parent is its table. They sort by table, with each
+        table first, then each of its pages followed by that page's rows.
+ */
+class LockTarget {
+public:
+	enum Level {
+		TABLE,
+		PAGE,
+		ROW
+	};
+
+	static LockTarget table(const Identifier& table_name) {return LockTarget(TABLE, table_name, 0, 0);}
+	static LockTarget page(const Identifier& table_name, BlockID block_id) {return LockTarget(PAGE, table_name, block_id, 0);}
+	static LockTarget row(const Identifier& table_name, Handle handle) {return LockTarget(ROW, table_name, handle.first, handle.second);}
+
+	LockTarget parent() const {return level == ROW ? page(table_name, block_id) : table(table_name);}
+	bool operator<(const LockTarget& other) const;
+	std::string to_string() const;
+
+	Level level;
+	Identifier table_name;
+	BlockID block_id;    // 0 for a table
+	RecordID record_id;  // 0 for a table or page
+
+protected:
+	LockTarget(Level level, const Identifier& table_name, BlockID block_id, RecordID record_id) :
+		level(level), table_name(table_name), block_id(block_id), record_id(record_id) {}
+};
+
+/**
+ * @class LockManager - grants transactions shared and exclusive locks on tables, pages and rows, making them wait when they conflict
+ *
+ *      Locks are hierarchical. Before a row is locked, its page and table get the matching
+        intention lock (IS under S, IX under X), so a table lock only has to be checked against the
+        locks on the table itself. A transaction that already holds a lock covering the one it asks
+        for (S or SIX or X on an ancestor for S, X on an ancestor for X) isn't given another.
+
+        Asking for a lock on something the transaction already has locked upgrades it to the least
+        mode stronger than both (S and IX make SIX). Upgrades go ahead of the transactions waiting
+        for new locks; otherwise waiters are served in the order they came, each one granted when
+        it's compatible with every lock held by others and every request ahead of it.
+
+        Before waiting, and again each time it wakes up, a transaction follows the wait-for graph
+        (waiter -> holder of, or earlier request for, a conflicting lock) from itself. If that leads
+        back to it, it gets a DeadlockError instead of waiting forever.
+
+        Escalation keeps a transaction that touches many rows from filling the lock table: once it
+        holds more than page_escalation row locks on one page, it tries for the page lock instead,
+        and once it has more than table_escalation pages of a table locked, the table lock (X if
+        any of them were for writing, S otherwise). An escalation that would have to wait is
+        skipped (and tried again with the next lock).
+
+        Locks are held until release_all(), at commit or rollback (strict two-phase locking). A
+        transaction's locks keep rows from changing under it; they don't stop two writers from
+        changing the same block at once (page latches do that).
+
+        Typical use by a session: lock_table(IX) before inserting and lock_row(X) on the new row's
+        handle after; lock_row(X) before updating or deleting a row; lock_row(S) before reading one
+        (or lock_table(S) to scan the whole table).
+ */
+class LockManager {
+public:
+	enum LockMode {
+		NONE,
+		IS,   // intention shared: will lock parts of this shared
+		IX,   // intention exclusive: will lock parts of this exclusively
+		S,    // shared
+		SIX,  // shared, and will lock parts of this exclusively
+		X     // exclusive
+	};
+
+	/**
+	 * @param page_escalation   row locks one transaction may hold on a page before it tries for the page lock
+	 * @param table_escalation  pages one transaction may have locked in a table before it tries for the table lock
+	 */
+	LockManager(uint page_escalation = DEFAULT_PAGE_ESCALATION, uint table_escalation = DEFAULT_TABLE_ESCALATION) :
+		page_escalation(page_escalation), table_escalation(table_escalation), waits(0), deadlocks(0), escalations(0) {}
+	virtual ~LockManager() {}
+	LockManager(const LockManager& other) = delete;
+	LockManager(LockManager&& temp) = delete;
+	LockManager& operator=(const LockManager& other) = delete;
+	LockManager& operator=(LockManager&& temp) = delete;
+
+	/**
+	 * Lock a target, and its ancestors with the matching intention locks, waiting for conflicting locks to go away.
+	 * @param transaction  who wants it
+	 * @param target       table, page or row
+	 * @param mode         how (not NONE)
+	 * @throws             DeadlockError if waiting would never end
+	 */
+	virtual void lock(TransactionID transaction, const LockTarget& target, LockMode mode);
+
+	virtual void lock_table(TransactionID transaction, const Identifier& table_name, LockMode mode) {
+		lock(transaction, LockTarget::table(table_name), mode);
+	}
+	virtual void lock_page(TransactionID transaction, const Identifier& table_name, BlockID block_id, LockMode mode) {
+		lock(transaction, LockTarget::page(table_name, block_id), mode);
+	}
+	virtual void lock_row(TransactionID transaction, const Identifier& table_name, Handle handle, LockMode mode) {
+		lock(transaction, LockTarget::row(table_name, handle), mode);
+	}
+
+	/**
+	 * Release all of a transaction's locks (at commit or rollback) and wake up whoever was waiting for them.
+	 */
+	virtual void release_all(TransactionID transaction);
+
+	/**
+	 * @returns  the mode the transaction holds the target itself in (NONE if it doesn't, even if an ancestor's lock covers it)
+	 */
+	virtual LockMode held(TransactionID transaction, const LockTarget& target);
+
+	/**
+	 * Counts since construction: times a transaction had to wait, deadlocks found, and escalations done.
+	 */
+	u_int64_t get_waits() {std::lock_guard<std::mutex> guard(latch); return waits;}
+	u_int64_t get_deadlocks() {std::lock_guard<std::mutex> guard(latch); return deadlocks;}
+	u_int64_t get_escalations() {std::lock_guard<std::mutex> guard(latch); return escalations;}
+
+	/**
+	 * Can one transaction hold a lock in mode a while another holds one in mode b?
+	 */
+	static bool compatible(LockMode a, LockMode b);
+
+	/**
+	 * @returns  the least mode at least as strong as both a and b
+	 */
+	static LockMode supremum(LockMode a, LockMode b);
+
+	static const char* name(LockMode mode);
+
+	static const uint DEFAULT_PAGE_ESCALATION = 64;
+	static const uint DEFAULT_TABLE_ESCALATION = 128;
+
+protected:
+	struct Request {
+		TransactionID transaction;
+		LockMode mode;  // what it will hold once granted (an upgrade asks for the supremum)
+	};
+	struct Queue {
+		std::map<TransactionID, LockMode> granted;
+		std::deque<Request> waiting;
+	};
+
+	std::mutex latch;  // guards everything below
+	std::condition_variable released;
+	std::map<LockTarget, Queue> queues;                        // just the targets somebody holds or wants
+	std::map<TransactionID, std::set<LockTarget>> held_locks;
+	std::map<TransactionID, LockTarget> waiting_for;           // what each waiting transaction is waiting for
+	std::map<std::pair<TransactionID, LockTarget>, uint> child_locks;  // locks a transaction holds directly under a table or page
+	uint page_escalation;
+	uint table_escalation;
+	u_int64_t waits, deadlocks, escalations;
+
+	virtual void acquire(std::unique_lock<std::mutex>& guard, TransactionID transaction, const LockTarget& target,
+						 LockMode mode);
+	virtual bool covered(TransactionID transaction, const LockTarget& target, LockMode mode);
+	virtual bool grantable(const Queue& queue, TransactionID transaction, LockMode mode, uint position);
+	virtual bool deadlocked(TransactionID transaction);
+	virtual void blockers(TransactionID transaction, std::vector<TransactionID>& found);
+	virtual void escalate(TransactionID transaction, const LockTarget& target);
+	virtual void forget(TransactionID transaction, const LockTarget& target);
+};
+
+bool test_lock_manager();
@@ -0,0 +1,47 @@
+/**
+ * @file memory_pool.cpp - implementation of MemoryPool
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cstdlib>
+#include <new>
+#include <unordered_map>
+#include <vector>
+#include "memory_pool.h"
+
+using namespace std;
+
+// This thread's free lists, keyed by chunk size.
+class FreeLists {
+public:
+	~FreeLists() {
+		for (auto& free_list : lists)
+			for (auto const& chunk : free_list.second)
+				free(chunk);
+	}
+	unordered_map<size_t, vector<void*>> lists;
+};
+
+static thread_local FreeLists free_lists;
+
+void* MemoryPool::allocate(size_t size) {
+	vector<void*>& free_list = free_lists.lists[size];
+	if (!free_list.empty()) {
+		void* chunk = free_list.back();
+		free_list.pop_back();
+		return chunk;
+	}
+	void* chunk;
+	if (posix_memalign(&chunk, size >= BLOCK_ALIGNMENT ? BLOCK_ALIGNMENT : 16, size) != 0)
+		throw bad_alloc();
+	return chunk;
+}
+
+void MemoryPool::release(void* chunk, size_t size) {
+	if (chunk == nullptr)
+		return;
+	vector<void*>& free_list = free_lists.lists[size];
+	if (free_list.size() >= MAX_FREE)
+		free(chunk);
+	else
+		free_list.push_back(chunk);
+}
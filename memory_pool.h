@@ -0,0 +1,52 @@
+/**
+ * @file memory_pool.h - per-thread recycling of the memory the storage engines churn through
+ * MemoryPool
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <cstddef>
+#include <sys/types.h>
+
+/**
+ * @class MemoryPool - per-thread free lists of memory chunks, one list per chunk size
+ *
+ *      release() keeps a chunk on the calling thread's free list for its size (up to MAX_FREE of
+        them) instead of giving it back to the system, and allocate() takes from that list before
+        asking the system. No locking is needed since each thread only touches its own lists; a chunk
+        may be released by a different thread than allocated it. A thread's lists are freed when
+        it exits.
+
+        Chunks of BLOCK_ALIGNMENT bytes or more are aligned to BLOCK_ALIGNMENT (good enough for
+        O_DIRECT), smaller ones to 16 bytes.
+
+        Used for block buffers, marshaled records and, through their class operator new/delete,
+        SlottedPage objects.
+ */
+class MemoryPool {
+public:
+	/**
+	 * Get a chunk of memory.
+	 * @param size  bytes wanted
+	 * @returns     the chunk (give it back with release(chunk, size))
+	 */
+	static void* allocate(size_t size);
+
+	/**
+	 * Give back a chunk from allocate().
+	 * @param chunk  what allocate() returned (nullptr is ignored)
+	 * @param size   same size it was allocated with
+	 */
+	static void release(void* chunk, size_t size);
+
+	/**
+	 * most unused chunks of any one size kept per thread
+	 */
+	static const uint MAX_FREE = 64;
+
+	/**
+	 * alignment of chunks at least this big
+	 */
+	static const size_t BLOCK_ALIGNMENT = 4096;
+};
@@ -0,0 +1,288 @@
+/**
+ * @file metrics.cpp - implementation of Histogram, Metrics, StatementTimer and MetricsServer
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "metrics.h"
+#include "storage_engine.h"
+
+using namespace std;
+
+/*
+	Histogram
+*/
+
+Histogram::Histogram() : count(0), sum(0) {
+	for (uint i = 0; i < N_BUCKETS; i++)
+		counts[i].store(0, memory_order_relaxed);
+}
+
+void Histogram::record(u_int64_t ns) {
+	counts[bucket(ns)].fetch_add(1, memory_order_relaxed);
+	count.fetch_add(1, memory_order_relaxed);
+	sum.fetch_add(ns, memory_order_relaxed);
+}
+
+u_int64_t Histogram::quantile(double q) const {
+	// add up the buckets rather than trusting count, which a concurrent record() may have gotten to first
+	u_int64_t total = 0;
+	for (uint i = 0; i < N_BUCKETS; i++)
+		total += counts[i].load(memory_order_relaxed);
+	if (total == 0)
+		return 0;
+	u_int64_t rank = (u_int64_t)ceil(q * total);
+	if (rank == 0)
+		rank = 1;
+	u_int64_t seen = 0;
+	for (uint i = 0; i < N_BUCKETS; i++) {
+		seen += counts[i].load(memory_order_relaxed);
+		if (seen >= rank)
+			return highest_in_bucket(i);
+	}
+	return highest_in_bucket(N_BUCKETS - 1);
+}
+
+// Below SUB_BUCKETS, one bucket per value. Above, the top SUB_BUCKET_BITS + 1 bits pick the bucket.
+uint Histogram::bucket(u_int64_t ns) {
+	if (ns < SUB_BUCKETS)
+		return (uint)ns;
+	uint shift = 63 - __builtin_clzll(ns) - SUB_BUCKET_BITS;
+	return SUB_BUCKETS + shift * SUB_BUCKETS + (uint)((ns >> shift) - SUB_BUCKETS);
+}
+
+u_int64_t Histogram::highest_in_bucket(uint bucket) {
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+	uint shift = (bucket - SUB_BUCKETS) / SUB_BUCKETS;
+	u_int64_t lowest = (u_int64_t)(SUB_BUCKETS + (bucket - SUB_BUCKETS) % SUB_BUCKETS) << shift;
+	return lowest + ((u_int64_t)1 << shift) - 1;
+}
+
+
+/*
+	Metrics
+*/
+
+Histogram Metrics::statement_latency[N_STATEMENT_TYPES];
+atomic<u_int64_t> Metrics::statements[N_STATEMENT_TYPES];
+atomic<u_int64_t> Metrics::errors[N_STATEMENT_TYPES];
+Histogram Metrics::page_write_latency;
+atomic<u_int64_t> Metrics::counters[Stats::N_COUNTERS];
+atomic<u_int64_t> Metrics::operator_calls[Stats::N_OPERATORS];
+atomic<u_int64_t> Metrics::operator_ns[Stats::N_OPERATORS];
+
+void Metrics::statement(StatementType type, u_int64_t ns, bool failed) {
+	statements[type].fetch_add(1, memory_order_relaxed);
+	if (failed)
+		errors[type].fetch_add(1, memory_order_relaxed);
+	statement_latency[type].record(ns);
+}
+
+void Metrics::page_write(u_int64_t ns) {
+	page_write_latency.record(ns);
+}
+
+void Metrics::add(const Stats& done) {
+	for (uint i = 0; i < Stats::N_COUNTERS; i++)
+		counters[i].fetch_add(done.get((Stats::Counter)i), memory_order_relaxed);
+	for (uint i = 0; i < Stats::N_OPERATORS; i++) {
+		operator_calls[i].fetch_add(done.get_calls((Stats::Operator)i), memory_order_relaxed);
+		operator_ns[i].fetch_add(done.get_ns((Stats::Operator)i), memory_order_relaxed);
+	}
+}
+
+// The Berkeley DB buffer pool's statistics (the environment is opened DB_THREAD, so from any thread);
+// false if there aren't any to be had.
+static bool cache_stats(u_int64_t& hits, u_int64_t& misses, u_int64_t& pages_in, u_int64_t& pages_out) {
+	if (_DB_ENV == nullptr)
+		return false;
+	DB_MPOOL_STAT* mpool = nullptr;
+	try {
+		if (_DB_ENV->memp_stat(&mpool, nullptr, 0) != 0)
+			return false;
+	}
+	catch (DbException& e) {
+		return false;
+	}
+	hits = mpool->st_cache_hit;
+	misses = mpool->st_cache_miss;
+	pages_in = mpool->st_page_in;
+	pages_out = mpool->st_page_out;
+	free(mpool);
+	return true;
+}
+
+// # HELP and # TYPE lines for a metric
+static void describe(ostream& out, string metric, string type, string help) {
+	out << "# HELP " << metric << " " << help << endl;
+	out << "# TYPE " << metric << " " << type << endl;
+}
+
+// quantiles, sum and count of a histogram as a summary (labels is either empty or like 'type="show",')
+static void summary(ostream& out, string metric, string labels, const Histogram& histogram) {
+	static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+	for (auto const& q : quantiles) {
+		out << metric << "{" << labels << "quantile=\"" << q << "\"} ";
+		if (histogram.get_count() == 0)
+			out << "NaN" << endl;
+		else
+			out << histogram.quantile(q) / 1e9 << endl;
+	}
+	if (!labels.empty())
+		labels = "{" + labels.substr(0, labels.length() - 1) + "}";
+	out << metric << "_sum" << labels << " " << histogram.get_sum() / 1e9 << endl;
+	out << metric << "_count" << labels << " " << histogram.get_count() << endl;
+}
+
+string Metrics::prometheus() {
+	ostringstream out;
+	out << setprecision(9);
+
+	describe(out, "sql5300_statements_total", "counter", "Statements executed, by type.");
+	for (uint i = 0; i < N_STATEMENT_TYPES; i++)
+		out << "sql5300_statements_total{type=\"" << name((StatementType)i) << "\"} "
+			<< statements[i].load(memory_order_relaxed) << endl;
+	describe(out, "sql5300_statement_errors_total", "counter", "Statements that ended in an error, by type.");
+	for (uint i = 0; i < N_STATEMENT_TYPES; i++)
+		out << "sql5300_statement_errors_total{type=\"" << name((StatementType)i) << "\"} "
+			<< errors[i].load(memory_order_relaxed) << endl;
+	describe(out, "sql5300_statement_duration_seconds", "summary", "Time spent executing statements, by type.");
+	for (uint i = 0; i < N_STATEMENT_TYPES; i++)
+		summary(out, "sql5300_statement_duration_seconds", "type=\"" + string(name((StatementType)i)) + "\",",
+				statement_latency[i]);
+	describe(out, "sql5300_page_write_duration_seconds", "summary", "Time spent writing a block out to its file.");
+	summary(out, "sql5300_page_write_duration_seconds", "", page_write_latency);
+
+	for (uint i = 0; i < Stats::N_COUNTERS; i++) {
+		string metric = "sql5300_" + string(Stats::name((Stats::Counter)i)) + "_total";
+		describe(out, metric, "counter", "Running total of " + string(Stats::name((Stats::Counter)i)) + " (see SHOW STATS).");
+		out << metric << " " << counters[i].load(memory_order_relaxed) << endl;
+	}
+	describe(out, "sql5300_operator_calls_total", "counter", "Calls of each storage and executor operator.");
+	for (uint i = 0; i < Stats::N_OPERATORS; i++)
+		out << "sql5300_operator_calls_total{operator=\"" << Stats::name((Stats::Operator)i) << "\"} "
+			<< operator_calls[i].load(memory_order_relaxed) << endl;
+	describe(out, "sql5300_operator_seconds_total", "counter", "Time spent in each storage and executor operator (inclusive).");
+	for (uint i = 0; i < Stats::N_OPERATORS; i++)
+		out << "sql5300_operator_seconds_total{operator=\"" << Stats::name((Stats::Operator)i) << "\"} "
+			<< operator_ns[i].load(memory_order_relaxed) / 1e9 << endl;
+
+	u_int64_t hits = 0, misses = 0, pages_in = 0, pages_out = 0;
+	cache_stats(hits, misses, pages_in, pages_out);
+	describe(out, "sql5300_bdb_cache_hits_total", "counter", "Berkeley DB buffer pool requests found in the cache.");
+	out << "sql5300_bdb_cache_hits_total " << hits << endl;
+	describe(out, "sql5300_bdb_cache_misses_total", "counter", "Berkeley DB buffer pool requests not found in the cache.");
+	out << "sql5300_bdb_cache_misses_total " << misses << endl;
+	describe(out, "sql5300_bdb_cache_hit_ratio", "gauge", "Fraction of Berkeley DB buffer pool requests found in the cache.");
+	out << "sql5300_bdb_cache_hit_ratio " << (hits + misses == 0 ? 0.0 : (double)hits / (hits + misses)) << endl;
+	describe(out, "sql5300_bdb_pages_in_total", "counter", "Pages Berkeley DB read into its buffer pool.");
+	out << "sql5300_bdb_pages_in_total " << pages_in << endl;
+	describe(out, "sql5300_bdb_pages_out_total", "counter", "Pages Berkeley DB wrote out of its buffer pool.");
+	out << "sql5300_bdb_pages_out_total " << pages_out << endl;
+	return out.str();
+}
+
+const char* Metrics::name(StatementType type) {
+	static const char* names[N_STATEMENT_TYPES] = {"create", "drop", "show", "select", "insert", "update", "delete", "other"};
+	return names[type];
+}
+
+
+/*
+	StatementTimer
+*/
+
+StatementTimer::~StatementTimer() {
+	Metrics::statement(type, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count(),
+					   !ok);
+	Metrics::add(Stats::snapshot().since(before));
+}
+
+
+/*
+	MetricsServer
+*/
+
+MetricsServer::MetricsServer(u_int16_t port) : listen_fd(-1), stopping(false) {
+	this->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (this->listen_fd < 0)
+		throw runtime_error(string("can't make a socket: ") + strerror(errno));
+	int on = 1;
+	setsockopt(this->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = htons(port);
+	if (bind(this->listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0
+		|| listen(this->listen_fd, 16) != 0) {
+		string error = strerror(errno);
+		::close(this->listen_fd);
+		throw runtime_error("can't listen on 127.0.0.1:" + to_string(port) + ": " + error);
+	}
+	this->server = thread(&MetricsServer::serve, this);
+}
+
+// Shutting down the socket wakes up the accept() the server thread is waiting in.
+MetricsServer::~MetricsServer() {
+	this->stopping = true;
+	shutdown(this->listen_fd, SHUT_RDWR);
+	this->server.join();
+	::close(this->listen_fd);
+}
+
+void MetricsServer::serve() {
+	while (!this->stopping) {
+		int fd = accept(this->listen_fd, nullptr, nullptr);
+		if (fd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			break;
+		}
+		respond(fd);
+		::close(fd);
+	}
+}
+
+// One request per connection: GET /metrics gets the metrics, anything else a 404.
+void MetricsServer::respond(int fd) {
+	struct timeval timeout = {1, 0};  // don't let a client that never finishes its request hang us
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	string request;
+	char buffer[1024];
+	while (request.find("\r\n\r\n") == string::npos && request.length() < 8192) {
+		ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+		if (n <= 0)
+			break;
+		request.append(buffer, n);
+	}
+
+	string status, body;
+	if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0) {
+		status = "200 OK";
+		body = Metrics::prometheus();
+	}
+	else {
+		status = "404 Not Found";
+		body = "try GET /metrics\n";
+	}
+	string response = "HTTP/1.0 " + status + "\r\n"
+					  + "Content-Type: text/plain; version=0.0.4\r\n"
+					  + "Content-Length: " + to_string(body.length()) + "\r\n"
+					  + "Connection: close\r\n\r\n" + body;
+	for (size_t sent = 0; sent < response.length(); ) {
+		ssize_t n = send(fd, response.data() + sent, response.length() - sent, MSG_NOSIGNAL);
+		if (n <= 0)
+			break;
+		sent += n;
+	}
+}
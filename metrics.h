@@ -0,0 +1,176 @@
+/**
+ * @file metrics.h - process-wide metrics in Prometheus text format
+ * Histogram
+ * Metrics
+ * StatementTimer
+ * MetricsServer
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+#include "stats.h"
+
+/**
+ * @class Histogram - HDR-style latency histogram (log-linear buckets, about 3% precision)
+ *
+ *      Values below 2^SUB_BUCKET_BITS get a bucket each; above that, every power of 2 is split into
+        2^SUB_BUCKET_BITS equal buckets. record() is one relaxed atomic add per counter, so any thread
+        can record while another reads quantiles.
+ */
+class Histogram {
+public:
+	Histogram();
+	Histogram(const Histogram& other) = delete;
+	Histogram(Histogram&& temp) = delete;
+	Histogram& operator=(const Histogram& other) = delete;
+	Histogram& operator=(Histogram&& temp) = delete;
+
+	/**
+	 * Count one value.
+	 * @param ns  the latency in nanoseconds
+	 */
+	void record(u_int64_t ns);
+
+	u_int64_t get_count() const {return count.load(std::memory_order_relaxed);}
+	u_int64_t get_sum() const {return sum.load(std::memory_order_relaxed);}
+
+	/**
+	 * @param q  which quantile, e.g., 0.99
+	 * @returns  value (in nanoseconds) that fraction q of the recorded values are at or below (0 if none)
+	 */
+	u_int64_t quantile(double q) const;
+
+	static const uint SUB_BUCKET_BITS = 5;
+	static const uint SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static const uint N_BUCKETS = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+protected:
+	std::atomic<u_int64_t> counts[N_BUCKETS];
+	std::atomic<u_int64_t> count;
+	std::atomic<u_int64_t> sum;
+
+	static uint bucket(u_int64_t ns);
+	static u_int64_t highest_in_bucket(uint bucket);
+};
+
+/**
+ * @class Metrics - cumulative counters and latency histograms for the whole process
+ *
+ *      Everything is kept in atomics so MetricsServer's thread can read it while statements run.
+        The Stats totals belong to each thread, so a statement's StatementTimer adds what it did
+        (the difference between Stats snapshots) to the process-wide counters when it finishes. The
+        Berkeley DB cache statistics are only read when the metrics are asked for.
+ */
+class Metrics {
+public:
+	enum StatementType {
+		CREATE,
+		DROP,
+		SHOW,
+		SELECT,
+		INSERT,
+		UPDATE,
+		DELETE,
+		OTHER,
+		N_STATEMENT_TYPES
+	};
+
+	/**
+	 * Count a statement and record how long it took.
+	 * @param type    what kind of statement
+	 * @param ns      how long SQLExec::execute spent on it
+	 * @param failed  true if it ended in an error
+	 */
+	static void statement(StatementType type, u_int64_t ns, bool failed);
+
+	/**
+	 * Record how long writing a block out took.
+	 */
+	static void page_write(u_int64_t ns);
+
+	/**
+	 * Add what a statement did to the running totals.
+	 * @param done  the difference between Stats snapshots from before and after it
+	 */
+	static void add(const Stats& done);
+
+	/**
+	 * @returns  all the metrics in the Prometheus text exposition format (with the Berkeley DB cache
+	 *           statistics as of now)
+	 */
+	static std::string prometheus();
+
+protected:
+	static Histogram statement_latency[N_STATEMENT_TYPES];
+	static std::atomic<u_int64_t> statements[N_STATEMENT_TYPES];
+	static std::atomic<u_int64_t> errors[N_STATEMENT_TYPES];
+	static Histogram page_write_latency;
+
+	// added to by add()
+	static std::atomic<u_int64_t> counters[Stats::N_COUNTERS];
+	static std::atomic<u_int64_t> operator_calls[Stats::N_OPERATORS];
+	static std::atomic<u_int64_t> operator_ns[Stats::N_OPERATORS];
+
+	static const char* name(StatementType type);
+};
+
+/**
+ * @class StatementTimer - records a statement with Metrics when it goes out of scope
+ *
+ *      It counts as failed unless succeeded() was called first. What the statement did to the
+        calling thread's Stats while it was in scope is added to Metrics too.
+ */
+class StatementTimer {
+public:
+	StatementTimer(Metrics::StatementType type) : type(type), ok(false), start(std::chrono::steady_clock::now()),
+												  before(Stats::snapshot()) {}
+	~StatementTimer();
+	StatementTimer(const StatementTimer& other) = delete;
+	StatementTimer(StatementTimer&& temp) = delete;
+	StatementTimer& operator=(const StatementTimer& other) = delete;
+	StatementTimer& operator=(StatementTimer&& temp) = delete;
+
+	void succeeded() {ok = true;}
+
+protected:
+	Metrics::StatementType type;
+	bool ok;
+	std::chrono::steady_clock::time_point start;
+	Stats before;
+};
+
+/**
+ * @class MetricsServer - answers GET /metrics on a loopback port with Metrics::prometheus()
+ *
+ *      Runs on its own thread from construction until it is deleted. Only listens on 127.0.0.1,
+        so the metrics are only visible to a scraper (or ssh tunnel) on the same machine.
+ */
+class MetricsServer {
+public:
+	/**
+	 * Start listening.
+	 * @param port  TCP port on 127.0.0.1
+	 * @throws      std::runtime_error if the port can't be had
+	 */
+	MetricsServer(u_int16_t port);
+	virtual ~MetricsServer();
+	MetricsServer(const MetricsServer& other) = delete;
+	MetricsServer(MetricsServer&& temp) = delete;
+	MetricsServer& operator=(const MetricsServer& other) = delete;
+	MetricsServer& operator=(MetricsServer&& temp) = delete;
+
+protected:
+	int listen_fd;
+	std::atomic<bool> stopping;
+	std::thread server;
+
+	virtual void serve();
+	virtual void respond(int fd);
+};
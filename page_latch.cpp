@@ -0,0 +1,63 @@
+/**
+ * @file page_latch.cpp - implementation of PageLatch
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <thread>
+#include "page_latch.h"
+
+using namespace std;
+
+// Announce ourselves so no new shared holders get in, then wait for the ones there to leave.
+void PageLatch::lock() {
+	for (uint spins = 0; ; spins++) {
+		u_int32_t s = this->state.load(memory_order_relaxed);
+		if ((s & ~WAITING) == 0) {
+			if (this->state.compare_exchange_weak(s, WRITER, memory_order_acquire, memory_order_relaxed))
+				break;
+			continue;
+		}
+		if (!(s & WAITING))
+			this->state.fetch_or(WAITING, memory_order_relaxed);
+		pause(spins);
+	}
+	// odd before any of the writer's changes can be seen
+	this->version.store(this->version.load(memory_order_relaxed) + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+}
+
+void PageLatch::unlock() {
+	this->version.store(this->version.load(memory_order_relaxed) + 1, memory_order_release);
+	this->state.store(0, memory_order_release);  // another waiting writer sets WAITING again
+}
+
+void PageLatch::lock_shared() {
+	for (uint spins = 0; ; spins++) {
+		u_int32_t s = this->state.load(memory_order_relaxed);
+		if (!(s & (WRITER | WAITING))) {
+			if (this->state.compare_exchange_weak(s, s + 1, memory_order_acquire, memory_order_relaxed))
+				return;
+			continue;
+		}
+		pause(spins);
+	}
+}
+
+u_int64_t PageLatch::read_begin() const {
+	for (uint spins = 0; ; spins++) {
+		u_int64_t v = this->version.load(memory_order_acquire);
+		if (!(v & 1))
+			return v;
+		pause(spins);
+	}
+}
+
+
+/*
+	PROTECTED
+*/
+
+// Latches are held for microseconds, so spin a little before giving up the CPU.
+void PageLatch::pause(uint spins) {
+	if (spins >= 64)
+		this_thread::yield();
+}
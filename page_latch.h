@@ -0,0 +1,109 @@
+/**
+ * @file page_latch.h - short-term latches that keep threads from changing a block under each other
+ * PageLatch
+ * SharedPageLatch
+ * PageLatches
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <atomic>
+#include <sys/types.h>
+#include "storage_engine.h"
+
+/**
+ * @class PageLatch - reader/writer spin latch on a block, plus a version number for readers that don't take it
+ *
+ *      Held only while a block is being read or changed (never across a wait for a lock, see
+        LockManager). Writers lock() it, which also makes the version odd until unlock() makes it
+        even again. Readers either lock_shared() it, or read optimistically: read_begin() (which
+        waits out a writer), copy what they need out of the block, and keep it only if validate()
+        says no writer got in since. A waiting writer keeps new shared holders out, so a steady
+        stream of readers can't starve it.
+
+        lock() and unlock() are named so that std::lock_guard<PageLatch> works.
+
+        Each latch is padded out to a cache line, so that two of them in an array never share one.
+        (Padded rather than alignas(64): arrays of them are allocated with new, which under C++11
+        only promises the alignment of the largest fundamental type.)
+ */
+class PageLatch {
+public:
+	PageLatch() : state(0), version(0) {}
+	PageLatch(const PageLatch& other) = delete;
+	PageLatch(PageLatch&& temp) = delete;
+	PageLatch& operator=(const PageLatch& other) = delete;
+	PageLatch& operator=(PageLatch&& temp) = delete;
+
+	void lock();
+	void unlock();
+	void lock_shared();
+	void unlock_shared() {state.fetch_sub(1, std::memory_order_release);}
+
+	/**
+	 * Start an optimistic read (after any writer that has the latch now is done).
+	 * @returns  the version to hand to validate() when the read is done
+	 */
+	u_int64_t read_begin() const;
+
+	/**
+	 * @param version  from read_begin()
+	 * @returns        true if no writer has had the latch since read_begin()
+	 */
+	bool validate(u_int64_t version) const {
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return this->version.load(std::memory_order_relaxed) == version;
+	}
+
+protected:
+	static const uint CACHE_LINE = 64;
+
+	std::atomic<u_int32_t> state;    // WRITER and WAITING bits, and how many shared holders there are
+	std::atomic<u_int64_t> version;  // bumped by lock() and by unlock(), so odd while a writer has it
+	char padding[CACHE_LINE - 2 * sizeof(u_int64_t)];  // state and version take 16 bytes
+
+	static const u_int32_t WRITER = 0x80000000U;
+	static const u_int32_t WAITING = 0x40000000U;
+
+	static void pause(uint spins);
+};
+
+/**
+ * @class SharedPageLatch - holds a PageLatch shared from its construction to its destruction
+ */
+class SharedPageLatch {
+public:
+	explicit SharedPageLatch(PageLatch& latch) : latch(latch) {latch.lock_shared();}
+	~SharedPageLatch() {latch.unlock_shared();}
+	SharedPageLatch(const SharedPageLatch& other) = delete;
+	SharedPageLatch(SharedPageLatch&& temp) = delete;
+	SharedPageLatch& operator=(const SharedPageLatch& other) = delete;
+	SharedPageLatch& operator=(SharedPageLatch&& temp) = delete;
+
+protected:
+	PageLatch& latch;
+};
+
+/**
+ * @class PageLatches - the latches for one file's blocks
+ *
+ *      Blocks share a fixed set of N_LATCHES latches (block b gets latch b % N_LATCHES), so the
+        set never has to grow or be looked up under a lock. Nobody holds more than one at a time,
+        so two blocks sharing one can only make somebody wait (or retry a read) now and then.
+ */
+class PageLatches {
+public:
+	PageLatches() {}
+	PageLatches(const PageLatches& other) = delete;
+	PageLatches(PageLatches&& temp) = delete;
+	PageLatches& operator=(const PageLatches& other) = delete;
+	PageLatches& operator=(PageLatches&& temp) = delete;
+
+	PageLatch& get(BlockID block_id) {return latches[block_id % N_LATCHES];}
+
+	static const uint N_LATCHES = 256;
+
+protected:
+	PageLatch latches[N_LATCHES];
+};
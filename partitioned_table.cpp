@@ -0,0 +1,533 @@
+/**
+ * @file partitioned_table.cpp - implementation of PartitionedTable
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <set>
+#include "partitioned_table.h"
+#include "stats.h"
+
+using namespace std;
+
+PartitionedTable::PartitionedTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+								   Method method, Identifier key_column, const vector<Partition>& partitions) :
+	DbRelation(table_name, column_names, column_attributes), method(method), key_column(key_column),
+	key_type(ColumnAttribute::INT), partitions(partitions), by_id(), block_size(0) {
+	auto key = find(column_names.begin(), column_names.end(), key_column);
+	if (key == column_names.end())
+		throw DbRelationError("no column " + key_column + " in table " + table_name + " to partition it by");
+	this->key_type = column_attributes[key - column_names.begin()].get_data_type();
+	if (method == RANGE)
+		sort(this->partitions.begin(), this->partitions.end(), [](const Partition& a, const Partition& b) {
+			return a.upper_bound < b.upper_bound;
+		});
+	else
+		sort(this->partitions.begin(), this->partitions.end(), [](const Partition& a, const Partition& b) {
+			return a.id < b.id;
+		});
+	for (auto& partition : this->partitions)
+		make_table(partition);
+}
+
+PartitionedTable::~PartitionedTable() {
+	for (auto const& partition : this->partitions)
+		delete partition.table;
+}
+
+void PartitionedTable::create() {
+	for (auto const& partition : this->partitions)
+		partition.table->create();
+}
+
+void PartitionedTable::create_if_not_exists() {
+	for (auto const& partition : this->partitions)
+		partition.table->create_if_not_exists();
+}
+
+void PartitionedTable::drop() {
+	for (auto const& partition : this->partitions)
+		partition.table->drop();
+}
+
+void PartitionedTable::discard() {
+	for (auto const& partition : this->partitions)
+		partition.table->discard();
+}
+
+void PartitionedTable::open() {
+	for (auto const& partition : this->partitions)
+		partition.table->open();
+}
+
+void PartitionedTable::close() {
+	for (auto const& partition : this->partitions)
+		partition.table->close();
+}
+
+void PartitionedTable::set_block_size(uint block_size) {
+	for (auto const& partition : this->partitions)
+		partition.table->set_block_size(block_size);
+	this->block_size = block_size;
+}
+
+Handle PartitionedTable::insert(const ValueDict* row) {
+	Partition& partition = partition_of(row);
+	Handle handle = partition.table->insert(row);
+	if (handle.first >> BLOCK_BITS != 0) {
+		partition.table->del(handle);
+		throw DbRelationError("partition " + partition.name + " of " + this->table_name + " is full");
+	}
+	return Handle(partition.id << BLOCK_BITS | handle.first, handle.second);
+}
+
+void PartitionedTable::update(const Handle handle, const ValueDict* new_values) {
+	Handle partition_handle;
+	table_of(handle, partition_handle)->update(partition_handle, new_values);
+}
+
+void PartitionedTable::del(const Handle handle) {
+	Handle partition_handle;
+	table_of(handle, partition_handle)->del(partition_handle);
+}
+
+Handles* PartitionedTable::select() {
+	return select((const Predicates*)nullptr);
+}
+
+Handles* PartitionedTable::select(const ValueDict* where) {
+	if (where == nullptr)
+		return select((const Predicates*)nullptr);
+	Predicates predicates;
+	for (auto const& column : *where)
+		predicates.push_back(Predicate(column.first, Predicate::EQ, column.second));
+	return select(&predicates);
+}
+
+Handles* PartitionedTable::select(const Predicates* where) {
+	Handles* handles = new Handles();
+	try {
+		for (auto partition : pruned(where))
+			scan(*partition, where, handles);
+	}
+	catch (...) {
+		delete handles;
+		throw;
+	}
+	return handles;
+}
+
+ValueDict* PartitionedTable::project(Handle handle) {
+	Handle partition_handle;
+	return table_of(handle, partition_handle)->project(partition_handle);
+}
+
+ValueDict* PartitionedTable::project(Handle handle, const ColumnNames* column_names) {
+	Handle partition_handle;
+	return table_of(handle, partition_handle)->project(partition_handle, column_names);
+}
+
+void PartitionedTable::add_partition(const Partition& partition) {
+	if (this->method != RANGE)
+		throw DbRelationError("only RANGE partitions can be added");
+	if (partition.id >= MAX_PARTITIONS)
+		throw DbRelationError(this->table_name + " can't have more than " + to_string(MAX_PARTITIONS) + " partitions");
+	for (auto const& other : this->partitions)
+		if (other.name == partition.name)
+			throw DbRelationError("partition " + partition.name + " of " + this->table_name + " already exists");
+	if (!this->partitions.empty()) {
+		const Partition& last = this->partitions.back();
+		if (last.upper_bound == Partition::MAXVALUE)
+			throw DbRelationError("partition " + last.name + " of " + this->table_name + " already takes every key from "
+								  + bound_name(this->key_type, lower_bound(this->partitions.size() - 1)) + " up");
+		if (partition.upper_bound <= last.upper_bound)
+			throw DbRelationError("VALUES LESS THAN must be above partition " + last.name + "'s "
+								  + bound_name(this->key_type, last.upper_bound));
+		if (this->block_size == 0) {
+			// match the others (their files know their block size once they're open)
+			this->partitions.front().table->open();
+			this->block_size = this->partitions.front().table->get_block_size();
+		}
+	}
+
+	Partition added = partition;
+	make_table(added);
+	try {
+		added.table->create();
+	}
+	catch (...) {
+		this->by_id[added.id] = nullptr;
+		delete added.table;
+		throw;
+	}
+	this->partitions.push_back(added);
+}
+
+// The rows go with the files; nothing is deleted a row at a time.
+void PartitionedTable::drop_partition(const Identifier& name) {
+	if (this->method != RANGE)
+		throw DbRelationError("only RANGE partitions can be dropped");
+	auto partition = find_if(this->partitions.begin(), this->partitions.end(), [&name](const Partition& p) {
+		return p.name == name;
+	});
+	if (partition == this->partitions.end())
+		throw DbRelationError("no partition " + name + " in " + this->table_name);
+	if (this->partitions.size() == 1)
+		throw DbRelationError(name + " is the only partition of " + this->table_name + " (DROP TABLE drops it)");
+	partition->table->discard();
+	this->by_id[partition->id] = nullptr;
+	delete partition->table;
+	this->partitions.erase(partition);
+}
+
+Handles* PartitionedTable::select_partition(const Identifier& name) {
+	for (auto& partition : this->partitions) {
+		if (partition.name == name) {
+			Handles* handles = new Handles();
+			scan(partition, nullptr, handles);
+			return handles;
+		}
+	}
+	throw DbRelationError("no partition " + name + " in " + this->table_name);
+}
+
+uint PartitionedTable::unused_id() const {
+	uint id = 0;
+	while (id < this->by_id.size() && this->by_id[id] != nullptr)
+		id++;
+	return id;
+}
+
+string PartitionedTable::method_name(Method method) {
+	return method == RANGE ? "RANGE" : "HASH";
+}
+
+PartitionedTable::Method PartitionedTable::method_named(const string& name) {
+	if (name == "RANGE")
+		return RANGE;
+	if (name == "HASH")
+		return HASH;
+	throw DbRelationError("unknown partitioning method '" + name + "'");
+}
+
+bool PartitionedTable::is_acceptable_key(Method method, ColumnAttribute::DataType data_type) {
+	switch (data_type) {
+		case ColumnAttribute::INT:
+		case ColumnAttribute::BIGINT:
+		case ColumnAttribute::DATE:
+		case ColumnAttribute::TIMESTAMP:
+			return true;
+		case ColumnAttribute::TEXT:
+		case ColumnAttribute::BOOLEAN:
+			return method == HASH;
+		default:
+			return false;
+	}
+}
+
+int64_t PartitionedTable::bound_named(ColumnAttribute::DataType data_type, const string& literal) {
+	if (literal == "MAXVALUE")
+		return Partition::MAXVALUE;
+	if (literal.size() > 2 && (literal[0] == '\'' || literal[0] == '"') && literal.back() == literal[0]) {
+		if (data_type != ColumnAttribute::DATE && data_type != ColumnAttribute::TIMESTAMP)
+			throw DbRelationError("only DATE and TIMESTAMP partition bounds can be dates");
+		int64_t days;
+		if (!Value::parse_date(literal.substr(1, literal.size() - 2), days))
+			throw DbRelationError("partition bound " + literal + " isn't a date (YYYY-MM-DD)");
+		return data_type == ColumnAttribute::DATE ? days : days * 86400LL * 1000000;
+	}
+	char* end;
+	errno = 0;
+	long long bound = strtoll(literal.c_str(), &end, 10);
+	if (literal.empty() || *end != '\0' || errno == ERANGE)
+		throw DbRelationError("partition bound " + literal + " isn't an integer");
+	if (bound == Partition::MAXVALUE)
+		throw DbRelationError("partition bound " + literal + " is MAXVALUE");
+	return bound;
+}
+
+string PartitionedTable::bound_name(ColumnAttribute::DataType data_type, int64_t bound) {
+	if (bound == Partition::MAXVALUE)
+		return "MAXVALUE";
+	if (data_type == ColumnAttribute::DATE && bound >= INT_MIN && bound <= INT_MAX)
+		return Value::date((int32_t) bound).to_string();
+	if (data_type == ColumnAttribute::TIMESTAMP)
+		return Value::timestamp(bound).to_string();
+	return to_string(bound);
+}
+
+
+/*
+	PROTECTED
+*/
+
+void PartitionedTable::make_table(Partition& partition) {
+	partition.table = new HeapTable(this->table_name + "." + partition.name, this->column_names, this->column_attributes);
+	if (this->block_size != 0)
+		partition.table->set_block_size(this->block_size);
+	if (partition.id >= this->by_id.size())
+		this->by_id.resize(partition.id + 1, nullptr);
+	this->by_id[partition.id] = partition.table;
+}
+
+HeapTable* PartitionedTable::table_of(Handle handle, Handle& partition_handle) {
+	BlockID id = handle.first >> BLOCK_BITS;
+	if (id >= this->by_id.size() || this->by_id[id] == nullptr)
+		throw DbRelationError("no partition " + to_string(id) + " in " + this->table_name);
+	partition_handle = Handle(handle.first & ((1U << BLOCK_BITS) - 1), handle.second);
+	return this->by_id[id];
+}
+
+Partition& PartitionedTable::partition_of(const ValueDict* row) {
+	if (this->partitions.empty())
+		throw DbRelationError(this->table_name + " has no partitions");
+	auto column = row->find(this->key_column);
+	if (column == row->end())
+		return this->partitions.front();
+	int64_t key = 0;
+	if (column->second.data_type != this->key_type
+		|| (this->method == RANGE && !key_value(column->second, key)))
+		throw DbRelationError(this->key_column + " must be " + ColumnAttribute::type_name(this->key_type));
+	if (this->method == HASH)
+		return this->partitions[hash(column->second) % this->partitions.size()];
+
+	auto partition = upper_bound(this->partitions.begin(), this->partitions.end(), key,
+								 [](int64_t key, const Partition& p) {return key < p.upper_bound;});
+	if (partition == this->partitions.end() && this->partitions.back().upper_bound == Partition::MAXVALUE)
+		partition--;
+	if (partition == this->partitions.end())
+		throw DbRelationError("no partition of " + this->table_name + " for " + this->key_column + " = "
+							  + column->second.to_string());
+	return *partition;
+}
+
+// The partitions whose keys could satisfy the predicates on the key column (a key of another type satisfies nothing
+// but NE, but that's left for the partitions' selects to find out).
+vector<Partition*> PartitionedTable::pruned(const Predicates* where) {
+	vector<Partition*> chosen;
+	if (this->method == HASH) {
+		if (where != nullptr)
+			for (auto const& predicate : *where)
+				if (predicate.column_name == this->key_column && predicate.op == Predicate::EQ
+					&& predicate.value.data_type == this->key_type && !this->partitions.empty()) {
+					chosen.push_back(&this->partitions[hash(predicate.value) % this->partitions.size()]);
+					break;
+				}
+		if (chosen.empty())
+			for (auto& partition : this->partitions)
+				chosen.push_back(&partition);
+	}
+	else {
+		// keys from low to high, inclusive
+		int64_t low = LLONG_MIN, high = LLONG_MAX;
+		if (where != nullptr) {
+			for (auto const& predicate : *where) {
+				int64_t key;
+				if (predicate.column_name != this->key_column || !key_value(predicate.value, key))
+					continue;
+				switch (predicate.op) {
+					case Predicate::EQ:
+						low = max(low, key);
+						high = min(high, key);
+						break;
+					case Predicate::LT:
+						if (key == LLONG_MIN)
+							low = LLONG_MAX, high = LLONG_MIN;
+						else
+							high = min(high, key - 1);
+						break;
+					case Predicate::LE:
+						high = min(high, key);
+						break;
+					case Predicate::GT:
+						if (key == LLONG_MAX)
+							low = LLONG_MAX, high = LLONG_MIN;
+						else
+							low = max(low, key + 1);
+						break;
+					case Predicate::GE:
+						low = max(low, key);
+						break;
+					default:
+						break;
+				}
+			}
+		}
+		for (uint i = 0; i < this->partitions.size() && low <= high; i++) {
+			Partition& partition = this->partitions[i];
+			if (lower_bound(i) <= high && (partition.upper_bound == Partition::MAXVALUE || partition.upper_bound > low))
+				chosen.push_back(&partition);
+		}
+	}
+	if (Stats::tracing && chosen.size() < this->partitions.size()) {
+		string names;
+		for (auto const& partition : chosen)
+			names += (names.empty() ? "" : ", ") + partition->name;
+		Stats::trace("prune " + this->table_name + " to " + to_string(chosen.size()) + " of "
+					 + to_string(this->partitions.size()) + " partitions" + (names.empty() ? "" : " (" + names + ")"));
+	}
+	return chosen;
+}
+
+void PartitionedTable::scan(Partition& partition, const Predicates* where, Handles* handles) {
+	Handles* found = partition.table->select(where);
+	for (auto const& handle : *found)
+		handles->push_back(Handle(partition.id << BLOCK_BITS | handle.first, handle.second));
+	delete found;
+}
+
+// The integer a RANGE key is compared by, if value is of the key's type.
+bool PartitionedTable::key_value(const Value& value, int64_t& key) const {
+	if (value.data_type != this->key_type)
+		return false;
+	switch (value.data_type) {
+		case ColumnAttribute::INT:
+		case ColumnAttribute::DATE:
+			key = value.n;
+			return true;
+		case ColumnAttribute::BIGINT:
+		case ColumnAttribute::TIMESTAMP:
+			key = value.l;
+			return true;
+		default:
+			return false;
+	}
+}
+
+// the lowest key partition i takes
+int64_t PartitionedTable::lower_bound(uint i) const {
+	return i == 0 ? LLONG_MIN : this->partitions[i - 1].upper_bound;
+}
+
+// FNV-1a, so a row hashes to the same partition from one run to the next
+u_int64_t PartitionedTable::hash(const Value& value) {
+	string bytes;
+	switch (value.data_type) {
+		case ColumnAttribute::TEXT:
+			bytes = value.s;
+			break;
+		case ColumnAttribute::BIGINT:
+		case ColumnAttribute::TIMESTAMP:
+			for (uint i = 0; i < 8; i++)
+				bytes += (char) ((u_int64_t) value.l >> (8 * i));
+			break;
+		default:
+			for (uint i = 0; i < 4; i++)
+				bytes += (char) ((u_int32_t) value.n >> (8 * i));
+			break;
+	}
+	u_int64_t h = 14695981039346656037ULL;
+	for (unsigned char c : bytes) {
+		h ^= c;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+
+/*
+	TESTS
+*/
+
+bool test_partitioned_table() {
+	// the partitions pruned() picks, by name, and whether select() finds what a scan of every partition does
+	auto prunes_to = [](PartitionedTable& table, const Predicates& where, const set<Identifier>& expected) {
+		set<Identifier> names;
+		for (auto const& partition : table.pruned(&where))
+			names.insert(partition->name);
+		if (names != expected)
+			return false;
+		Handles every;
+		for (auto& partition : table.partitions)
+			table.scan(partition, &where, &every);
+		Handles* handles = table.select(&where);
+		bool same = set<Handle>(handles->begin(), handles->end()) == set<Handle>(every.begin(), every.end());
+		delete handles;
+		return same;
+	};
+
+	ColumnNames column_names = {"k", "n"};
+	ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::BIGINT), ColumnAttribute(ColumnAttribute::INT)};
+	vector<Partition> partitions = {Partition("high", 2, Partition::MAXVALUE), Partition("low", 0, -100),
+									Partition("middle", 1, 100)};  // any order
+	PartitionedTable range("_test_prange", column_names, column_attributes, PartitionedTable::RANGE, "k", partitions);
+	range.create();
+	int64_t keys[] = {LLONG_MIN, -101, -100, 0, 99, 100, LLONG_MAX};
+	ValueDict row;
+	for (auto const& key : keys) {
+		row["k"] = Value::bigint(key);
+		range.insert(&row);
+	}
+	ValueDict null_key;
+	null_key["n"] = Value(1);
+	Handle null_handle = range.insert(&null_key);
+
+	set<Identifier> all = {"low", "middle", "high"}, none;
+	Value int_zero(0);  // an INT against the BIGINT key says nothing about which partitions
+	bool ok = null_handle.first >> PartitionedTable::BLOCK_BITS == 0  // a NULL key goes in the first partition
+			  && prunes_to(range, {}, all)
+			  && prunes_to(range, {Predicate("k", Predicate::LT, Value::bigint(LLONG_MIN))}, none)
+			  && prunes_to(range, {Predicate("k", Predicate::LE, Value::bigint(LLONG_MIN))}, {"low"})
+			  && prunes_to(range, {Predicate("k", Predicate::GT, Value::bigint(LLONG_MAX))}, none)
+			  && prunes_to(range, {Predicate("k", Predicate::GE, Value::bigint(LLONG_MAX))}, {"high"})
+			  && prunes_to(range, {Predicate("k", Predicate::EQ, Value::bigint(LLONG_MAX))}, {"high"})
+			  && prunes_to(range, {Predicate("k", Predicate::GE, Value::bigint(100))}, {"high"})
+			  && prunes_to(range, {Predicate("k", Predicate::LT, Value::bigint(100))}, {"low", "middle"})
+			  && prunes_to(range, {Predicate("k", Predicate::LT, Value::bigint(-100))}, {"low"})
+			  && prunes_to(range, {Predicate("k", Predicate::GE, Value::bigint(-100)),
+								   Predicate("k", Predicate::LE, Value::bigint(99))}, {"middle"})
+			  && prunes_to(range, {Predicate("k", Predicate::GT, Value::bigint(0)),
+								   Predicate("k", Predicate::LT, Value::bigint(0))}, none)
+			  && prunes_to(range, {Predicate("k", Predicate::EQ, int_zero)}, all)
+			  && prunes_to(range, {Predicate("n", Predicate::EQ, Value(1))}, all);
+	Handles* handles = range.select(&null_key);
+	ok = ok && handles->size() == 1 && handles->at(0) == null_handle;
+	delete handles;
+	range.drop();
+
+	vector<Partition> buckets;
+	for (uint id = 0; id < 4; id++)
+		buckets.push_back(Partition("p" + to_string(id), id, 0));
+	PartitionedTable hashed("_test_phash", column_names, column_attributes, PartitionedTable::HASH, "k", buckets);
+	hashed.create();
+	for (int64_t key = 0; key < 40; key++) {
+		row["k"] = Value::bigint(key);
+		hashed.insert(&row);
+	}
+	null_handle = hashed.insert(&null_key);
+	set<Identifier> every_bucket = {"p0", "p1", "p2", "p3"};
+	for (int64_t key = 0; ok && key < 40; key++) {
+		Predicates where = {Predicate("k", Predicate::EQ, Value::bigint(key))};
+		set<Identifier> bucket = {"p" + to_string(PartitionedTable::hash(Value::bigint(key)) % 4)};
+		handles = hashed.select(&where);
+		ok = handles->size() == 1 && prunes_to(hashed, where, bucket)
+			 && prunes_to(hashed, {Predicate("k", Predicate::EQ, Value((int32_t)key))}, every_bucket);
+		delete handles;
+	}
+	ok = ok && null_handle.first >> PartitionedTable::BLOCK_BITS == 0
+		 && prunes_to(hashed, {Predicate("k", Predicate::GE, Value::bigint(10))}, every_bucket);
+	hashed.drop();
+	if (!ok)
+		return false;
+
+	// date bounds, with February 29th only in leap years
+	for (auto const& date : {"2020-02-29", "2000-02-29", "1970-01-01", "1969-12-31", "2018-07-20"}) {
+		int64_t bound = PartitionedTable::bound_named(ColumnAttribute::DATE, string("'") + date + "'");
+		if (PartitionedTable::bound_name(ColumnAttribute::DATE, bound) != date)
+			return false;
+	}
+	if (PartitionedTable::bound_named(ColumnAttribute::TIMESTAMP, "'1970-01-02'") != 86400LL * 1000000)
+		return false;
+	for (auto const& date : {"'2019-02-29'", "'1900-02-29'", "'2020-02-30'", "'2020-04-31'", "'2020-13-01'",
+							 "'2020-00-10'", "'2020-01-01x'"}) {
+		try {
+			PartitionedTable::bound_named(ColumnAttribute::DATE, date);
+			return false;
+		}
+		catch (DbRelationError& e) {
+			// as it should
+		}
+	}
+	return true;
+}
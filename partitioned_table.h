@@ -0,0 +1,171 @@
+/**
+ * @file partitioned_table.h - a table split by one of its columns into several heap tables
+ * Partition
+ * PartitionedTable: DbRelation
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <climits>
+#include <vector>
+#include "heap_storage.h"
+
+/**
+ * @class Partition - one piece of a PartitionedTable, as kept in the _partitions table
+ */
+class Partition {
+public:
+	Partition(Identifier name, uint id, int64_t upper_bound) : name(name), id(id), upper_bound(upper_bound), table(nullptr) {}
+
+	Identifier name;
+	uint id;              // goes in the top bits of the block ids of its rows' handles (never two the same in a table)
+	int64_t upper_bound;  // RANGE: its keys are below this (MAXVALUE for the last partition to take all the rest); 0 for HASH
+	HeapTable* table;     // <table>.<name> (owned by the PartitionedTable)
+
+	static const int64_t MAXVALUE = LLONG_MAX;
+};
+
+/**
+ * @class PartitionedTable - DbRelation whose rows are spread over several HeapTables by the value of one column
+ *
+ *      CREATE TABLE ... PARTITION BY RANGE (<key>) (PARTITION <name> VALUES LESS THAN (<bound>), ...)
+        puts each row in the first partition (in bound order) whose bound is above its key, so each
+        partition holds the keys from the bound of the one before it up to its own. The last one can
+        be VALUES LESS THAN MAXVALUE to catch all the rest; otherwise a row past the last bound is
+        refused. RANGE keys are INT, BIGINT, DATE or TIMESTAMP columns, and bounds are compared with
+        their integer value (days or microseconds since 1970 for a DATE or TIMESTAMP).
+
+        CREATE TABLE ... PARTITION BY HASH (<key>) PARTITIONS <n> puts each row in partition
+        hash(key) mod n (named p0 ... pn-1). HASH keys can be of any type but DOUBLE. Either way, a
+        row without a key goes in the first partition.
+
+        Each partition is a HeapTable of its own, <table>.<partition>, and a row's handle is its
+        handle in the partition with the partition's id in the top PARTITION_BITS bits of the block
+        id. select() only scans the partitions whose keys could satisfy the predicates on the key
+        column (for HASH only an equality narrows it down, to one partition). So dropping a RANGE
+        partition (ALTER TABLE ... DROP PARTITION, for retention) is just moving its files into the
+        Trash, and its keys are taken over by the next partition up. ALTER TABLE ... ADD PARTITION
+        adds one above the last bound.
+ */
+class PartitionedTable : public DbRelation {
+public:
+	enum Method {
+		RANGE,
+		HASH
+	};
+
+	/**
+	 * @param partitions  from the _partitions table, in any order (their tables aren't made yet)
+	 */
+	PartitionedTable(Identifier table_name, ColumnNames column_names, ColumnAttributes column_attributes,
+					 Method method, Identifier key_column, const std::vector<Partition>& partitions);
+	virtual ~PartitionedTable();
+	PartitionedTable(const PartitionedTable& other) = delete;
+	PartitionedTable(PartitionedTable&& temp) = delete;
+	PartitionedTable& operator=(const PartitionedTable& other) = delete;
+	PartitionedTable& operator=(PartitionedTable&& temp) = delete;
+
+	virtual void create();
+	virtual void create_if_not_exists();
+	virtual void drop();
+	virtual void discard();
+
+	virtual void open();
+	virtual void close();
+
+	virtual void set_block_size(uint block_size);
+
+	virtual Handle insert(const ValueDict* row);
+	virtual void update(const Handle handle, const ValueDict* new_values);
+	virtual void del(const Handle handle);
+
+	virtual Handles* select();
+	virtual Handles* select(const ValueDict* where);
+	virtual Handles* select(const Predicates* where);
+	virtual ValueDict* project(Handle handle);
+	virtual ValueDict* project(Handle handle, const ColumnNames* column_names);
+	using DbRelation::select;
+	using DbRelation::project;
+
+	/**
+	 * Add a RANGE partition above the others and create its files.
+	 * @param partition  its name, id (see unused_id) and upper bound
+	 * @throws           DbRelationError for a HASH table, a name already used, or a bound not above the last one
+	 */
+	virtual void add_partition(const Partition& partition);
+
+	/**
+	 * Drop a RANGE partition, with all its rows, by moving its files into the Trash.
+	 * @throws  DbRelationError for a HASH table, a partition that isn't there, or the only one left
+	 */
+	virtual void drop_partition(const Identifier& name);
+
+	/**
+	 * @returns  the handles of all the rows in one partition (so they can be taken out of indices before it's dropped)
+	 */
+	virtual Handles* select_partition(const Identifier& name);
+
+	/**
+	 * @returns  the lowest partition id not in use
+	 */
+	virtual uint unused_id() const;
+
+	virtual Method get_method() const {return method;}
+	virtual const Identifier& get_key_column() const {return key_column;}
+	virtual ColumnAttribute::DataType get_key_type() const {return key_type;}
+	virtual const std::vector<Partition>& get_partitions() const {return partitions;}
+
+	/**
+	 * @returns  "RANGE" or "HASH" (as kept in _partitions)
+	 */
+	static std::string method_name(Method method);
+
+	/**
+	 * @throws  DbRelationError if name isn't RANGE or HASH
+	 */
+	static Method method_named(const std::string& name);
+
+	/**
+	 * Can a column of this type be the key for this method?
+	 */
+	static bool is_acceptable_key(Method method, ColumnAttribute::DataType data_type);
+
+	/**
+	 * Read a RANGE bound as written in VALUES LESS THAN: an integer, MAXVALUE, or for a DATE or
+	 * TIMESTAMP key, a date in quotes ('2018-07-20', midnight UTC for a TIMESTAMP).
+	 * @throws  DbRelationError if it isn't one of those
+	 */
+	static int64_t bound_named(ColumnAttribute::DataType data_type, const std::string& literal);
+
+	/**
+	 * @returns  a RANGE bound as SQL, e.g., 100, 2018-07-20 or MAXVALUE
+	 */
+	static std::string bound_name(ColumnAttribute::DataType data_type, int64_t bound);
+
+	friend bool test_partitioned_table();
+
+	static const uint PARTITION_BITS = 10;
+	static const uint BLOCK_BITS = 32 - PARTITION_BITS;
+	static const uint MAX_PARTITIONS = 1U << PARTITION_BITS;
+
+protected:
+	Method method;
+	Identifier key_column;
+	ColumnAttribute::DataType key_type;
+	std::vector<Partition> partitions; // RANGE: by upper bound, HASH: by id (which is then the hash bucket)
+	std::vector<HeapTable*> by_id;     // partition tables by id (nullptr for ids not in use)
+	uint block_size;                   // from set_block_size (0 to leave the default), for added partitions too
+
+	virtual void make_table(Partition& partition);
+	virtual HeapTable* table_of(Handle handle, Handle& partition_handle);
+	virtual Partition& partition_of(const ValueDict* row);
+	virtual std::vector<Partition*> pruned(const Predicates* where);
+	virtual void scan(Partition& partition, const Predicates* where, Handles* handles);
+	virtual bool key_value(const Value& value, int64_t& key) const;
+	virtual int64_t lower_bound(uint i) const;
+
+	static u_int64_t hash(const Value& value);
+};
+
+bool test_partitioned_table();
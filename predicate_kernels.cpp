@@ -0,0 +1,260 @@
+/**
+ * @file predicate_kernels.cpp - implementation of PredicateKernels
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "predicate_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+typedef u_int16_t u16;
+
+static uint n_words(uint count) {
+	return (count + 63) / 64;
+}
+
+/*
+ * The kernels. A range kernel writes all n_words(count) words of its selection; an inverted one may
+ * leave bits set past the last value, which the caller clears.
+ */
+
+static void range_scalar(const int32_t* values, uint count, int32_t low, int32_t high, bool invert, uint64_t* words) {
+	for (uint w = 0; w < n_words(count); w++) {
+		uint64_t word = 0;
+		uint n = min(count - w * 64, 64U);
+		for (uint i = 0; i < n; i++) {
+			int32_t value = values[w * 64 + i];
+			word |= (uint64_t)(low <= value && value <= high) << i;
+		}
+		words[w] = invert ? ~word : word;
+	}
+}
+
+static bool bytes_equal_scalar(const char* a, const char* b, uint n) {
+	return memcmp(a, b, n) == 0;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// a word at a time: 64 values, 8 per comparison, collecting the ones outside [low, high]
+__attribute__((target("avx2")))
+static void range_avx2(const int32_t* values, uint count, int32_t low, int32_t high, bool invert, uint64_t* words) {
+	__m256i lows = _mm256_set1_epi32(low);
+	__m256i highs = _mm256_set1_epi32(high);
+	uint i = 0;
+	for (; i + 64 <= count; i += 64) {
+		uint64_t outside = 0;
+		for (uint j = 0; j < 64; j += 8) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(values + i + j));
+			__m256i out = _mm256_or_si256(_mm256_cmpgt_epi32(lows, v), _mm256_cmpgt_epi32(v, highs));
+			outside |= (uint64_t)(uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(out)) << j;
+		}
+		words[i / 64] = invert ? outside : ~outside;
+	}
+	if (i < count)
+		range_scalar(values + i, count - i, low, high, invert, words + i / 64);
+}
+
+__attribute__((target("sse2")))
+static void range_sse2(const int32_t* values, uint count, int32_t low, int32_t high, bool invert, uint64_t* words) {
+	__m128i lows = _mm_set1_epi32(low);
+	__m128i highs = _mm_set1_epi32(high);
+	uint i = 0;
+	for (; i + 64 <= count; i += 64) {
+		uint64_t outside = 0;
+		for (uint j = 0; j < 64; j += 4) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(values + i + j));
+			__m128i out = _mm_or_si128(_mm_cmpgt_epi32(lows, v), _mm_cmpgt_epi32(v, highs));
+			outside |= (uint64_t)(uint8_t)_mm_movemask_ps(_mm_castsi128_ps(out)) << j;
+		}
+		words[i / 64] = invert ? outside : ~outside;
+	}
+	if (i < count)
+		range_scalar(values + i, count - i, low, high, invert, words + i / 64);
+}
+
+__attribute__((target("avx2")))
+static bool bytes_equal_avx2(const char* a, const char* b, uint n) {
+	uint i = 0;
+	for (; i + 32 <= n; i += 32)
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(a + i)),
+												   _mm256_loadu_si256((const __m256i*)(b + i)))) != -1)
+			return false;
+	return memcmp(a + i, b + i, n - i) == 0;
+}
+
+__attribute__((target("sse2")))
+static bool bytes_equal_sse2(const char* a, const char* b, uint n) {
+	uint i = 0;
+	for (; i + 16 <= n; i += 16)
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + i)),
+											 _mm_loadu_si128((const __m128i*)(b + i)))) != 0xFFFF)
+			return false;
+	return memcmp(a + i, b + i, n - i) == 0;
+}
+
+#endif
+
+struct Kernels {
+	const char* name;
+	void (*range)(const int32_t* values, uint count, int32_t low, int32_t high, bool invert, uint64_t* words);
+	bool (*bytes_equal)(const char* a, const char* b, uint n);
+};
+
+static Kernels choose_kernels() {
+#ifdef HAVE_X86_KERNELS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return {"avx2", range_avx2, bytes_equal_avx2};
+	if (__builtin_cpu_supports("sse2"))
+		return {"sse2", range_sse2, bytes_equal_sse2};
+#endif
+	return {"scalar", range_scalar, bytes_equal_scalar};
+}
+
+static const Kernels& kernels() {
+	static const Kernels chosen = choose_kernels();
+	return chosen;
+}
+
+// clear the bits past the last value
+static void trim(PredicateKernels::Selection& selection, uint count) {
+	if (count % 64 != 0)
+		selection.back() &= (1ULL << (count % 64)) - 1;
+}
+
+static void select_range(const int32_t* values, uint count, int32_t low, int32_t high, bool invert,
+						 PredicateKernels::Selection& selection) {
+	selection.assign(n_words(count), 0);
+	if (count == 0)
+		return;
+	kernels().range(values, count, low, high, invert, selection.data());
+	trim(selection, count);
+}
+
+
+/*
+	PUBLIC
+*/
+
+void PredicateKernels::compare(const int32_t* values, uint count, Predicate::Operator op, int32_t constant,
+							   Selection& selection) {
+	switch (op) {
+		case Predicate::EQ:
+			select_range(values, count, constant, constant, false, selection);
+			break;
+		case Predicate::NE:
+			select_range(values, count, constant, constant, true, selection);
+			break;
+		case Predicate::LT:
+			if (constant == INT32_MIN)
+				selection.assign(n_words(count), 0);
+			else
+				select_range(values, count, INT32_MIN, constant - 1, false, selection);
+			break;
+		case Predicate::LE:
+			select_range(values, count, INT32_MIN, constant, false, selection);
+			break;
+		case Predicate::GT:
+			if (constant == INT32_MAX)
+				selection.assign(n_words(count), 0);
+			else
+				select_range(values, count, constant + 1, INT32_MAX, false, selection);
+			break;
+		case Predicate::GE:
+			select_range(values, count, constant, INT32_MAX, false, selection);
+			break;
+		default:
+			throw DbRelationError("unknown comparison operator");
+	}
+}
+
+void PredicateKernels::range(const int32_t* values, uint count, int32_t low, int32_t high, Selection& selection) {
+	select_range(values, count, low, high, false, selection);
+}
+
+void PredicateKernels::equal_texts(const char* values, uint count, const std::string& constant, bool invert,
+								   Selection& selection) {
+	selection.assign(n_words(count), 0);
+	size_t length = constant.length();  // may be longer than any value, which is no reason to match one
+	bool (*bytes_equal)(const char* a, const char* b, uint n) = kernels().bytes_equal;
+	for (uint i = 0; i < count; i++) {
+		u16 size = *(u16*)values;
+		if ((size == length && bytes_equal(values + sizeof(u16), constant.data(), size)) != invert)
+			selection[i / 64] |= 1ULL << (i % 64);
+		values += sizeof(u16) + size;
+	}
+}
+
+bool PredicateKernels::could_match(Predicate::Operator op, int32_t constant, int32_t min, int32_t max) {
+	if (min > max)
+		return false;  // no values at all
+	switch (op) {
+		case Predicate::EQ:
+			return min <= constant && constant <= max;
+		case Predicate::NE:
+			return !(min == constant && max == constant);
+		case Predicate::LT:
+			return min < constant;
+		case Predicate::LE:
+			return min <= constant;
+		case Predicate::GT:
+			return max > constant;
+		case Predicate::GE:
+			return max >= constant;
+		default:
+			throw DbRelationError("unknown comparison operator");
+	}
+}
+
+bool PredicateKernels::satisfies(int comparison, Predicate::Operator op) {
+	switch (op) {
+		case Predicate::EQ:
+			return comparison == 0;
+		case Predicate::NE:
+			return comparison != 0;
+		case Predicate::LT:
+			return comparison < 0;
+		case Predicate::LE:
+			return comparison <= 0;
+		case Predicate::GT:
+			return comparison > 0;
+		case Predicate::GE:
+			return comparison >= 0;
+		default:
+			throw DbRelationError("unknown comparison operator");
+	}
+}
+
+void PredicateKernels::set(Selection& selection, uint from, uint length, bool on) {
+	for (uint i = from; i < from + length; i++) {
+		if (i % 64 == 0 && i + 64 <= from + length) {
+			selection[i / 64] = on ? ~0ULL : 0;  // a whole word at once
+			i += 63;
+		}
+		else if (on) {
+			selection[i / 64] |= 1ULL << (i % 64);
+		}
+		else {
+			selection[i / 64] &= ~(1ULL << (i % 64));
+		}
+	}
+}
+
+bool PredicateKernels::any(const Selection& selection) {
+	for (auto const& word : selection)
+		if (word != 0)
+			return true;
+	return false;
+}
+
+const char* PredicateKernels::implementation() {
+	return kernels().name;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file predicate_kernels.h - evaluating a predicate over a whole array of values at once
+ * PredicateKernels
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include "storage_engine.h"
+
+/**
+ * @class PredicateKernels - tight loops that check a column's values against a constant
+ *
+ *      Results are selection bitmaps: bit i % 64 of word i / 64 is set if value i qualifies (bits
+        past the last value are clear). Every INT comparison is turned into a range check
+        (low <= value <= high, possibly negated), so there's one kernel for all of them.
+
+        Each kernel comes in AVX2, SSE2 and plain C++ versions. Which one is used is decided once,
+        from what CPUID says this processor has, the first time a kernel is called; the compiler
+        flags don't have to ask for AVX2 for the AVX2 versions to be used where they can be.
+ */
+class PredicateKernels {
+public:
+	typedef std::vector<uint64_t> Selection;
+
+	/**
+	 * Which values satisfy <value> <op> <constant>?
+	 * @param values     count values
+	 * @param selection  returned by reference: the qualifying values
+	 */
+	static void compare(const int32_t* values, uint count, Predicate::Operator op, int32_t constant,
+						Selection& selection);
+
+	/**
+	 * Which values are in [low, high]?
+	 * @param values     count values
+	 * @param selection  returned by reference: the qualifying values
+	 */
+	static void range(const int32_t* values, uint count, int32_t low, int32_t high, Selection& selection);
+
+	/**
+	 * Which strings equal constant (or, if invert, don't)?
+	 * @param values     count strings, each a 2-byte length followed by its bytes, one after another
+	 * @param selection  returned by reference: the qualifying values
+	 */
+	static void equal_texts(const char* values, uint count, const std::string& constant, bool invert,
+							Selection& selection);
+
+	/**
+	 * Could any value in [min, max] satisfy <value> <op> <constant>?
+	 */
+	static bool could_match(Predicate::Operator op, int32_t constant, int32_t min, int32_t max);
+
+	/**
+	 * Does a comparison result (< 0, 0, > 0, as from memcmp) satisfy op?
+	 */
+	static bool satisfies(int comparison, Predicate::Operator op);
+
+	/**
+	 * Set (or clear) the bits for values [from, from + length) of a selection.
+	 */
+	static void set(Selection& selection, uint from, uint length, bool on = true);
+
+	/**
+	 * Is any bit of the selection set?
+	 */
+	static bool any(const Selection& selection);
+
+	/**
+	 * @returns  "avx2", "sse2" or "scalar", whichever kernels this processor runs
+	 */
+	static const char* implementation();
+};
@@ -0,0 +1,314 @@
+/**
+ * @file record_codec.cpp - implementation of RecordCodec
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <algorithm>
+#include <cstring>
+#include "record_codec.h"
+
+using namespace std;
+
+typedef u_int16_t u16;
+
+/**
+ * @class FixedIntCodec - codec for a table of N (at most 8) INT columns: every record is a 1-byte null
+ *                        bitmap followed by N 4-byte values, column c at 1 + 4 * c
+ */
+template <uint N>
+class FixedIntCodec : public RecordCodec {
+public:
+	FixedIntCodec(const ColumnNames& column_names, const ColumnAttributes& column_attributes) :
+			RecordCodec(column_names, column_attributes) {}
+
+	virtual uint encode(const ValueDict* row, char* bytes, uint max_inline, uint max_size,
+						const OverflowWriter& put_overflow) const {
+		const uint size = 1 + N * sizeof(int32_t);
+		if (size > max_size)
+			throw DbRelationError("row is too big to fit in a block");
+		const Value** values = gather(row);
+		char nulls = 0;
+		for (uint c = 0; c < N; c++) {
+			if (values[c] == nullptr)
+				nulls |= (char)(1 << c);
+			*(int32_t*)(bytes + 1 + c * sizeof(int32_t)) = values[c] == nullptr ? 0 : values[c]->n;
+		}
+		bytes[0] = nulls;
+		return size;
+	}
+
+	virtual ValueDict* decode(const char* bytes, const OverflowReader& get_overflow) const {
+		ValueDict* row = new ValueDict();
+		for (uint s = 0; s < N; s++) {
+			uint c = this->sorted_columns[s];
+			if (!bit(bytes, c))
+				row->emplace_hint(row->end(), this->sorted_names[s],
+								  Value(*(int32_t*)(bytes + 1 + c * sizeof(int32_t))));
+		}
+		return row;
+	}
+	using RecordCodec::decode;
+};
+
+RecordCodec* RecordCodec::create(const ColumnNames& column_names, const ColumnAttributes& column_attributes) {
+	bool all_int = true;
+	for (auto const& ca : column_attributes)
+		if (ca.get_data_type() != ColumnAttribute::INT)
+			all_int = false;
+	if (all_int) {
+		switch (column_names.size()) {
+			case 1:
+				return new FixedIntCodec<1>(column_names, column_attributes);
+			case 2:
+				return new FixedIntCodec<2>(column_names, column_attributes);
+			case 3:
+				return new FixedIntCodec<3>(column_names, column_attributes);
+			case 4:
+				return new FixedIntCodec<4>(column_names, column_attributes);
+			default:
+				break;
+		}
+	}
+	return new RecordCodec(column_names, column_attributes);
+}
+
+RecordCodec::RecordCodec(const ColumnNames& column_names, const ColumnAttributes& column_attributes) :
+		n(column_names.size()), supported(true) {
+	uint fixed_bytes = 0, n_texts = 0;
+	for (uint c = 0; c < this->n; c++) {
+		ColumnAttribute::DataType data_type = column_attributes[c].get_data_type();
+		this->types.push_back(data_type);
+		if (data_type == ColumnAttribute::TEXT)
+			n_texts++;
+		else if (fixed_width(data_type) == 0)
+			this->supported = false;
+		fixed_bytes += fixed_width(data_type);
+	}
+
+	this->overflow_bitmap = (this->n + 7) / 8;
+	uint fixed_offset = this->overflow_bitmap + (n_texts + 7) / 8;
+	uint text_offset = fixed_offset + fixed_bytes;
+	this->var_start = text_offset + n_texts * sizeof(u16);
+	uint text_number = 0;
+	for (uint c = 0; c < this->n; c++) {
+		if (this->types[c] == ColumnAttribute::TEXT) {
+			this->slots.push_back(text_offset);
+			this->text_numbers.push_back(text_number++);
+			text_offset += sizeof(u16);
+		}
+		else {
+			this->slots.push_back(fixed_offset);
+			this->text_numbers.push_back(0);
+			fixed_offset += fixed_width(this->types[c]);
+		}
+	}
+
+	for (uint c = 0; c < this->n; c++)
+		this->sorted_columns.push_back(c);
+	sort(this->sorted_columns.begin(), this->sorted_columns.end(),
+		 [&column_names](uint a, uint b) {return column_names[a] < column_names[b];});
+	for (auto const& c : this->sorted_columns)
+		this->sorted_names.push_back(column_names[c]);
+}
+
+uint RecordCodec::encode(const ValueDict* row, char* bytes, uint max_inline, uint max_size,
+						 const OverflowWriter& put_overflow) const {
+	if (!this->supported)
+		throw DbRelationError("Don't know how to marshal a column of this data type");
+	const Value** values = gather(row);
+
+	uint size = this->var_start;
+	for (uint c = 0; c < this->n; c++)
+		if (this->types[c] == ColumnAttribute::TEXT && values[c] != nullptr)
+			size += values[c]->s.length() > max_inline ? 2 * sizeof(u_int32_t) : values[c]->s.length();
+
+	// still too big: the longest of the TEXT values left inline go out of line too, until it fits
+	vector<bool> out_of_line;
+	while (size > max_size) {
+		out_of_line.resize(this->n, false);
+		int longest = -1;
+		for (uint c = 0; c < this->n; c++)
+			if (this->types[c] == ColumnAttribute::TEXT && values[c] != nullptr && !out_of_line[c]
+				&& values[c]->s.length() <= max_inline && values[c]->s.length() > 2 * sizeof(u_int32_t)
+				&& (longest < 0 || values[c]->s.length() > values[longest]->s.length()))
+				longest = c;
+		if (longest < 0)
+			throw DbRelationError("row is too big to fit in a block");
+		out_of_line[longest] = true;
+		size -= values[longest]->s.length() - 2 * sizeof(u_int32_t);
+	}
+
+	memset(bytes, 0, this->var_start);
+	uint offset = this->var_start;
+	for (uint c = 0; c < this->n; c++) {
+		const Value* value = values[c];
+		if (value == nullptr)
+			set_bit(bytes, c);
+		if (this->types[c] != ColumnAttribute::TEXT) {
+			char* slot = bytes + this->slots[c];
+			if (value == nullptr)
+				continue;  // already zero
+			switch (this->types[c]) {
+				case ColumnAttribute::INT:
+				case ColumnAttribute::DATE:
+					*(int32_t*)slot = value->n;
+					break;
+				case ColumnAttribute::BIGINT:
+				case ColumnAttribute::TIMESTAMP:
+					*(int64_t*)slot = value->l;
+					break;
+				case ColumnAttribute::DOUBLE:
+					*(double*)slot = value->d;
+					break;
+				default:
+					*slot = value->n != 0;  // BOOLEAN
+			}
+			continue;
+		}
+		if (value == nullptr) {
+			// NULL TEXT is empty
+		}
+		else if (value->s.length() > max_inline || (!out_of_line.empty() && out_of_line[c])) {
+			set_bit(bytes + this->overflow_bitmap, this->text_numbers[c]);
+			*(u_int32_t*)(bytes + offset) = value->s.length();
+			*(u_int32_t*)(bytes + offset + sizeof(u_int32_t)) = put_overflow(value->s);
+			offset += 2 * sizeof(u_int32_t);
+		}
+		else {
+			memcpy(bytes + offset, value->s.data(), value->s.length()); // assume ascii for now
+			offset += value->s.length();
+		}
+		*(u16*)(bytes + this->slots[c]) = offset;
+	}
+	return offset;
+}
+
+ValueDict* RecordCodec::decode(const char* bytes, const OverflowReader& get_overflow) const {
+	if (!this->supported)
+		throw DbRelationError("Don't know how to unmarshal a column of this data type");
+	ValueDict* row = new ValueDict();
+	for (uint s = 0; s < this->n; s++) {
+		Value value;
+		if (decode_column(bytes, this->sorted_columns[s], value, get_overflow))
+			row->emplace_hint(row->end(), this->sorted_names[s], std::move(value));
+	}
+	return row;
+}
+
+ValueDict* RecordCodec::decode(const char* bytes, const ColumnNames* column_names,
+							   const OverflowReader& get_overflow) const {
+	ValueDict* row = new ValueDict();
+	for (auto const& column_name : *column_names) {
+		int column = column_number(column_name);
+		if (column < 0) {
+			delete row;
+			throw DbRelationError("table does not have column named '" + column_name + "'");
+		}
+		Value value;
+		if (decode_column(bytes, column, value, get_overflow))
+			(*row)[column_name] = std::move(value);
+	}
+	return row;
+}
+
+bool RecordCodec::decode_column(const char* bytes, uint column, Value& value, const OverflowReader& get_overflow) const {
+	if (bit(bytes, column))
+		return false;
+	const char* slot = bytes + this->slots[column];
+	value.data_type = this->types[column];
+	switch (this->types[column]) {
+		case ColumnAttribute::INT:
+		case ColumnAttribute::DATE:
+			value.n = *(int32_t*)slot;
+			return true;
+		case ColumnAttribute::BIGINT:
+		case ColumnAttribute::TIMESTAMP:
+			value.l = *(int64_t*)slot;
+			return true;
+		case ColumnAttribute::DOUBLE:
+			value.d = *(double*)slot;
+			return true;
+		case ColumnAttribute::BOOLEAN:
+			value.n = *slot != 0;
+			return true;
+		case ColumnAttribute::TEXT:
+			break;
+		default:
+			throw DbRelationError("Don't know how to unmarshal a column of this data type");
+	}
+
+	// starts where the TEXT value before it ends, whose end offset is right before this one's
+	uint text_number = this->text_numbers[column];
+	uint start = text_number == 0 ? this->var_start : *(u16*)(bytes + this->slots[column] - sizeof(u16));
+	uint end = *(u16*)(bytes + this->slots[column]);
+	if (bit(bytes + this->overflow_bitmap, text_number)) {
+		u_int32_t length = *(u_int32_t*)(bytes + start);
+		BlockID block_id = *(u_int32_t*)(bytes + start + sizeof(u_int32_t));
+		value.s = get_overflow(block_id, length);
+	}
+	else {
+		value.s.assign(bytes + start, end - start);  // assume ascii for now
+	}
+	return true;
+}
+
+void RecordCodec::overflow_chains(const char* bytes, vector<BlockID>& chains) const {
+	for (uint c = 0; c < this->n; c++) {
+		if (this->types[c] != ColumnAttribute::TEXT || bit(bytes, c)
+			|| !bit(bytes + this->overflow_bitmap, this->text_numbers[c]))
+			continue;
+		uint start = this->text_numbers[c] == 0 ? this->var_start : *(u16*)(bytes + this->slots[c] - sizeof(u16));
+		chains.push_back(*(u_int32_t*)(bytes + start + sizeof(u_int32_t)));
+	}
+}
+
+int RecordCodec::column_number(const Identifier& column_name) const {
+	auto it = lower_bound(this->sorted_names.begin(), this->sorted_names.end(), column_name);
+	if (it == this->sorted_names.end() || *it != column_name)
+		return -1;
+	return this->sorted_columns[it - this->sorted_names.begin()];
+}
+
+
+/*
+	PROTECTED
+*/
+
+// bytes a value of the type takes in the fixed part of a record (0 for TEXT, or a type we can't store)
+uint RecordCodec::fixed_width(ColumnAttribute::DataType data_type) {
+	switch (data_type) {
+		case ColumnAttribute::INT:
+		case ColumnAttribute::DATE:
+			return sizeof(int32_t);
+		case ColumnAttribute::BIGINT:
+		case ColumnAttribute::TIMESTAMP:
+			return sizeof(int64_t);
+		case ColumnAttribute::DOUBLE:
+			return sizeof(double);
+		case ColumnAttribute::BOOLEAN:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+// The row's value for each column, by column number (nullptr for NULL). Both the row and sorted_names
+// are in name order, so one pass over the row finds them all. Points into per-thread scratch space
+// good until the next call.
+const Value** RecordCodec::gather(const ValueDict* row) const {
+	static thread_local vector<const Value*> values;
+	values.resize(this->n);
+	auto it = row->begin();
+	for (uint s = 0; s < this->n; s++) {
+		const Identifier& column_name = this->sorted_names[s];
+		while (it != row->end() && it->first < column_name)
+			it++;  // a column we don't store
+		if (it == row->end() || it->first != column_name) {
+			values[this->sorted_columns[s]] = nullptr;
+		}
+		else {
+			values[this->sorted_columns[s]] = &it->second;
+			it++;
+		}
+	}
+	return values.data();
+}
@@ -0,0 +1,120 @@
+/**
+ * @file record_codec.h - turning rows into records and back, specialized to a table's columns
+ * RecordCodec
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <functional>
+#include "storage_engine.h"
+
+/**
+ * @class RecordCodec - the record format of one table's rows, worked out once from its columns
+ *
+ *      Every column has a place at a fixed offset, so any one of them can be read without looking
+        at the others:
+            null bitmap:      (columns + 7) / 8 bytes, bit c set if column c is NULL
+            overflow bitmap:  (TEXT columns + 7) / 8 bytes, bit t set if the t-th TEXT column is out of line
+            other columns:    fixed width, in column order (zero if NULL): INT and DATE 4 bytes,
+                              BIGINT, DOUBLE and TIMESTAMP 8 bytes, BOOLEAN 1 byte
+            TEXT columns:     2-byte record offset of the end of each one's value, in column order
+            then the TEXT values themselves, back to back in column order
+        A TEXT value starts where the one before it ends (the first starts right after the offsets).
+        A NULL TEXT value is empty. One longer than max_inline is stored by the caller somewhere else
+        and takes 8 bytes here: its 4-byte length and the 4-byte block id where the caller put it. If
+        the record would still be bigger than max_size, the longest TEXT values left go the same way
+        until it isn't.
+
+        A NULL is a column that's missing from the row's ValueDict, both going in and coming out.
+
+        The layout and the name order of the columns are figured out when the codec is made, so a
+        whole row is encoded or decoded in a tight loop that walks the ValueDict once in its own
+        (name) order. Tables of only a few INT columns get a template-instantiated codec with the
+        loops unrolled; everything else uses the general one. Make one with create().
+ */
+class RecordCodec {
+public:
+	typedef std::function<BlockID(const std::string&)> OverflowWriter;      // stores a value, returns where
+	typedef std::function<std::string(BlockID, uint)> OverflowReader;       // block id, length -> value
+
+	/**
+	 * Make the best codec for a table with these columns.
+	 * @returns  a new codec (owned by the caller)
+	 */
+	static RecordCodec* create(const ColumnNames& column_names, const ColumnAttributes& column_attributes);
+
+	RecordCodec(const ColumnNames& column_names, const ColumnAttributes& column_attributes);
+	virtual ~RecordCodec() {}
+	RecordCodec(const RecordCodec& other) = delete;
+	RecordCodec(RecordCodec&& temp) = delete;
+	RecordCodec& operator=(const RecordCodec& other) = delete;
+	RecordCodec& operator=(RecordCodec&& temp) = delete;
+
+	/**
+	 * Write the record for a row.
+	 * @param row           a value for each column that isn't NULL (any others are ignored)
+	 * @param bytes         room for at least max_size bytes
+	 * @param max_inline    TEXT values longer than this go to put_overflow (and shorter ones too, longest
+	 *                      first, if that's what it takes to get the record down to max_size)
+	 * @param max_size      biggest record allowed
+	 * @param put_overflow  where long TEXT values go
+	 * @returns             size of the record
+	 * @throws              DbRelationError if the record would be too big even with all its TEXT values
+	 *                      out of line (checked before anything is given to put_overflow)
+	 */
+	virtual uint encode(const ValueDict* row, char* bytes, uint max_inline, uint max_size,
+						const OverflowWriter& put_overflow) const;
+
+	/**
+	 * Read a row back from its record.
+	 * @param bytes         the record
+	 * @param get_overflow  where long TEXT values come back from
+	 * @returns             a new row, without its NULL columns (owned by the caller)
+	 */
+	virtual ValueDict* decode(const char* bytes, const OverflowReader& get_overflow) const;
+
+	/**
+	 * Read just some of the columns of a row back from its record.
+	 * @param column_names  which ones
+	 * @returns             a new row of those columns that aren't NULL (owned by the caller)
+	 * @throws              DbRelationError if one of column_names isn't a column of the table
+	 */
+	virtual ValueDict* decode(const char* bytes, const ColumnNames* column_names,
+							  const OverflowReader& get_overflow) const;
+
+	/**
+	 * Read one column's value straight out of a record.
+	 * @param column  column number
+	 * @param value   set to the value, unless it's NULL
+	 * @returns       false if the value is NULL
+	 */
+	virtual bool decode_column(const char* bytes, uint column, Value& value, const OverflowReader& get_overflow) const;
+
+	/**
+	 * Find where the record's out-of-line TEXT values were put (so they can be freed with the record).
+	 * @param chains  the block ids put_overflow returned for them are appended to it
+	 */
+	virtual void overflow_chains(const char* bytes, std::vector<BlockID>& chains) const;
+
+	/**
+	 * @returns  the column number of column_name, or -1 if the table doesn't have it
+	 */
+	int column_number(const Identifier& column_name) const;
+
+protected:
+	uint n;                                          // number of columns
+	std::vector<ColumnAttribute::DataType> types;    // by column number
+	std::vector<uint> slots;                         // by column number: offset of its value, or a TEXT's end offset
+	std::vector<uint> text_numbers;                  // by column number: which TEXT column it is (TEXT only)
+	uint overflow_bitmap;                            // offset of the overflow bitmap
+	uint var_start;                                  // offset of the first TEXT value
+	std::vector<Identifier> sorted_names;            // column names in ValueDict order
+	std::vector<uint> sorted_columns;                // column number of each of sorted_names
+	bool supported;                                  // every column has a type we know how to store
+
+	const Value** gather(const ValueDict* row) const;
+	static uint fixed_width(ColumnAttribute::DataType data_type);
+	static bool bit(const char* bitmap, uint i) {return (bitmap[i / 8] >> (i % 8)) & 1;}
+	static void set_bit(char* bitmap, uint i) {bitmap[i / 8] |= (char)(1 << (i % 8));}
+};
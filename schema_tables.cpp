@@ -4,16 +4,29 @@
  * @see "Seattle University, CPSC5300, Summer 2018"
  */
 #include "schema_tables.h"
+#include "column_storage.h"
+#include "direct_storage.h"
 #include "ParseTreeToString.h"
 
 
 void initialize_schema_tables() {
+    // the snapshot is only written once the schema tables are all there
+    if (Tables::load_snapshot())
+        return;
+
     Tables tables;
     tables.create_if_not_exists();
     tables.close();
     Columns columns;
     columns.create_if_not_exists();
     columns.close();
+    Indices indices;
+    indices.create_if_not_exists();
+    indices.close();
+    Partitions partitions;
+    partitions.create_if_not_exists();
+    partitions.close();
+    tables.save_snapshot();
 }
 
 // Not terribly useful since the parser weeds most of these out
@@ -33,7 +46,17 @@ bool is_acceptable_identifier(Identifier identifier) {
 }
 
 bool is_acceptable_data_type(std::string dt) {
-    return dt == "INT" || dt == "TEXT";  // for now
+    try {
+        ColumnAttribute::type_named(dt);
+        return true;
+    } catch (DbRelationError& e) {
+        return false;
+    }
+}
+
+bool is_acceptable_storage_engine(std::string engine) {
+    return engine == "HEAP" || engine == "COLUMNAR" || engine == "FLAT" || engine == "DIRECT" || engine == "MMAP"
+           || engine == "PARTITIONED";
 }
 
 
@@ -44,38 +67,47 @@ bool is_acceptable_data_type(std::string dt) {
  */
 const Identifier Tables::TABLE_NAME = "_tables";
 Columns* Tables::columns_table = nullptr;
+Partitions* Tables::partitions_table = nullptr;
+CatalogSnapshot* Tables::snapshot = nullptr;
 std::map<Identifier,DbRelation*> Tables::table_cache;
 
-// get the column name for _tables column
+// get the column names for _tables columns
 ColumnNames& Tables::COLUMN_NAMES() {
     static ColumnNames cn;
-    if (cn.empty())
+    if (cn.empty()) {
         cn.push_back("table_name");
+        cn.push_back("storage_engine");
+    }
     return cn;
 }
 
-// get the column attribute for _tables column
+// get the column attributes for _tables columns
 ColumnAttributes& Tables::COLUMN_ATTRIBUTES() {
     static ColumnAttributes cas;
     if (cas.empty()) {
         ColumnAttribute ca(ColumnAttribute::TEXT);
         cas.push_back(ca);
+        cas.push_back(ca);
     }
     return cas;
 }
 
-// ctor - we have a fixed table structure of just one column: table_name
+// ctor - we have a fixed table structure of two columns: table_name, storage_engine
 Tables::Tables() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
     Tables::table_cache[TABLE_NAME] = this;
     if (Tables::columns_table == nullptr)
         columns_table = new Columns();
     Tables::table_cache[columns_table->TABLE_NAME] = columns_table;
+    if (Tables::partitions_table == nullptr)
+        partitions_table = new Partitions();
+    Tables::table_cache[partitions_table->TABLE_NAME] = partitions_table;
 }
 
 // Create the file and also, manually add schema tables.
 void Tables::create() {
     HeapTable::create();
     ValueDict row;
+    row["storage_engine"] = Value("HEAP");
     row["table_name"] = Value("_tables");
     insert(&row);
     row["table_name"] = Value("_columns");
@@ -84,28 +116,53 @@ void Tables::create() {
 
 // Manually check that table_name is unique.
 Handle Tables::insert(const ValueDict* row) {
+    if (!is_acceptable_storage_engine(row->at("storage_engine").s))
+        throw DbRelationError("unknown storage engine '" + row->at("storage_engine").s + "'");
+
     // Try SELECT * FROM _tables WHERE table_name = row["table_name"] and it should return nothing
-    Handles* handles = select(row);
+    ValueDict where;
+    where["table_name"] = row->at("table_name");
+    Handles* handles = select(&where);
     bool unique = handles->empty();
     delete handles;
     if (!unique)
         throw DbRelationError(row->at("table_name").s + " already exists");
+    if (Tables::snapshot != nullptr)
+        Tables::snapshot->forget(row->at("table_name").s);
+    // a get_table of it from before it existed left a table without columns in the cache
+    auto cached = Tables::table_cache.find(row->at("table_name").s);
+    if (cached != Tables::table_cache.end() && cached->second->get_column_names().empty()) {
+        delete cached->second;
+        Tables::table_cache.erase(cached);
+    }
     return HeapTable::insert(row);
 }
 
 // Remove a row, but first remove from table cache if there
 // NOTE: once the row is deleted, any reference to the table (from get_table() below) is gone! So drop the table first.
 void Tables::del(Handle handle) {
-    // remove from cache, if there
+    uncache(handle);
+    HeapTable::del(handle);
+}
+
+// Remove several rows at once (a block at a time), but first remove each from the table cache
+void Tables::del(const Handles* handles) {
+    for (auto const &handle: *handles)
+        uncache(handle);
+    HeapTable::del(handles);
+}
+
+void Tables::uncache(Handle handle) {
     ValueDict* row = project(handle);
     Identifier table_name = row->at("table_name").s;
+    delete row;
+    if (Tables::snapshot != nullptr)
+        Tables::snapshot->forget(table_name);
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end()) {
         DbRelation* table = Tables::table_cache.at(table_name);
         Tables::table_cache.erase(table_name);
         delete table;
     }
-
-    HeapTable::del(handle);
 }
 
 // Return a list of column names and column attributes for given table.
@@ -113,6 +170,7 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
     // SELECT * FROM _columns WHERE table_name = <table_name>
     ValueDict where;
     where["table_name"] = table_name;
+    Tables::columns_table->open();
     Handles* handles = Tables::columns_table->select(&where);
 
     ColumnAttribute column_attribute;
@@ -122,7 +180,7 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
         Identifier column_name = (*row)["column_name"].s;
         column_names.push_back(column_name);
 
-        column_attribute.set_data_type((*row)["data_type"].s == "INT" ? ColumnAttribute::INT : ColumnAttribute::TEXT);
+        column_attribute.set_data_type(ColumnAttribute::type_named((*row)["data_type"].s));
         column_attributes.push_back(column_attribute);
 
         delete row;
@@ -130,21 +188,137 @@ void Tables::get_columns(Identifier table_name, ColumnNames &column_names, Colum
     delete handles;
 }
 
+// Return the storage engine recorded in _tables for the given table (HEAP if it isn't there).
+Identifier Tables::get_storage_engine(Identifier table_name) {
+    CatalogEntry entry;
+    if (Tables::snapshot != nullptr && Tables::snapshot->get(table_name, entry))
+        return entry.storage_engine;
+
+    ValueDict where;
+    where["table_name"] = table_name;
+    open();
+    Handles* handles = select(&where);
+    Identifier storage_engine = "HEAP";
+    if (!handles->empty()) {
+        ValueDict* row = project(handles->front());
+        storage_engine = row->at("storage_engine").s;
+        delete row;
+    }
+    delete handles;
+    return storage_engine;
+}
+
 // Return a table for given table_name.
 DbRelation& Tables::get_table(Identifier table_name) {
     // if they are asking about a table we've once constructed, then just return that one
     if (Tables::table_cache.find(table_name) != Tables::table_cache.end())
         return  *Tables::table_cache[table_name];
 
-    // otherwise assume it is a HeapTable (for now)
+    // otherwise instantiate it according to its storage engine (from the snapshot if it has it)
     ColumnNames column_names;
     ColumnAttributes column_attributes;
-    get_columns(table_name, column_names, column_attributes);
-    DbRelation* table = new HeapTable(table_name, column_names, column_attributes);
+    Identifier storage_engine;
+    CatalogEntry entry;
+    if (Tables::snapshot != nullptr && Tables::snapshot->get(table_name, entry)) {
+        column_names = entry.column_names;
+        column_attributes = entry.column_attributes;
+        storage_engine = entry.storage_engine;
+    } else {
+        get_columns(table_name, column_names, column_attributes);
+        storage_engine = get_storage_engine(table_name);
+        if (Tables::snapshot != nullptr && !column_names.empty())
+            Tables::snapshot->put(table_name, CatalogEntry(storage_engine, column_names, column_attributes));
+    }
+    DbRelation* table;
+    if (storage_engine == "COLUMNAR")
+        table = new ColumnTable(table_name, column_names, column_attributes);
+    else if (storage_engine == "FLAT")
+        table = new HeapTable(table_name, column_names, column_attributes,
+                              new DirectFile(table_name, DirectFile::BUFFERED));
+    else if (storage_engine == "DIRECT")
+        table = new HeapTable(table_name, column_names, column_attributes,
+                              new DirectFile(table_name, DirectFile::DIRECT));
+    else if (storage_engine == "MMAP")
+        table = new HeapTable(table_name, column_names, column_attributes,
+                              new DirectFile(table_name, DirectFile::MMAP));
+    else if (storage_engine == "PARTITIONED") {
+        PartitionedTable::Method method;
+        Identifier key_column;
+        std::vector<Partition> partitions;
+        Tables::partitions_table->get_partitions(table_name, method, key_column, partitions);
+        table = new PartitionedTable(table_name, column_names, column_attributes, method, key_column, partitions);
+    }
+    else
+        table = new HeapTable(table_name, column_names, column_attributes);
     Tables::table_cache[table_name] = table;
     return *table;
 }
 
+// Take a table out of the cache, leaving it to the caller.
+DbRelation* Tables::release_table(Identifier table_name) {
+    DbRelation* table = &get_table(table_name);
+    Tables::table_cache.erase(table_name);
+    return table;
+}
+
+// Only the tables changed since the last save are looked up; the rest are copied from the old snapshot.
+void Tables::save_snapshot() {
+    if (Tables::snapshot == nullptr)
+        return;
+    try {
+        if (Tables::snapshot->is_loaded()) {
+            std::set<Identifier> changed = Tables::snapshot->get_unknown();
+            for (auto const& table_name: changed) {
+                ColumnNames column_names;
+                ColumnAttributes column_attributes;
+                get_columns(table_name, column_names, column_attributes);
+                if (column_names.empty())
+                    Tables::snapshot->remove(table_name);
+                else
+                    Tables::snapshot->put(table_name, CatalogEntry(get_storage_engine(table_name), column_names,
+                                                                   column_attributes));
+            }
+        } else {
+            // SELECT * FROM _tables, then SELECT * FROM _columns
+            std::map<Identifier, CatalogEntry> entries;
+            open();
+            Handles* handles = select();
+            for (auto const& handle: *handles) {
+                ValueDict* row = project(handle);
+                entries[row->at("table_name").s].storage_engine = row->at("storage_engine").s;
+                delete row;
+            }
+            delete handles;
+            Tables::columns_table->open();
+            handles = Tables::columns_table->select();
+            for (auto const& handle: *handles) {
+                ValueDict* row = Tables::columns_table->project(handle);
+                auto entry = entries.find(row->at("table_name").s);
+                if (entry != entries.end()) {
+                    entry->second.column_names.push_back(row->at("column_name").s);
+                    entry->second.column_attributes.push_back(ColumnAttribute::type_named(row->at("data_type").s));
+                }
+                delete row;
+            }
+            delete handles;
+            for (auto entry = entries.begin(); entry != entries.end(); )
+                entry = entry->second.column_names.empty() ? entries.erase(entry) : ++entry;
+            Tables::snapshot->reset(entries);
+        }
+        Tables::snapshot->save();
+    } catch (DbException& e) {
+        // the schema tables are still right; without the file, the next start builds it again
+    }
+}
+
+bool Tables::load_snapshot() {
+    const char* home;
+    _DB_ENV->get_home(&home);
+    delete Tables::snapshot;
+    Tables::snapshot = new CatalogSnapshot(std::string(home) + "/" + CatalogSnapshot::FILE_NAME);
+    return Tables::snapshot->load();
+}
+
 
 /*
  * ****************************
@@ -188,6 +362,8 @@ void Columns::create() {
     row["table_name"] = Value("_tables");
     row["column_name"] = Value("table_name");
     insert(&row);
+    row["column_name"] = Value("storage_engine");
+    insert(&row);
     row["table_name"] = Value("_columns");
     row["column_name"] = Value("table_name");
     insert(&row);
@@ -218,6 +394,245 @@ Handle Columns::insert(const ValueDict* row) {
     if (!unique)
         throw DbRelationError("duplicate column " + row->at("table_name").s + "." + row->at("column_name").s);
 
+    if (Tables::snapshot != nullptr)
+        Tables::snapshot->forget(row->at("table_name").s);
+    return HeapTable::insert(row);
+}
+
+// Remove a row, but first take its table out of the catalog snapshot
+void Columns::del(Handle handle) {
+    ValueDict* row = project(handle);
+    if (Tables::snapshot != nullptr)
+        Tables::snapshot->forget(row->at("table_name").s);
+    delete row;
+    HeapTable::del(handle);
+}
+
+// Remove several rows at once (a block at a time), but first take their tables out of the catalog snapshot
+void Columns::del(const Handles* handles) {
+    if (Tables::snapshot != nullptr) {
+        for (auto const& handle: *handles) {
+            ValueDict* row = project(handle);
+            Tables::snapshot->forget(row->at("table_name").s);
+            delete row;
+        }
+    }
+    HeapTable::del(handles);
+}
+
+
+/*
+ * ****************************
+ * Indices class implementation
+ * ****************************
+ */
+const Identifier Indices::TABLE_NAME = "_indices";
+std::map<std::pair<Identifier,Identifier>,DbIndex*> Indices::index_cache;
+
+// get the column names for _indices columns
+ColumnNames& Indices::COLUMN_NAMES() {
+    static ColumnNames cn;
+    if (cn.empty()) {
+        cn.push_back("table_name");
+        cn.push_back("index_name");
+        cn.push_back("seq_in_index");
+        cn.push_back("column_name");
+        cn.push_back("index_type");
+        cn.push_back("is_included");
+    }
+    return cn;
+}
+
+// get the column attributes for _indices columns
+ColumnAttributes& Indices::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes cas;
+    if (cas.empty()) {
+        cas.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::INT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::BOOLEAN));
+    }
+    return cas;
+}
+
+// ctor - we have a fixed table structure of six columns
+Indices::Indices() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+}
+
+// Manually check that (table_name, index_name, column_name) is unique and the index type is one we have.
+Handle Indices::insert(const ValueDict* row) {
+    if (row->at("index_type").s != "BTREE")
+        throw DbRelationError("unknown index type '" + row->at("index_type").s + "'");
+
+    ValueDict where;
+    where["table_name"] = row->at("table_name");
+    where["index_name"] = row->at("index_name");
+    where["column_name"] = row->at("column_name");
+    Handles* handles = select(&where);
+    bool unique = handles->empty();
+    delete handles;
+    if (!unique)
+        throw DbRelationError("duplicate index column " + row->at("index_name").s + "." + row->at("column_name").s);
+    return HeapTable::insert(row);
+}
+
+// Remove a row, but first remove the index from the index cache if there
+// NOTE: the cached DbIndex is deleted, so drop the index before deleting its rows.
+void Indices::del(Handle handle) {
+    uncache(handle);
+    HeapTable::del(handle);
+}
+
+// Remove several rows at once (a block at a time), but first remove their indices from the index cache
+void Indices::del(const Handles* handles) {
+    for (auto const &handle: *handles)
+        uncache(handle);
+    HeapTable::del(handles);
+}
+
+void Indices::uncache(Handle handle) {
+    ValueDict* row = project(handle);
+    std::pair<Identifier,Identifier> key(row->at("table_name").s, row->at("index_name").s);
+    delete row;
+    if (Indices::index_cache.find(key) != Indices::index_cache.end()) {
+        DbIndex* index = Indices::index_cache.at(key);
+        Indices::index_cache.erase(key);
+        delete index;
+    }
+}
+
+// Return the names of the indices on the given table, each once.
+ColumnNames Indices::get_index_names(Identifier table_name) {
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    where["seq_in_index"] = Value(1);  // every index has a first column
+    Handles* handles = select(&where);
+    ColumnNames index_names;
+    ColumnNames index_name_column = {"index_name"};
+    for (auto const& handle: *handles) {
+        ValueDict* row = project(handle, &index_name_column);
+        index_names.push_back(row->at("index_name").s);
+        delete row;
+    }
+    delete handles;
+    return index_names;
+}
+
+// Return the key and include columns of the given index, each in seq_in_index order.
+void Indices::get_columns(Identifier table_name, Identifier index_name, ColumnNames &key_columns,
+                          ColumnNames &include_columns) {
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    where["index_name"] = Value(index_name);
+    Handles* handles = select(&where);
+    std::map<int, std::pair<Identifier, bool>> columns;  // seq_in_index -> (column_name, is_included)
+    for (auto const& handle: *handles) {
+        ValueDict* row = project(handle);
+        columns[row->at("seq_in_index").n] = std::make_pair(row->at("column_name").s, row->at("is_included").n != 0);
+        delete row;
+    }
+    delete handles;
+    for (auto const& column: columns)
+        (column.second.second ? include_columns : key_columns).push_back(column.second.first);
+}
+
+// Return an index for the given table and index name.
+DbIndex& Indices::get_index(DbRelation& table, Identifier index_name) {
+    Identifier table_name = table.get_table_name();
+    std::pair<Identifier,Identifier> key(table_name, index_name);
+    if (Indices::index_cache.find(key) != Indices::index_cache.end())
+        return *Indices::index_cache[key];
+
+    ColumnNames key_columns, include_columns;
+    get_columns(table_name, index_name, key_columns, include_columns);
+    if (key_columns.empty())
+        throw DbRelationError("no index " + index_name + " on " + table_name);
+    DbIndex* index = new BTreeIndex(table, index_name, key_columns, include_columns);
+    Indices::index_cache[key] = index;
+    return *index;
+}
+
+// Take an index out of the cache, leaving it to the caller.
+DbIndex* Indices::release_index(DbRelation& table, Identifier index_name) {
+    DbIndex* index = &get_index(table, index_name);
+    Indices::index_cache.erase(std::make_pair(table.get_table_name(), index_name));
+    return index;
+}
+
+
+/*
+ * *******************************
+ * Partitions class implementation
+ * *******************************
+ */
+const Identifier Partitions::TABLE_NAME = "_partitions";
+
+// get the column names for _partitions columns
+ColumnNames& Partitions::COLUMN_NAMES() {
+    static ColumnNames cn;
+    if (cn.empty()) {
+        cn.push_back("table_name");
+        cn.push_back("partition_name");
+        cn.push_back("partition_id");
+        cn.push_back("method");
+        cn.push_back("column_name");
+        cn.push_back("upper_bound");
+    }
+    return cn;
+}
+
+// get the column attributes for _partitions columns
+ColumnAttributes& Partitions::COLUMN_ATTRIBUTES() {
+    static ColumnAttributes cas;
+    if (cas.empty()) {
+        cas.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::INT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::TEXT));
+        cas.push_back(ColumnAttribute(ColumnAttribute::BIGINT));
+    }
+    return cas;
+}
+
+// ctor - we have a fixed table structure of six columns
+Partitions::Partitions() : HeapTable(TABLE_NAME, COLUMN_NAMES(), COLUMN_ATTRIBUTES()) {
+}
+
+// Manually check that (table_name, partition_name) is unique and the method is one we have.
+Handle Partitions::insert(const ValueDict* row) {
+    PartitionedTable::method_named(row->at("method").s);
+    if (!is_acceptable_identifier(row->at("partition_name").s))
+        throw DbRelationError("unacceptable partition name '" + row->at("partition_name").s + "'");
+
+    ValueDict where;
+    where["table_name"] = row->at("table_name");
+    where["partition_name"] = row->at("partition_name");
+    Handles* handles = select(&where);
+    bool unique = handles->empty();
+    delete handles;
+    if (!unique)
+        throw DbRelationError("duplicate partition " + row->at("table_name").s + "." + row->at("partition_name").s);
     return HeapTable::insert(row);
 }
 
+// Return the method, key column and partitions of the given table.
+void Partitions::get_partitions(Identifier table_name, PartitionedTable::Method &method, Identifier &key_column,
+                                std::vector<Partition> &partitions) {
+    ValueDict where;
+    where["table_name"] = Value(table_name);
+    Handles* handles = select(&where);
+    method = PartitionedTable::RANGE;
+    for (auto const& handle: *handles) {
+        ValueDict* row = project(handle);
+        method = PartitionedTable::method_named(row->at("method").s);
+        key_column = row->at("column_name").s;
+        partitions.push_back(Partition(row->at("partition_name").s, row->at("partition_id").n, row->at("upper_bound").l));
+        delete row;
+    }
+    delete handles;
+    if (partitions.empty())
+        throw DbRelationError("no partitions for " + table_name);
+}
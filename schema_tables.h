@@ -1,6 +1,8 @@
 /**
  * @file schema_tables.h - schema table classes:
  * 		Columns
+ * 		Indices
+ * 		Partitions
  * 		Tables
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Summer 2018"
@@ -8,16 +10,21 @@
 #pragma once
 
 #include "heap_storage.h"
+#include "btree.h"
+#include "catalog_snapshot.h"
+#include "partitioned_table.h"
 
 /**
  * Initialize access to the schema tables.
  * Must be called before anything else is done with any of the schema 
  * data structures.
+ * With a catalog snapshot to load, the schema tables aren't opened until they're used.
  */
 void initialize_schema_tables();
 
 
 class Columns; // forward declare
+class Partitions;
 
 /**
  * @class Tables - The singleton table that stores the metadata for all other tables.
@@ -39,6 +46,7 @@ public:
     virtual void create();
     virtual Handle insert(const ValueDict* row);
     virtual void del(Handle handle);
+    virtual void del(const Handles* handles);
 
 	/**
 	 * Get the columns and their attributes for a given table.
@@ -50,6 +58,13 @@ public:
 	 */
     virtual void get_columns(Identifier table_name, ColumnNames &column_names, ColumnAttributes &column_attributes);
 
+	/**
+	 * Get the storage engine a table was created with (HEAP, COLUMNAR, FLAT, DIRECT, MMAP or PARTITIONED).
+	 * @param table_name  table to look up
+	 * @returns           its storage_engine from _tables
+	 */
+    virtual Identifier get_storage_engine(Identifier table_name);
+
 	/**
 	 * Get the correctly instantiated DbRelation for a given table.
 	 * @param table_name  table to get
@@ -57,6 +72,29 @@ public:
 	 */
     virtual DbRelation& get_table(Identifier table_name);
 
+	/**
+	 * Take a table out of the cache without deleting it, e.g., to discard its files once its rows
+	 * are out of the catalog (which would otherwise delete it from the cache).
+	 * @param table_name  table to take
+	 * @returns           instantiated DbRelation, which the caller now owns
+	 */
+    virtual DbRelation* release_table(Identifier table_name);
+
+	/**
+	 * Bring the catalog snapshot up to date after DDL: look up each table changed since it was last
+	 * saved and write it again (or build it from scratch if it has never been loaded).
+	 */
+    virtual void save_snapshot();
+
+	/**
+	 * Load the catalog snapshot from the environment's home.
+	 * @returns  false if there isn't one it can use (so it has to be built with save_snapshot)
+	 */
+    static bool load_snapshot();
+
+	// the definitions in _tables and _columns, for get_table without scanning them (nullptr until loaded)
+    static CatalogSnapshot* snapshot;
+
 protected:
 	// hard-coded columns for _tables table
     static ColumnNames& COLUMN_NAMES();
@@ -65,9 +103,15 @@ protected:
 	// keep a reference to the columns table (for get_columns method)
     static Columns* columns_table;
 
+	// and to the partitions table (for get_table of a PARTITIONED table)
+    static Partitions* partitions_table;
+
 private:
 	// keep a cache of all the tables we've instantiated so far
     static std::map<Identifier,DbRelation*> table_cache;
+
+	// remove the table of a _tables row from the cache (and delete it), if there, and from the snapshot
+    void uncache(Handle handle);
 };
 
 
@@ -88,6 +132,8 @@ public:
 	// HeapTable overrides
     virtual void create();
     virtual Handle insert(const ValueDict* row);
+    virtual void del(Handle handle);
+    virtual void del(const Handles* handles);
 
 protected:
 	// hard-coded columns for the _columns table
@@ -95,3 +141,108 @@ protected:
     static ColumnAttributes& COLUMN_ATTRIBUTES();
 };
 
+
+/**
+ * @class Indices - The singleton table that stores the index metadata for all tables.
+ *
+ *      One row per column of each index: its key columns, in order, by seq_in_index 1, 2, ...,
+        followed by its include columns (is_included) numbered on from there.
+ */
+class Indices : public HeapTable {
+public:
+	/**
+	 * Name of the indices table ("_indices")
+	 */
+    static const Identifier TABLE_NAME;
+
+	// ctor/dtor
+    Indices();
+    virtual ~Indices() {}
+
+	// HeapTable overrides
+    virtual Handle insert(const ValueDict* row);
+    virtual void del(Handle handle);
+    virtual void del(const Handles* handles);
+
+	/**
+	 * Get the names of all the indices on a table.
+	 * @param table_name  table to get index names for
+	 * @returns           index names, each once
+	 */
+    virtual ColumnNames get_index_names(Identifier table_name);
+
+	/**
+	 * Get the columns of an index.
+	 * @param table_name       table the index is on
+	 * @param index_name       index to get column info for
+	 * @param key_columns      returned by reference: its key columns, in order
+	 * @param include_columns  returned by reference: its include columns
+	 */
+    virtual void get_columns(Identifier table_name, Identifier index_name, ColumnNames &key_columns,
+                             ColumnNames &include_columns);
+
+	/**
+	 * Get the correctly instantiated DbIndex for a given index.
+	 * @param table       table the index is on (from Tables::get_table)
+	 * @param index_name  index to get
+	 * @returns           instantiated DbIndex of the correct type
+	 */
+    virtual DbIndex& get_index(DbRelation& table, Identifier index_name);
+
+	/**
+	 * Take an index out of the cache without deleting it (see Tables::release_table).
+	 * @param table       table the index is on
+	 * @param index_name  index to take
+	 * @returns           instantiated DbIndex, which the caller now owns
+	 */
+    virtual DbIndex* release_index(DbRelation& table, Identifier index_name);
+
+protected:
+	// hard-coded columns for the _indices table
+    static ColumnNames& COLUMN_NAMES();
+    static ColumnAttributes& COLUMN_ATTRIBUTES();
+
+private:
+	// keep a cache of all the indices we've instantiated so far
+    static std::map<std::pair<Identifier,Identifier>,DbIndex*> index_cache;
+
+	// remove the index of an _indices row from the cache (and delete it), if there
+    void uncache(Handle handle);
+};
+
+
+/**
+ * @class Partitions - The singleton table that stores the partition maps of the PARTITIONED tables.
+ *
+ *      One row per partition, each with the table's method (RANGE or HASH) and key column, and its
+        own id and upper bound (see Partition).
+ */
+class Partitions : public HeapTable {
+public:
+	/**
+	 * Name of the partitions table ("_partitions")
+	 */
+    static const Identifier TABLE_NAME;
+
+	// ctor/dtor
+    Partitions();
+    virtual ~Partitions() {}
+
+	// HeapTable overrides
+    virtual Handle insert(const ValueDict* row);
+
+	/**
+	 * Get the partition map of a table.
+	 * @param table_name   table to get the partitions of
+	 * @param method       returned by reference: RANGE or HASH
+	 * @param key_column   returned by reference: column the table is partitioned by
+	 * @param partitions   returned by reference: its partitions (in no particular order)
+	 */
+    virtual void get_partitions(Identifier table_name, PartitionedTable::Method &method, Identifier &key_column,
+                                std::vector<Partition> &partitions);
+
+protected:
+	// hard-coded columns for the _partitions table
+    static ColumnNames& COLUMN_NAMES();
+    static ColumnAttributes& COLUMN_ATTRIBUTES();
+};
@@ -0,0 +1,134 @@
+/**
+ * @file slow_query_log.cpp - implementation of SlowQueryLog
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+#include "slow_query_log.h"
+
+using namespace std;
+
+SlowQueryLog::SlowQueryLog(string path, double threshold_ms, u_int64_t max_bytes, uint max_files) :
+		path(path), threshold_ms(threshold_ms), max_bytes(max_bytes), max_files(max_files), bytes(0),
+		dropped(0), stopping(false) {
+	open_file();
+	this->writer = thread(&SlowQueryLog::write_entries, this);
+}
+
+SlowQueryLog::~SlowQueryLog() {
+	{
+		lock_guard<std::mutex> lock(this->queue_mutex);
+		this->stopping = true;
+	}
+	this->work_ready.notify_one();
+	this->writer.join();
+}
+
+void SlowQueryLog::log(const string& statement, double elapsed_ms, u_int64_t rows_examined, const string& plan) {
+	Entry entry = {chrono::system_clock::now(), statement, elapsed_ms, rows_examined, plan};
+	{
+		lock_guard<std::mutex> lock(this->queue_mutex);
+		if (this->queue.size() >= MAX_QUEUE) {
+			this->dropped++;
+			return;
+		}
+		this->queue.push_back(entry);
+	}
+	this->work_ready.notify_one();
+}
+
+u_int64_t SlowQueryLog::get_dropped() {
+	lock_guard<std::mutex> lock(this->queue_mutex);
+	return this->dropped;
+}
+
+
+/*
+	PROTECTED
+*/
+
+// Writer thread: take everything that's queued, write it without holding the lock, repeat.
+void SlowQueryLog::write_entries() {
+	unique_lock<std::mutex> lock(this->queue_mutex);
+	while (true) {
+		this->work_ready.wait(lock, [this] {return this->stopping || !this->queue.empty();});
+		if (this->queue.empty())
+			break;  // stopping, and nothing left to write
+		deque<Entry> batch;
+		batch.swap(this->queue);
+		lock.unlock();
+		for (auto const& entry : batch)
+			write(entry);
+		this->out.flush();
+		lock.lock();
+	}
+}
+
+// text in double quotes, with quotes, backslashes and line breaks escaped so each entry stays on one line
+static string quoted(const string& s) {
+	string q = "\"";
+	for (auto const& c : s) {
+		if (c == '"' || c == '\\')
+			q += '\\';
+		if (c == '\n')
+			q += "\\n";
+		else if (c == '\r')
+			q += "\\r";
+		else
+			q += c;
+	}
+	return q + "\"";
+}
+
+void SlowQueryLog::write(const Entry& entry) {
+	time_t seconds = chrono::system_clock::to_time_t(entry.when);
+	long ms = chrono::duration_cast<chrono::milliseconds>(entry.when.time_since_epoch()).count() % 1000;
+	struct tm utc;
+	gmtime_r(&seconds, &utc);
+	char when[32];
+	strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &utc);
+
+	ostringstream line;
+	line << when << "." << setfill('0') << setw(3) << ms << "Z"
+		 << " duration_ms=" << fixed << setprecision(3) << entry.elapsed_ms
+		 << " rows_examined=" << entry.rows_examined
+		 << " statement=" << quoted(entry.statement)
+		 << " plan=" << quoted(entry.plan) << endl;
+	string text = line.str();
+
+	if (this->bytes > 0 && this->bytes + text.length() > this->max_bytes)
+		rotate();
+	this->out << text;
+	this->bytes += text.length();
+}
+
+void SlowQueryLog::open_file() {
+	this->out.open(this->path, ios::out | ios::app);
+	if (!this->out)
+		throw runtime_error("can't open slow query log " + this->path + ": " + strerror(errno));
+	this->out.seekp(0, ios::end);
+	this->bytes = (u_int64_t)this->out.tellp();
+}
+
+// <path>.<n-1> -> <path>.<n>, ..., <path> -> <path>.1, and start a new <path>
+void SlowQueryLog::rotate() {
+	this->out.close();
+	if (this->max_files == 0) {
+		remove(this->path.c_str());
+	}
+	else {
+		for (uint n = this->max_files - 1; n >= 1; n--)
+			rename((this->path + "." + to_string(n)).c_str(), (this->path + "." + to_string(n + 1)).c_str());
+		rename(this->path.c_str(), (this->path + ".1").c_str());
+	}
+	try {
+		open_file();
+	}
+	catch (runtime_error& e) {
+		this->bytes = 0;  // nowhere to write; later entries are lost
+	}
+}
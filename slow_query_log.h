@@ -0,0 +1,99 @@
+/**
+ * @file slow_query_log.h - log of the statements that took too long, written in the background
+ * SlowQueryLog
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+
+/**
+ * @class SlowQueryLog - appends a line to a file for each statement that ran longer than a threshold
+ *
+ *      log() just puts the entry on a queue for the writer thread (or drops it, if MAX_QUEUE entries
+        are already waiting), so a statement never waits on the disk. When the file gets to max_bytes,
+        it becomes <path>.1 (<path>.1 becomes <path>.2, and so on, keeping max_files old files) and
+        a new <path> is started. Each line looks like:
+            2018-07-20T17:03:12.345Z duration_ms=1234.567 rows_examined=80000 statement="..." plan="..."
+ */
+class SlowQueryLog {
+public:
+	/**
+	 * Open (or continue) the log and start the writer thread.
+	 * @param path          log file
+	 * @param threshold_ms  statements taking at least this many milliseconds are slow
+	 * @param max_bytes     size at which the file is rotated
+	 * @param max_files     how many rotated files to keep
+	 * @throws              std::runtime_error if path can't be opened
+	 */
+	SlowQueryLog(std::string path, double threshold_ms, u_int64_t max_bytes, uint max_files);
+
+	/**
+	 * Writes out whatever is still queued, then stops the writer thread.
+	 */
+	virtual ~SlowQueryLog();
+	SlowQueryLog(const SlowQueryLog& other) = delete;
+	SlowQueryLog(SlowQueryLog&& temp) = delete;
+	SlowQueryLog& operator=(const SlowQueryLog& other) = delete;
+	SlowQueryLog& operator=(SlowQueryLog&& temp) = delete;
+
+	/**
+	 * Is a statement that took this long slow enough to log?
+	 */
+	bool is_slow(double elapsed_ms) const {return elapsed_ms >= threshold_ms;}
+
+	/**
+	 * Queue an entry for the log.
+	 * @param statement      the statement's SQL
+	 * @param elapsed_ms     how long it took
+	 * @param rows_examined  rows its scans looked at
+	 * @param plan           the steps it took (from Stats::plan())
+	 */
+	virtual void log(const std::string& statement, double elapsed_ms, u_int64_t rows_examined, const std::string& plan);
+
+	/**
+	 * @returns  number of entries thrown away because the queue was full
+	 */
+	u_int64_t get_dropped();
+
+	/**
+	 * most entries waiting for the writer before log() starts dropping them
+	 */
+	static const uint MAX_QUEUE = 1000;
+
+protected:
+	struct Entry {
+		std::chrono::system_clock::time_point when;
+		std::string statement;
+		double elapsed_ms;
+		u_int64_t rows_examined;
+		std::string plan;
+	};
+	std::string path;
+	double threshold_ms;
+	u_int64_t max_bytes;
+	uint max_files;
+	std::ofstream out;
+	u_int64_t bytes;  // in the current file
+
+	std::mutex queue_mutex;
+	std::condition_variable work_ready;
+	std::deque<Entry> queue;
+	u_int64_t dropped;
+	bool stopping;
+	std::thread writer;
+
+	virtual void write_entries();
+	virtual void write(const Entry& entry);
+	virtual void open_file();
+	virtual void rotate();
+};
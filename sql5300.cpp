@@ -8,11 +8,27 @@
 #include <cstring>
 #include <iostream>
 #include <string>
+#include <sstream>
 #include <cassert>
+#include <chrono>
 #include "db_cxx.h"
 #include "SQLParser.h"
 #include "sqlhelper.h"
-#include "heap_storage.h"
+#include "ParseTreeToString.h"
+#include "SQLExec.h"
+#include "bitmap_scan.h"
+#include "btree.h"
+#include "catalog_snapshot.h"
+#include "column_encoding.h"
+#include "direct_storage.h"
+#include "lock_manager.h"
+#include "metrics.h"
+#include "partitioned_table.h"
+#include "slow_query_log.h"
+#include "stats.h"
+#include "trash.h"
+#include "wire_protocol.h"
+#include "zone_map.h"
 using namespace std;
 using namespace hsql;
 
@@ -21,255 +37,148 @@ using namespace hsql;
  */
 DbEnv* _DB_ENV;
 
-// forward declare
-string operatorExpressionToString(const Expr* expr);
-
-/**
- * Convert the hyrise Expr AST back into the equivalent SQL
- * @param expr expression to unparse
- * @return     SQL equivalent to *expr
- */
-string expressionToString(const Expr *expr) {
-	string ret;
-	switch (expr->type) {
-	case kExprStar:
-		ret += "*";
-		break;
-	case kExprColumnRef:
-		if (expr->table != NULL)
-			ret += string(expr->table) + ".";
-	case kExprLiteralString:
-		ret += expr->name;
-		break;
-	case kExprLiteralFloat:
-		ret += to_string(expr->fval);
-		break;
-	case kExprLiteralInt:
-		ret += to_string(expr->ival);
-		break;
-	case kExprFunctionRef:
-		ret += string(expr->name) + "?" + expr->expr->name;
-		break;
-	case kExprOperator:
-		ret += operatorExpressionToString(expr);
-		break;
-	default:
-		ret += "???";  // in case there are exprssion types we don't know about here
-		break;
-	}
-	if (expr->alias != NULL)
-		ret += string(" AS ") + expr->alias;
-	return ret;
-}
-
-/**
- * Convert the hyrise Expr AST for an operator expression back into the equivalent SQL
- * @param expr operator expression to unparse
- * @return     SQL equivalent to *expr
- */
-string operatorExpressionToString(const Expr* expr) {
-	if (expr == NULL)
-		return "null";
-
-	string ret;
-	// Unary prefix operator: NOT
-	if(expr->opType == Expr::NOT)
-		ret += "NOT ";
-
-	// Left-hand side of expression
-	ret += expressionToString(expr->expr) + " ";
-
-	// Operator itself
-	switch (expr->opType) {
-	case Expr::SIMPLE_OP:
-		ret += expr->opChar;
-		break;
-	case Expr::AND:
-		ret += "AND";
-		break;
-	case Expr::OR:
-		ret += "OR";
-		break;
-	default:
-		break; // e.g., for NOT
-	}
-
-	// Right-hand side of expression (only present for binary operators)
-	if (expr->expr2 != NULL)
-		ret += " " + expressionToString(expr->expr2);
-	return ret;
-}
-
 /**
- * Convert the hyrise TableRef AST back into the equivalent SQL
- * @param table  table reference AST to unparse
- * @return       SQL equivalent to *table
+ * How many rows of a result the shell prints before waiting for FETCH
  */
-string tableRefInfoToString(const TableRef *table) {
-	string ret;
-	switch (table->type) {
-	case kTableSelect:
-		ret += "kTableSelect FIXME"; // FIXME
-		break;
-	case kTableName:
-		ret += table->name;
-		if (table->alias != NULL)
-			ret += string(" AS ") + table->alias;
-		break;
-	case kTableJoin:
-		ret += tableRefInfoToString(table->join->left);
-		switch (table->join->type) {
-		case kJoinCross:
-		case kJoinInner:
-			ret += " JOIN ";
-			break;
-		case kJoinOuter:
-		case kJoinLeftOuter:
-		case kJoinLeft:
-			ret += " LEFT JOIN ";
-			break;
-		case kJoinRightOuter:
-		case kJoinRight:
-			ret += " RIGHT JOIN ";
-			break;
-		case kJoinNatural:
-			ret += " NATURAL JOIN ";
-			break;
-		}
-		ret += tableRefInfoToString(table->join->right);
-		if (table->join->condition != NULL)
-			ret += " ON " + expressionToString(table->join->condition);
-		break;
-	case kTableCrossProduct:
-		bool doComma = false;
-		for (TableRef* tbl : *table->list) {
-			if (doComma)
-				ret += ", ";
-			ret += tableRefInfoToString(tbl);
-			doComma = true;
-		}
-		break;
-	}
-	return ret;
-}
+const uint PAGE_ROWS = 100;
 
 /**
- * Convert the hyrise ColumnDefinition AST back into the equivalent SQL
- * @param col  column definition to unparse
- * @return     SQL equivalent to *col
+ * Recognize the shell's FETCH [n|ALL] command.
+ * @param query  line typed into the shell
+ * @param n      returned by reference: number of rows asked for (PAGE_ROWS if not given, 0 for ALL)
+ * @returns      true if query is a FETCH command
  */
-string columnDefinitionToString(const ColumnDefinition *col) {
-	string ret(col->name);
-	switch(col->type) {
-	case ColumnDefinition::DOUBLE:
-		ret += " DOUBLE";
-		break;
-	case ColumnDefinition::INT:
-		ret += " INT";
-		break;
-	case ColumnDefinition::TEXT:
-		ret += " TEXT";
-		break;
-	default:
-		ret += " ...";
-		break;
-	}
-	return ret;
+bool is_fetch(const string &query, uint &n) {
+	istringstream words(query);
+	string word, count, extra;
+	words >> word >> count >> extra;
+	for (auto &c : word)
+		c = toupper(c);
+	for (auto &c : count)
+		c = toupper(c);
+	if (word != "FETCH" || !extra.empty())
+		return false;
+	if (count.empty())
+		n = PAGE_ROWS;
+	else if (count == "ALL")
+		n = 0;
+	else if (count.find_first_not_of("0123456789") == string::npos)
+		n = (uint)stoul(count);
+	else
+		return false;
+	return true;
 }
 
 /**
- * Execute an SQL select statement (but for now, just spit back the SQL)
- * @param stmt  Hyrise AST for the select statement
- * @returns     a string (for now) of the SQL statment
+ * Find the end of the batch starting at a statement: a run of INSERT ... VALUES statements into the
+ * same table goes to SQLExec as one batch, anything else on its own.
+ * @param result      the parsed statements
+ * @param extensions  our additions to each of them
+ * @param i           index of the first statement in the batch
+ * @returns           index just past its last statement
  */
-string executeSelect(const SelectStatement *stmt) {
-	string ret("SELECT ");
-	bool doComma = false;
-	for (Expr* expr : *stmt->selectList) {
-		if(doComma)
-			ret += ", ";
-		ret += expressionToString(expr);
-		doComma = true;
-	}
-	ret += " FROM " + tableRefInfoToString(stmt->fromTable);
-	if (stmt->whereClause != NULL)
-		ret += " WHERE " + expressionToString(stmt->whereClause);
-	return ret;
+uint batch_end(const SQLParserResult *result, const vector<SQLExtensions> &extensions, uint i) {
+	if (i < extensions.size() && extensions[i].explain_analyze)
+		return i + 1;
+	uint end = i + 1;
+	while (end < result->size() && SQLExec::batches_with(result->getStatement(end),
+			end < extensions.size() ? extensions[end] : SQLExtensions(), result->getStatement(end - 1)))
+		end++;
+	return end;
 }
 
 /**
- * Execute an SQL insert statement (but for now, just spit back the SQL)
- * @param stmt  Hyrise AST for the insert statement
- * @returns     a string (for now) of the SQL statment
+ * Finish off a page of output. If the result has more rows, tell the user how to get them.
+ * @param result  result that was just printed from
+ * @returns       true if rows remain for a later FETCH
  */
-string executeInsert(const InsertStatement *stmt) {
-	return "INSERT ...";
-}
-
-/**
- * Execute an SQL create statement (but for now, just spit back the SQL)
- * @param stmt  Hyrise AST for the create statement
- * @returns     a string (for now) of the SQL statment
- */
-string executeCreate(const CreateStatement *stmt) {
-	string ret("CREATE TABLE ");
-	if (stmt->type != CreateStatement::kTable )
-		return ret + "...";
-	if (stmt->ifNotExists)
-		ret += "IF NOT EXISTS ";
-	ret += string(stmt->tableName) + " (";
-	bool doComma = false;
-	for (ColumnDefinition *col : *stmt->columns) {
-		if(doComma)
-			ret += ", ";
-		ret += columnDefinitionToString(col);
-		doComma = true;
-	}
-	ret += ")";
-	return ret;
-}
-
-/**
- * Execute an SQL statement (but for now, just spit back the SQL)
- * @param stmt  Hyrise AST for the statement
- * @returns     a string (for now) of the SQL statment
- */
-string execute(const SQLStatement *stmt) {
-	switch (stmt->type()) {
-	case kStmtSelect:
-		return executeSelect((const SelectStatement*) stmt);
-	case kStmtInsert:
-		return executeInsert((const InsertStatement*) stmt);
-	case kStmtCreate:
-		return executeCreate((const CreateStatement*) stmt);
-	default:
-		return "Not implemented";
-	}
+bool more_to_fetch(QueryResult *result) {
+	if (result->has_more())
+		cout << "(more rows -- FETCH [n] to continue)";
+	cout << endl;
+	return result->has_more();
 }
 
 /**
  * Main entry point of the sql5300 program
- * @args dbenvpath  the path to the BerkeleyDB database environment
+ * @args --metrics-port PORT    also serve GET /metrics (Prometheus text) on 127.0.0.1:PORT
+ * @args --slow-log FILE        log statements that take too long to FILE
+ * @args --slow-log-ms MS       what's too long (default 100 milliseconds)
+ * @args --slow-log-max-mb MB   size at which the slow log is rotated (default 10)
+ * @args --slow-log-files N     how many rotated slow logs to keep (default 5)
+ * @args dbenvpath              the path to the BerkeleyDB database environment
  */
 int main(int argc, char *argv[]) {
 
 	// Open/create the db enviroment
-	if (argc != 2) {
-		cerr << "Usage: cpsc5300: dbenvpath" << endl;
+	char *envHome = nullptr;
+	int metrics_port = 0;
+	string slow_log_path;
+	double slow_log_ms = 100;
+	int slow_log_max_mb = 10, slow_log_files = 5;
+	bool usage_ok = true;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--metrics-port" && has_value)
+			metrics_port = atoi(argv[++i]);
+		else if (arg == "--slow-log" && has_value)
+			slow_log_path = argv[++i];
+		else if (arg == "--slow-log-ms" && has_value)
+			slow_log_ms = atof(argv[++i]);
+		else if (arg == "--slow-log-max-mb" && has_value)
+			slow_log_max_mb = atoi(argv[++i]);
+		else if (arg == "--slow-log-files" && has_value)
+			slow_log_files = atoi(argv[++i]);
+		else if (arg[0] != '-' && envHome == nullptr)
+			envHome = argv[i];
+		else
+			usage_ok = false;
+	}
+	if (!usage_ok || envHome == nullptr || metrics_port < 0 || metrics_port > 65535 || slow_log_ms < 0
+		|| slow_log_max_mb <= 0 || slow_log_files < 0) {
+		cerr << "Usage: cpsc5300: [--metrics-port PORT] [--slow-log FILE [--slow-log-ms MS] [--slow-log-max-mb MB]"
+			 << " [--slow-log-files N]] dbenvpath" << endl;
 		return 1;
 	}
-	char *envHome = argv[1];
 	cout << "(sql5300: running with database environment at " << envHome << ")" << endl;
 	DbEnv env(0U);
 	env.set_message_stream(&cout);
 	env.set_error_stream(&cerr);
 	try {
-		env.open(envHome, DB_CREATE | DB_INIT_MPOOL, 0);
+		env.open(envHome, DB_CREATE | DB_INIT_MPOOL | DB_THREAD, 0);
 	} catch (DbException& exc) {
 		cerr << "(sql5300: " << exc.what() << ")";
 		exit(1);
 	}
 	_DB_ENV = &env;
+	initialize_schema_tables();
+	Trash *trash = new Trash();  // dropped files are removed in the background
+
+	MetricsServer *metrics_server = nullptr;
+	if (metrics_port != 0) {
+		try {
+			metrics_server = new MetricsServer((u_int16_t)metrics_port);
+			cout << "(sql5300: metrics at http://127.0.0.1:" << metrics_port << "/metrics)" << endl;
+		} catch (runtime_error& e) {
+			cerr << "(sql5300: " << e.what() << ")" << endl;
+			exit(1);
+		}
+	}
+
+	SlowQueryLog *slow_log = nullptr;
+	if (!slow_log_path.empty()) {
+		try {
+			slow_log = new SlowQueryLog(slow_log_path, slow_log_ms, (u_int64_t)slow_log_max_mb << 20, slow_log_files);
+		} catch (runtime_error& e) {
+			cerr << "(sql5300: " << e.what() << ")" << endl;
+			exit(1);
+		}
+		Stats::tracing = true;  // so we have the plans to log
+	}
+
+	// result still being paged through with FETCH (freed when the next statement runs)
+	QueryResult *cursor = nullptr;
 
 	// Enter the SQL shell loop
 	while (true) {
@@ -282,21 +191,84 @@ int main(int argc, char *argv[]) {
 			break;  // only way to get out
 		if (query == "test") {
 			cout << "test_heap_storage: " << (test_heap_storage() ? "ok" : "failed") << endl;
+			cout << "test_zone_map: " << (test_zone_map() ? "ok" : "failed") << endl;
+			cout << "test_direct_storage: " << (test_direct_storage() ? "ok" : "failed") << endl;
+			cout << "test_column_encoding: " << (test_column_encoding() ? "ok" : "failed") << endl;
+			cout << "test_btree: " << (test_btree() ? "ok" : "failed") << endl;
+			cout << "test_bitmap_scan: " << (test_bitmap_scan() ? "ok" : "failed") << endl;
+			cout << "test_lock_manager: " << (test_lock_manager() ? "ok" : "failed") << endl;
+			cout << "test_partitioned_table: " << (test_partitioned_table() ? "ok" : "failed") << endl;
+			cout << "test_catalog_snapshot: " << (test_catalog_snapshot() ? "ok" : "failed") << endl;
+			cout << "test_sql_exec: " << (test_sql_exec() ? "ok" : "failed") << endl;
+			cout << "test_wire_protocol: " << (test_wire_protocol() ? "ok" : "failed") << endl;
+			continue;
+		}
+		uint fetch_rows;
+		if (is_fetch(query, fetch_rows)) {
+			if (cursor == nullptr) {
+				cout << "no open result to FETCH from" << endl;
+			} else {
+				cursor->print_rows(cout, fetch_rows);
+				if (!more_to_fetch(cursor)) {
+					delete cursor;
+					cursor = nullptr;
+				}
+			}
 			continue;
 		}
 
-		// use the Hyrise sql parser to get us our AST
+		// take out our own additions to SQL, then use the Hyrise sql parser to get us our AST
+		vector<SQLExtensions> extensions = SQLExtensions::strip(query);
 		SQLParserResult* result = SQLParser::parseSQLString(query);
 		if (!result->isValid()) {
 			cout << "invalid SQL: " << query << endl;
+			delete result;
 			continue;
 		}
 
-		// execute the statement
-		for (uint i = 0; i < result->size(); ++i) {
-			cout << execute(result->getStatement(i)) << endl;
+		// execute the statements, a batch at a time
+		for (uint i = 0, end; i < result->size(); i = end) {
+			end = batch_end(result, extensions, i);
+			const SQLStatement *statement = result->getStatement(i);
+			delete cursor;
+			cursor = nullptr;
+			string statement_text = ParseTreeToString::statement(statement);
+			if (end - i > 1)
+				statement_text += " (and " + to_string(end - i - 1) + " more INSERTs into the same table)";
+			Stats before = Stats::snapshot();
+			Stats::clear_plan();
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			try {
+				cout << statement_text << endl;
+				QueryResult *query_result;
+				if (end - i > 1) {
+					vector<const InsertStatement *> batch;
+					for (uint j = i; j < end; j++)
+						batch.push_back((const InsertStatement *) result->getStatement(j));
+					query_result = SQLExec::execute_batch(batch);
+				} else {
+					query_result = SQLExec::execute(statement, i < extensions.size() ? extensions[i] : SQLExtensions());
+				}
+				query_result->print(cout, PAGE_ROWS);
+				if (more_to_fetch(query_result))
+					cursor = query_result;
+				else
+					delete query_result;
+			} catch (SQLExecError& e) {
+				cout << "Error: " << e.what() << endl;
+			}
+
+			// time to run the statement and show its first page of rows
+			double elapsed_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+			if (slow_log != nullptr && slow_log->is_slow(elapsed_ms))
+				slow_log->log(statement_text, elapsed_ms, Stats::snapshot().since(before).get(Stats::ROWS_SCANNED),
+							  Stats::plan());
 		}
+		delete result;
 	}
+	delete cursor;
+	delete metrics_server;
+	delete slow_log;
+	delete trash;  // waits for the files still in the trash
 	return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,74 @@
+/**
+ * @file stats.cpp - implementation of Stats
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include "stats.h"
+
+thread_local Stats Stats::totals;
+thread_local bool Stats::tracing = false;
+thread_local std::vector<std::pair<std::string, u_int64_t>> Stats::steps;
+thread_local bool Stats::steps_dropped = false;
+
+Stats::Stats() {
+	for (uint i = 0; i < N_COUNTERS; i++)
+		counters[i] = 0;
+	for (uint i = 0; i < N_OPERATORS; i++)
+		calls[i] = ns[i] = 0;
+}
+
+Stats Stats::snapshot() {
+	return totals;
+}
+
+Stats Stats::since(const Stats& earlier) const {
+	Stats difference;
+	for (uint i = 0; i < N_COUNTERS; i++)
+		difference.counters[i] = counters[i] - earlier.counters[i];
+	for (uint i = 0; i < N_OPERATORS; i++) {
+		difference.calls[i] = calls[i] - earlier.calls[i];
+		difference.ns[i] = ns[i] - earlier.ns[i];
+	}
+	return difference;
+}
+
+const char* Stats::name(Counter counter) {
+	static const char* names[N_COUNTERS] = {
+		"pages_read", "pages_written", "pages_skipped", "pages_prefetched", "bdb_gets", "bdb_puts",
+		"records_read", "records_written", "bytes_slid", "rows_scanned", "rows_filtered",
+		"bytes_marshaled", "bytes_unmarshaled", "index_entries_read"
+	};
+	return names[counter];
+}
+
+const char* Stats::name(Operator op) {
+	static const char* names[N_OPERATORS] = {"execute", "select", "project", "insert", "delete", "fetch"};
+	return names[op];
+}
+
+void Stats::trace(const std::string& step) {
+	if (!steps.empty() && steps.back().first == step)
+		steps.back().second++;
+	else if (steps.size() < MAX_STEPS)
+		steps.push_back(std::make_pair(step, 1));
+	else
+		steps_dropped = true;
+}
+
+std::string Stats::plan() {
+	std::string plan;
+	for (auto const& step : steps) {
+		if (!plan.empty())
+			plan += "; ";
+		plan += step.first;
+		if (step.second > 1)
+			plan += " x" + std::to_string(step.second);
+	}
+	if (steps_dropped)
+		plan += "; ...";
+	return plan;
+}
+
+void Stats::clear_plan() {
+	steps.clear();
+	steps_dropped = false;
+}
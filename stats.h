@@ -0,0 +1,151 @@
+/**
+ * @file stats.h - counting what the storage engines and executor do, so we can see where a query's time goes
+ * Stats
+ * OperatorTimer
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+/**
+ * @class Stats - a set of event counters and per-operator call counts and times
+ *
+ *      The hot paths bump the running totals with Stats::count() and OperatorTimer; they are plain
+        (unlocked) adds to an array of the calling thread's own, so they cost next to nothing and
+        threads running statements at the same time don't mix up each other's numbers. To see what
+        one query did, take a snapshot() before and after (on the thread running it) and subtract
+        with since(). Operator times are inclusive: a PROJECT done during a FETCH counts toward both.
+
+        While tracing is on, the storage engines also describe each physical step they take (which
+        table they scanned and how, etc.) with trace(), and plan() strings those steps together.
+ */
+class Stats {
+public:
+	enum Counter {
+		PAGES_READ,         // blocks handed out by a file's get()
+		PAGES_WRITTEN,      // blocks written with a file's put() (including new ones)
+		PAGES_SKIPPED,      // blocks (or row groups) a scan didn't read because its zone map ruled them out
+		PAGES_PREFETCHED,   // blocks asked to be read ahead
+		BDB_GETS,           // Db::get calls
+		BDB_PUTS,           // Db::put calls
+		RECORDS_READ,       // SlottedPage::get calls
+		RECORDS_WRITTEN,    // SlottedPage::add and put calls
+		BYTES_SLID,         // bytes moved around within blocks to close up or open up space
+		ROWS_SCANNED,       // rows a select looked at
+		ROWS_FILTERED,      // rows a select looked at and rejected
+		BYTES_MARSHALED,    // size of the records made from rows
+		BYTES_UNMARSHALED,  // size of the records turned back into rows
+		INDEX_ENTRIES_READ, // index entries a lookup or index scan looked at
+		N_COUNTERS
+	};
+
+	enum Operator {
+		EXECUTE,  // SQLExec::execute of a whole statement
+		SELECT,   // DbRelation::select
+		PROJECT,  // DbRelation::project
+		INSERT,   // DbRelation::insert
+		DELETE,   // DbRelation::del
+		FETCH,    // QueryResult::fetch
+		N_OPERATORS
+	};
+
+	Stats();
+
+	/**
+	 * Add to a running total.
+	 * @param counter  what happened
+	 * @param n        how many times (or bytes)
+	 */
+	static void count(Counter counter, u_int64_t n = 1) {
+		totals.counters[counter] += n;
+	}
+
+	/**
+	 * Add one call of an operator that took ns nanoseconds to the running totals.
+	 */
+	static void time(Operator op, u_int64_t ns) {
+		totals.calls[op]++;
+		totals.ns[op] += ns;
+	}
+
+	/**
+	 * @returns  a copy of this thread's running totals since it started
+	 */
+	static Stats snapshot();
+
+	/**
+	 * @param earlier  an earlier snapshot()
+	 * @returns        what happened between earlier and this snapshot
+	 */
+	Stats since(const Stats& earlier) const;
+
+	u_int64_t get(Counter counter) const {return counters[counter];}
+	u_int64_t get_calls(Operator op) const {return calls[op];}
+	u_int64_t get_ns(Operator op) const {return ns[op];}
+
+	/**
+	 * @returns  lower-case name for a counter or operator, e.g., "pages_read" or "select"
+	 */
+	static const char* name(Counter counter);
+	static const char* name(Operator op);
+
+	/**
+	 * Are trace() calls being recorded? Off unless someone wants the plans (check before building a step).
+	 */
+	static thread_local bool tracing;
+
+	/**
+	 * Record a step of the current plan. The same step repeated back to back is kept once, with a count.
+	 * @param step  e.g., "insert into foo"
+	 */
+	static void trace(const std::string& step);
+
+	/**
+	 * @returns  the steps recorded since clear_plan(), separated by "; " (repeats shown like "project foo x12")
+	 */
+	static std::string plan();
+
+	/**
+	 * Forget the steps recorded so far.
+	 */
+	static void clear_plan();
+
+protected:
+	u_int64_t counters[N_COUNTERS];
+	u_int64_t calls[N_OPERATORS];
+	u_int64_t ns[N_OPERATORS];
+
+	static thread_local Stats totals;
+	static thread_local std::vector<std::pair<std::string, u_int64_t>> steps;
+	static thread_local bool steps_dropped;
+
+	static const uint MAX_STEPS = 64;  // a plan with more steps than this just ends with "..."
+};
+
+/**
+ * @class OperatorTimer - adds the time from its construction to its destruction to Stats as one call of an operator
+ *
+ *      Put one at the top of a function to time every way out of it, exceptions included.
+ */
+class OperatorTimer {
+public:
+	OperatorTimer(Stats::Operator op) : op(op), start(std::chrono::steady_clock::now()) {}
+	~OperatorTimer() {
+		Stats::time(op, std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count());
+	}
+	OperatorTimer(const OperatorTimer& other) = delete;
+	OperatorTimer(OperatorTimer&& temp) = delete;
+	OperatorTimer& operator=(const OperatorTimer& other) = delete;
+	OperatorTimer& operator=(OperatorTimer&& temp) = delete;
+
+protected:
+	Stats::Operator op;
+	std::chrono::steady_clock::time_point start;
+};
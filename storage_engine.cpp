@@ -1,17 +1,280 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include "storage_engine.h"
+#include "bitmap_scan.h"
+
+static const char *type_names[] = {"INT", "TEXT", "BIGINT", "DOUBLE", "BOOLEAN", "DATE", "TIMESTAMP"};
+
+std::string ColumnAttribute::type_name(DataType data_type) {
+    return type_names[data_type];
+}
+
+ColumnAttribute::DataType ColumnAttribute::type_named(const std::string &name) {
+    for (int i = INT; i <= TIMESTAMP; i++)
+        if (name == type_names[i])
+            return (DataType) i;
+    throw DbRelationError("unknown data type '" + name + "'");
+}
+
+Value Value::bigint(int64_t l) {
+    Value value;
+    value.data_type = ColumnAttribute::BIGINT;
+    value.l = l;
+    return value;
+}
+
+Value Value::double_value(double d) {
+    Value value;
+    value.data_type = ColumnAttribute::DOUBLE;
+    value.d = d;
+    return value;
+}
+
+Value Value::boolean(bool b) {
+    Value value;
+    value.data_type = ColumnAttribute::BOOLEAN;
+    value.n = b ? 1 : 0;
+    return value;
+}
+
+Value Value::date(int32_t days) {
+    Value value;
+    value.data_type = ColumnAttribute::DATE;
+    value.n = days;
+    return value;
+}
+
+Value Value::timestamp(int64_t microseconds) {
+    Value value;
+    value.data_type = ColumnAttribute::TIMESTAMP;
+    value.l = microseconds;
+    return value;
+}
 
 bool Value::operator==(const Value &other) const {
     if (this->data_type != other.data_type)
         return false;
-    if (this->data_type == ColumnAttribute::INT)
-        return this->n == other.n;
-    return this->s == other.s;
+    switch (this->data_type) {
+        case ColumnAttribute::INT:
+        case ColumnAttribute::BOOLEAN:
+        case ColumnAttribute::DATE:
+            return this->n == other.n;
+        case ColumnAttribute::BIGINT:
+        case ColumnAttribute::TIMESTAMP:
+            return this->l == other.l;
+        case ColumnAttribute::DOUBLE:
+            return this->d == other.d;
+        default:
+            return this->s == other.s;
+    }
 }
 
 bool Value::operator!=(const Value &other) const {
     return !(*this == other);
 }
 
+bool Value::operator<(const Value &other) const {
+    if (this->data_type != other.data_type)
+        return this->data_type < other.data_type;
+    switch (this->data_type) {
+        case ColumnAttribute::INT:
+        case ColumnAttribute::BOOLEAN:
+        case ColumnAttribute::DATE:
+            return this->n < other.n;
+        case ColumnAttribute::BIGINT:
+        case ColumnAttribute::TIMESTAMP:
+            return this->l < other.l;
+        case ColumnAttribute::DOUBLE:
+            return this->d < other.d;
+        default:
+            return this->s < other.s;
+    }
+}
+
+// year, month and day of the days'th day after 1970-01-01 (proleptic Gregorian calendar)
+static void civil_from_days(int64_t days, int64_t &year, unsigned &month, unsigned &day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned day_of_era = (unsigned) (days - era * 146097);
+    unsigned year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    unsigned day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    unsigned mp = (5 * day_of_year + 2) / 153;
+    day = day_of_year - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = (int64_t) year_of_era + era * 400 + (month <= 2);
+}
+
+// days since 1970-01-01 of a date in the proleptic Gregorian calendar
+static int64_t days_from_civil(int64_t year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned year_of_era = (unsigned) (year - era * 400);
+    unsigned day_of_year = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + (int64_t) day_of_era - 719468;
+}
+
+bool Value::parse_date(const std::string &text, int64_t &days) {
+    static const unsigned month_days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int year;
+    unsigned month, day;
+    char end;
+    if (sscanf(text.c_str(), "%d-%u-%u%c", &year, &month, &day, &end) != 3 || month < 1 || month > 12 || day < 1)
+        return false;
+    bool leap = year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+    if (day > month_days[month - 1] + (month == 2 && leap))
+        return false;
+    days = days_from_civil(year, month, day);
+    return true;
+}
+
+static std::string date_string(int64_t days) {
+    int64_t year;
+    unsigned month, day;
+    civil_from_days(days, year, month, day);
+    char text[32];
+    snprintf(text, sizeof(text), "%04lld-%02u-%02u", (long long) year, month, day);
+    return text;
+}
+
+std::string Value::to_string() const {
+    switch (this->data_type) {
+        case ColumnAttribute::INT:
+            return std::to_string(this->n);
+        case ColumnAttribute::TEXT:
+            return "\"" + this->s + "\"";
+        case ColumnAttribute::BIGINT:
+            return std::to_string(this->l);
+        case ColumnAttribute::DOUBLE: {
+            // the shortest of %.15g and %.17g that reads back as the same number
+            char text[32];
+            snprintf(text, sizeof(text), "%.15g", this->d);
+            if (strtod(text, nullptr) != this->d)
+                snprintf(text, sizeof(text), "%.17g", this->d);
+            return text;
+        }
+        case ColumnAttribute::BOOLEAN:
+            return this->n ? "true" : "false";
+        case ColumnAttribute::DATE:
+            return date_string(this->n);
+        case ColumnAttribute::TIMESTAMP: {
+            const int64_t per_day = 86400LL * 1000000;
+            int64_t days = this->l / per_day, micros = this->l % per_day;
+            if (micros < 0) {
+                days--;
+                micros += per_day;
+            }
+            int64_t seconds = micros / 1000000;
+            char text[48];
+            snprintf(text, sizeof(text), "%s %02d:%02d:%02d", date_string(days).c_str(), (int) (seconds / 3600),
+                     (int) (seconds / 60 % 60), (int) (seconds % 60));
+            std::string timestamp = text;
+            if (micros % 1000000 != 0) {
+                snprintf(text, sizeof(text), ".%06d", (int) (micros % 1000000));
+                timestamp += std::string(text).substr(0, std::string(text).find_last_not_of('0') + 1);
+            }
+            return timestamp;
+        }
+        default:
+            return "???";
+    }
+}
+
+bool Predicate::test(const Value &column_value) const {
+    if (column_value.data_type != this->value.data_type)
+        return this->op == NE;
+    switch (this->op) {
+        case EQ:
+            return column_value == this->value;
+        case NE:
+            return column_value != this->value;
+        case LT:
+            return column_value < this->value;
+        case LE:
+            return !(this->value < column_value);
+        case GT:
+            return this->value < column_value;
+        case GE:
+            return !(column_value < this->value);
+        default:
+            throw DbRelationError("unknown comparison operator");
+    }
+}
+
+std::string Predicate::to_string() const {
+    static const char *symbols[] = {"=", "<>", "<", "<=", ">", ">="};
+    return this->column_name + " " + symbols[this->op] + " " + this->value.to_string();
+}
+
+std::string Predicate::to_string(const std::vector<Predicate> &predicates) {
+    std::string sql;
+    for (auto const &predicate: predicates)
+        sql += (sql.empty() ? "" : " AND ") + predicate.to_string();
+    return sql;
+}
+
+// Checks every row of select() against the predicates.
+Handles* DbRelation::select(const Predicates* where) {
+    Handles* handles = this->select();
+    if (where == nullptr)
+        return handles;
+    ColumnNames column_names;
+    for (auto const& predicate : *where)
+        column_names.push_back(predicate.column_name);
+    Handles* selected = new Handles();
+    for (auto const& handle : *handles) {
+        ValueDict* row = this->project(handle, &column_names);
+        bool match = true;
+        for (auto const& predicate : *where) {
+            ValueDict::const_iterator column = row->find(predicate.column_name);
+            if (!(match = column != row->end() && predicate.test(column->second)))
+                break;
+        }
+        delete row;
+        if (match)
+            selected->push_back(handle);
+    }
+    delete handles;
+    return selected;
+}
+
+bool DbRelation::select_more(const Predicates* where, u_int64_t& position, Handles* handles) {
+    if (position != 0)
+        return false;
+    Handles* selected = this->select(where);
+    handles->insert(handles->end(), selected->begin(), selected->end());
+    delete selected;
+    position = 1;
+    return false;
+}
+
+// Projects each candidate and checks it against the predicates.
+Handles* DbRelation::select(const HandleBitmap* candidates, const Predicates* where) {
+    Handles* handles = candidates->handles();
+    if (where == nullptr || where->empty())
+        return handles;
+    ColumnNames column_names;
+    for (auto const& predicate : *where)
+        column_names.push_back(predicate.column_name);
+    Handles* selected = new Handles();
+    for (auto const& handle : *handles) {
+        ValueDict* row = this->project(handle, &column_names);
+        bool match = true;
+        for (auto const& predicate : *where) {
+            ValueDict::const_iterator column = row->find(predicate.column_name);
+            if (!(match = column != row->end() && predicate.test(column->second)))
+                break;
+        }
+        delete row;
+        if (match)
+            selected->push_back(handle);
+    }
+    delete handles;
+    return selected;
+}
+
 // Just pulls out the column names from a ValueDict and passes that to the usual form of project().
 ValueDict* DbRelation::project(Handle handle, const ValueDict* where) {
     ColumnNames t;
@@ -20,3 +283,24 @@ ValueDict* DbRelation::project(Handle handle, const ValueDict* where) {
     return this->project(handle, &t);
 }
 
+
+// An equality predicate for each key value.
+Handles* DbIndex::lookup(const ValueDict* key_values) {
+    Predicates where;
+    for (auto const& column: *key_values)
+        where.push_back(Predicate(column.first, Predicate::EQ, column.second));
+    return this->select(&where);
+}
+
+// Every column wanted or tested has to be a key or include column.
+bool DbIndex::covers(const ColumnNames* column_names, const Predicates* where) const {
+    ColumnNames needed = *column_names;
+    if (where != nullptr)
+        for (auto const& predicate: *where)
+            needed.push_back(predicate.column_name);
+    for (auto const& column_name: needed)
+        if (std::find(this->key_columns.begin(), this->key_columns.end(), column_name) == this->key_columns.end()
+            && std::find(this->include_columns.begin(), this->include_columns.end(), column_name) == this->include_columns.end())
+            return false;
+    return true;
+}
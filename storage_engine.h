@@ -3,6 +3,7 @@
  * DbBlock
  * DbFile
  * DbRelation
+ * DbIndex
  *
  * @author Kevin Lundeen
  * @see "Seattle University, CPSC5300, Summer 2018"
@@ -11,6 +12,7 @@
 
 #include <exception>
 #include <map>
+#include <string>
 #include <utility>
 #include <vector>
 #include "db_cxx.h"
@@ -27,6 +29,7 @@ typedef u_int16_t RecordID;
 typedef u_int32_t BlockID;
 typedef std::vector<RecordID> RecordIDs;
 typedef std::length_error DbBlockNoRoomError;
+class HandleBitmap;  // see bitmap_scan.h
 
 /**
  * @class DbBlock - abstract base class for blocks in our database files 
@@ -47,10 +50,23 @@ typedef std::length_error DbBlockNoRoomError;
 class DbBlock {
 public:
 	/**
-	 * our blocks are 4kB
+	 * our blocks are 4kB unless the file was created with some other size
 	 */ 
 	static const uint BLOCK_SZ = 4096;
 
+	/**
+	 * range of block sizes a file can be created with (each a power of two)
+	 */
+	static const uint MIN_BLOCK_SZ = 4096;
+	static const uint MAX_BLOCK_SZ = 65536;
+
+	/**
+	 * Is this a block size a file can be created with?
+	 */
+	static bool is_valid_block_size(uint block_size) {
+		return block_size >= MIN_BLOCK_SZ && block_size <= MAX_BLOCK_SZ && (block_size & (block_size - 1)) == 0;
+	}
+
 	/**
 	 * ctor/dtor (subclasses should handle the big-5)
 	 */ 
@@ -116,6 +132,12 @@ public:
 	 */
 	virtual BlockID get_block_id() {return block_id;}
 
+	/**
+	 * Get the size of this block (the block size of the file it belongs to).
+	 * @returns this block's size in bytes
+	 */
+	virtual uint get_block_size() {return block.get_size();}
+
 protected:
 	Dbt block;
 	BlockID block_id;
@@ -134,6 +156,7 @@ typedef std::vector<BlockID> BlockIDs;  // FIXME: will need to turn this into an
  *	get(block_id)
  *	put(block)
  *	block_ids()
+ *	prefetch(block_id)
  */
 class DbFile {
 public:
@@ -151,6 +174,12 @@ public:
 	 */
 	virtual void drop() = 0;
 
+	/**
+	 * Remove the file, but only as far as moving it into the Trash (which removes it in the background).
+	 * Files that don't know how just drop().
+	 */
+	virtual void discard() {drop();}
+
 	/**
 	 * Open the file.
 	 */
@@ -187,6 +216,13 @@ public:
 	 */ 
 	virtual BlockIDs* block_ids() = 0;
 
+	/**
+	 * Hint that a get() of this block is coming soon, so the file can start reading it now
+	 * (files that can't read ahead just ignore it).
+	 * @param block_id  block that will be wanted
+	 */
+	virtual void prefetch(BlockID block_id) {}
+
 protected:
 	std::string name;  // filename (or part of it)
 };
@@ -199,14 +235,32 @@ class ColumnAttribute {
 public:
 	enum DataType {
 		INT,
-		TEXT
+		TEXT,
+		BIGINT,
+		DOUBLE,
+		BOOLEAN,
+		DATE,
+		TIMESTAMP
 	};
+	ColumnAttribute() : data_type(INT) {}
 	ColumnAttribute(DataType data_type) : data_type(data_type) {}
 	virtual ~ColumnAttribute() {}
 
-	virtual DataType get_data_type() { return data_type; }
+	virtual DataType get_data_type() const { return data_type; }
 	virtual void set_data_type(DataType data_type) {this->data_type = data_type;}
 
+	/**
+	 * @returns  the SQL name of a data type, e.g., "BIGINT" (as kept in _columns)
+	 */
+	static std::string type_name(DataType data_type);
+
+	/**
+	 * @param name  SQL name of a data type, as from type_name()
+	 * @returns     the data type
+	 * @throws      DbRelationError if there's no such data type
+	 */
+	static DataType type_named(const std::string& name);
+
 protected:
 	DataType data_type;
 };
@@ -218,12 +272,37 @@ protected:
 class Value {
 public:
 	ColumnAttribute::DataType data_type;
-	int32_t n;
-	std::string s;
+	int32_t n;      // INT, BOOLEAN (0 or 1), DATE (days since 1970-01-01)
+	int64_t l;      // BIGINT, TIMESTAMP (microseconds since 1970-01-01 00:00:00 UTC)
+	double d;       // DOUBLE
+	std::string s;  // TEXT
+
+	Value() : n(0), l(0), d(0) {data_type = ColumnAttribute::INT;}
+	Value(int32_t n) : n(n), l(0), d(0) {data_type = ColumnAttribute::INT;}
+	Value(std::string s) : n(0), l(0), d(0), s(s) {data_type = ColumnAttribute::TEXT; }
+
+	// the other types (named, since their C++ types would make for ambiguous constructors)
+	static Value bigint(int64_t l);
+	static Value double_value(double d);
+	static Value boolean(bool b);
+	static Value date(int32_t days);
+	static Value timestamp(int64_t microseconds);
 
-	Value() : n(0) {data_type = ColumnAttribute::INT;}
-	Value(int32_t n) : n(n) {data_type = ColumnAttribute::INT;}
-	Value(std::string s) : s(s) {data_type = ColumnAttribute::TEXT; }
+	/**
+	 * Read a date as it's written in SQL, YYYY-MM-DD (proleptic Gregorian calendar).
+	 * @param days  returned by reference: days since 1970-01-01
+	 * @returns     false if text isn't a date, e.g., 2019-02-29
+	 */
+	static bool parse_date(const std::string &text, int64_t &days);
+
+	bool operator==(const Value &other) const;
+	bool operator!=(const Value &other) const;
+	bool operator<(const Value &other) const;
+
+	/**
+	 * @returns  the value as it's written in SQL, e.g., 42, "joe", true, 2018-07-20 or 2018-07-20 17:03:12.5
+	 */
+	std::string to_string() const;
 };
 
 // More type aliases
@@ -233,6 +312,45 @@ typedef std::vector<ColumnAttribute> ColumnAttributes;
 typedef std::pair<BlockID, RecordID> Handle;
 typedef std::vector<Handle> Handles;  // FIXME: will need to turn this into an iterator at some point
 typedef std::map<Identifier, Value> ValueDict;
+typedef std::vector<ValueDict*> ValueDicts;
+
+
+/**
+ * @class Predicate - comparison of a column with a constant: <column_name> <op> <value>
+ */
+class Predicate {
+public:
+	enum Operator {
+		EQ,
+		NE,
+		LT,
+		LE,
+		GT,
+		GE
+	};
+	Predicate(Identifier column_name, Operator op, Value value) : column_name(column_name), op(op), value(value) {}
+	virtual ~Predicate() {}
+
+	Identifier column_name;
+	Operator op;
+	Value value;
+
+	/**
+	 * Does a column value satisfy this predicate? (Values of a different type only satisfy NE.)
+	 */
+	virtual bool test(const Value &column_value) const;
+
+	/**
+	 * @returns  the predicate as SQL, e.g., x >= 10 or name = "joe"
+	 */
+	virtual std::string to_string() const;
+
+	/**
+	 * @returns  the predicates as SQL, AND'ed together
+	 */
+	static std::string to_string(const std::vector<Predicate>& predicates);
+};
+typedef std::vector<Predicate> Predicates;  // all must hold (i.e., AND'ed together)
 
 
 /**
@@ -260,6 +378,8 @@ public:
  *	del(handle)
  *	select()
  *	select(where)
+ *	select(predicates)
+ *	select(candidates, predicates)
  *	project(handle)
  *	project(handle, column_names)
  */
@@ -282,11 +402,26 @@ public:
 	 */
 	virtual void create_if_not_exists() = 0;
 
+	/**
+	 * Choose the block size for the files create() makes: CREATE TABLE ... WITH (PAGE_SIZE = <block_size>).
+	 * Existing files keep the block size they were created with.
+	 * @param block_size  see DbBlock::is_valid_block_size
+	 */
+	virtual void set_block_size(uint block_size) {
+		throw DbRelationError("storage engine does not support choosing a page size");
+	}
+
 	/**
 	 * Execute: DROP TABLE <table_name>
 	 */
 	virtual void drop() = 0;
 
+	/**
+	 * Execute: DROP TABLE <table_name>, but have the Trash remove the files in the background, so it takes
+	 * about the same time however big the table is. Storage engines that can't just drop().
+	 */
+	virtual void discard() {drop();}
+
 	/**
 	 * Open existing table.
 	 * Enables: insert, update, del, select, project.
@@ -306,6 +441,18 @@ public:
 	 */
 	virtual Handle insert(const ValueDict* row) = 0;
 
+	/**
+	 * Insert several rows at once (storage engines that can fill a block at a time do).
+	 * @param rows  dictionaries keyed by column names
+	 * @returns     handles to the new rows, in the same order (caller frees)
+	 */
+	virtual Handles* insert(const ValueDicts* rows) {
+		Handles* handles = new Handles();
+		for (auto const& row : *rows)
+			handles->push_back(insert(row));
+		return handles;
+	}
+
 	/**
 	 * Conceptually, execute: UPDATE INTO <table_name> SET <new_valus> WHERE <handle>
 	 * where handle is sufficient to identify one specific record (e.g., returned
@@ -323,6 +470,15 @@ public:
 	 */ 
 	virtual void del(const Handle handle) = 0;
 
+	/**
+	 * Delete several rows at once (storage engines that can do it in fewer writes than a del() per row do).
+	 * @param handles  the rows to delete
+	 */
+	virtual void del(const Handles* handles) {
+		for (auto const& handle : *handles)
+			del(handle);
+	}
+
 	/**
 	 * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE 1
 	 * @returns  a pointer to a list of handles for qualifying rows (caller frees)
@@ -336,6 +492,39 @@ public:
 	 */
 	virtual Handles* select(const ValueDict* where) = 0;
 
+	/**
+	 * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+	 * for where-clauses that compare columns with <, <=, >, >= and <> as well as =.
+	 * This version just checks every row; storage engines that can skip rows should override it.
+	 * @param where  predicates, all of which must be true (every row qualifies if null)
+	 * @returns      a pointer to a list of handles for qualifying rows (freed by caller)
+	 */
+	virtual Handles* select(const Predicates* where);
+
+	/**
+	 * The next piece of SELECT <handle> FROM <table_name> WHERE <where>, for a result that is handed
+	 * out as it is found (see QueryResult). Start with position 0 and call again, with the position
+	 * it leaves, until it returns false.
+	 * This version finds every row on the first call; storage engines that can scan a few blocks at a
+	 * time should override it.
+	 * @param where     predicates, all of which must be true (every row qualifies if null)
+	 * @param position  how far the scan has got (0 to start); updated
+	 * @param handles   the qualifying rows found are appended to it
+	 * @returns         false once the scan is finished
+	 */
+	virtual bool select_more(const Predicates* where, u_int64_t& position, Handles* handles);
+
+	/**
+	 * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <handle> IN <candidates> AND <where>
+	 * for finishing off a bitmap scan (see BitmapScan).
+	 * This version projects each candidate in turn; storage engines should override it to visit
+	 * each block once, in order.
+	 * @param candidates  the only rows that can qualify
+	 * @param where       predicates, all of which must be true (every candidate qualifies if null)
+	 * @returns           a pointer to a list of handles for qualifying rows, in block order (freed by caller)
+	 */
+	virtual Handles* select(const HandleBitmap* candidates, const Predicates* where);
+
 	/**
 	 * Return a sequence of all values for handle (SELECT *).
 	 * @param handle  row to get values from
@@ -352,9 +541,159 @@ public:
 	 */
 	virtual ValueDict* project(Handle handle, const ColumnNames* column_names) = 0;
 
+	/**
+	 * Return a sequence of values for handle given by the keys of where
+	 * (handy for checking a row against a where-clause).
+	 * @param handle  row to get values from
+	 * @param where   dictionary whose keys are the column names to project
+	 * @returns       dictionary of values from row (keyed by where's keys)
+	 */
+	virtual ValueDict* project(Handle handle, const ValueDict* where);
+
+	/**
+	 * Accessors for the relation's name and columns.
+	 */
+	virtual const Identifier& get_table_name() const {return table_name;}
+	virtual const ColumnNames& get_column_names() const {return column_names;}
+	virtual const ColumnAttributes& get_column_attributes() const {return column_attributes;}
+
 protected:
 	Identifier table_name;
 	ColumnNames column_names;
 	ColumnAttributes column_attributes;
 };
 
+
+/**
+ * @class DbIndex - top-level object handling a physical index on some of a relation's columns
+ *
+ *      An index is ordered by its key columns and can also carry copies of other (include) columns
+ *      of each row, so that a query that only needs those columns never has to visit the relation:
+ *      CREATE INDEX <name> ON <table> (<key_columns>) INCLUDE (<include_columns>).
+ *
+ *      The index doesn't watch the relation. Whoever changes the relation tells the index about it:
+ *      insert() after a row is added and del() before one is deleted.
+ *
+ * Methods:
+ *	create()
+ *	drop()
+ *
+ *	open()
+ *	close()
+ *
+ *	insert(handle)
+ *	del(handle)
+ *	lookup(key_values)
+ *	select(where)
+ *	narrows(where)
+ *	bitmap(where)
+ *	covers(column_names, where)
+ *	project(where, column_names)
+ */
+class DbIndex {
+public:
+	// ctor/dtor
+	DbIndex(DbRelation& relation, Identifier name, ColumnNames key_columns, ColumnNames include_columns) :
+		relation(relation), name(name), key_columns(key_columns), include_columns(include_columns) {}
+	virtual ~DbIndex() {}
+
+	/**
+	 * Execute: CREATE INDEX <name> ON <table_name> (<key_columns>) INCLUDE (<include_columns>)
+	 * Assumes the metadata and validation are already done. Adds every row already in the relation.
+	 */
+	virtual void create() = 0;
+
+	/**
+	 * Execute: DROP INDEX <name> FROM <table_name>
+	 */
+	virtual void drop() = 0;
+
+	/**
+	 * Execute: DROP INDEX <name> FROM <table_name>, leaving the file's removal to the Trash.
+	 */
+	virtual void discard() {drop();}
+
+	/**
+	 * Open existing index.
+	 * Enables: insert, del, lookup, select, project.
+	 */
+	virtual void open() = 0;
+
+	/**
+	 * Closes an open index.
+	 * Disables: insert, del, lookup, select, project.
+	 */
+	virtual void close() = 0;
+
+	/**
+	 * Add a row that was just inserted into the relation.
+	 * @param handle  the new row
+	 */
+	virtual void insert(Handle handle) = 0;
+
+	/**
+	 * Remove a row that is about to be deleted from the relation (it must still be there).
+	 * @param handle  the row
+	 */
+	virtual void del(Handle handle) = 0;
+
+	/**
+	 * Find the rows with these key values.
+	 * @param key_values  values for some (or all) of the key columns
+	 * @returns           a pointer to a list of handles for qualifying rows (freed by caller)
+	 */
+	virtual Handles* lookup(const ValueDict* key_values);
+
+	/**
+	 * Conceptually, execute: SELECT <handle> FROM <table_name> WHERE <where>
+	 * using the index to find the rows.
+	 * @param where  predicates, all of which must be true (every row qualifies if null)
+	 * @returns      a pointer to a list of handles for qualifying rows, in key order (freed by caller)
+	 */
+	virtual Handles* select(const Predicates* where) = 0;
+
+	/**
+	 * Can the index find the rows for these predicates without reading all of its entries?
+	 * @param where  predicates (may be null)
+	 */
+	virtual bool narrows(const Predicates* where) const = 0;
+
+	/**
+	 * The rows that satisfy all of where's predicates on the index's key and include columns
+	 * (predicates on other columns are ignored), as a bitmap to combine with other indices'.
+	 * @param where  predicates (every row qualifies if null)
+	 * @returns      a pointer to the set of handles for qualifying rows (freed by caller)
+	 */
+	virtual HandleBitmap* bitmap(const Predicates* where) = 0;
+
+	/**
+	 * Can project() answer a query for these columns and predicates without the relation?
+	 * @param column_names  columns wanted
+	 * @param where         predicates (may be null)
+	 */
+	virtual bool covers(const ColumnNames* column_names, const Predicates* where) const;
+
+	/**
+	 * Conceptually, execute: SELECT <column_names> FROM <table_name> WHERE <where>
+	 * answered entirely from the index (an index-only scan).
+	 * @param where         predicates, all of which must be true (every row qualifies if null)
+	 * @param column_names  columns wanted
+	 * @returns             a pointer to a list of qualifying rows, in key order (freed by caller)
+	 * @throws              DbRelationError if the index doesn't cover the query (see covers())
+	 */
+	virtual ValueDicts* project(const Predicates* where, const ColumnNames* column_names) = 0;
+
+	/**
+	 * Accessors for the index's name and columns.
+	 */
+	virtual const Identifier& get_name() const {return name;}
+	virtual const ColumnNames& get_key_columns() const {return key_columns;}
+	virtual const ColumnNames& get_include_columns() const {return include_columns;}
+
+protected:
+	DbRelation& relation;
+	Identifier name;
+	ColumnNames key_columns;
+	ColumnNames include_columns;
+};
+
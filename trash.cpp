@@ -0,0 +1,135 @@
+/**
+ * @file trash.cpp - implementation of Trash
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "trash.h"
+#include "storage_engine.h"
+
+using namespace std;
+
+const char* const Trash::DIRECTORY = "trash";
+mutex Trash::running_mutex;
+Trash* Trash::running = nullptr;
+
+Trash::Trash() : removing(0), stopping(false) {
+	// left over from last time
+	string directory = home() + "/" + DIRECTORY;
+	DIR* dir = opendir(directory.c_str());
+	if (dir != nullptr) {
+		for (struct dirent* entry = readdir(dir); entry != nullptr; entry = readdir(dir)) {
+			string name = entry->d_name;
+			if (name == "." || name == "..")
+				continue;
+			bool db = name.size() > 3 && name.compare(name.size() - 3, 3, ".db") == 0;
+			this->queue.push_back(make_pair(string(DIRECTORY) + "/" + name, db ? BERKELEY_DB : PLAIN));
+		}
+		closedir(dir);
+	}
+	this->remover = thread(&Trash::remove_files, this);
+	lock_guard<mutex> lock(running_mutex);
+	running = this;
+}
+
+Trash::~Trash() {
+	{
+		lock_guard<mutex> lock(running_mutex);
+		running = nullptr;
+	}
+	{
+		lock_guard<mutex> lock(this->queue_mutex);
+		this->stopping = true;
+	}
+	this->work_ready.notify_one();
+	this->remover.join();
+}
+
+void Trash::discard(const string& filename, Kind kind) {
+	string trashed = trash_name(filename);
+	if (kind == BERKELEY_DB) {
+		Db db(_DB_ENV, 0);
+		db.rename(filename.c_str(), nullptr, trashed.c_str(), 0);
+	}
+	else if (rename((home() + "/" + filename).c_str(), (home() + "/" + trashed).c_str()) != 0) {
+		throw DbException(("can't move " + filename + " to the trash").c_str(), errno);
+	}
+
+	{
+		lock_guard<mutex> lock(running_mutex);
+		if (running != nullptr) {
+			{
+				lock_guard<mutex> queue_lock(running->queue_mutex);
+				running->queue.push_back(make_pair(trashed, kind));
+			}
+			running->work_ready.notify_one();
+			return;
+		}
+	}
+	remove(trashed, kind);
+}
+
+uint Trash::pending() {
+	lock_guard<mutex> lock(running_mutex);
+	if (running == nullptr)
+		return 0;
+	lock_guard<mutex> queue_lock(running->queue_mutex);
+	return running->queue.size() + running->removing;
+}
+
+
+/*
+	PROTECTED
+*/
+
+// Remover thread: one file at a time, without holding the lock while it's removed.
+void Trash::remove_files() {
+	unique_lock<mutex> lock(this->queue_mutex);
+	while (true) {
+		this->work_ready.wait(lock, [this] {return this->stopping || !this->queue.empty();});
+		if (this->queue.empty())
+			break;  // stopping, and nothing left to remove
+		pair<string, Kind> file = this->queue.front();
+		this->queue.pop_front();
+		this->removing++;
+		lock.unlock();
+		remove(file.first, file.second);
+		lock.lock();
+		this->removing--;
+	}
+}
+
+// A file that won't go stays in the trash directory, to be tried again next time.
+void Trash::remove(const string& filename, Kind kind) {
+	if (kind == BERKELEY_DB) {
+		try {
+			Db db(_DB_ENV, 0);
+			db.remove(filename.c_str(), nullptr, 0);
+		}
+		catch (DbException& e) {
+		}
+	}
+	else {
+		unlink((home() + "/" + filename).c_str());
+	}
+}
+
+string Trash::home() {
+	const char* home;
+	_DB_ENV->get_home(&home);
+	return home;
+}
+
+// trash/<when this process started>-<how many files it has discarded before>-<filename>, so names never collide
+string Trash::trash_name(const string& filename) {
+	static const long long started = chrono::duration_cast<chrono::microseconds>(
+			chrono::system_clock::now().time_since_epoch()).count();
+	static atomic<u_int64_t> discarded(0);
+	mkdir((home() + "/" + DIRECTORY).c_str(), 0755);  // EEXIST after the first time
+	return string(DIRECTORY) + "/" + to_string(started) + "-" + to_string(discarded++) + "-" + filename;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file trash.h - where dropped files wait to be removed, so that dropping doesn't wait on the disk
+ * Trash
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <sys/types.h>
+
+/**
+ * @class Trash - moves dropped files aside and removes them on a thread of its own
+ *
+ *      discard() renames a file of the database environment into its trash directory,
+        <env home>/trash, which takes the same short time however big the file is, and leaves the
+        removal to the remover thread. The file's name is free again as soon as discard() returns.
+
+        sql5300 constructs the one Trash (after the environment is opened) and deletes it at the
+        end, which waits for the files already discarded to be removed. Whatever is still in the
+        trash directory when a Trash is constructed (say, after a crash) is removed first. Without a
+        Trash, discard() still renames the file but then removes it right there.
+ */
+class Trash {
+public:
+	enum Kind {
+		BERKELEY_DB,  // removed with Db::remove, so the environment forgets it too
+		PLAIN         // just unlinked
+	};
+
+	/**
+	 * Start the remover thread (with the files already in the trash directory queued up for it).
+	 */
+	Trash();
+
+	/**
+	 * Removes whatever is still queued, then stops the remover thread.
+	 */
+	virtual ~Trash();
+	Trash(const Trash& other) = delete;
+	Trash(Trash&& temp) = delete;
+	Trash& operator=(const Trash& other) = delete;
+	Trash& operator=(Trash&& temp) = delete;
+
+	/**
+	 * Move a file into the trash directory and have it removed.
+	 * @param filename  relative to the environment's home (it must be closed)
+	 * @param kind      how to remove it
+	 * @throws          DbException if it can't be renamed (e.g., it isn't there)
+	 */
+	static void discard(const std::string& filename, Kind kind);
+
+	/**
+	 * @returns  how many discarded files are still waiting to be removed
+	 */
+	static uint pending();
+
+	/**
+	 * name of the trash directory, in the environment's home
+	 */
+	static const char* const DIRECTORY;
+
+protected:
+	std::mutex queue_mutex;
+	std::condition_variable work_ready;
+	std::deque<std::pair<std::string, Kind>> queue;  // trash file names, relative to the home
+	uint removing;  // taken off the queue, not yet removed
+	bool stopping;
+	std::thread remover;
+
+	static std::mutex running_mutex;
+	static Trash* running;  // the one constructed, if any (guarded by running_mutex)
+
+	virtual void remove_files();
+	static void remove(const std::string& filename, Kind kind);
+	static std::string home();
+	static std::string trash_name(const std::string& filename);
+};
@@ -0,0 +1,386 @@
+/**
+ * @file wire_protocol.cpp - implementation of ResultWriter and ResultReader
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include "wire_protocol.h"
+using namespace std;
+
+// little-endian integer encoding
+static void put_u16(string &bytes, uint16_t n) {
+    bytes += (char) (n & 0xff);
+    bytes += (char) (n >> 8);
+}
+
+static void put_u32(string &bytes, uint32_t n) {
+    for (int shift = 0; shift < 32; shift += 8)
+        bytes += (char) ((n >> shift) & 0xff);
+}
+
+static void put_u64(string &bytes, uint64_t n) {
+    for (int shift = 0; shift < 64; shift += 8)
+        bytes += (char) ((n >> shift) & 0xff);
+}
+
+static uint16_t get_u16(const string &bytes, size_t &offset) {
+    if (offset + 2 > bytes.size())
+        throw WireProtocolError("truncated frame");
+    uint16_t n = (uint8_t) bytes[offset] | (uint16_t) ((uint8_t) bytes[offset + 1] << 8);
+    offset += 2;
+    return n;
+}
+
+static uint32_t get_u32(const string &bytes, size_t &offset) {
+    if (offset + 4 > bytes.size())
+        throw WireProtocolError("truncated frame");
+    uint32_t n = 0;
+    for (int i = 3; i >= 0; i--)
+        n = (n << 8) | (uint8_t) bytes[offset + i];
+    offset += 4;
+    return n;
+}
+
+static uint64_t get_u64(const string &bytes, size_t &offset) {
+    if (offset + 8 > bytes.size())
+        throw WireProtocolError("truncated frame");
+    uint64_t n = 0;
+    for (int i = 7; i >= 0; i--)
+        n = (n << 8) | (uint8_t) bytes[offset + i];
+    offset += 8;
+    return n;
+}
+
+
+/*
+ * ResultWriter
+ */
+
+void ResultWriter::write(QueryResult &result) {
+    const ColumnNames *column_names = result.get_column_names();
+    if (column_names != nullptr) {
+        const ColumnAttributes *column_attributes = result.get_column_attributes();
+        if (column_attributes == nullptr || column_attributes->size() != column_names->size())
+            throw WireProtocolError("result has no data types for its columns");
+
+        // wire order is sorted by column name (the order we get walking a ValueDict)
+        map<Identifier, uint16_t> wire_order;
+        for (uint16_t i = 0; i < column_names->size(); i++)
+            wire_order[column_names->at(i)] = i;
+        if (wire_order.size() != column_names->size())
+            throw WireProtocolError("duplicate column names in result");
+        vector<ColumnAttribute::DataType> data_types;
+        string header;
+        put_u16(header, (uint16_t) wire_order.size());
+        for (auto const &column: wire_order) {
+            ColumnAttribute attribute = column_attributes->at(column.second);
+            data_types.push_back(attribute.get_data_type());
+            header += (char) attribute.get_data_type();
+            put_u16(header, column.second);
+            put_u16(header, (uint16_t) column.first.size());
+            header += column.first;
+        }
+        write_frame(HEADER, header);
+
+        string batch;
+        uint16_t batch_rows = 0;
+        while (result.has_more()) {
+            ValueDicts *rows = result.fetch(QueryResult::FETCH_BATCH);
+            for (auto const &row: *rows) {
+                if (batch_rows == 0)
+                    put_u16(batch, 0);  // row count, filled in when the batch is sent
+                size_t null_bitmap = batch.size();
+                batch.append((data_types.size() + 7) / 8, '\0');
+                uint col = 0;
+                ValueDict::const_iterator column = row->begin();
+                for (auto const &wire: wire_order) {
+                    if (column == row->end() || column->first != wire.first) {
+                        if (column != row->end() && column->first < wire.first)
+                            break;  // a column the result doesn't have
+                        batch[null_bitmap + col / 8] |= (char) (1 << (col % 8));
+                        col++;
+                        continue;
+                    }
+                    const Value &value = column->second;
+                    switch (data_types[col++]) {
+                        case ColumnAttribute::INT:
+                        case ColumnAttribute::DATE:
+                            put_u32(batch, (uint32_t) value.n);
+                            break;
+                        case ColumnAttribute::BIGINT:
+                        case ColumnAttribute::TIMESTAMP:
+                            put_u64(batch, (uint64_t) value.l);
+                            break;
+                        case ColumnAttribute::DOUBLE: {
+                            uint64_t bits;
+                            memcpy(&bits, &value.d, sizeof(bits));
+                            put_u64(batch, bits);
+                            break;
+                        }
+                        case ColumnAttribute::BOOLEAN:
+                            batch += (char) (value.n != 0);
+                            break;
+                        case ColumnAttribute::TEXT:
+                            if (value.s.size() > UINT32_MAX)
+                                throw WireProtocolError("text value too long to send");
+                            put_u32(batch, (uint32_t) value.s.size());
+                            batch += value.s;
+                            break;
+                        default:
+                            throw WireProtocolError("don't know how to encode this data type");
+                    }
+                    column++;
+                }
+                if (column != row->end())
+                    throw WireProtocolError("row does not match the result's columns");
+                delete row;
+                if (++batch_rows == BATCH_ROWS || batch.size() >= BATCH_BYTES) {
+                    batch[0] = (char) (batch_rows & 0xff);
+                    batch[1] = (char) (batch_rows >> 8);
+                    write_frame(ROWS, batch);
+                    batch.clear();
+                    batch_rows = 0;
+                }
+            }
+            delete rows;
+        }
+        if (batch_rows > 0) {
+            batch[0] = (char) (batch_rows & 0xff);
+            batch[1] = (char) (batch_rows >> 8);
+            write_frame(ROWS, batch);
+        }
+    }
+    write_frame(MESSAGE, result.get_message());
+    out.flush();
+}
+
+void ResultWriter::write_frame(char tag, const string &payload) {
+    string prefix(1, tag);
+    put_u32(prefix, (uint32_t) payload.size());
+    out.write(prefix.data(), prefix.size());
+    out.write(payload.data(), payload.size());
+}
+
+
+/*
+ * ResultReader
+ */
+
+bool ResultReader::next(vector<Value> &row) {
+    while (batch_rows == 0) {
+        if (done)
+            return false;
+        char tag = read_frame(batch);
+        offset = 0;
+        switch (tag) {
+            case ResultWriter::HEADER:
+                read_header(batch);
+                break;
+            case ResultWriter::ROWS:
+                batch_rows = get_u16(batch, offset);
+                if (batch_rows == 0 && offset != batch.size())
+                    throw WireProtocolError("bytes after the last row of a frame");
+                break;
+            case ResultWriter::MESSAGE:
+                message = batch;
+                done = true;
+                break;
+            default:
+                throw WireProtocolError(string("unknown frame tag '") + tag + "'");
+        }
+    }
+
+    row.assign(column_names.size(), Value());
+    nulls.assign(column_names.size(), false);
+    size_t null_bitmap = offset;
+    offset += (positions.size() + 7) / 8;
+    if (offset > batch.size())
+        throw WireProtocolError("truncated frame");
+    for (uint col = 0; col < positions.size(); col++) {
+        uint16_t position = positions[col];
+        Value &value = row[position];
+        value.data_type = column_attributes[position].get_data_type();
+        if (batch[null_bitmap + col / 8] & (1 << (col % 8))) {
+            nulls[position] = true;
+            continue;
+        }
+        switch (value.data_type) {
+            case ColumnAttribute::INT:
+            case ColumnAttribute::DATE:
+                value.n = (int32_t) get_u32(batch, offset);
+                break;
+            case ColumnAttribute::BIGINT:
+            case ColumnAttribute::TIMESTAMP:
+                value.l = (int64_t) get_u64(batch, offset);
+                break;
+            case ColumnAttribute::DOUBLE: {
+                uint64_t bits = get_u64(batch, offset);
+                memcpy(&value.d, &bits, sizeof(bits));
+                break;
+            }
+            case ColumnAttribute::BOOLEAN:
+                if (offset + 1 > batch.size())
+                    throw WireProtocolError("truncated frame");
+                value.n = batch[offset++] != 0;
+                break;
+            default: {
+                uint32_t size = get_u32(batch, offset);
+                if (size > batch.size() - offset)
+                    throw WireProtocolError("truncated frame");
+                value.s.assign(batch, offset, size);
+                offset += size;
+            }
+        }
+    }
+    if (--batch_rows == 0 && offset != batch.size())
+        throw WireProtocolError("bytes after the last row of a frame");
+    return true;
+}
+
+char ResultReader::read_frame(string &payload) {
+    char prefix[5];
+    if (!in.read(prefix, sizeof(prefix)))
+        throw WireProtocolError("stream ended before the end of the result");
+    string length(prefix + 1, 4);
+    size_t offset = 0;
+    payload.resize(get_u32(length, offset));
+    if (!payload.empty() && !in.read(&payload[0], payload.size()))
+        throw WireProtocolError("stream ended in the middle of a frame");
+    return prefix[0];
+}
+
+void ResultReader::read_header(const string &payload) {
+    size_t offset = 0;
+    uint16_t n = get_u16(payload, offset);
+    column_names.assign(n, Identifier());
+    column_attributes.assign(n, ColumnAttribute());
+    positions.clear();
+    for (uint16_t col = 0; col < n; col++) {
+        if (offset + 1 > payload.size())
+            throw WireProtocolError("truncated frame");
+        ColumnAttribute::DataType data_type = (ColumnAttribute::DataType) payload[offset++];
+        if (data_type < ColumnAttribute::INT || data_type > ColumnAttribute::TIMESTAMP)
+            throw WireProtocolError("unknown data type in header");
+        uint16_t position = get_u16(payload, offset);
+        uint16_t size = get_u16(payload, offset);
+        if (position >= n || offset + size > payload.size())
+            throw WireProtocolError("bad column in header");
+        column_names[position] = payload.substr(offset, size);
+        column_attributes[position].set_data_type(data_type);
+        positions.push_back(position);
+        offset += size;
+    }
+}
+
+
+/*
+ * TESTS
+ */
+
+// Every row the writer sends has to come back from the reader with the same values and NULLs.
+static bool reads_back(const ValueDicts &rows, const ColumnNames &column_names,
+                       const ColumnAttributes &column_attributes) {
+    ValueDicts *copies = new ValueDicts();
+    for (auto const &row: rows)
+        copies->push_back(new ValueDict(*row));
+    QueryResult result(new ColumnNames(column_names), new ColumnAttributes(column_attributes), copies,
+                       "successfully returned " + to_string(rows.size()) + " rows");
+    stringstream stream;
+    ResultWriter(stream).write(result);
+
+    ResultReader reader(stream);
+    vector<Value> row;
+    try {
+        for (auto const &expected: rows) {
+            if (!reader.next(row) || reader.get_column_names() != column_names)
+                return false;
+            for (uint i = 0; i < column_names.size(); i++) {
+                auto value = expected->find(column_names[i]);
+                if (reader.is_null(i) != (value == expected->end()))
+                    return false;
+                if (value != expected->end()
+                    && (row[i] != value->second || row[i].data_type != value->second.data_type))
+                    return false;
+            }
+        }
+        return !reader.next(row) && reader.get_message() == result.get_message();
+    }
+    catch (WireProtocolError &e) {
+        return false;
+    }
+}
+
+// A stream with a header for one INT column x, then the given frames.
+static bool reader_rejects(const string &frames) {
+    string header;
+    put_u16(header, 1);
+    header += (char) ColumnAttribute::INT;
+    put_u16(header, 0);
+    put_u16(header, 1);
+    header += "x";
+    string bytes(1, ResultWriter::HEADER);
+    put_u32(bytes, (uint32_t) header.size());
+    stringstream stream(bytes + header + frames);
+    ResultReader reader(stream);
+    vector<Value> row;
+    try {
+        while (reader.next(row))
+            continue;
+    }
+    catch (WireProtocolError &e) {
+        return true;
+    }
+    return false;
+}
+
+bool test_wire_protocol() {
+    ColumnNames column_names = {"t", "i", "l", "d", "b", "day", "ts"};  // not in wire order
+    ColumnAttributes column_attributes;
+    for (auto const &data_type: {ColumnAttribute::TEXT, ColumnAttribute::INT, ColumnAttribute::BIGINT,
+                                 ColumnAttribute::DOUBLE, ColumnAttribute::BOOLEAN, ColumnAttribute::DATE,
+                                 ColumnAttribute::TIMESTAMP})
+        column_attributes.push_back(ColumnAttribute(data_type));
+
+    // more rows than fit in one frame, every other one with a NULL somewhere, and a TEXT value
+    // longer than a u16 could say, which sends its frame early
+    ValueDicts rows;
+    for (int i = 0; i < 2 * (int) ResultWriter::BATCH_ROWS + 10; i++) {
+        ValueDict *row = new ValueDict();
+        (*row)["t"] = Value(i == 8 ? string(70000, 'x') : "row " + to_string(i));
+        (*row)["i"] = Value(i % 2 ? INT32_MIN : INT32_MAX - i);
+        (*row)["l"] = Value::bigint(i % 3 ? INT64_MIN + i : INT64_MAX);
+        (*row)["d"] = Value::double_value(i / 4.0 - 100);
+        (*row)["b"] = Value::boolean(i % 5 == 0);
+        (*row)["day"] = Value::date(i - 1000);
+        (*row)["ts"] = Value::timestamp(-1000000LL * i);
+        if (i % 2)
+            row->erase(column_names[i % column_names.size()]);
+        rows.push_back(row);
+    }
+    rows.push_back(new ValueDict());  // all NULLs
+    bool ok = reads_back(rows, column_names, column_attributes)
+              && reads_back(ValueDicts(), column_names, column_attributes);
+    for (auto const &row: rows)
+        delete row;
+    if (!ok)
+        return false;
+
+    // a frame of rows with bytes left over after its last row, or with none but bytes anyway
+    string one_row, empty;
+    put_u16(one_row, 1);
+    one_row += '\0';
+    put_u32(one_row, 42);
+    put_u16(empty, 0);
+    string message(1, ResultWriter::MESSAGE);
+    put_u32(message, 0);
+    for (auto const &payload: {one_row + '\0', empty + '\0'}) {
+        string frame(1, ResultWriter::ROWS);
+        put_u32(frame, (uint32_t) payload.size());
+        if (!reader_rejects(frame + payload + message))
+            return false;
+    }
+    string frame(1, ResultWriter::ROWS);
+    put_u32(frame, (uint32_t) one_row.size());
+    return !reader_rejects(frame + one_row + message);
+}
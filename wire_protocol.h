@@ -0,0 +1,126 @@
+/**
+ * @file wire_protocol.h - compact binary encoding of query results.
+ * ResultWriter
+ * ResultReader
+ *
+ * A result is sent as a sequence of frames. Each frame is a one-byte tag and a u32 payload length,
+ * followed by the payload. All integers are little-endian.
+ *
+ *     'H' header:   u16 column count, then for each column (in wire order):
+ *                       u8 data type, u16 display position, u16 name length, name bytes
+ *     'R' rows:     u16 row count, then for each row:
+ *                       null bitmap          (column count + 7) / 8 bytes; bit i (bit i % 8 of byte i / 8)
+ *                                            is set if the column i-th in wire order is NULL
+ *                       the values of the columns that aren't NULL, in wire order:
+ *                       INT, DATE            4 bytes (DATE: days since 1970-01-01)
+ *                       BIGINT, TIMESTAMP    8 bytes (TIMESTAMP: microseconds since 1970-01-01 00:00:00)
+ *                       DOUBLE               8 bytes, IEEE 754
+ *                       BOOLEAN              1 byte, 0 or 1
+ *                       TEXT                 u32 length, bytes
+ *     'M' message:  the result's message text (always the last frame of a result)
+ *
+ * Wire order is the order of the column names in a ValueDict (i.e., sorted), which lets the writer
+ * walk each row's dictionary once instead of looking up every column by name; the reader puts the
+ * values back in display order using the positions from the header. A NULL column is the one a row's
+ * dictionary doesn't have.
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "SQLExec.h"
+
+/**
+ * @class WireProtocolError - malformed or truncated stream
+ */
+class WireProtocolError : public std::runtime_error {
+public:
+    explicit WireProtocolError(std::string s) : runtime_error(s) {}
+};
+
+/**
+ * @class ResultWriter - server side: encode a QueryResult onto a binary stream
+ */
+class ResultWriter {
+public:
+    /**
+     * Frame tags
+     */
+    static const char HEADER = 'H';
+    static const char ROWS = 'R';
+    static const char MESSAGE = 'M';
+
+    /**
+     * A row batch is sent once it has this many rows or this many bytes, whichever comes first.
+     */
+    static const uint BATCH_ROWS = 1024;
+    static const uint BATCH_BYTES = 64 * 1024;
+
+    ResultWriter(std::ostream &out) : out(out) {}
+    virtual ~ResultWriter() {}
+
+    /**
+     * Send the whole result (consumes its rows, pulling them FETCH_BATCH at a time).
+     * @param result  query result to send
+     */
+    virtual void write(QueryResult &result);
+
+protected:
+    std::ostream &out;
+
+    virtual void write_frame(char tag, const std::string &payload);
+};
+
+/**
+ * @class ResultReader - client side: decode a QueryResult sent by ResultWriter
+ */
+class ResultReader {
+public:
+    ResultReader(std::istream &in) : in(in), done(false), batch_rows(0), offset(0) {}
+    virtual ~ResultReader() {}
+
+    /**
+     * Get the next row, with its values in display order (same order as get_column_names()).
+     * @param row  returned by reference: the row's values
+     * @returns    false once there are no more rows (the message is then available)
+     */
+    virtual bool next(std::vector<Value> &row);
+
+    /**
+     * Was a column of the row next() last returned NULL? (Its value in the row is then a default Value.)
+     * @param column  index in display order
+     */
+    bool is_null(uint column) const { return nulls.at(column); }
+
+    /**
+     * Column names in display order (empty for results without rows, like CREATE TABLE).
+     * Available once next() has been called.
+     */
+    const ColumnNames &get_column_names() const { return column_names; }
+    const ColumnAttributes &get_column_attributes() const { return column_attributes; }
+
+    /**
+     * The result's message. Available once next() has returned false.
+     */
+    const std::string &get_message() const { return message; }
+
+protected:
+    std::istream &in;
+    bool done;
+    ColumnNames column_names;
+    ColumnAttributes column_attributes;
+    std::vector<uint16_t> positions;  // display position of each column in wire order
+    std::vector<bool> nulls;          // of the last row, in display order
+    std::string message;
+    std::string batch;
+    uint batch_rows;
+    size_t offset;
+
+    virtual char read_frame(std::string &payload);
+    virtual void read_header(const std::string &payload);
+};
+
+bool test_wire_protocol();
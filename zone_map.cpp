@@ -0,0 +1,331 @@
+/**
+ * @file zone_map.cpp - implementation of ZoneMap
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#include <climits>
+#include <cstring>
+#include "zone_map.h"
+#include "heap_storage.h"
+#include "stats.h"
+#include "trash.h"
+
+using namespace std;
+
+typedef u_int16_t u16;
+
+/*
+	PUBLIC
+*/
+
+ZoneMap::ZoneMap(Identifier table_name, const ColumnNames& column_names, const ColumnAttributes& column_attributes) :
+	column_names(column_names), column_attributes(column_attributes), entry_size(sizeof(u16)),
+	dbfilename(table_name + ".zone.db"), closed(true), available(false), db(_DB_ENV, 0) {
+	for (auto& column_attribute : this->column_attributes) {
+		this->offsets.push_back(this->entry_size);
+		if (column_attribute.get_data_type() == ColumnAttribute::INT)
+			this->entry_size += 2 * sizeof(int32_t);
+		else if (column_attribute.get_data_type() == ColumnAttribute::TEXT)
+			this->entry_size += BLOOM_BYTES;
+		// other types get no synopsis
+	}
+}
+
+void ZoneMap::create() {
+	db_open(DB_CREATE | DB_EXCL);
+}
+
+void ZoneMap::drop() {
+	close();
+	Db db(_DB_ENV, 0);
+	db.remove(this->dbfilename.c_str(), nullptr, 0);
+}
+
+void ZoneMap::discard() {
+	close();
+	Trash::discard(this->dbfilename, Trash::BERKELEY_DB);
+}
+
+// A missing zone file just means we can't skip anything.
+void ZoneMap::open() {
+	try {
+		db_open();
+	}
+	catch (DbException& e) {
+		this->available = false;
+	}
+}
+
+void ZoneMap::close() {
+	if (this->closed)
+		return;
+	this->db.close(0);
+	this->closed = true;
+	this->available = false;
+}
+
+void ZoneMap::add(BlockID block_id, const ValueDict* row) {
+	if (!this->available)
+		return;
+	char* entry = get(block_id);
+	widen(entry, row);
+	put(block_id, entry);
+	delete[] entry;
+}
+
+void ZoneMap::rebuild(BlockID block_id, const ValueDicts& rows) {
+	if (!this->available)
+		return;
+	char* entry = new char[this->entry_size];
+	init_entry(entry);
+	for (auto const& row : rows)
+		widen(entry, row);
+	put(block_id, entry);
+	delete[] entry;
+}
+
+// Without predicates every block is read, even one the entry says is empty: rows can go into it
+// between the scan listing the blocks and getting here, and a scan of the whole table has to see them.
+bool ZoneMap::may_match(BlockID block_id, const Predicates* where) {
+	if (!this->available || where == nullptr || where->empty())
+		return true;
+	char* entry = get(block_id);
+	bool match = *(u16*)entry > 0;
+	if (match)
+		for (auto const& predicate : *where)
+			if (!(match = may_match(entry, predicate)))
+				break;
+	delete[] entry;
+	return match;
+}
+
+
+/*
+	PROTECTED
+*/
+
+void ZoneMap::db_open(uint flags) {
+	if (!this->closed)
+		return;
+	this->db.set_re_len(this->entry_size);
+	this->db.open(nullptr, this->dbfilename.c_str(), nullptr, DB_RECNO, flags | DB_THREAD, 0644);  // inserting threads share it
+	this->closed = false;
+	this->available = true;
+}
+
+// Entry for the block (an empty one if we haven't seen the block yet).
+// caller responsible for freeing the returned bytes.
+char* ZoneMap::get(BlockID block_id) {
+	char* entry = new char[this->entry_size];
+	Dbt key(&block_id, sizeof(block_id));
+	Dbt data(entry, this->entry_size);
+	data.set_ulen(this->entry_size);
+	data.set_flags(DB_DBT_USERMEM);  // a DB_THREAD handle can't hand back memory of its own
+	Stats::count(Stats::BDB_GETS);
+	if (this->db.get(nullptr, &key, &data, 0) != 0 || data.get_size() != this->entry_size)
+		init_entry(entry);
+	return entry;
+}
+
+void ZoneMap::put(BlockID block_id, const char* entry) {
+	Dbt key(&block_id, sizeof(block_id));
+	Dbt data((void*)entry, this->entry_size);
+	this->db.put(nullptr, &key, &data, 0);
+	Stats::count(Stats::BDB_PUTS);
+}
+
+// No rows: every INT range is empty (min > max) and every bloom filter is clear.
+void ZoneMap::init_entry(char* entry) {
+	memset(entry, 0, this->entry_size);
+	for (uint i = 0; i < this->column_attributes.size(); i++) {
+		if (this->column_attributes[i].get_data_type() == ColumnAttribute::INT) {
+			*(int32_t*)(entry + this->offsets[i]) = INT32_MAX;
+			*(int32_t*)(entry + this->offsets[i] + sizeof(int32_t)) = INT32_MIN;
+		}
+	}
+}
+
+void ZoneMap::widen(char* entry, const ValueDict* row) {
+	*(u16*)entry += 1;
+	for (uint i = 0; i < this->column_names.size(); i++) {
+		ValueDict::const_iterator column = row->find(this->column_names[i]);
+		if (column == row->end())
+			continue;
+		const Value& value = column->second;
+		char* synopsis = entry + this->offsets[i];
+		if (this->column_attributes[i].get_data_type() == ColumnAttribute::INT) {
+			if (value.n < *(int32_t*)synopsis)
+				*(int32_t*)synopsis = value.n;
+			if (value.n > *(int32_t*)(synopsis + sizeof(int32_t)))
+				*(int32_t*)(synopsis + sizeof(int32_t)) = value.n;
+		}
+		else if (this->column_attributes[i].get_data_type() == ColumnAttribute::TEXT) {
+			uint bits[BLOOM_HASHES];
+			bloom_bits(value.s, bits);
+			for (auto const& bit : bits)
+				synopsis[bit / 8] |= 1 << (bit % 8);
+		}
+	}
+}
+
+bool ZoneMap::may_match(const char* entry, const Predicate& predicate) {
+	int i = column_index(predicate.column_name);
+	if (i < 0 || predicate.value.data_type != this->column_attributes[i].get_data_type())
+		return true;  // let the scan sort it out
+	const char* synopsis = entry + this->offsets[i];
+	if (predicate.value.data_type == ColumnAttribute::INT) {
+		int32_t min = *(int32_t*)synopsis;
+		int32_t max = *(int32_t*)(synopsis + sizeof(int32_t));
+		int32_t n = predicate.value.n;
+		switch (predicate.op) {
+			case Predicate::EQ:
+				return min <= n && n <= max;
+			case Predicate::NE:
+				return !(min == n && max == n);
+			case Predicate::LT:
+				return min < n;
+			case Predicate::LE:
+				return min <= n;
+			case Predicate::GT:
+				return max > n;
+			case Predicate::GE:
+				return max >= n;
+			default:
+				return true;
+		}
+	}
+	if (predicate.value.data_type != ColumnAttribute::TEXT || predicate.op != Predicate::EQ)
+		return true;
+	uint bits[BLOOM_HASHES];
+	bloom_bits(predicate.value.s, bits);
+	for (auto const& bit : bits)
+		if ((synopsis[bit / 8] & (1 << (bit % 8))) == 0)
+			return false;
+	return true;
+}
+
+int ZoneMap::column_index(const Identifier& column_name) {
+	for (uint i = 0; i < this->column_names.size(); i++)
+		if (this->column_names[i] == column_name)
+			return i;
+	return -1;
+}
+
+// Which bits of a bloom filter the string sets: double hashing off a 64-bit FNV-1a hash.
+void ZoneMap::bloom_bits(const string& s, uint bits[BLOOM_HASHES]) {
+	uint64_t hash = 14695981039346656037ULL;
+	for (auto const& c : s) {
+		hash ^= (unsigned char)c;
+		hash *= 1099511628211ULL;
+	}
+	uint32_t h1 = (uint32_t)hash;
+	uint32_t h2 = (uint32_t)(hash >> 32) | 1;
+	for (uint i = 0; i < BLOOM_HASHES; i++)
+		bits[i] = (h1 + i * h2) % (BLOOM_BYTES * 8);
+}
+
+
+/*
+	TESTS
+*/
+
+// The handles of the rows of a full scan that satisfy the predicate, without the zone map.
+static Handles scanned(DbRelation& table, const Predicate& predicate) {
+	Handles* all = table.select();
+	Handles handles;
+	ColumnNames column_names = {predicate.column_name};
+	for (auto const& handle : *all) {
+		ValueDict* row = table.project(handle, &column_names);
+		auto value = row->find(predicate.column_name);
+		if (value != row->end() && predicate.test(value->second))
+			handles.push_back(handle);
+		delete row;
+	}
+	delete all;
+	return handles;
+}
+
+// select and select_more, which skip the blocks the zone map rules out, have to find the same rows.
+static bool same_as_scan(DbRelation& table, const Predicate& predicate) {
+	Handles expected = scanned(table, predicate);
+	Predicates where = {predicate};
+	Handles* selected = table.select(&where);
+	bool same = *selected == expected;
+	delete selected;
+	Handles more;
+	u_int64_t position = 0;
+	while (table.select_more(&where, position, &more))
+		continue;
+	return same && more == expected;
+}
+
+// Every comparison with each block's smallest and largest value and their neighbours, and TEXT
+// equalities with values that are there and some that aren't.
+static bool prunes_correctly(DbRelation& table) {
+	map<BlockID, pair<int32_t, int32_t>> ranges;
+	Handles* all = table.select();
+	ColumnNames a = {"a"};
+	for (auto const& handle : *all) {
+		ValueDict* row = table.project(handle, &a);
+		int32_t n = row->at("a").n;
+		auto range = ranges.find(handle.first);
+		if (range == ranges.end())
+			ranges[handle.first] = make_pair(n, n);
+		else
+			range->second = make_pair(min(n, range->second.first), max(n, range->second.second));
+		delete row;
+	}
+	delete all;
+	for (auto const& range : ranges)
+		for (int32_t edge : {range.second.first, range.second.second})
+			for (int32_t n : {edge - 1, edge, edge + 1})
+				for (auto const& op : {Predicate::EQ, Predicate::NE, Predicate::LT, Predicate::LE, Predicate::GT,
+									   Predicate::GE})
+					if (!same_as_scan(table, Predicate("a", op, Value(n))))
+						return false;
+	for (auto const& s : {"word 0", "word 17", "word 41", "no such word", "", "word"})
+		for (auto const& op : {Predicate::EQ, Predicate::NE})
+			if (!same_as_scan(table, Predicate("s", op, Value(s))))
+				return false;
+	return true;
+}
+
+bool test_zone_map() {
+	ColumnNames column_names = {"a", "s", "b"};
+	ColumnAttributes column_attributes = {ColumnAttribute(ColumnAttribute::INT), ColumnAttribute(ColumnAttribute::TEXT),
+										  ColumnAttribute(ColumnAttribute::BIGINT)};
+	HeapTable table("_test_zone_map_cpp", column_names, column_attributes);
+	table.create_if_not_exists();
+	// each block gets a range of a of its own, overlapping the next block's a little, and a few of
+	// the TEXT values
+	ValueDict row;
+	for (int i = 0; i < 1500; i++) {
+		row["a"] = Value(i + (i * 7919) % 50);
+		row["s"] = Value("word " + to_string(i / 30 % 45) + string(40, '.'));
+		row["b"] = Value::bigint(i);
+		table.insert(&row);
+	}
+	for (auto const& s : {"word 0", "word 17", "word 41"}) {  // some exact hits for the bloom filters
+		row["s"] = Value(s);
+		row["a"] = Value(-7);
+		table.insert(&row);
+	}
+	bool ok = prunes_correctly(table);
+
+	// take out the rows that set some blocks' ranges, and one of the exact TEXT values, so the
+	// entries of their blocks are rebuilt
+	Handles* all = table.select();
+	Handles doomed;
+	ColumnNames a_and_s = {"a", "s"};
+	for (uint i = 0; i < all->size(); i++) {
+		ValueDict* values = table.project((*all)[i], &a_and_s);
+		if (i % 30 == 0 || i % 30 == 29 || values->at("a").n % 13 == 0 || values->at("s").s == "word 17")
+			doomed.push_back((*all)[i]);
+		delete values;
+	}
+	delete all;
+	table.del(&doomed);
+	ok = ok && prunes_correctly(table);
+	table.drop();
+	return ok;
+}
+
@@ -0,0 +1,94 @@
+/**
+ * @file zone_map.h - per-block synopses used to skip blocks during scans
+ * ZoneMap
+ *
+ * @see "Seattle University, CPSC5300, Summer 2018"
+ */
+#pragma once
+
+#include "db_cxx.h"
+#include "storage_engine.h"
+
+/**
+ * @class ZoneMap - what each block of a heap file might contain
+ *
+ *      Kept in its own Berkeley DB RecNo file, <table>.zone.db, with one fixed-length entry per block
+        of the table's file (same record number as the block id):
+            Bytes 0x00 - 0x01: number of live rows in the block
+            then for each column, in column order:
+                INT columns:  4-byte minimum and 4-byte maximum value in the block
+                TEXT columns: BLOOM_BYTES-byte bloom filter of the values in the block
+                others:       nothing (a predicate on one never skips a block)
+
+        Entries are widened as rows are added and rebuilt from the block's remaining rows when a row
+        is deleted, so they stay exact for INT ranges. may_match() only ever answers false when no row
+        of the block can satisfy the predicates: a block with no live rows, an INT predicate outside
+        [min, max], or a TEXT equality whose value is not in the bloom filter.
+
+        Tables created before zone maps existed have no zone file; for them the zone map is
+        unavailable and every block may match.
+ */
+class ZoneMap {
+public:
+	ZoneMap(Identifier table_name, const ColumnNames& column_names, const ColumnAttributes& column_attributes);
+	virtual ~ZoneMap() {}
+	ZoneMap(const ZoneMap& other) = delete;
+	ZoneMap(ZoneMap&& temp) = delete;
+	ZoneMap& operator=(const ZoneMap& other) = delete;
+	ZoneMap& operator=(ZoneMap&& temp) = delete;
+
+	virtual void create();
+	virtual void drop();
+	virtual void discard();  // drop(), leaving the file's removal to the Trash
+	virtual void open();
+	virtual void close();
+
+	/**
+	 * Note that row was added to block block_id.
+	 */
+	virtual void add(BlockID block_id, const ValueDict* row);
+
+	/**
+	 * Replace the entry for block block_id with one for exactly these rows.
+	 */
+	virtual void rebuild(BlockID block_id, const ValueDicts& rows);
+
+	/**
+	 * Could any row in block block_id satisfy all the predicates?
+	 * @param where  predicates (null means every row qualifies)
+	 * @returns      false only if it is certain that none can (never without predicates)
+	 */
+	virtual bool may_match(BlockID block_id, const Predicates* where);
+
+	/**
+	 * size of each TEXT column's bloom filter
+	 */
+	static const uint BLOOM_BYTES = 64;
+
+	/**
+	 * number of bits set in the bloom filter for each value
+	 */
+	static const uint BLOOM_HASHES = 3;
+
+protected:
+	ColumnNames column_names;
+	ColumnAttributes column_attributes;
+	std::vector<uint> offsets;  // where each column's synopsis starts within an entry
+	uint entry_size;
+	std::string dbfilename;
+	bool closed;
+	bool available;
+	Db db;
+
+	virtual void db_open(uint flags=0);
+	virtual char* get(BlockID block_id);
+	virtual void put(BlockID block_id, const char* entry);
+	virtual void init_entry(char* entry);
+	virtual void widen(char* entry, const ValueDict* row);
+	virtual bool may_match(const char* entry, const Predicate& predicate);
+	virtual int column_index(const Identifier& column_name);
+
+	static void bloom_bits(const std::string& s, uint bits[BLOOM_HASHES]);
+};
+
+bool test_zone_map();